@@ -0,0 +1,165 @@
+#pragma once
+
+#include <vector>
+#include <math.h>
+#include <algorithm>
+#include <stdint.h>
+
+#include "vec3.h"
+
+/*
+	Running float RGB sums for progressive rendering. Every pass adds a few samples per pixel on top of what is
+	already there, so the image keeps improving for as long as the camera holds still. The main thread resets it
+	(while the render workers are parked) whenever the camera view generation changes.
+
+	For adaptive sampling it also keeps the per pixel sum of squared luminance so the standard error of the mean can be
+	estimated. Pixels whose error drops under the threshold (after a minimum number of samples), or that hit the maximum,
+	are reported as converged and the workers skip them.
+
+	Everything besides the color (first hit albedo, normal, depth...) lives in the AOV framebuffer.
+*/
+class AccumulationBuffer {
+public:
+	AccumulationBuffer(uint32_t resWidthInPixels, uint32_t resHeightInPixels) :
+		_resWidthInPixels(resWidthInPixels), _resHeightInPixels(resHeightInPixels), _viewGeneration(0), _passCount(0),
+		_minSamples(0), _maxSamples(0), _errorThreshold(0.0f) {
+
+		size_t numOfPixels = (size_t)resWidthInPixels * resHeightInPixels;
+		_colorSum.assign(numOfPixels, vec3(0, 0, 0));
+		_luminanceSquaredSum.assign(numOfPixels, 0.0f);
+		_sampleCount.assign(numOfPixels, 0);
+	}
+
+	//maxSamples of 0 means no cap, errorThreshold of 0 disables the error test
+	void configureAdaptiveSampling(uint32_t minSamples, uint32_t maxSamples, float errorThreshold) {
+		_minSamples = minSamples;
+		_maxSamples = maxSamples;
+		_errorThreshold = errorThreshold;
+	}
+
+	void reset(uint64_t viewGeneration) {
+		std::fill(_colorSum.begin(), _colorSum.end(), vec3(0, 0, 0));
+		std::fill(_luminanceSquaredSum.begin(), _luminanceSquaredSum.end(), 0.0f);
+		std::fill(_sampleCount.begin(), _sampleCount.end(), 0);
+		_viewGeneration = viewGeneration;
+		_passCount = 0;
+	}
+
+	//only the thread that owns the pixel for this pass may call this
+	void addSamples(uint32_t pixelIndex, const vec3 &sampleSum, float luminanceSquaredSum, uint32_t numOfSamples) {
+		_colorSum[pixelIndex] += sampleSum;
+		_luminanceSquaredSum[pixelIndex] += luminanceSquaredSum;
+		_sampleCount[pixelIndex] += numOfSamples;
+	}
+
+	bool isConverged(uint32_t pixelIndex) const {
+		uint32_t n = _sampleCount[pixelIndex];
+
+		if (_maxSamples > 0 && n >= _maxSamples) {
+			return true;
+		}
+		if (_errorThreshold <= 0.0f || n < _minSamples || n < 2) {
+			return false;
+		}
+
+		float mean = luminance(_colorSum[pixelIndex]) / n;
+		float variance = (_luminanceSquaredSum[pixelIndex] - n * mean * mean) / (n - 1);
+		if (variance < 0.0f) variance = 0.0f;
+
+		//relative standard error of the mean, with a floor so black pixels do not chase zero
+		float standardError = sqrt(variance / n);
+		return standardError <= _errorThreshold * (mean > 0.01f ? mean : 0.01f);
+	}
+
+	uint32_t countConvergedPixels() const {
+		uint32_t converged = 0;
+		for (uint32_t i = 0; i < (uint32_t)_sampleCount.size(); i++) {
+			if (isConverged(i)) converged++;
+		}
+		return converged;
+	}
+
+	static float luminance(const vec3 &c) {
+		return 0.2126f * c.r() + 0.7152f * c.g() + 0.0722f * c.b();
+	}
+
+	vec3 resolve(uint32_t pixelIndex) const {
+		if (_sampleCount[pixelIndex] == 0) {
+			return vec3(0, 0, 0);
+		}
+		return _colorSum[pixelIndex] / float(_sampleCount[pixelIndex]);
+	}
+
+	void passCompleted() {
+		_passCount++;
+	}
+
+	uint32_t getPassCount() const {
+		return _passCount;
+	}
+
+	uint64_t getViewGeneration() const {
+		return _viewGeneration;
+	}
+
+	uint32_t getSampleCount(uint32_t pixelIndex) const {
+		return _sampleCount[pixelIndex];
+	}
+
+	const vec3 &getColorSum(uint32_t pixelIndex) const {
+		return _colorSum[pixelIndex];
+	}
+
+	float getLuminanceSquaredSum(uint32_t pixelIndex) const {
+		return _luminanceSquaredSum[pixelIndex];
+	}
+
+	//the raw sums, width * height of each, for writing a checkpoint (renderCheckpoint.h)
+	const vec3 *getColorSums() const {
+		return _colorSum.data();
+	}
+
+	const float *getLuminanceSquaredSums() const {
+		return _luminanceSquaredSum.data();
+	}
+
+	const uint32_t *getSampleCounts() const {
+		return _sampleCount.data();
+	}
+
+	//back to a checkpointed state, same rules as reset (nothing may be accumulating)
+	void restore(uint64_t viewGeneration, uint32_t passCount, const vec3 *colorSums, const float *luminanceSquaredSums, const uint32_t *sampleCounts) {
+		std::copy(colorSums, colorSums + _colorSum.size(), _colorSum.begin());
+		std::copy(luminanceSquaredSums, luminanceSquaredSums + _luminanceSquaredSum.size(), _luminanceSquaredSum.begin());
+		std::copy(sampleCounts, sampleCounts + _sampleCount.size(), _sampleCount.begin());
+		_viewGeneration = viewGeneration;
+		_passCount = passCount;
+	}
+
+	//forget one pixel's samples, only the thread that owns the pixel may call this
+	void clearPixel(uint32_t pixelIndex) {
+		_colorSum[pixelIndex] = vec3(0, 0, 0);
+		_luminanceSquaredSum[pixelIndex] = 0.0f;
+		_sampleCount[pixelIndex] = 0;
+	}
+
+	uint32_t getWidth() const {
+		return _resWidthInPixels;
+	}
+
+	uint32_t getHeight() const {
+		return _resHeightInPixels;
+	}
+
+protected:
+	uint32_t _resWidthInPixels, _resHeightInPixels;
+	uint64_t _viewGeneration;
+	uint32_t _passCount;
+
+	uint32_t _minSamples, _maxSamples;
+	float _errorThreshold;
+
+	std::vector<vec3> _colorSum;
+	std::vector<float> _luminanceSquaredSum;
+	std::vector<uint32_t> _sampleCount;
+};
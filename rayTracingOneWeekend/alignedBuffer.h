@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <new>
+#include <utility>
+
+#if defined (_WIN32)
+#include <malloc.h>
+#endif
+
+//one x86 cache line, keeps planes from sharing lines and lets wide loads start aligned
+#define CACHE_LINE_SIZE_IN_BYTES 64
+
+/*
+	Fixed size, cache line aligned array of trivially copyable elements. std::vector can't be told about alignment
+	before C++17 so the framebuffer planes use this instead.
+*/
+template <typename T>
+class AlignedBuffer {
+public:
+	AlignedBuffer() : _data(NULL), _count(0) {}
+
+	explicit AlignedBuffer(size_t count) : _data(NULL), _count(0) {
+		allocate(count);
+	}
+
+	~AlignedBuffer() {
+		release();
+	}
+
+	AlignedBuffer(AlignedBuffer &&other) : _data(other._data), _count(other._count) {
+		other._data = NULL;
+		other._count = 0;
+	}
+
+	AlignedBuffer &operator=(AlignedBuffer &&other) {
+		if (this != &other) {
+			release();
+			std::swap(_data, other._data);
+			std::swap(_count, other._count);
+		}
+		return *this;
+	}
+
+	AlignedBuffer(const AlignedBuffer &) = delete;
+	AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+
+	//throws std::bad_alloc like a std::vector would, the buffer is left empty
+	void allocate(size_t count) {
+		release();
+
+		if (count == 0) {
+			return;
+		}
+		if (count > (SIZE_MAX - CACHE_LINE_SIZE_IN_BYTES) / sizeof(T)) {
+			throw std::bad_alloc();
+		}
+
+		size_t sizeInBytes = count * sizeof(T);
+		//round up, some aligned allocators want a multiple of the alignment
+		sizeInBytes = (sizeInBytes + CACHE_LINE_SIZE_IN_BYTES - 1) & ~(size_t)(CACHE_LINE_SIZE_IN_BYTES - 1);
+
+#if defined (_WIN32)
+		_data = (T *)_aligned_malloc(sizeInBytes, CACHE_LINE_SIZE_IN_BYTES);
+#else
+		void *pointer = NULL;
+		if (posix_memalign(&pointer, CACHE_LINE_SIZE_IN_BYTES, sizeInBytes) != 0) {
+			pointer = NULL;
+		}
+		_data = (T *)pointer;
+#endif
+		if (_data == NULL) {
+			throw std::bad_alloc();
+		}
+		_count = count;
+		clear();
+	}
+
+	void release() {
+		if (_data != NULL) {
+#if defined (_WIN32)
+			_aligned_free(_data);
+#else
+			free(_data);
+#endif
+		}
+		_data = NULL;
+		_count = 0;
+	}
+
+	void clear() {
+		if (_data != NULL) {
+			memset(_data, 0, _count * sizeof(T));
+		}
+	}
+
+	T *data() { return _data; }
+	const T *data() const { return _data; }
+	size_t size() const { return _count; }
+	bool empty() const { return _count == 0; }
+
+	T &operator[](size_t i) { return _data[i]; }
+	const T &operator[](size_t i) const { return _data[i]; }
+
+protected:
+	T *_data;
+	size_t _count;
+};
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdint.h>
+
+#include "vec3.h"
+#include "alignedBuffer.h"
+
+//which arbitrary output variables to record, OR them together
+#define AOV_FLAG_DEPTH			(1 << 0)
+#define AOV_FLAG_NORMAL			(1 << 1)
+#define AOV_FLAG_ALBEDO			(1 << 2)
+#define AOV_FLAG_MATERIAL_ID	(1 << 3)
+#define AOV_FLAG_PRIMITIVE_ID	(1 << 4)
+#define AOV_FLAG_SAMPLE_COUNT	(1 << 5)
+#define AOV_FLAG_TIME			(1 << 6)
+
+//one float plane each, vectors take three consecutive planes
+enum AOVPlane {
+	AOV_PLANE_DEPTH = 0,
+	AOV_PLANE_NORMAL_X,
+	AOV_PLANE_NORMAL_Y,
+	AOV_PLANE_NORMAL_Z,
+	AOV_PLANE_ALBEDO_R,
+	AOV_PLANE_ALBEDO_G,
+	AOV_PLANE_ALBEDO_B,
+	AOV_PLANE_MATERIAL_ID,
+	AOV_PLANE_PRIMITIVE_ID,
+	AOV_PLANE_SAMPLE_COUNT,
+	AOV_PLANE_TIME,
+	AOV_NUM_OF_PLANES
+};
+
+//what one batch of samples of a pixel contributes, depth/normal/albedo/time are sums over the batch
+struct AOVSample {
+	float depthSum;
+	vec3 normalSum;
+	vec3 albedoSum;
+	uint32_t materialId;
+	uint32_t primitiveId;
+	float seconds;
+};
+
+/*
+	Multi-channel framebuffer for everything besides the beauty image. Every channel is its own cache line aligned
+	float plane so a consumer (denoiser, adaptive sampler, heatmap) only streams the planes it reads, and threads
+	writing neighbouring pixels of one plane do not drag the other planes' lines along.
+
+	Depth, normal and albedo are accumulated like the color and divided by the sample count when read. Ids are taken
+	from the first batch a pixel gets after a reset. Time is total seconds spent on the pixel.
+	The sample count plane is always allocated since the averages need it.
+*/
+class AOVFramebuffer {
+public:
+	AOVFramebuffer(uint32_t resWidthInPixels, uint32_t resHeightInPixels, uint32_t enabledFlags) :
+		_resWidthInPixels(resWidthInPixels), _resHeightInPixels(resHeightInPixels), _enabledFlags(enabledFlags | AOV_FLAG_SAMPLE_COUNT) {
+
+		size_t numOfPixels = (size_t)resWidthInPixels * resHeightInPixels;
+
+		for (int plane = 0; plane < AOV_NUM_OF_PLANES; plane++) {
+			if (isEnabled(planeFlag((AOVPlane)plane))) {
+				_planes[plane].allocate(numOfPixels);
+			}
+		}
+	}
+
+	bool isEnabled(uint32_t flag) const {
+		return (_enabledFlags & flag) != 0;
+	}
+
+	uint32_t getEnabledFlags() const {
+		return _enabledFlags;
+	}
+
+	//NULL when the channel was not requested
+	float *plane(AOVPlane plane) {
+		return _planes[plane].data();
+	}
+
+	const float *plane(AOVPlane plane) const {
+		return _planes[plane].data();
+	}
+
+	uint32_t getWidth() const {
+		return _resWidthInPixels;
+	}
+
+	uint32_t getHeight() const {
+		return _resHeightInPixels;
+	}
+
+	//render workers must be parked
+	void reset() {
+		for (int plane = 0; plane < AOV_NUM_OF_PLANES; plane++) {
+			_planes[plane].clear();
+		}
+	}
+
+	//only the thread that owns the pixel for this pass may call this
+	void addSamples(uint32_t pixelIndex, const AOVSample &sample, uint32_t numOfSamples) {
+		float *sampleCount = _planes[AOV_PLANE_SAMPLE_COUNT].data();
+
+		if (isEnabled(AOV_FLAG_MATERIAL_ID) && sampleCount[pixelIndex] == 0.0f) {
+			_planes[AOV_PLANE_MATERIAL_ID][pixelIndex] = float(sample.materialId);
+		}
+		if (isEnabled(AOV_FLAG_PRIMITIVE_ID) && sampleCount[pixelIndex] == 0.0f) {
+			_planes[AOV_PLANE_PRIMITIVE_ID][pixelIndex] = float(sample.primitiveId);
+		}
+		if (isEnabled(AOV_FLAG_DEPTH)) {
+			_planes[AOV_PLANE_DEPTH][pixelIndex] += sample.depthSum;
+		}
+		if (isEnabled(AOV_FLAG_NORMAL)) {
+			_planes[AOV_PLANE_NORMAL_X][pixelIndex] += sample.normalSum.x();
+			_planes[AOV_PLANE_NORMAL_Y][pixelIndex] += sample.normalSum.y();
+			_planes[AOV_PLANE_NORMAL_Z][pixelIndex] += sample.normalSum.z();
+		}
+		if (isEnabled(AOV_FLAG_ALBEDO)) {
+			_planes[AOV_PLANE_ALBEDO_R][pixelIndex] += sample.albedoSum.r();
+			_planes[AOV_PLANE_ALBEDO_G][pixelIndex] += sample.albedoSum.g();
+			_planes[AOV_PLANE_ALBEDO_B][pixelIndex] += sample.albedoSum.b();
+		}
+		if (isEnabled(AOV_FLAG_TIME)) {
+			_planes[AOV_PLANE_TIME][pixelIndex] += sample.seconds;
+		}
+
+		sampleCount[pixelIndex] += float(numOfSamples);
+	}
+
+	float getSampleCount(uint32_t pixelIndex) const {
+		return _planes[AOV_PLANE_SAMPLE_COUNT][pixelIndex];
+	}
+
+	float resolveDepth(uint32_t pixelIndex) const {
+		return average(AOV_PLANE_DEPTH, pixelIndex);
+	}
+
+	vec3 resolveNormal(uint32_t pixelIndex) const {
+		if (!isEnabled(AOV_FLAG_NORMAL)) {
+			return vec3(0, 0, 0);
+		}
+		vec3 normalSum(
+			_planes[AOV_PLANE_NORMAL_X][pixelIndex],
+			_planes[AOV_PLANE_NORMAL_Y][pixelIndex],
+			_planes[AOV_PLANE_NORMAL_Z][pixelIndex]
+		);
+		//escaped rays leave a zero normal, keep it zero instead of dividing by 0
+		if (normalSum.squared_length() == 0.0f) {
+			return normalSum;
+		}
+		return unit_vector(normalSum);
+	}
+
+	vec3 resolveAlbedo(uint32_t pixelIndex) const {
+		return vec3(average(AOV_PLANE_ALBEDO_R, pixelIndex), average(AOV_PLANE_ALBEDO_G, pixelIndex), average(AOV_PLANE_ALBEDO_B, pixelIndex));
+	}
+
+	//one PFM per requested channel next to the beauty image, named <prefix>_<channel>.pfm
+	uint32_t writeToFiles(const std::string &prefix) const;
+
+	static uint32_t planeFlag(AOVPlane plane) {
+		switch (plane) {
+		case AOV_PLANE_DEPTH: return AOV_FLAG_DEPTH;
+		case AOV_PLANE_NORMAL_X:
+		case AOV_PLANE_NORMAL_Y:
+		case AOV_PLANE_NORMAL_Z: return AOV_FLAG_NORMAL;
+		case AOV_PLANE_ALBEDO_R:
+		case AOV_PLANE_ALBEDO_G:
+		case AOV_PLANE_ALBEDO_B: return AOV_FLAG_ALBEDO;
+		case AOV_PLANE_MATERIAL_ID: return AOV_FLAG_MATERIAL_ID;
+		case AOV_PLANE_PRIMITIVE_ID: return AOV_FLAG_PRIMITIVE_ID;
+		case AOV_PLANE_SAMPLE_COUNT: return AOV_FLAG_SAMPLE_COUNT;
+		case AOV_PLANE_TIME: return AOV_FLAG_TIME;
+		default: return 0;
+		}
+	}
+
+protected:
+	float average(AOVPlane plane, uint32_t pixelIndex) const {
+		float sampleCount = _planes[AOV_PLANE_SAMPLE_COUNT][pixelIndex];
+		if (_planes[plane].empty() || sampleCount == 0.0f) {
+			return 0.0f;
+		}
+		return _planes[plane][pixelIndex] / sampleCount;
+	}
+
+	uint32_t writePlanesToPFM(const std::string &fileName, AOVPlane firstPlane, int numOfPlanes, bool averaged) const;
+
+	uint32_t _resWidthInPixels, _resHeightInPixels;
+	uint32_t _enabledFlags;
+
+	AlignedBuffer<float> _planes[AOV_NUM_OF_PLANES];
+};
+
+uint32_t AOVFramebuffer::writeToFiles(const std::string &prefix) const {
+	uint32_t failures = 0;
+
+	if (isEnabled(AOV_FLAG_DEPTH)) failures += writePlanesToPFM(prefix + "_depth.pfm", AOV_PLANE_DEPTH, 1, true);
+	if (isEnabled(AOV_FLAG_NORMAL)) failures += writePlanesToPFM(prefix + "_normal.pfm", AOV_PLANE_NORMAL_X, 3, true);
+	if (isEnabled(AOV_FLAG_ALBEDO)) failures += writePlanesToPFM(prefix + "_albedo.pfm", AOV_PLANE_ALBEDO_R, 3, true);
+	if (isEnabled(AOV_FLAG_MATERIAL_ID)) failures += writePlanesToPFM(prefix + "_materialId.pfm", AOV_PLANE_MATERIAL_ID, 1, false);
+	if (isEnabled(AOV_FLAG_PRIMITIVE_ID)) failures += writePlanesToPFM(prefix + "_primitiveId.pfm", AOV_PLANE_PRIMITIVE_ID, 1, false);
+	if (isEnabled(AOV_FLAG_SAMPLE_COUNT)) failures += writePlanesToPFM(prefix + "_sampleCount.pfm", AOV_PLANE_SAMPLE_COUNT, 1, false);
+	if (isEnabled(AOV_FLAG_TIME)) failures += writePlanesToPFM(prefix + "_time.pfm", AOV_PLANE_TIME, 1, false);
+
+	return failures;
+}
+
+/*
+	Portable float map, "Pf" grayscale or "PF" RGB, rows bottom to top which is how the planes are stored already.
+	- http://www.pauldebevec.com/Research/HDR/PFM/
+*/
+uint32_t AOVFramebuffer::writePlanesToPFM(const std::string &fileName, AOVPlane firstPlane, int numOfPlanes, bool averaged) const {
+	std::ofstream outputStream(fileName.c_str(), std::ios::out | std::ios::binary);
+
+	if (outputStream.fail()) {
+		std::cout << "Failed to open " << fileName << "\n";
+		return 1;
+	}
+
+	//negative scale marks little endian
+	outputStream << (numOfPlanes == 3 ? "PF" : "Pf") << "\n" << _resWidthInPixels << " " << _resHeightInPixels << "\n-1.0\n";
+
+	std::unique_ptr<float[]> row(new float[_resWidthInPixels * numOfPlanes]);
+
+	for (uint32_t y = 0; y < _resHeightInPixels; y++) {
+		for (uint32_t x = 0; x < _resWidthInPixels; x++) {
+			uint32_t pixelIndex = y * _resWidthInPixels + x;
+
+			for (int c = 0; c < numOfPlanes; c++) {
+				AOVPlane plane = (AOVPlane)(firstPlane + c);
+				row[x * numOfPlanes + c] = averaged ? average(plane, pixelIndex) : _planes[plane][pixelIndex];
+			}
+		}
+		outputStream.write((const char *)row.get(), sizeof(float) * _resWidthInPixels * numOfPlanes);
+	}
+
+	outputStream.close();
+
+	return 0;
+}
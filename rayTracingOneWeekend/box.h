@@ -9,8 +9,28 @@
 
 class Box : public Hitable {
 public:
-	Box() {}
+	Box() : _hitableList(NULL), _ownsSides(false) {}
 	Box(const vec3 &p0, const vec3 &p1, Material *materialPointer);
+	//sides the caller built and keeps (laid out like the constructor above does), see sceneFile.h
+	Box(const vec3 &p0, const vec3 &p1, Hitable *sides) : _pMin(p0), _pMax(p1), _hitableList(sides), _ownsSides(false) {}
+
+	//the six sides (and the flips around three of them) are the box's own
+	virtual ~Box() {
+		HitableList *sides = (HitableList *)_hitableList;
+		if (sides == NULL || !_ownsSides) {
+			return;
+		}
+
+		for (uint32_t side = 0; side < sides->_listSize; side++) {
+			FlipNormals *flipped = dynamic_cast<FlipNormals *>(sides->_hitableList[side]);
+			if (flipped != NULL) {
+				delete flipped->_hitable;
+			}
+			delete sides->_hitableList[side];
+		}
+		delete[] sides->_hitableList;
+		delete sides;
+	}
 
 	virtual bool hit(const ray &r, float t0, float t1, HitRecord &hitRecord) const;
 	virtual bool boundingBox(float t0, float t1, AABB &box) const {
@@ -20,6 +40,7 @@ public:
 
 	vec3 _pMin, _pMax;
 	Hitable *_hitableList;
+	bool _ownsSides;
 };
 
 Box::Box(const vec3 &p0, const vec3 &p1, Material *materialPointer) {
@@ -38,6 +59,7 @@ Box::Box(const vec3 &p0, const vec3 &p1, Material *materialPointer) {
 	list[5] = new FlipNormals(new YZRectangle(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), materialPointer));
 	
 	_hitableList = new HitableList(list, sides);
+	_ownsSides = true;
 }
 
 bool Box::hit(const ray &ray, float t0, float t1, HitRecord &hitRecord) const {
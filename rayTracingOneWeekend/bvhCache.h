@@ -0,0 +1,277 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <unordered_map>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "hitable.h"
+#include "bvhNode.h"
+#include "mappedFile.h"
+
+#define BVH_CACHE_VERSION 1
+//set on a child index that is a leaf (an index into the leaves) instead of a node
+#define BVH_CACHE_LEAF_BIT 0x80000000u
+//deepest tree FlatBvh can walk, BvhNode halves the list every level so this is far more than any scene needs
+#define FLAT_BVH_STACK_SIZE 64
+
+//32 bytes, children are indices so the array means the same wherever it is mapped
+struct FlatBvhNode {
+	float boundsMin[3];
+	float boundsMax[3];
+	uint32_t left, right;
+};
+
+//fixed size, followed by the nodes, root first
+struct BvhCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSizeInBytes;
+	uint32_t numOfNodes;
+	uint32_t numOfLeaves;
+	//geometry and build settings the tree was built from, see BvhCache::makeKey
+	uint64_t key;
+	uint64_t payloadChecksum;
+};
+
+static_assert(sizeof(FlatBvhNode) == 32 && sizeof(BvhCacheHeader) == 40, "the BVH cache is written as is");
+
+/*
+	A BvhNode tree flattened into an array, every child after its parent. Traversal is a loop over a small stack instead
+	of a virtual call per node, and the leaves are tested with the closest hit so far as tMax, so boxes behind it get
+	skipped instead of traced into.
+
+	Neither the nodes nor the leaves are owned, they are a mapped cache file (or a vector) and a scene's shape table.
+*/
+class FlatBvh : public Hitable {
+public:
+	FlatBvh(const FlatBvhNode *nodes, Hitable *const *leaves) : _nodes(nodes), _leaves(leaves) {}
+
+	virtual bool hit(const ray &r, float tMin, float tMax, HitRecord &hitRecord) const;
+	virtual bool boundingBox(float t0, float t1, AABB &box) const {
+		const FlatBvhNode &root = _nodes[0];
+		box = AABB(vec3(root.boundsMin[0], root.boundsMin[1], root.boundsMin[2]), vec3(root.boundsMax[0], root.boundsMax[1], root.boundsMax[2]));
+		return true;
+	}
+
+protected:
+	//the same slab test as AABB::hit, straight off the node
+	static bool hitBounds(const FlatBvhNode &node, const ray &r, float tMin, float tMax) {
+		for (int a = 0; a < 3; a++) {
+			float t0 = (node.boundsMin[a] - r.origin()[a]) / r.direction()[a];
+			float t1 = (node.boundsMax[a] - r.origin()[a]) / r.direction()[a];
+
+			tMin = ffmax(ffmin(t0, t1), tMin);
+			tMax = ffmin(ffmax(t0, t1), tMax);
+
+			if (tMax <= tMin) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	const FlatBvhNode *_nodes;
+	Hitable *const *_leaves;
+};
+
+bool FlatBvh::hit(const ray &r, float tMin, float tMax, HitRecord &hitRecord) const {
+	uint32_t stack[FLAT_BVH_STACK_SIZE];
+	uint32_t stackSize = 0;
+	bool hitAnything = false;
+
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+		const FlatBvhNode &node = _nodes[stack[--stackSize]];
+		if (!hitBounds(node, r, tMin, tMax)) {
+			continue;
+		}
+
+		//a node over a single leaf has it on both sides
+		uint32_t children[2] = { node.left, node.right };
+		uint32_t numOfChildren = node.right == node.left ? 1 : 2;
+
+		for (uint32_t child = 0; child < numOfChildren; child++) {
+			if (children[child] & BVH_CACHE_LEAF_BIT) {
+				HitRecord leafRecord;
+				if (_leaves[children[child] & ~BVH_CACHE_LEAF_BIT]->hit(r, tMin, tMax, leafRecord)) {
+					hitAnything = true;
+					tMax = leafRecord.pointAtParameterT;
+					hitRecord = leafRecord;
+				}
+			}
+			else if (stackSize < FLAT_BVH_STACK_SIZE) {
+				stack[stackSize++] = children[child];
+			}
+		}
+	}
+
+	return hitAnything;
+}
+
+/*
+	Saves the BVH of a scene file next to it (see sceneFile.h) so later launches map it instead of building it. The
+	cache is only used when its key matches: a hash of the geometry, the leaf count, the build's time range and the
+	format, anything else is rebuilt and written over it. Written to path.tmp and renamed like the checkpoints.
+*/
+class BvhCache {
+public:
+	static uint64_t makeKey(uint64_t geometryHash, uint32_t numOfLeaves, float time0, float time1) {
+		struct {
+			uint64_t geometryHash;
+			uint32_t numOfLeaves;
+			float time0, time1;
+			uint32_t version;
+			uint32_t nodeSizeInBytes;
+			uint32_t stackSize;
+		} settings = { geometryHash, numOfLeaves, time0, time1, BVH_CACHE_VERSION, (uint32_t)sizeof(FlatBvhNode), FLAT_BVH_STACK_SIZE };
+
+		return checksumBytes((const uint8_t *)&settings, sizeof(settings));
+	}
+
+	//leaves[] are root's leaves in the order the flat tree refers to them. False if something isn't one of them or the tree is too deep.
+	static bool flatten(const BvhNode *root, Hitable *const *leaves, uint32_t numOfLeaves, std::vector<FlatBvhNode> &nodes);
+
+	//0 on success like ImageWriter::write
+	static uint32_t write(const std::string &path, uint64_t key, uint32_t numOfLeaves, const std::vector<FlatBvhNode> &nodes);
+
+	//maps path if it holds the tree for key, quietly false otherwise (it just gets rebuilt)
+	static bool open(const std::string &path, uint64_t key, uint32_t numOfLeaves, MappedFile &file, const FlatBvhNode *&nodes);
+};
+
+bool BvhCache::flatten(const BvhNode *root, Hitable *const *leaves, uint32_t numOfLeaves, std::vector<FlatBvhNode> &nodes) {
+	std::unordered_map<const Hitable *, uint32_t> leafIndices;
+	for (uint32_t leaf = 0; leaf < numOfLeaves; leaf++) {
+		leafIndices[leaves[leaf]] = leaf;
+	}
+
+	nodes.clear();
+
+	//every node is appended before its children, which get patched in once they have their own index
+	struct Pending {
+		const BvhNode *node;
+		uint32_t index;
+		uint32_t depth;
+	};
+	std::vector<Pending> pending;
+
+	auto addNode = [&nodes, &pending](const BvhNode *node, uint32_t depth) {
+		FlatBvhNode flatNode;
+		for (int a = 0; a < 3; a++) {
+			flatNode.boundsMin[a] = node->_box.min()[a];
+			flatNode.boundsMax[a] = node->_box.max()[a];
+		}
+		flatNode.left = flatNode.right = 0;
+
+		Pending entry = { node, (uint32_t)nodes.size(), depth };
+		nodes.push_back(flatNode);
+		pending.push_back(entry);
+		return entry.index;
+	};
+
+	addNode(root, 1);
+
+	while (!pending.empty()) {
+		Pending entry = pending.back();
+		pending.pop_back();
+
+		if (entry.depth >= FLAT_BVH_STACK_SIZE) {
+			std::cout << "The BVH is deeper than " << FLAT_BVH_STACK_SIZE << " levels\n";
+			return false;
+		}
+
+		uint32_t children[2];
+		const Hitable *sides[2] = { entry.node->_left, entry.node->_right };
+
+		for (int side = 0; side < 2; side++) {
+			auto leaf = leafIndices.find(sides[side]);
+			if (leaf != leafIndices.end()) {
+				children[side] = leaf->second | BVH_CACHE_LEAF_BIT;
+				continue;
+			}
+
+			const BvhNode *child = dynamic_cast<const BvhNode *>(sides[side]);
+			if (child == NULL) {
+				std::cout << "The BVH has a leaf that isn't in the scene\n";
+				return false;
+			}
+			children[side] = side == 1 && sides[1] == sides[0] ? children[0] : addNode(child, entry.depth + 1);
+		}
+
+		nodes[entry.index].left = children[0];
+		nodes[entry.index].right = children[1];
+	}
+	return true;
+}
+
+uint32_t BvhCache::write(const std::string &path, uint64_t key, uint32_t numOfLeaves, const std::vector<FlatBvhNode> &nodes) {
+	BvhCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "RTBVH", sizeof("RTBVH"));
+	header.version = BVH_CACHE_VERSION;
+	header.headerSizeInBytes = sizeof(header);
+	header.numOfNodes = (uint32_t)nodes.size();
+	header.numOfLeaves = numOfLeaves;
+	header.key = key;
+
+	size_t payloadSizeInBytes = nodes.size() * sizeof(FlatBvhNode);
+	std::string temporaryPath = path + ".tmp";
+	MappedFile file;
+
+	if (nodes.empty() || !file.create(temporaryPath, sizeof(header) + payloadSizeInBytes)) {
+		std::cout << "Can't create " << temporaryPath << "\n";
+		return 1;
+	}
+
+	uint8_t *payload = file.mutableData() + sizeof(header);
+	memcpy(payload, nodes.data(), payloadSizeInBytes);
+	header.payloadChecksum = checksumBytes(payload, payloadSizeInBytes);
+	memcpy(file.mutableData(), &header, sizeof(header));
+
+	bool flushed = file.flush();
+	file.close();
+
+	if (!flushed || !replaceFile(temporaryPath, path)) {
+		std::cout << "Failed to write " << path << "\n";
+		remove(temporaryPath.c_str());
+		return 1;
+	}
+	return 0;
+}
+
+bool BvhCache::open(const std::string &path, uint64_t key, uint32_t numOfLeaves, MappedFile &file, const FlatBvhNode *&nodes) {
+	BvhCacheHeader header;
+
+	if (!file.open(path) || file.getSizeInBytes() < sizeof(header)) {
+		file.close();
+		return false;
+	}
+	memcpy(&header, file.data(), sizeof(header));
+
+	size_t payloadSizeInBytes = (size_t)header.numOfNodes * sizeof(FlatBvhNode);
+	const uint8_t *payload = file.data() + sizeof(header);
+
+	bool matches = memcmp(header.magic, "RTBVH", sizeof("RTBVH")) == 0 && header.version == BVH_CACHE_VERSION && header.headerSizeInBytes == sizeof(header) &&
+		header.key == key && header.numOfLeaves == numOfLeaves && header.numOfNodes > 0 &&
+		file.getSizeInBytes() == sizeof(header) + payloadSizeInBytes && checksumBytes(payload, payloadSizeInBytes) == header.payloadChecksum;
+
+	//children after their parents and leaves in range, so nothing walks off the arrays or around in circles
+	const FlatBvhNode *flatNodes = (const FlatBvhNode *)payload;
+	for (uint32_t node = 0; matches && node < header.numOfNodes; node++) {
+		for (uint32_t child : { flatNodes[node].left, flatNodes[node].right }) {
+			matches = matches && ((child & BVH_CACHE_LEAF_BIT) ? (child & ~BVH_CACHE_LEAF_BIT) < numOfLeaves : child > node && child < header.numOfNodes);
+		}
+	}
+
+	if (!matches) {
+		file.close();
+		return false;
+	}
+
+	nodes = flatNodes;
+	return true;
+}
@@ -11,15 +11,25 @@ int boxZCompare(const void *a, const void *b);
 
 class BvhNode : public Hitable {
 public:
-	BvhNode() {}
+	BvhNode() : _left(NULL), _right(NULL), _ownsChildren(false) {}
 	BvhNode(Hitable **l, int n, float time0, float time1);
 
+	//frees the inner nodes it made, the leaves belong to whoever handed them in (and may be gone already, see sceneOwner.h)
+	virtual ~BvhNode() {
+		if (_ownsChildren) {
+			delete _left;
+			delete _right;
+		}
+	}
+
 	virtual bool hit(const ray &r, float tmin, float tmax, HitRecord &record) const;
 	virtual bool boundingBox(float t0, float t1, AABB &box) const;
 
 	Hitable *_left;
 	Hitable *_right;
 	AABB _box;
+	//the children are inner nodes this one made, not leaves
+	bool _ownsChildren;
 };
 
 BvhNode::BvhNode(Hitable **l, int n, float time0, float time1) {
@@ -35,6 +45,8 @@ BvhNode::BvhNode(Hitable **l, int n, float time0, float time1) {
 		qsort(l, n, sizeof(Hitable *), boxZCompare);
 	}
 
+	_ownsChildren = n > 2;
+
 	if (n == 1) {
 		_left = _right = l[0];
 	}
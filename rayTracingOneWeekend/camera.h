@@ -7,11 +7,15 @@
 #include "defines.h"
 #include "mathUtilities.h"
 
+//origin, lower left corner, horizontal, vertical, u, v, lens radius and the shutter times
+#define CAMERA_RAY_STATE_SIZE 21
+
 class Camera {
 
 public:
 	Camera(vec3 lookFrom, vec3 lookAt, vec3 upDirection, float vFoV, float aspect, float aperture, float focusDistance, float t0, float t1) :
-		_lookFromPoint(lookFrom), _lookAt(lookAt), _upDirection(upDirection), _vFoV(vFoV), _aspect(aspect), _aperture(aperture), _focusDistance(focusDistance), _time0(t0), _time1(t1) {
+		_lookFromPoint(lookFrom), _lookAt(lookAt), _upDirection(upDirection), _vFoV(vFoV), _aspect(aspect), _aperture(aperture), _focusDistance(focusDistance), _time0(t0), _time1(t1),
+		_origin(0, 0, 0), _lowerLeftCorner(0, 0, 0), _horizontal(0, 0, 0), _vertical(0, 0, 0), _lensRadius(0), _viewGeneration(0) {
 
 		/*drowan_NOTE_20200202
 		On page 182 of 3D Math Primer for Graphics and Game Development, 2nd Ed.
@@ -93,6 +97,7 @@ public:
 		_orientationMatrix = nedWorldBasisOrientationMatrix;
 		_positionMatrix = basisPositionMatrix;
 
+#if CAMERA_PRINT_BASIS_EN == 1
 		std::cout << "basisOrientationMatrix: \n"
 			<< nedWorldBasisOrientationMatrix[0] << "\n"
 			<< nedWorldBasisOrientationMatrix[1] << "\n"
@@ -104,6 +109,7 @@ public:
 			<< basisPositionMatrix[1] << "\n"
 			<< basisPositionMatrix[2] << "\n"
 			<< basisPositionMatrix[3] << "\n";		
+#endif
 
 		/*
 		std::cout
@@ -179,6 +185,7 @@ public:
 	void setTime(float t0, float t1) {
 		_time0 = t0;
 		_time1 = t1;
+		_viewGeneration++;
 
 		setCamera();
 	}
@@ -220,6 +227,11 @@ public:
 		return _aspect;
 	}
 
+	//angle one pixel row covers at the center of the view, the spread of the rays' cones (see ray::footprintAt)
+	float getPixelSpreadAngle(uint32_t heightInPixels) const {
+		return heightInPixels > 0 ? 2.0f * tan(_vFoV * float(M_PI) / 360.0f) / heightInPixels : 0.0f;
+	}
+
 	float setAperture() {
 		return _aperture;
 	}
@@ -266,6 +278,35 @@ public:
 		return _orientationVersor;
 	}
 
+	//changes every time the rays the camera generates change, anything accumulated for an older generation is stale
+	uint64_t getViewGeneration() const {
+		return _viewGeneration;
+	}
+
+	//everything getRay uses, so another process can generate exactly the same rays (see distributedRender.h)
+	void getRayState(float state[CAMERA_RAY_STATE_SIZE]) const {
+		const vec3 *vectors[] = { &_origin, &_lowerLeftCorner, &_horizontal, &_vertical, &_u, &_v };
+		for (int i = 0; i < 6; i++) {
+			state[i * 3 + 0] = vectors[i]->x();
+			state[i * 3 + 1] = vectors[i]->y();
+			state[i * 3 + 2] = vectors[i]->z();
+		}
+		state[18] = _lensRadius;
+		state[19] = _time0;
+		state[20] = _time1;
+	}
+
+	void setRayState(const float state[CAMERA_RAY_STATE_SIZE]) {
+		vec3 *vectors[] = { &_origin, &_lowerLeftCorner, &_horizontal, &_vertical, &_u, &_v };
+		for (int i = 0; i < 6; i++) {
+			*vectors[i] = vec3(state[i * 3 + 0], state[i * 3 + 1], state[i * 3 + 2]);
+		}
+		_lensRadius = state[18];
+		_time0 = state[19];
+		_time1 = state[20];
+		_viewGeneration++;
+	}
+
 protected:
 
 	void setCamera_Euler() {
@@ -342,11 +383,22 @@ protected:
 	}
 
 	void setCamera() {
+		vec3 previousOrigin = _origin;
+		vec3 previousLowerLeftCorner = _lowerLeftCorner;
+		vec3 previousHorizontal = _horizontal;
+		vec3 previousVertical = _vertical;
+		float previousLensRadius = _lensRadius;
+
 #if 0
 		setCamera_Euler();
 #else
 		setCamera_QuaternionMatrix();
 #endif
+
+		if (_origin != previousOrigin || _lowerLeftCorner != previousLowerLeftCorner ||
+			_horizontal != previousHorizontal || _vertical != previousVertical || _lensRadius != previousLensRadius) {
+			_viewGeneration++;
+		}
 	}
 
 private:
@@ -377,4 +429,6 @@ private:
 	mat4x4 _positionMatrix;
 
 	quaternion _orientationVersor;
+
+	uint64_t _viewGeneration;
 };
\ No newline at end of file
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <math.h>
+
+#include "vec3.h"
+#include "quaternion.h"
+#include "mat4x4.h"
+#include "camera.h"
+
+//where the camera is and what it looks at, at some point of the sequence
+struct CameraKeyframe {
+	float time;
+	vec3 lookFrom;
+	vec3 lookAt;
+	float vFoV;
+};
+
+/*
+	Camera moves for sequence renders (see sequenceRender.h). Between two keyframes the position and field of view are
+	lerped and the orientation is slerped, so a turn goes at a constant angular speed and the view never shears or
+	shrinks like it would with lerped look-at points. Before the first and after the last keyframe the camera holds.
+
+	Every keyframe's orientation is the body frame of camera.h (x along the view, y to the right, z down) built from
+	lookFrom/lookAt and the world up, it rolls only if the path turns through the vertical.
+*/
+class CameraPath {
+public:
+	//the lens and world up every camera on the path gets
+	explicit CameraPath(float aperture = 0.0f, float focusDistance = 1.0f, const vec3 &worldUp = vec3(0, 0, -1)) :
+		_aperture(aperture), _focusDistance(focusDistance), _worldUp(unit_vector(worldUp)) {
+	}
+
+	//kept sorted by time, a keyframe looking at its own position is ignored
+	bool addKeyframe(const CameraKeyframe &keyframe);
+
+	//one keyframe a line: "time fromX fromY fromZ atX atY atZ [vFoV]", # starts a comment. Adds to what is there.
+	bool load(const std::string &path, float defaultVFoV);
+
+	size_t getNumOfKeyframes() const {
+		return _keys.size();
+	}
+
+	float getStartTime() const {
+		return _keys.empty() ? 0.0f : _keys.front().time;
+	}
+
+	float getEndTime() const {
+		return _keys.empty() ? 0.0f : _keys.back().time;
+	}
+
+	//needs at least one keyframe. The shutter times go to the camera as is (motion blur of moving hitables).
+	Camera cameraAt(float time, float aspectRatio, float shutterOpen = 0.0f, float shutterClose = 1.0f) const;
+
+protected:
+	struct Key {
+		float time;
+		vec3 lookFrom;
+		quaternion orientation;
+		float vFoV;
+	};
+
+	float _aperture;
+	float _focusDistance;
+	vec3 _worldUp;
+
+	std::vector<Key> _keys;
+};
+
+bool CameraPath::addKeyframe(const CameraKeyframe &keyframe) {
+	vec3 view = keyframe.lookAt - keyframe.lookFrom;
+	if (view.length() <= 0.0f) {
+		return false;
+	}
+
+	vec3 xAxis = unit_vector(view);
+	vec3 yAxis = cross(-_worldUp, xAxis);
+
+	//looking straight up or down, any right will do
+	if (yAxis.length() < 1e-6f) {
+		yAxis = cross(xAxis, fabs(xAxis.x()) < 0.9f ? vec3(1, 0, 0) : vec3(0, 1, 0));
+	}
+	yAxis = unit_vector(yAxis);
+	vec3 zAxis = cross(xAxis, yAxis);
+
+	Key key = { keyframe.time, keyframe.lookFrom, quaternion::basisToQuaternion(xAxis, yAxis, zAxis), keyframe.vFoV };
+
+	auto position = std::upper_bound(_keys.begin(), _keys.end(), key.time, [](float time, const Key &other) {
+		return time < other.time;
+	});
+	_keys.insert(position, key);
+
+	return true;
+}
+
+bool CameraPath::load(const std::string &path, float defaultVFoV) {
+	std::ifstream file(path);
+	if (!file) {
+		std::cout << "Can't open camera path " << path << "\n";
+		return false;
+	}
+
+	std::string line;
+	uint32_t lineNumber = 0;
+
+	while (std::getline(file, line)) {
+		lineNumber++;
+
+		size_t comment = line.find('#');
+		if (comment != std::string::npos) {
+			line.erase(comment);
+		}
+		if (line.find_first_not_of(" \t\r") == std::string::npos) {
+			continue;
+		}
+
+		std::istringstream fields(line);
+		CameraKeyframe keyframe;
+		float fromX, fromY, fromZ, atX, atY, atZ;
+
+		if (!(fields >> keyframe.time >> fromX >> fromY >> fromZ >> atX >> atY >> atZ)) {
+			std::cout << path << ":" << lineNumber << " needs time, lookFrom x y z and lookAt x y z\n";
+			return false;
+		}
+		if (!(fields >> keyframe.vFoV)) {
+			keyframe.vFoV = defaultVFoV;
+		}
+		keyframe.lookFrom = vec3(fromX, fromY, fromZ);
+		keyframe.lookAt = vec3(atX, atY, atZ);
+
+		if (!addKeyframe(keyframe)) {
+			std::cout << path << ":" << lineNumber << " looks at its own position\n";
+			return false;
+		}
+	}
+
+	if (_keys.empty()) {
+		std::cout << path << " has no keyframes\n";
+		return false;
+	}
+	return true;
+}
+
+Camera CameraPath::cameraAt(float time, float aspectRatio, float shutterOpen, float shutterClose) const {
+	//first key after time, the camera is between the one before it and it
+	auto next = std::upper_bound(_keys.begin(), _keys.end(), time, [](float time, const Key &other) {
+		return time < other.time;
+	});
+
+	const Key &from = next == _keys.begin() ? _keys.front() : *(next - 1);
+	const Key &to = next == _keys.end() ? _keys.back() : *next;
+
+	float t = to.time > from.time ? (time - from.time) / (to.time - from.time) : 0.0f;
+
+	vec3 lookFrom = from.lookFrom + t * (to.lookFrom - from.lookFrom);
+	float vFoV = from.vFoV + t * (to.vFoV - from.vFoV);
+	quaternion orientation = quaternion::slerp(from.orientation, to.orientation, t);
+
+	vec3 view = quaternion::rotateVector(orientation, vec3(1, 0, 0));
+	vec3 right = quaternion::rotateVector(orientation, vec3(0, 1, 0));
+	vec3 up = quaternion::rotateVector(orientation, vec3(0, 0, -1));
+
+	Camera camera(lookFrom, lookFrom + view, up, vFoV, aspectRatio, _aperture, _focusDistance, shutterOpen, shutterClose);
+
+	//the rays come from the orientation matrix, not lookAt: rows are back (-view), right and up like the NED default
+	mat4x4 orientationMatrix;
+	orientationMatrix.m[0] = { -view.x(), -view.y(), -view.z(), 0.0 };
+	orientationMatrix.m[1] = { right.x(), right.y(), right.z(), 0.0 };
+	orientationMatrix.m[2] = { up.x(), up.y(), up.z(), 0.0 };
+	orientationMatrix.m[3] = { 0.0, 0.0, 0.0, 1.0 };
+	camera.setOrientationMatrix(orientationMatrix);
+
+	return camera;
+}
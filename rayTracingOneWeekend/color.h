@@ -7,9 +7,24 @@
 #include "ray.h"
 #include "hitable.h"
 #include "material.h"
+#include "lightSampler.h"
+
+//depth of a primary ray that escaped the scene, far enough that nothing real gets mixed with it by the denoiser
+#define FEATURE_MISS_DEPTH 1.0e6f
+
+//first hit surface properties, recorded into the AOV framebuffer
+struct FirstHitFeatures {
+	vec3 albedo;
+	vec3 normal;
+	float depth;
+	uint32_t materialId;
+	uint32_t primitiveId;
+};
 
 //Color is called recursively!
-vec3 color(const ray &rayCast, Hitable *world, int depth) {	
+//When emitters are given, diffuse hits sample a light directly and the next bounce skips those emitters so they are not counted twice.
+//When features is given, the primary hit (depth 0) writes its albedo, normal, distance and ids into it.
+vec3 color(const ray &rayCast, Hitable *world, int depth, const EmitterRegistry *emitters = NULL, bool skipSampledEmitters = false, FirstHitFeatures *features = NULL) {	
 	//provide a way to store the hit vector to act on it outside the hit check
 	HitRecord hitRecord;
 
@@ -21,9 +36,31 @@ vec3 color(const ray &rayCast, Hitable *world, int depth) {
 		vec3 attenuation;		
 		vec3 emitted = hitRecord.materialPointer->emitted(hitRecord.u, hitRecord.v, hitRecord.point);
 
+		if (skipSampledEmitters && emitters->isSampledMaterial(hitRecord.materialPointer)) {
+			emitted = vec3(0, 0, 0);
+		}
+
 		//depth refers to number of recursive calls to bounce the ray around???
-		if (depth < DEPTH_RECURSION && hitRecord.materialPointer->scatter(rayCast, hitRecord, attenuation, scattered)) {
-			return emitted + attenuation * color(scattered, world, depth + 1);
+		bool scatteredRay = depth < DEPTH_RECURSION && hitRecord.materialPointer->scatter(rayCast, hitRecord, attenuation, scattered);
+
+		if (features != NULL) {
+			//lights have no albedo, use their (clamped) emission so they stay separated from their surroundings
+			vec3 albedo = scatteredRay ? attenuation : emitted;
+			features->albedo = vec3(ffmin(albedo.r(), 1.0f), ffmin(albedo.g(), 1.0f), ffmin(albedo.b(), 1.0f));
+			features->normal = unit_vector(hitRecord.normal);
+			features->depth = hitRecord.pointAtParameterT * rayCast.direction().length();
+			features->materialId = hitRecord.materialPointer->_materialId;
+			features->primitiveId = hitRecord.primitiveId;
+		}
+
+		if (scatteredRay) {
+#if DIRECT_LIGHT_SAMPLING_EN == 1
+			if (emitters != NULL && !emitters->empty() && hitRecord.materialPointer->isDiffuse()) {
+				vec3 direct = sampleDirectLight(hitRecord, world, *emitters, rayCast.time());
+				return emitted + attenuation * (direct + color(scattered, world, depth + 1, emitters, true));
+			}
+#endif
+			return emitted + attenuation * color(scattered, world, depth + 1, emitters, false);
 		}
 		else {
 			return emitted;
@@ -31,6 +68,14 @@ vec3 color(const ray &rayCast, Hitable *world, int depth) {
 	}
 	//does not hit anything, so "background" gradient
 	else {
+		if (features != NULL) {
+			features->albedo = vec3(1, 1, 1);
+			features->normal = vec3(0, 0, 0);
+			features->depth = FEATURE_MISS_DEPTH;
+			features->materialId = 0;
+			features->primitiveId = 0;
+		}
+
 #if GLOBAL_ILLUM_EN == 1
 		if (depth < 1) {
 			// maybe this becomes like a sky box or global illumination???
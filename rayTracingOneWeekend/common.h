@@ -11,11 +11,13 @@ struct RenderProperties {
 	uint32_t resWidthInPixels, resHeightInPixels;
 	uint8_t bytesPerPixel;
 	uint32_t antiAliasingSamplesPerPixel;
-	uint32_t finalImageBufferSizeInBytes;
+	uint32_t samplesPerFrame;
+	//64 bit, a 32K x 32K BGRA image is already past 4GB
+	uint64_t finalImageBufferSizeInBytes;
 };
 
 struct WorkerImageBuffer {
-	uint32_t sizeInBytes;
+	uint64_t sizeInBytes;
 	uint32_t resWidthInPixels, resHeightInPixels;
 	std::shared_ptr<uint8_t> buffer;
 };
@@ -30,6 +32,7 @@ struct GUIControlInputs {
 	bool leftShiftAsserted = false;
 };
 
+//gui and bitblit threads, the render threads live in RenderThreadPool (threadPool.h)
 struct WorkerThread {
 	uint32_t id;
 
@@ -12,6 +12,8 @@ public:
 	ConstantMedium(Hitable *boundary, float density, Texture *texture) : _boundary(boundary), _density(density) { 
 		_phaseFunction = new Isotropic(texture);
 	}
+	//an Isotropic the caller already made (and keeps), see sceneFile.h
+	ConstantMedium(Hitable *boundary, float density, Material *phaseFunction) : _boundary(boundary), _density(density), _phaseFunction(phaseFunction) {}
 
 	virtual bool hit(const ray &inputRay, float tMin, float tMax, HitRecord &hitRecord) const;
 	virtual bool boundingBox(float t0, float t1, AABB &boundingBox) const {
@@ -66,6 +68,7 @@ bool ConstantMedium::hit(const ray &inputRay, float tMin, float tMax, HitRecord
 
 				hitRecord.normal = vec3(1, 0, 0); //arbitary choice?
 				hitRecord.materialPointer = _phaseFunction;
+				hitRecord.primitiveId = _primitiveId;
 				return true;
 			}
 		}
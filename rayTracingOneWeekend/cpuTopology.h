@@ -0,0 +1,350 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <algorithm>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined (__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#elif defined (_WIN32)
+#include <Windows.h>
+#endif
+
+struct LogicalCpu {
+	uint32_t id;
+	int32_t packageId;
+	int32_t coreId;
+	int32_t nodeId;
+	//0 for the first hardware thread of a physical core, 1 for its SMT sibling, ...
+	uint32_t smtIndex;
+};
+
+/*
+	Which logical CPUs exist, which physical core and socket each one belongs to and which NUMA node it sits on.
+
+	On Linux this is read from sysfs:
+	- /sys/devices/system/cpu/online
+	- /sys/devices/system/cpu/cpuN/topology/{physical_package_id,core_id}
+	- /sys/devices/system/node/nodeM/cpulist
+	and only the online CPUs the process may run on (sched_getaffinity, so cgroup cpusets and taskset count) are kept.
+	On Windows it comes from GetLogicalProcessorInformationEx. A thread affinity mask only addresses one processor group,
+	so only group 0 is used, again cut down to the process affinity mask.
+	Anywhere else (or if the OS won't say) every hardware thread is treated as its own core on node 0 and nothing gets pinned.
+
+	getWorkerPlacement() orders the CPUs so the first workers each get a physical core of their own, spread round robin
+	over the NUMA nodes, and only then start doubling up on SMT siblings. Two render threads on one core fight over the
+	same L1/L2 and the FPU, so the siblings only pay off once every core is already busy.
+*/
+class CpuTopology {
+public:
+	CpuTopology() : _numOfNodes(1), _numOfPhysicalCores(0), _discovered(false) {
+		discover();
+	}
+
+	const std::vector<LogicalCpu> &getCpus() const {
+		return _cpus;
+	}
+
+	uint32_t getNumOfLogicalCpus() const {
+		return (uint32_t)_cpus.size();
+	}
+
+	uint32_t getNumOfPhysicalCores() const {
+		return _numOfPhysicalCores;
+	}
+
+	uint32_t getNumOfNodes() const {
+		return _numOfNodes;
+	}
+
+	//true when the layout came from the OS, false for the flat fallback
+	bool isDiscovered() const {
+		return _discovered;
+	}
+
+	//NUMA node of a logical CPU, 0 when unknown
+	int32_t getNodeOfCpu(uint32_t cpuId) const {
+		for (const LogicalCpu &cpu : _cpus) {
+			if (cpu.id == cpuId) {
+				return cpu.nodeId;
+			}
+		}
+		return 0;
+	}
+
+	//logical CPU id for each of numOfWorkers workers, wraps around if there are more workers than CPUs
+	std::vector<uint32_t> getWorkerPlacement(uint32_t numOfWorkers, bool useSmtSiblings) const;
+
+	//pins the calling thread, false if the OS refused or pinning isn't supported here
+	static bool pinCurrentThread(uint32_t cpuId);
+
+protected:
+	void discover();
+
+	static bool readInt(const std::string &path, int32_t &value);
+	static std::vector<uint32_t> parseCpuList(const std::string &list);
+
+	std::vector<LogicalCpu> _cpus;
+	uint32_t _numOfNodes;
+	uint32_t _numOfPhysicalCores;
+	bool _discovered;
+};
+
+bool CpuTopology::readInt(const std::string &path, int32_t &value) {
+	std::ifstream inputStream(path.c_str());
+	if (!inputStream.is_open()) {
+		return false;
+	}
+	inputStream >> value;
+	return !inputStream.fail();
+}
+
+//sysfs cpu lists look like "0-3,8-11,16"
+std::vector<uint32_t> CpuTopology::parseCpuList(const std::string &list) {
+	std::vector<uint32_t> cpus;
+	size_t position = 0;
+
+	while (position < list.size()) {
+		size_t comma = list.find(',', position);
+		std::string range = list.substr(position, comma == std::string::npos ? std::string::npos : comma - position);
+
+		size_t dash = range.find('-');
+		if (!range.empty() && range[0] >= '0' && range[0] <= '9') {
+			uint32_t first = (uint32_t)strtoul(range.c_str(), NULL, 10);
+			uint32_t last = (dash == std::string::npos) ? first : (uint32_t)strtoul(range.c_str() + dash + 1, NULL, 10);
+
+			for (uint32_t cpu = first; cpu <= last; cpu++) {
+				cpus.push_back(cpu);
+			}
+		}
+
+		if (comma == std::string::npos) {
+			break;
+		}
+		position = comma + 1;
+	}
+
+	return cpus;
+}
+
+void CpuTopology::discover() {
+	_cpus.clear();
+
+#if defined (__linux__)
+	std::ifstream onlineStream("/sys/devices/system/cpu/online");
+	std::string onlineList;
+
+	if (onlineStream.is_open() && std::getline(onlineStream, onlineList)) {
+		std::vector<uint32_t> online = parseCpuList(onlineList);
+
+		//a cpuset/taskset can leave the process fewer CPUs than are online, pinning to the others would just fail
+		cpu_set_t allowedSet;
+		CPU_ZERO(&allowedSet);
+		bool haveAllowedSet = sched_getaffinity(0, sizeof(allowedSet), &allowedSet) == 0;
+
+		for (uint32_t id : online) {
+			if (haveAllowedSet && (id >= CPU_SETSIZE || !CPU_ISSET(id, &allowedSet))) {
+				continue;
+			}
+
+			std::string topologyPath = "/sys/devices/system/cpu/cpu" + std::to_string(id) + "/topology/";
+
+			LogicalCpu cpu;
+			cpu.id = id;
+			cpu.packageId = 0;
+			cpu.coreId = (int32_t)id;
+			cpu.nodeId = 0;
+			cpu.smtIndex = 0;
+
+			readInt(topologyPath + "physical_package_id", cpu.packageId);
+			readInt(topologyPath + "core_id", cpu.coreId);
+
+			_cpus.push_back(cpu);
+		}
+
+		//node directories can be sparse (node0, node2) so walk the directory instead of counting up
+		DIR *nodeDirectory = opendir("/sys/devices/system/node");
+		if (nodeDirectory) {
+			uint32_t numOfNodes = 0;
+
+			while (dirent *entry = readdir(nodeDirectory)) {
+				std::string name = entry->d_name;
+				if (name.compare(0, 4, "node") != 0 || name.size() < 5 || name[4] < '0' || name[4] > '9') {
+					continue;
+				}
+
+				int32_t nodeId = (int32_t)strtol(name.c_str() + 4, NULL, 10);
+				std::ifstream cpuListStream(("/sys/devices/system/node/" + name + "/cpulist").c_str());
+				std::string cpuList;
+
+				if (cpuListStream.is_open() && std::getline(cpuListStream, cpuList)) {
+					for (uint32_t id : parseCpuList(cpuList)) {
+						for (LogicalCpu &cpu : _cpus) {
+							if (cpu.id == id) {
+								cpu.nodeId = nodeId;
+							}
+						}
+					}
+				}
+				numOfNodes++;
+			}
+			closedir(nodeDirectory);
+
+			_numOfNodes = numOfNodes > 0 ? numOfNodes : 1;
+		}
+
+		_discovered = !_cpus.empty();
+	}
+#elif defined (_WIN32)
+	DWORD_PTR processMask = 0, systemMask = 0;
+	if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) {
+		processMask = ~DWORD_PTR(0);
+	}
+
+	DWORD length = 0;
+	GetLogicalProcessorInformationEx(RelationAll, NULL, &length);
+
+	std::vector<uint8_t> buffer(length);
+	if (length > 0 && GetLogicalProcessorInformationEx(RelationAll, (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)buffer.data(), &length)) {
+		//the entries come in any order, so collect the package and node masks first and hand them out at the end
+		std::vector<KAFFINITY> packageMasks;
+		std::vector<std::pair<int32_t, KAFFINITY>> nodeMasks;
+		int32_t coreId = 0;
+
+		for (DWORD offset = 0; offset < length; ) {
+			const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *info = (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX *)(buffer.data() + offset);
+
+			if (info->Relationship == RelationProcessorCore || info->Relationship == RelationProcessorPackage) {
+				KAFFINITY mask = 0;
+				for (WORD group = 0; group < info->Processor.GroupCount; group++) {
+					if (info->Processor.GroupMask[group].Group == 0) {
+						mask = info->Processor.GroupMask[group].Mask & processMask;
+					}
+				}
+
+				if (info->Relationship == RelationProcessorPackage) {
+					packageMasks.push_back(mask);
+				}
+				else if (mask != 0) {
+					//every core entry is one physical core, its bits are the SMT siblings
+					for (uint32_t id = 0; id < sizeof(KAFFINITY) * 8; id++) {
+						if (mask & (KAFFINITY(1) << id)) {
+							LogicalCpu cpu = { id, 0, coreId, 0, 0 };
+							_cpus.push_back(cpu);
+						}
+					}
+					coreId++;
+				}
+			}
+			else if (info->Relationship == RelationNumaNode && info->NumaNode.GroupMask.Group == 0) {
+				nodeMasks.push_back(std::make_pair((int32_t)info->NumaNode.NodeNumber, info->NumaNode.GroupMask.Mask));
+			}
+
+			offset += info->Size;
+		}
+
+		for (LogicalCpu &cpu : _cpus) {
+			for (size_t package = 0; package < packageMasks.size(); package++) {
+				if (packageMasks[package] & (KAFFINITY(1) << cpu.id)) {
+					cpu.packageId = (int32_t)package;
+				}
+			}
+			for (const std::pair<int32_t, KAFFINITY> &node : nodeMasks) {
+				if (node.second & (KAFFINITY(1) << cpu.id)) {
+					cpu.nodeId = node.first;
+				}
+			}
+		}
+
+		_numOfNodes = nodeMasks.empty() ? 1 : (uint32_t)nodeMasks.size();
+		_discovered = !_cpus.empty();
+	}
+#endif
+
+	if (_cpus.empty()) {
+		uint32_t numOfCpus = std::thread::hardware_concurrency();
+		if (numOfCpus == 0) numOfCpus = 1;
+
+		for (uint32_t id = 0; id < numOfCpus; id++) {
+			LogicalCpu cpu = { id, 0, (int32_t)id, 0, 0 };
+			_cpus.push_back(cpu);
+		}
+		_numOfNodes = 1;
+	}
+
+	//number the hardware threads of each physical core, lowest CPU id first
+	std::sort(_cpus.begin(), _cpus.end(), [](const LogicalCpu &a, const LogicalCpu &b) {
+		if (a.packageId != b.packageId) return a.packageId < b.packageId;
+		if (a.coreId != b.coreId) return a.coreId < b.coreId;
+		return a.id < b.id;
+	});
+
+	_numOfPhysicalCores = 0;
+	for (size_t i = 0; i < _cpus.size(); i++) {
+		bool sameCore = i > 0 && _cpus[i].packageId == _cpus[i - 1].packageId && _cpus[i].coreId == _cpus[i - 1].coreId;
+		_cpus[i].smtIndex = sameCore ? _cpus[i - 1].smtIndex + 1 : 0;
+		if (!sameCore) _numOfPhysicalCores++;
+	}
+}
+
+std::vector<uint32_t> CpuTopology::getWorkerPlacement(uint32_t numOfWorkers, bool useSmtSiblings) const {
+	//one list per SMT level, each one interleaved over the nodes
+	uint32_t maxSmtIndex = 0;
+	int32_t maxNodeId = 0;
+	for (const LogicalCpu &cpu : _cpus) {
+		maxSmtIndex = std::max(maxSmtIndex, cpu.smtIndex);
+		maxNodeId = std::max(maxNodeId, cpu.nodeId);
+	}
+
+	std::vector<uint32_t> order;
+
+	for (uint32_t smtIndex = 0; smtIndex <= (useSmtSiblings ? maxSmtIndex : 0); smtIndex++) {
+		std::vector<std::vector<uint32_t>> perNode(maxNodeId + 1);
+
+		for (const LogicalCpu &cpu : _cpus) {
+			if (cpu.smtIndex == smtIndex) {
+				perNode[cpu.nodeId].push_back(cpu.id);
+			}
+		}
+
+		bool added = true;
+		for (size_t position = 0; added; position++) {
+			added = false;
+			for (std::vector<uint32_t> &nodeCpus : perNode) {
+				if (position < nodeCpus.size()) {
+					order.push_back(nodeCpus[position]);
+					added = true;
+				}
+			}
+		}
+	}
+
+	std::vector<uint32_t> placement;
+	for (uint32_t worker = 0; worker < numOfWorkers && !order.empty(); worker++) {
+		placement.push_back(order[worker % order.size()]);
+	}
+
+	return placement;
+}
+
+bool CpuTopology::pinCurrentThread(uint32_t cpuId) {
+#if defined (__linux__)
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	CPU_SET(cpuId, &cpuSet);
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+#elif defined (_WIN32)
+	if (cpuId >= 64) {
+		return false;
+	}
+	return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpuId) != 0;
+#else
+	return false;
+#endif
+}
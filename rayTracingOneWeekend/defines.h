@@ -7,9 +7,82 @@
 #define DEFAULT_RENDER_WIDTH 800
 #define DEFAULT_RENDER_HEIGHT 800
 #define DEFAULT_RENDER_AA 64
-#define DEBUG_RUN_THREADS 7 //0 selects max available threads
+#define DEBUG_RUN_THREADS 0 //0 selects one thread per core (or per hardware thread with WORKER_AFFINITY_USE_SMT)
+#define WORKER_AFFINITY_EN 1 //pin render threads, one per physical core first and spread over the NUMA nodes, see cpuTopology.h
+#define WORKER_AFFINITY_USE_SMT 1 //also run on the SMT siblings once every physical core has a thread
+#define TILE_SIZE_IN_PIXELS 32 //workers render and steal square tiles of this size, see tileScheduler.h
+#ifndef CAMERA_PRINT_BASIS_EN
+#define CAMERA_PRINT_BASIS_EN 1 //dump the basis matrices every time a camera is made, the library build turns this off
+#endif
 
-#define OUTPUT_BMP_EN 0
+//keep adding samples to a float buffer while the camera holds still, otherwise every frame renders DEFAULT_RENDER_AA from scratch
+#define PROGRESSIVE_RENDER_EN 1
+#define PROGRESSIVE_SAMPLES_PER_FRAME 4
+#define CHECKPOINT_INTERVAL_MS 60000 //"--checkpoint <path>" saves the progressive render this often (at a pass boundary), "--resume <path>" picks it up, see renderCheckpoint.h
+
+//stop sampling pixels once their relative standard error is under the threshold, see accumulationBuffer.h
+#define ADAPTIVE_SAMPLING_EN 1
+#define ADAPTIVE_SAMPLING_MIN_SAMPLES 16
+#define ADAPTIVE_SAMPLING_MAX_SAMPLES 4096
+#define ADAPTIVE_SAMPLING_ERROR_THRESHOLD 0.02
+#define ADAPTIVE_SAMPLING_BATCH 4
+
+//a-trous wavelet filter guided by first hit albedo/normal/depth, runs after the workers finish each pass
+#define DENOISER_EN 1
+#define DENOISER_ITERATIONS 5
+#define DENOISER_COLOR_SIGMA 1.0
+#define DENOISER_NORMAL_SIGMA 64.0
+#define DENOISER_DEPTH_SIGMA 0.05
+#define DENOISER_REPORT_TIME 1
+
+//extra per pixel channels recorded next to the color, see aovFramebuffer.h for the flags. The denoiser adds the ones it needs.
+#define AOV_CHANNELS (AOV_FLAG_DEPTH | AOV_FLAG_NORMAL | AOV_FLAG_ALBEDO | AOV_FLAG_SAMPLE_COUNT)
+#define AOV_OUTPUT_EN 0 //write every channel as a .pfm along with the bmp
+
+//"--coordinator" renders the first frame on worker processes started with "--worker <host>", see distributedRender.h
+#define DISTRIBUTED_PORT 5150
+#define DISTRIBUTED_MIN_WORKERS 1 //the coordinator waits for this many workers before it hands out tiles
+#define DISTRIBUTED_WAIT_FOR_WORKERS_MS 30000
+#define DISTRIBUTED_WORKER_TIMEOUT_MS 60000 //a worker that doesn't return a tile in this long is dropped and its tiles reassigned
+#define DISTRIBUTED_TILES_IN_FLIGHT_PER_THREAD 2
+
+//--daemon [socket path], scenes stay built between requests (see renderDaemon.h)
+#define RENDER_DAEMON_SOCKET_PATH "rayTracingOneWeekend.sock"
+#define RENDER_DAEMON_MAX_BAND_SIZE_IN_BYTES (4 * 1024 * 1024) //the finished image goes back in row bands of about this size
+#define RENDER_DAEMON_MAX_RES_IN_PIXELS 16384 //requests wider or taller than this are turned down
+#define RENDER_DAEMON_MAX_NUM_OF_PIXELS (8192 * 8192) //and so are ones with more pixels than this, the buffers are sized per pixel
+#define RENDER_DAEMON_MAX_SAMPLES_PER_PIXEL 65536
+#define RENDER_DAEMON_MAX_CACHED_SCENES 8 //the least recently used scene is destroyed to make room past this
+#define RENDER_DAEMON_MAX_SCENE_PATH_SIZE 256 //scene file path in a request, terminator included
+
+#define OUT_OF_CORE_BAND_HEIGHT_IN_PIXELS TILE_SIZE_IN_PIXELS //"--poster" renders and writes bands of this many rows, see outOfCoreRender.h
+#define OUT_OF_CORE_BANDS_IN_FLIGHT 4 //bands resident at once, the workers spill over into the next band instead of waiting on the write
+
+//"--sequence <camera path> <frames> <output pattern>" renders numbered frames, see sequenceRender.h
+#define SEQUENCE_FRAMES_IN_FLIGHT 0 //frames rendering at once, 0 picks enough for SEQUENCE_TILES_PER_THREAD
+#define SEQUENCE_TILES_PER_THREAD 4
+#define SEQUENCE_MAX_FRAMES_IN_FLIGHT 16
+#define IMAGE_WRITER_POOL_THREADS 2 //threads encoding and writing finished frames, see imageWriterPool.h
+#define IMAGE_WRITER_POOL_QUEUE_DEPTH 4 //finished frames that can wait for a writer before the render waits instead
+#define FRAME_STREAM_FPS 30 //"-" or a .y4m/.rgb output pattern streams raw frames instead, see frameStream.h
+#define FRAME_STREAM_CHROMA_420 1 //Y4M chroma, 1 = 4:2:0 which every encoder takes, 0 = 4:4:4
+
+//decoded textures are cached as raw files next to the source and mapped read only, shared by every process on the node
+//(what the mip chains are built from when TEXTURE_MIP_CACHE_EN is 0)
+#define SHARED_IMAGE_CACHE_EN 1
+#define SHARED_IMAGE_CACHE_SUFFIX ".rgb8"
+//image textures are converted to a mipmapped, tiled file next to the source instead and mapped, see mipmapCache.h
+#define TEXTURE_MIP_CACHE_EN 1
+#define TEXTURE_MIP_CACHE_SUFFIX ".rtmip"
+
+//"--scene <path>" renders a scene file, text is compiled to path + this on first use, see sceneFile.h
+#define SCENE_FILE_COMPILED_SUFFIX ".rtscene"
+#define SCENE_FILE_BVH_CACHE_SUFFIX ".bvh" //the world's BVH is cached next to the compiled file, see bvhCache.h
+
+#define OUTPUT_BMP_EN 0 //write the final image to OUTPUT_IMAGE_PATH, "--output <path>" always writes it
+#define OUTPUT_IMAGE_PATH "test.bmp" //.bmp, .ppm or .png, see imageWriter.h
+#define OUTPUT_HDR_EN 0 //write the linear float image to OUTPUT_HDR_IMAGE_PATH, "--hdr-output <path>" always writes it
+#define OUTPUT_HDR_IMAGE_PATH "test.hdr" //.pfm, .hdr or .exr, see hdrImageWriter.h
 #define RUN_RAY_TRACE 1
 #define BYPASS_SCENE_CONFIG 1
 
@@ -19,12 +92,14 @@
 #define CAPTURE_MOUSE 0
 #define ENABLE_MOUSE_CONTROLS 0
 #define ENABLE_KEYBOARD_CONTROLS 0
+#define INPUT_POLL_INTERVAL_MS 4 //how often the mouse/keyboard are checked for a change while a frame renders, a change cancels the frame at the next tile
 
 #define GLOBAL_ILLUM_EN 1
 #define SKY_ILLUM_GAIN 1.0
 #define GLOBAL_ILLUM_GAIN 0.3
 #define CAMERA_DOF_EN 0
 #define DEPTH_RECURSION 50
+#define DIRECT_LIGHT_SAMPLING_EN 1 //pick lights by power with an alias table, see lightSampler.h
 
 #define ENABLE_BITBLIT 1
 #define DEBUG_SET_PIXEL 0
\ No newline at end of file
@@ -0,0 +1,212 @@
+#pragma once
+
+#include <vector>
+#include <chrono>
+#include <math.h>
+#include <algorithm>
+#include <stdint.h>
+
+#include "vec3.h"
+#include "accumulationBuffer.h"
+#include "aovFramebuffer.h"
+#include "threadPool.h"
+
+/*
+	Edge-avoiding a-trous wavelet filter run on the resolved float image after the render workers are done.
+	- https://jo.dreggn.org/home/2010_atrous.pdf
+
+	The color is divided by the first hit albedo first so textures are not blurred, filtered with a 5x5 B3 spline
+	kernel whose taps spread out 1, 2, 4, ... pixels per iteration, and then multiplied by the albedo again.
+	Taps are weighted down when the color, normal or depth differ too much from the center pixel.
+
+	All the buffers are planar float arrays. Every tap costs one expf (color and depth weights together) and, for pixels
+	with a normal, one powf, the taps that fall off the image are cut from the loop bounds instead of tested.
+	The gather and every iteration split the rows into one band per render thread and run on the render pool, which
+	is parked between frames anyway, so no threads are created per frame.
+*/
+class ATrousDenoiser {
+public:
+	ATrousDenoiser(uint32_t resWidthInPixels, uint32_t resHeightInPixels, uint32_t numOfIterations) :
+		_resWidthInPixels(resWidthInPixels), _resHeightInPixels(resHeightInPixels), _numOfIterations(numOfIterations),
+		_colorSigma(1.0f), _normalSigma(64.0f), _depthSigma(0.05f), _lastDenoiseTimeMs(0.0) {
+
+		size_t n = (size_t)resWidthInPixels * resHeightInPixels;
+
+		for (int c = 0; c < 3; c++) {
+			_color[0][c].assign(n, 0.0f);
+			_color[1][c].assign(n, 0.0f);
+			_albedo[c].assign(n, 0.0f);
+			_normal[c].assign(n, 0.0f);
+		}
+		_depth.assign(n, 0.0f);
+	}
+
+	void setSigmas(float colorSigma, float normalSigma, float depthSigma) {
+		_colorSigma = colorSigma;
+		_normalSigma = normalSigma;
+		_depthSigma = depthSigma;
+	}
+
+	//the render pool's frame must be finished, its threads do the bands and the buffers are read directly. The AOVs need depth, normal and albedo enabled.
+	void denoise(const AccumulationBuffer &accumulationBuffer, const AOVFramebuffer &aovFramebuffer, RenderThreadPool &threadPool);
+
+	vec3 getPixel(uint32_t pixelIndex) const {
+		const std::vector<float> *output = _color[_outputIndex];
+		return vec3(output[0][pixelIndex], output[1][pixelIndex], output[2][pixelIndex]) *
+			vec3(_albedo[0][pixelIndex] + ALBEDO_EPSILON, _albedo[1][pixelIndex] + ALBEDO_EPSILON, _albedo[2][pixelIndex] + ALBEDO_EPSILON);
+	}
+
+	double getLastDenoiseTimeMs() const {
+		return _lastDenoiseTimeMs;
+	}
+
+protected:
+	void gatherRows(const AccumulationBuffer &accumulationBuffer, const AOVFramebuffer &aovFramebuffer, uint32_t rowStart, uint32_t rowEnd);
+	void filterRows(uint32_t rowStart, uint32_t rowEnd, int stepWidth, float colorSigma, int inputIndex);
+
+	static constexpr float ALBEDO_EPSILON = 0.001f;
+
+	uint32_t _resWidthInPixels, _resHeightInPixels;
+	uint32_t _numOfIterations;
+
+	float _colorSigma, _normalSigma, _depthSigma;
+	double _lastDenoiseTimeMs;
+
+	//ping-pong color planes, _outputIndex points at the last written one
+	std::vector<float> _color[2][3];
+	int _outputIndex = 0;
+
+	std::vector<float> _albedo[3];
+	std::vector<float> _normal[3];
+	std::vector<float> _depth;
+};
+
+constexpr float ATrousDenoiser::ALBEDO_EPSILON;
+
+void ATrousDenoiser::denoise(const AccumulationBuffer &accumulationBuffer, const AOVFramebuffer &aovFramebuffer, RenderThreadPool &threadPool) {
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	uint32_t numOfBands = threadPool.getNumOfThreads();
+	uint32_t rowsPerBand = (_resHeightInPixels + numOfBands - 1) / numOfBands;
+
+	auto bandRows = [this, rowsPerBand](uint32_t band, uint32_t &rowStart, uint32_t &rowEnd) {
+		rowStart = std::min(band * rowsPerBand, _resHeightInPixels);
+		rowEnd = std::min(rowStart + rowsPerBand, _resHeightInPixels);
+	};
+
+	threadPool.submitFrame([&](uint32_t band) {
+		uint32_t rowStart, rowEnd;
+		bandRows(band, rowStart, rowEnd);
+		gatherRows(accumulationBuffer, aovFramebuffer, rowStart, rowEnd);
+	});
+	threadPool.waitForFrame();
+
+	_outputIndex = 0;
+
+	for (uint32_t iteration = 0; iteration < _numOfIterations; iteration++) {
+		int stepWidth = 1 << iteration;
+		//tighten the color weight every level, the coarser levels should only smooth what is left over
+		float colorSigma = _colorSigma / float(stepWidth);
+		int inputIndex = _outputIndex;
+
+		threadPool.submitFrame([&](uint32_t band) {
+			uint32_t rowStart, rowEnd;
+			bandRows(band, rowStart, rowEnd);
+			filterRows(rowStart, rowEnd, stepWidth, colorSigma, inputIndex);
+		});
+		threadPool.waitForFrame();
+
+		_outputIndex = 1 - _outputIndex;
+	}
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - startTime;
+	_lastDenoiseTimeMs = elapsed.count();
+}
+
+void ATrousDenoiser::gatherRows(const AccumulationBuffer &accumulationBuffer, const AOVFramebuffer &aovFramebuffer, uint32_t rowStart, uint32_t rowEnd) {
+	for (uint32_t row = rowStart; row < rowEnd; row++) {
+		for (uint32_t column = 0; column < _resWidthInPixels; column++) {
+			uint32_t i = row * _resWidthInPixels + column;
+
+			vec3 albedo = aovFramebuffer.resolveAlbedo(i);
+			vec3 color = accumulationBuffer.resolve(i);
+			vec3 normal = aovFramebuffer.resolveNormal(i);
+
+			for (int c = 0; c < 3; c++) {
+				_albedo[c][i] = albedo[c];
+				//demodulate so the filter only sees lighting
+				_color[0][c][i] = color[c] / (albedo[c] + ALBEDO_EPSILON);
+				_normal[c][i] = normal[c];
+			}
+			_depth[i] = aovFramebuffer.resolveDepth(i);
+		}
+	}
+}
+
+void ATrousDenoiser::filterRows(uint32_t rowStart, uint32_t rowEnd, int stepWidth, float colorSigma, int inputIndex) {
+	static const float kernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+
+	const float *inR = _color[inputIndex][0].data();
+	const float *inG = _color[inputIndex][1].data();
+	const float *inB = _color[inputIndex][2].data();
+	float *outR = _color[1 - inputIndex][0].data();
+	float *outG = _color[1 - inputIndex][1].data();
+	float *outB = _color[1 - inputIndex][2].data();
+
+	const float *nX = _normal[0].data();
+	const float *nY = _normal[1].data();
+	const float *nZ = _normal[2].data();
+	const float *depth = _depth.data();
+
+	int width = (int)_resWidthInPixels;
+	int height = (int)_resHeightInPixels;
+	float inverseColorSigmaSquared = 1.0f / (colorSigma * colorSigma);
+
+	for (int row = (int)rowStart; row < (int)rowEnd; row++) {
+		//the kernel rows that are on the image
+		int kyStart = -std::min(2, row / stepWidth);
+		int kyEnd = std::min(2, (height - 1 - row) / stepWidth);
+
+		for (int column = 0; column < width; column++) {
+			int center = row * width + column;
+			int kxStart = -std::min(2, column / stepWidth);
+			int kxEnd = std::min(2, (width - 1 - column) / stepWidth);
+
+			float cR = inR[center], cG = inG[center], cB = inB[center];
+			float cNX = nX[center], cNY = nY[center], cNZ = nZ[center];
+			float cDepth = depth[center];
+			//escaped rays have no normal, let them blend with each other
+			bool centerHasNormal = (cNX != 0.0f || cNY != 0.0f || cNZ != 0.0f);
+			float depthScale = 1.0f / (_depthSigma * float(stepWidth) * cDepth + 1.0e-4f);
+
+			float sumR = 0.0f, sumG = 0.0f, sumB = 0.0f, sumWeight = 0.0f;
+
+			for (int ky = kyStart; ky <= kyEnd; ky++) {
+				const int tapRow = (row + ky * stepWidth) * width + column;
+
+				for (int kx = kxStart; kx <= kxEnd; kx++) {
+					int tap = tapRow + kx * stepWidth;
+
+					float dR = inR[tap] - cR, dG = inG[tap] - cG, dB = inB[tap] - cB;
+					//exp(-a) * exp(-b) in one go
+					float colorDepthWeight = expf(-(dR * dR + dG * dG + dB * dB) * inverseColorSigmaSquared - fabsf(depth[tap] - cDepth) * depthScale);
+
+					float normalDot = std::max(cNX * nX[tap] + cNY * nY[tap] + cNZ * nZ[tap], 0.0f);
+					float normalWeight = centerHasNormal ? powf(normalDot, _normalSigma) : 1.0f;
+
+					float weight = kernel[kx + 2] * kernel[ky + 2] * colorDepthWeight * normalWeight;
+
+					sumR += inR[tap] * weight;
+					sumG += inG[tap] * weight;
+					sumB += inB[tap] * weight;
+					sumWeight += weight;
+				}
+			}
+
+			//the center tap always has full weight so sumWeight is never 0
+			outR[center] = sumR / sumWeight;
+			outG[center] = sumG / sumWeight;
+			outB[center] = sumB / sumWeight;
+		}
+	}
+}
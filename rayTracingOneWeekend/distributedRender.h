@@ -0,0 +1,675 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <condition_variable>
+#include <string.h>
+#include <stdint.h>
+
+#include "tcpSocket.h"
+#include "defines.h"
+#include "vec3.h"
+#include "camera.h"
+#include "hitable.h"
+#include "lightSampler.h"
+#include "accumulationBuffer.h"
+#include "tileScheduler.h"
+#include "threadPool.h"
+#include "renderer.h"
+
+/*
+	Coordinator/worker mode, one frame spread over several processes (and machines) over TCP.
+
+	The hitables are a pointer graph with no serialized form, so instead of the scene itself the coordinator ships
+	what it takes to rebuild it: the scene id and the RNG seed it was generated with. Every scene builder draws only
+	from randomNumberGenerator, so a worker that seeds the same way gets the same spheres, materials and BVH. Textures
+	loaded from files have to be found next to the worker too. The camera goes out once per frame as its ray state.
+
+	Messages are a {type, size} header followed by a fixed layout payload. Both ends have to be the same build on the
+	same endianness, there is no versioning.
+
+	coordinator								worker
+											HELLO {threads}
+	SCENE {id, seed, size}
+	FRAME {id, spp, camera}
+	TILE {frame, tile} (a few per worker)
+											TILE_RESULT {frame, tile, per pixel sums}
+	...
+	BYE
+
+	The coordinator keeps a couple of tiles per worker thread in flight. A worker that disconnects or doesn't answer
+	within DISTRIBUTED_WORKER_TIMEOUT_MS is dropped and its in flight tiles go back in the queue for the others. Results
+	are the raw color/luminance squared sums and sample counts, so they add into the coordinator's accumulation buffer
+	exactly as if a local thread had traced them. The coordinator's own render threads can pull from the same queue,
+	they trace with the same seed and pass as a worker would, so a tile comes out the same wherever it ran.
+
+	Only one frame is distributed per renderFrame() call. main.cpp calls it once, for the first frame's full AA budget,
+	and the interactive passes after that (and anything after a camera move) render locally.
+*/
+
+enum DistributedMessageType {
+	DISTRIBUTED_MSG_HELLO = 1,
+	DISTRIBUTED_MSG_SCENE,
+	DISTRIBUTED_MSG_FRAME,
+	DISTRIBUTED_MSG_TILE,
+	DISTRIBUTED_MSG_TILE_RESULT,
+	DISTRIBUTED_MSG_BYE
+};
+
+struct DistributedMessageHeader {
+	uint32_t type;
+	uint32_t sizeInBytes;
+};
+
+struct DistributedHelloMessage {
+	uint32_t numOfThreads;
+};
+
+struct DistributedSceneMessage {
+	uint32_t sceneId;
+	uint32_t resWidthInPixels, resHeightInPixels;
+	uint32_t reserved;
+	uint64_t seed;
+};
+
+struct DistributedFrameMessage {
+	uint64_t frameId;
+	uint32_t samplesPerPixel;
+	float cameraRayState[CAMERA_RAY_STATE_SIZE];
+};
+
+struct DistributedTileMessage {
+	uint64_t frameId;
+	uint32_t columnStart, columnEnd;
+	uint32_t rowStart, rowEnd;
+	uint32_t index;
+};
+
+//follows a DistributedTileMessage in TILE_RESULT, one per tile pixel, rows bottom to top
+struct DistributedPixelSum {
+	float colorSum[3];
+	float luminanceSquaredSum;
+	uint32_t sampleCount;
+};
+
+bool sendDistributedMessage(TcpSocket &socket, uint32_t type, const void *payload, uint32_t sizeInBytes) {
+	DistributedMessageHeader header = { type, sizeInBytes };
+	return socket.sendAll(&header, sizeof(header)) && (sizeInBytes == 0 || socket.sendAll(payload, sizeInBytes));
+}
+
+//anything bigger than this is a corrupt stream, not a tile
+#define DISTRIBUTED_MAX_MESSAGE_SIZE (64 * 1024 * 1024)
+
+bool receiveDistributedMessage(TcpSocket &socket, DistributedMessageHeader &header, std::vector<uint8_t> &payload) {
+	if (!socket.receiveAll(&header, sizeof(header)) || header.sizeInBytes > DISTRIBUTED_MAX_MESSAGE_SIZE) {
+		return false;
+	}
+	payload.resize(header.sizeInBytes);
+	return header.sizeInBytes == 0 || socket.receiveAll(payload.data(), header.sizeInBytes);
+}
+
+class DistributedCoordinator {
+public:
+	DistributedCoordinator(uint32_t sceneId, uint64_t seed, uint32_t resWidthInPixels, uint32_t resHeightInPixels) :
+		_resWidthInPixels(resWidthInPixels), _resHeightInPixels(resHeightInPixels), _frameId(0), _running(false) {
+
+		_scene.sceneId = sceneId;
+		_scene.resWidthInPixels = resWidthInPixels;
+		_scene.resHeightInPixels = resHeightInPixels;
+		_scene.reserved = 0;
+		_scene.seed = seed;
+	}
+
+	~DistributedCoordinator() {
+		stop();
+	}
+
+	//starts taking worker connections in the background
+	bool start(uint16_t port) {
+		if (!_listenSocket.listen(port)) {
+			std::cout << "Coordinator failed to listen on port " << port << "\n";
+			return false;
+		}
+
+		_running = true;
+		_acceptThread = std::thread(&DistributedCoordinator::acceptProcedure, this);
+		return true;
+	}
+
+	uint16_t getPort() const {
+		return _listenSocket.getLocalPort();
+	}
+
+	//sends every worker BYE and disconnects them
+	void stop() {
+		if (!_running) {
+			return;
+		}
+		_running = false;
+
+		//shutdown wakes accept() on Linux, closing it does on Windows
+		_listenSocket.shutdown();
+		_listenSocket.close();
+		_acceptThread.join();
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (std::unique_ptr<RemoteWorker> &worker : _workers) {
+			sendDistributedMessage(worker->socket, DISTRIBUTED_MSG_BYE, NULL, 0);
+			worker->socket.close();
+		}
+		_workers.clear();
+	}
+
+	//blocks until numOfWorkers are connected or the timeout runs out, returns how many there are
+	uint32_t waitForWorkers(uint32_t numOfWorkers, std::chrono::milliseconds timeout) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		_workersConditionVar.wait_for(lock, timeout, [this, numOfWorkers] {return _workers.size() >= numOfWorkers; });
+		return (uint32_t)_workers.size();
+	}
+
+	uint32_t getNumOfWorkers() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return (uint32_t)_workers.size();
+	}
+
+	/*
+		Traces samplesPerPixel samples of every pixel on the connected workers and adds them to accumulationBuffer.
+		With a localThreadPool (parked, the previous frame waited on) its threads take tiles from the same queue too.
+		Returns how many tiles could not be rendered because every worker was lost, 0 when the frame is complete,
+		which is always the case with local threads.
+	*/
+	uint32_t renderFrame(const Camera &camera, uint32_t samplesPerPixel, AccumulationBuffer &accumulationBuffer,
+		RenderThreadPool *localThreadPool = NULL, Hitable *world = NULL, const EmitterRegistry *emitters = NULL);
+
+protected:
+	struct RemoteWorker {
+		TcpSocket socket;
+		uint32_t numOfThreads;
+	};
+
+	//shared by the per worker connection threads of one frame
+	struct FrameState {
+		std::mutex mutex;
+		std::condition_variable conditionVar;
+		std::deque<RenderTile> pendingTiles;
+		uint32_t tilesRemaining;
+		uint32_t numOfLiveWorkers;
+		//the local threads take whatever the workers leave, so a frame can't run out of hands
+		bool hasLocalThreads;
+		AccumulationBuffer *accumulationBuffer;
+	};
+
+	void acceptProcedure() {
+		while (_running) {
+			TcpSocket socket = _listenSocket.accept();
+			if (!socket.isOpen()) {
+				continue;
+			}
+
+			socket.setReceiveTimeout(DISTRIBUTED_WORKER_TIMEOUT_MS);
+
+			DistributedMessageHeader header;
+			std::vector<uint8_t> payload;
+			if (!receiveDistributedMessage(socket, header, payload) || header.type != DISTRIBUTED_MSG_HELLO || payload.size() != sizeof(DistributedHelloMessage)) {
+				continue;
+			}
+
+			if (!sendDistributedMessage(socket, DISTRIBUTED_MSG_SCENE, &_scene, sizeof(_scene))) {
+				continue;
+			}
+
+			std::unique_ptr<RemoteWorker> worker(new RemoteWorker);
+			worker->socket = std::move(socket);
+			worker->numOfThreads = ((const DistributedHelloMessage *)payload.data())->numOfThreads;
+			if (worker->numOfThreads == 0) worker->numOfThreads = 1;
+
+			std::lock_guard<std::mutex> lock(_mutex);
+			std::cout << "Worker connected (" << worker->numOfThreads << " threads)\n";
+			_workers.push_back(std::move(worker));
+			_workersConditionVar.notify_all();
+		}
+	}
+
+	//false when the worker has to be dropped
+	bool driveWorker(RemoteWorker &worker, const DistributedFrameMessage &frame, FrameState &state);
+
+	//one local pool thread, pulls from the pending tiles until every tile of the frame is done
+	void traceLocalTiles(const DistributedFrameMessage &frame, const Camera &camera, Hitable *world, const EmitterRegistry *emitters, FrameState &state);
+
+	uint32_t _resWidthInPixels, _resHeightInPixels;
+	DistributedSceneMessage _scene;
+	uint64_t _frameId;
+
+	TcpSocket _listenSocket;
+	std::thread _acceptThread;
+	std::atomic<bool> _running;
+
+	std::mutex _mutex;
+	std::condition_variable _workersConditionVar;
+	std::vector<std::unique_ptr<RemoteWorker>> _workers;
+};
+
+uint32_t DistributedCoordinator::renderFrame(const Camera &camera, uint32_t samplesPerPixel, AccumulationBuffer &accumulationBuffer,
+	RenderThreadPool *localThreadPool, Hitable *world, const EmitterRegistry *emitters) {
+
+	DistributedFrameMessage frame;
+	frame.frameId = ++_frameId;
+	frame.samplesPerPixel = samplesPerPixel;
+	camera.getRayState(frame.cameraRayState);
+
+	FrameState state;
+	state.hasLocalThreads = localThreadPool != NULL && world != NULL;
+	state.accumulationBuffer = &accumulationBuffer;
+
+	//same tile layout and order as the local render
+	TileScheduler tileLayout(1, _resWidthInPixels, _resHeightInPixels, TILE_SIZE_IN_PIXELS);
+	tileLayout.beginFrame();
+
+	RenderTile tile;
+	while (tileLayout.nextTile(0, tile)) {
+		state.pendingTiles.push_back(tile);
+	}
+	state.tilesRemaining = (uint32_t)state.pendingTiles.size();
+
+	//workers that connect while the frame runs join the next one
+	std::vector<RemoteWorker *> workers;
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (std::unique_ptr<RemoteWorker> &worker : _workers) {
+			workers.push_back(worker.get());
+		}
+	}
+	state.numOfLiveWorkers = (uint32_t)workers.size();
+
+	std::vector<std::thread> connectionThreads;
+	std::vector<char> workerLost(workers.size(), 0);
+
+	for (size_t i = 0; i < workers.size(); i++) {
+		connectionThreads.push_back(std::thread([this, &workers, &workerLost, &frame, &state, i] {
+			workerLost[i] = driveWorker(*workers[i], frame, state) ? 0 : 1;
+		}));
+	}
+
+	if (state.hasLocalThreads) {
+		localThreadPool->submitFrame([this, &frame, &camera, world, emitters, &state](uint32_t) {
+			traceLocalTiles(frame, camera, world, emitters, state);
+		});
+		localThreadPool->waitForFrame();
+	}
+
+	for (std::thread &thread : connectionThreads) {
+		thread.join();
+	}
+
+	//forget the ones that went away
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		for (size_t i = 0; i < workers.size(); i++) {
+			if (workerLost[i]) {
+				std::cout << "Worker lost, its tiles were handed to the others\n";
+				for (size_t w = 0; w < _workers.size(); w++) {
+					if (_workers[w].get() == workers[i]) {
+						_workers.erase(_workers.begin() + w);
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	return state.tilesRemaining;
+}
+
+bool DistributedCoordinator::driveWorker(RemoteWorker &worker, const DistributedFrameMessage &frame, FrameState &state) {
+	std::deque<RenderTile> inFlight;
+	uint32_t window = worker.numOfThreads * DISTRIBUTED_TILES_IN_FLIGHT_PER_THREAD;
+	bool alive = sendDistributedMessage(worker.socket, DISTRIBUTED_MSG_FRAME, &frame, sizeof(frame));
+
+	DistributedMessageHeader header;
+	std::vector<uint8_t> payload;
+
+	while (alive) {
+		//top up the window, or wait around in case a lost worker's tiles come back
+		size_t firstNewTile = inFlight.size();
+		{
+			std::unique_lock<std::mutex> lock(state.mutex);
+
+			if (inFlight.empty()) {
+				state.conditionVar.wait(lock, [&state] {return state.tilesRemaining == 0 || !state.pendingTiles.empty(); });
+				if (state.tilesRemaining == 0) {
+					break;
+				}
+			}
+
+			while (inFlight.size() < window && !state.pendingTiles.empty()) {
+				inFlight.push_back(state.pendingTiles.front());
+				state.pendingTiles.pop_front();
+			}
+		}
+
+		for (size_t i = firstNewTile; i < inFlight.size() && alive; i++) {
+			const RenderTile &tile = inFlight[i];
+			DistributedTileMessage tileMessage = { frame.frameId, tile.columnStart, tile.columnEnd, tile.rowStart, tile.rowEnd, tile.index };
+
+			alive = sendDistributedMessage(worker.socket, DISTRIBUTED_MSG_TILE, &tileMessage, sizeof(tileMessage));
+		}
+
+		if (!alive || !receiveDistributedMessage(worker.socket, header, payload) || header.type != DISTRIBUTED_MSG_TILE_RESULT ||
+			payload.size() < sizeof(DistributedTileMessage)) {
+			alive = false;
+			break;
+		}
+
+		DistributedTileMessage tileMessage;
+		memcpy(&tileMessage, payload.data(), sizeof(tileMessage));
+
+		//results come back in any order, match them up by tile index
+		size_t position = 0;
+		while (position < inFlight.size() && inFlight[position].index != tileMessage.index) {
+			position++;
+		}
+
+		const size_t numOfTilePixels = (size_t)(tileMessage.columnEnd - tileMessage.columnStart) * (tileMessage.rowEnd - tileMessage.rowStart);
+		if (tileMessage.frameId != frame.frameId || position == inFlight.size() ||
+			payload.size() != sizeof(DistributedTileMessage) + numOfTilePixels * sizeof(DistributedPixelSum)) {
+			alive = false;
+			break;
+		}
+
+		RenderTile tile = inFlight[position];
+		inFlight.erase(inFlight.begin() + position);
+
+		//tiles never overlap so the connection threads can add into the accumulation buffer side by side
+		const uint8_t *pixelData = payload.data() + sizeof(DistributedTileMessage);
+		for (uint32_t row = tile.rowStart; row < tile.rowEnd; row++) {
+			for (uint32_t column = tile.columnStart; column < tile.columnEnd; column++, pixelData += sizeof(DistributedPixelSum)) {
+				DistributedPixelSum pixel;
+				memcpy(&pixel, pixelData, sizeof(pixel));
+
+				state.accumulationBuffer->addSamples(row * _resWidthInPixels + column,
+					vec3(pixel.colorSum[0], pixel.colorSum[1], pixel.colorSum[2]), pixel.luminanceSquaredSum, pixel.sampleCount);
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(state.mutex);
+		if (--state.tilesRemaining == 0) {
+			state.conditionVar.notify_all();
+		}
+	}
+
+	if (!alive) {
+		worker.socket.close();
+
+		std::lock_guard<std::mutex> lock(state.mutex);
+		state.pendingTiles.insert(state.pendingTiles.end(), inFlight.begin(), inFlight.end());
+		state.numOfLiveWorkers--;
+
+		//nobody left to pick them up, let the others stop waiting
+		if (state.numOfLiveWorkers == 0 && !state.hasLocalThreads) {
+			state.pendingTiles.clear();
+		}
+		state.conditionVar.notify_all();
+	}
+
+	return alive;
+}
+
+void DistributedCoordinator::traceLocalTiles(const DistributedFrameMessage &frame, const Camera &camera, Hitable *world, const EmitterRegistry *emitters, FrameState &state) {
+	std::vector<vec3> tileColor(TILE_SIZE_IN_PIXELS * TILE_SIZE_IN_PIXELS);
+	Camera tileCamera = camera;
+
+	//same as DistributedWorker::traceTiles, minus the scratch buffer since these add straight into the real one
+	TileTraceContext context;
+	context.resWidthInPixels = _resWidthInPixels;
+	context.resHeightInPixels = _resHeightInPixels;
+	context.firstRow = 0;
+	context.samplesPerPass = frame.samplesPerPixel;
+	context.batchSize = 0;
+	context.seed = _scene.seed;
+	context.pass = (uint32_t)(frame.frameId - 1);
+	context.camera = &tileCamera;
+	context.world = world;
+	context.emitters = emitters;
+	context.accumulationBuffer = state.accumulationBuffer;
+	context.aovFramebuffer = NULL;
+
+	while (true) {
+		RenderTile tile;
+		{
+			//nothing pending can still mean tiles out on workers, one that drops hands them back here
+			std::unique_lock<std::mutex> lock(state.mutex);
+			state.conditionVar.wait(lock, [&state] {return state.tilesRemaining == 0 || !state.pendingTiles.empty(); });
+
+			if (state.pendingTiles.empty()) {
+				return;
+			}
+			tile = state.pendingTiles.front();
+			state.pendingTiles.pop_front();
+		}
+
+		traceTile(tile, context, tileColor.data(), TILE_SIZE_IN_PIXELS);
+
+		std::lock_guard<std::mutex> lock(state.mutex);
+		if (--state.tilesRemaining == 0) {
+			state.conditionVar.notify_all();
+		}
+	}
+}
+
+/*
+	Worker side. connect() does the handshake and learns the scene to rebuild, serve() then traces whatever tiles the
+	coordinator sends on a local RenderThreadPool until it says BYE or goes away.
+*/
+class DistributedWorker {
+public:
+	explicit DistributedWorker(uint32_t numOfThreads, const std::vector<uint32_t> &cpuPlacement = std::vector<uint32_t>()) :
+		_numOfThreads(numOfThreads > 0 ? numOfThreads : 1), _cpuPlacement(cpuPlacement), _closed(false) {
+
+		memset(&_scene, 0, sizeof(_scene));
+	}
+
+	bool connect(const std::string &host, uint16_t port) {
+		if (!_socket.connect(host, port)) {
+			std::cout << "Failed to connect to coordinator " << host << ":" << port << "\n";
+			return false;
+		}
+
+		DistributedHelloMessage hello = { _numOfThreads };
+		DistributedMessageHeader header;
+		std::vector<uint8_t> payload;
+
+		if (!sendDistributedMessage(_socket, DISTRIBUTED_MSG_HELLO, &hello, sizeof(hello)) ||
+			!receiveDistributedMessage(_socket, header, payload) || header.type != DISTRIBUTED_MSG_SCENE || payload.size() != sizeof(_scene)) {
+			std::cout << "Coordinator handshake failed\n";
+			_socket.close();
+			return false;
+		}
+
+		memcpy(&_scene, payload.data(), sizeof(_scene));
+		return true;
+	}
+
+	uint32_t getSceneId() const {
+		return _scene.sceneId;
+	}
+
+	//seed the RNG with this before building the scene
+	uint64_t getSeed() const {
+		return _scene.seed;
+	}
+
+	//returns once the coordinator said BYE or the connection dropped
+	void serve(Hitable *world, const EmitterRegistry *emitters);
+
+protected:
+	//what the pool threads need for one tile, the camera is rebuilt per frame
+	struct FrameInfo {
+		FrameInfo() : camera(vec3(0, 0, 0), vec3(1, 0, 0), vec3(0, 0, -1), 90.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f) {}
+
+		uint64_t frameId;
+		uint32_t samplesPerPixel;
+		Camera camera;
+	};
+
+	struct QueuedTile {
+		std::shared_ptr<const FrameInfo> frame;
+		RenderTile tile;
+	};
+
+	void traceTiles(Hitable *world, const EmitterRegistry *emitters);
+
+	uint32_t _numOfThreads;
+	std::vector<uint32_t> _cpuPlacement;
+	DistributedSceneMessage _scene;
+	TcpSocket _socket;
+
+	std::unique_ptr<AccumulationBuffer> _accumulationBuffer;
+
+	std::mutex _queueMutex;
+	std::condition_variable _queueConditionVar;
+	std::deque<QueuedTile> _queue;
+	bool _closed;
+
+	std::mutex _sendMutex;
+};
+
+void DistributedWorker::serve(Hitable *world, const EmitterRegistry *emitters) {
+	//scratch sums, every tile clears its own pixels before tracing so the result is just this request's samples
+	_accumulationBuffer.reset(new AccumulationBuffer(_scene.resWidthInPixels, _scene.resHeightInPixels));
+
+	RenderThreadPool threadPool(_numOfThreads, _cpuPlacement);
+
+	//one long "frame" for the whole session, the threads block on the tile queue in between
+	threadPool.submitFrame([this, world, emitters](uint32_t) {traceTiles(world, emitters); });
+
+	std::shared_ptr<FrameInfo> frame;
+	DistributedMessageHeader header;
+	std::vector<uint8_t> payload;
+
+	while (receiveDistributedMessage(_socket, header, payload)) {
+		if (header.type == DISTRIBUTED_MSG_FRAME && payload.size() == sizeof(DistributedFrameMessage)) {
+			DistributedFrameMessage frameMessage;
+			memcpy(&frameMessage, payload.data(), sizeof(frameMessage));
+
+			frame.reset(new FrameInfo);
+			frame->frameId = frameMessage.frameId;
+			frame->samplesPerPixel = frameMessage.samplesPerPixel;
+			frame->camera.setRayState(frameMessage.cameraRayState);
+		}
+		else if (header.type == DISTRIBUTED_MSG_TILE && payload.size() == sizeof(DistributedTileMessage) && frame) {
+			DistributedTileMessage tileMessage;
+			memcpy(&tileMessage, payload.data(), sizeof(tileMessage));
+
+			if (tileMessage.columnEnd > _scene.resWidthInPixels || tileMessage.rowEnd > _scene.resHeightInPixels ||
+				tileMessage.columnStart >= tileMessage.columnEnd || tileMessage.rowStart >= tileMessage.rowEnd) {
+				break;
+			}
+
+			QueuedTile queuedTile;
+			queuedTile.frame = frame;
+			queuedTile.tile.columnStart = tileMessage.columnStart;
+			queuedTile.tile.columnEnd = tileMessage.columnEnd;
+			queuedTile.tile.rowStart = tileMessage.rowStart;
+			queuedTile.tile.rowEnd = tileMessage.rowEnd;
+			queuedTile.tile.index = tileMessage.index;
+
+			std::lock_guard<std::mutex> lock(_queueMutex);
+			_queue.push_back(queuedTile);
+			_queueConditionVar.notify_one();
+		}
+		else {
+			//BYE or something we don't understand
+			break;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_queueMutex);
+		_closed = true;
+		_queueConditionVar.notify_all();
+	}
+
+	threadPool.waitForFrame();
+	threadPool.shutdown();
+	_socket.close();
+}
+
+void DistributedWorker::traceTiles(Hitable *world, const EmitterRegistry *emitters) {
+	std::vector<vec3> tileColor(TILE_SIZE_IN_PIXELS * TILE_SIZE_IN_PIXELS);
+	std::vector<uint8_t> result;
+
+	while (true) {
+		QueuedTile queuedTile;
+		{
+			std::unique_lock<std::mutex> lock(_queueMutex);
+			_queueConditionVar.wait(lock, [this] {return _closed || !_queue.empty(); });
+
+			if (_queue.empty()) {
+				return;
+			}
+			queuedTile = _queue.front();
+			_queue.pop_front();
+		}
+
+		const RenderTile &tile = queuedTile.tile;
+		uint32_t tileWidth = tile.getWidth();
+
+		//tiles are whatever size the coordinator cut them to, the scratch grows to fit
+		if (tileColor.size() < (size_t)tileWidth * tile.getHeight()) {
+			tileColor.resize((size_t)tileWidth * tile.getHeight());
+		}
+
+		for (uint32_t row = tile.rowStart; row < tile.rowEnd; row++) {
+			for (uint32_t column = tile.columnStart; column < tile.columnEnd; column++) {
+				_accumulationBuffer->clearPixel(row * _scene.resWidthInPixels + column);
+			}
+		}
+
+		Camera camera = queuedTile.frame->camera;
+
+		TileTraceContext context;
+		context.resWidthInPixels = _scene.resWidthInPixels;
+		context.resHeightInPixels = _scene.resHeightInPixels;
+		context.firstRow = 0;
+		context.samplesPerPass = queuedTile.frame->samplesPerPixel;
+		context.batchSize = 0;
+		//frames count from 1, the coordinator's own passes carry on after them
+		context.seed = _scene.seed;
+		context.pass = (uint32_t)(queuedTile.frame->frameId - 1);
+		context.camera = &camera;
+		context.world = world;
+		context.emitters = emitters;
+		context.accumulationBuffer = _accumulationBuffer.get();
+		context.aovFramebuffer = NULL;
+
+		traceTile(tile, context, tileColor.data(), tileWidth);
+
+		DistributedTileMessage tileMessage = { queuedTile.frame->frameId, tile.columnStart, tile.columnEnd, tile.rowStart, tile.rowEnd, tile.index };
+		result.resize(sizeof(tileMessage) + (size_t)tileWidth * tile.getHeight() * sizeof(DistributedPixelSum));
+		memcpy(result.data(), &tileMessage, sizeof(tileMessage));
+
+		uint8_t *pixelData = result.data() + sizeof(tileMessage);
+		for (uint32_t row = tile.rowStart; row < tile.rowEnd; row++) {
+			for (uint32_t column = tile.columnStart; column < tile.columnEnd; column++, pixelData += sizeof(DistributedPixelSum)) {
+				uint32_t pixelIndex = row * _scene.resWidthInPixels + column;
+				const vec3 &colorSum = _accumulationBuffer->getColorSum(pixelIndex);
+
+				DistributedPixelSum pixel = { { colorSum.r(), colorSum.g(), colorSum.b() }, _accumulationBuffer->getLuminanceSquaredSum(pixelIndex), _accumulationBuffer->getSampleCount(pixelIndex) };
+				memcpy(pixelData, &pixel, sizeof(pixel));
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(_sendMutex);
+		if (!sendDistributedMessage(_socket, DISTRIBUTED_MSG_TILE_RESULT, result.data(), (uint32_t)result.size())) {
+			//the read loop notices the dead connection and closes the queue
+			_socket.shutdown();
+		}
+	}
+}
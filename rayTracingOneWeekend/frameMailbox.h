@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <condition_variable>
+#include <string.h>
+#include <stdint.h>
+
+/*
+	Triple buffered hand off between the render loop and the presentation (bitblit) thread.
+
+	There are three byte buffers and each one is always owned by exactly one side: the renderer is drawing into one,
+	the presenter is showing one and the third sits in the mailbox. publish() swaps the finished render buffer into the
+	mailbox and hands back whatever was there, so the renderer can start the next frame right away. acquire() swaps the
+	mailbox buffer with the one the presenter is done with, but only when a new frame landed since last time. A frame the
+	presenter never got to is simply overwritten by the next publish, so a slow blit drops frames instead of holding up
+	the render threads.
+
+	The mailbox itself is one atomic word (buffer index plus a "fresh" bit), the mutex/condition variable is only there
+	so an idle presenter can sleep until something is published.
+*/
+class FrameMailbox {
+public:
+	static const uint32_t NUM_OF_BUFFERS = 3;
+
+	explicit FrameMailbox(uint64_t sizeInBytes) :
+		_sizeInBytes(sizeInBytes), _renderIndex(0), _presentIndex(1), _mailbox(2), _closed(false), _publishedCount(0) {
+
+		for (uint32_t i = 0; i < NUM_OF_BUFFERS; i++) {
+			_buffers[i] = std::shared_ptr<uint8_t>(new uint8_t[(size_t)sizeInBytes], std::default_delete<uint8_t[]>());
+			memset(_buffers[i].get(), 0, (size_t)sizeInBytes);
+		}
+	}
+
+	//renderer side, the buffer to draw the next frame into
+	std::shared_ptr<uint8_t> getRenderBuffer() const {
+		return _buffers[_renderIndex];
+	}
+
+	//renderer side, the frame in the render buffer is done. The returned buffer holds an older frame (blank on the first couple of calls)
+	std::shared_ptr<uint8_t> publish() {
+		uint32_t previous = _mailbox.exchange(_renderIndex | FRESH_BIT, std::memory_order_acq_rel);
+		_renderIndex = previous & INDEX_MASK;
+		_publishedCount.fetch_add(1, std::memory_order_relaxed);
+
+		//a presenter that just checked the mailbox under the mutex is either asleep by now or will see the fresh bit
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+		}
+		_frameConditionVar.notify_one();
+
+		return _buffers[_renderIndex];
+	}
+
+	//presenter side, swaps in the newest frame if there is one. false means keep showing what you have
+	bool acquire() {
+		if ((_mailbox.load(std::memory_order_acquire) & FRESH_BIT) == 0) {
+			return false;
+		}
+
+		uint32_t newest = _mailbox.exchange(_presentIndex, std::memory_order_acq_rel);
+		_presentIndex = newest & INDEX_MASK;
+		return true;
+	}
+
+	//presenter side, sleeps until a frame is published or the mailbox is closed, false once closed
+	bool waitForFrame() {
+		std::unique_lock<std::mutex> lock(_mutex);
+		_frameConditionVar.wait(lock, [this] {return _closed || (_mailbox.load(std::memory_order_acquire) & FRESH_BIT) != 0; });
+		return !_closed;
+	}
+
+	std::shared_ptr<uint8_t> getPresentBuffer() const {
+		return _buffers[_presentIndex];
+	}
+
+	//wakes the presenter up for good
+	void close() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		_closed = true;
+		_frameConditionVar.notify_all();
+	}
+
+	uint64_t getSizeInBytes() const {
+		return _sizeInBytes;
+	}
+
+	uint64_t getPublishedCount() const {
+		return _publishedCount.load(std::memory_order_relaxed);
+	}
+
+protected:
+	static const uint32_t FRESH_BIT = 0x80000000;
+	static const uint32_t INDEX_MASK = 0x7fffffff;
+
+	uint64_t _sizeInBytes;
+	std::shared_ptr<uint8_t> _buffers[NUM_OF_BUFFERS];
+
+	//only touched by the renderer and the presenter respectively
+	uint32_t _renderIndex;
+	uint32_t _presentIndex;
+
+	std::atomic<uint32_t> _mailbox;
+
+	std::mutex _mutex;
+	std::condition_variable _frameConditionVar;
+	bool _closed;
+
+	std::atomic<uint64_t> _publishedCount;
+};
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#if !defined (_WIN32)
+#include <signal.h>
+#endif
+
+#include "defines.h"
+#include "imageWriter.h"
+
+/*
+	Raw video out of a sequence render (see sequenceRender.h), for piping straight into an encoder without any image
+	files in between:
+
+		rayTracingOneWeekend --sequence turntable.txt 240 - | ffmpeg -i - turntable.mp4
+
+	Y4M (YUV4MPEG2) is a text header and then every frame as "FRAME\n" and its planes, any encoder that reads a pipe
+	takes it. The colors are the engine's display bytes (sqrt gamma, like writeColorToImageBuffer) converted with BT.601
+	to limited range Y'CbCr, 4:2:0 with the chroma of every 2x2 block averaged (C420jpeg siting) or 4:4:4. .rgb is bare
+	RGB24 frames with no header at all, the reader has to be told the size and rate (-f rawvideo -pix_fmt rgb24 -s WxH).
+
+	"-" writes to stdout, any other path is opened like a file, so a named pipe (mkfifo) works too. Writes block while
+	the reader is behind, which is what keeps a render from running away from a slow encoder.
+	- https://wiki.multimedia.cx/index.php/YUV4MPEG2
+*/
+
+enum FrameStreamFormat {
+	FRAME_STREAM_FORMAT_Y4M = 0,
+	FRAME_STREAM_FORMAT_RGB24,
+	FRAME_STREAM_FORMAT_UNKNOWN
+};
+
+//"-" (stdout, Y4M) or from the extension, .y4m/.rgb in any case
+inline FrameStreamFormat frameStreamFormatFromPath(const std::string &path) {
+	if (path == "-") {
+		return FRAME_STREAM_FORMAT_Y4M;
+	}
+
+	size_t dot = path.find_last_of('.');
+	if (dot == std::string::npos) {
+		return FRAME_STREAM_FORMAT_UNKNOWN;
+	}
+
+	std::string extension = path.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+
+	if (extension == "y4m") return FRAME_STREAM_FORMAT_Y4M;
+	if (extension == "rgb") return FRAME_STREAM_FORMAT_RGB24;
+	return FRAME_STREAM_FORMAT_UNKNOWN;
+}
+
+class FrameStream {
+public:
+	FrameStream() : _format(FRAME_STREAM_FORMAT_UNKNOWN), _width(0), _height(0), _chromaSubsampled(true), _framesWritten(0) {}
+
+	FrameStream(const FrameStream &) = delete;
+	FrameStream &operator=(const FrameStream &) = delete;
+
+	//Y4M gets the rate and chroma in its header, RGB24 ignores both
+	bool open(const std::string &path, uint32_t width, uint32_t height, uint32_t framesPerSecond = FRAME_STREAM_FPS, bool chromaSubsampled = FRAME_STREAM_CHROMA_420 == 1);
+
+	//linear RGB floats top row first, like RenderJob::outputPixels. 0 stride = width * 3.
+	bool writeFrame(const float *rgb, size_t rowStrideInFloats = 0);
+
+	bool close() {
+		return _sink.close();
+	}
+
+	uint32_t getFramesWritten() const {
+		return _framesWritten;
+	}
+
+protected:
+	//BT.601 limited range on 8 bit R'G'B'
+	static uint8_t toY(int r, int g, int b) {
+		return (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+	}
+
+	static uint8_t toCb(int r, int g, int b) {
+		return (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+	}
+
+	static uint8_t toCr(int r, int g, int b) {
+		return (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+	}
+
+	ImageFileSink _sink;
+	FrameStreamFormat _format;
+	uint32_t _width, _height;
+	bool _chromaSubsampled;
+	uint32_t _framesWritten;
+
+	//the converted frame, reused, it only has to live until the sink is flushed
+	std::vector<uint8_t> _bgr;
+	std::vector<uint8_t> _frame;
+};
+
+bool FrameStream::open(const std::string &path, uint32_t width, uint32_t height, uint32_t framesPerSecond, bool chromaSubsampled) {
+	_format = frameStreamFormatFromPath(path);
+	_width = width;
+	_height = height;
+	_chromaSubsampled = chromaSubsampled;
+	_framesWritten = 0;
+
+	if (_format == FRAME_STREAM_FORMAT_UNKNOWN || width == 0 || height == 0) {
+		std::cout << "Can't stream to " << path << ", use - for stdout or a .y4m or .rgb name\n";
+		return false;
+	}
+
+#if !defined (_WIN32)
+	//an encoder that quits closes the pipe, the next write should fail with EPIPE instead of killing the render
+	signal(SIGPIPE, SIG_IGN);
+#endif
+
+	bool opened = path == "-" ? _sink.openStandardOutput() : _sink.open(path);
+	if (!opened) {
+		std::cout << "Can't open " << path << "\n";
+		return false;
+	}
+
+	if (_format == FRAME_STREAM_FORMAT_Y4M) {
+		char header[128];
+		int headerSize = snprintf(header, sizeof(header), "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 %s XCOLORRANGE=LIMITED\n",
+			width, height, framesPerSecond > 0 ? framesPerSecond : 1, chromaSubsampled ? "C420jpeg" : "C444");
+
+		_sink.append(header, (size_t)headerSize);
+		if (!_sink.flush()) {
+			std::cout << "Failed to write to " << path << "\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+bool FrameStream::writeFrame(const float *rgb, size_t rowStrideInFloats) {
+	size_t rowSizeInBytes = (size_t)_width * 3;
+	if (rowStrideInFloats == 0) {
+		rowStrideInFloats = rowSizeInBytes;
+	}
+
+	_bgr.resize(rowSizeInBytes * _height);
+	for (uint32_t row = 0; row < _height; row++) {
+		linearRowToBGR(rgb + row * rowStrideInFloats, &_bgr[row * rowSizeInBytes], _width);
+	}
+
+	if (_format == FRAME_STREAM_FORMAT_RGB24) {
+		_frame.resize(_bgr.size());
+		for (size_t i = 0; i < _bgr.size(); i += 3) {
+			_frame[i + 0] = _bgr[i + 2];
+			_frame[i + 1] = _bgr[i + 1];
+			_frame[i + 2] = _bgr[i + 0];
+		}
+	}
+	else {
+		static const char frameHeader[] = "FRAME\n";
+		size_t numOfPixels = (size_t)_width * _height;
+		uint32_t chromaWidth = _chromaSubsampled ? (_width + 1) / 2 : _width;
+		uint32_t chromaHeight = _chromaSubsampled ? (_height + 1) / 2 : _height;
+		size_t chromaSize = (size_t)chromaWidth * chromaHeight;
+
+		_frame.resize(sizeof(frameHeader) - 1 + numOfPixels + 2 * chromaSize);
+		memcpy(_frame.data(), frameHeader, sizeof(frameHeader) - 1);
+
+		uint8_t *yPlane = _frame.data() + sizeof(frameHeader) - 1;
+		uint8_t *cbPlane = yPlane + numOfPixels;
+		uint8_t *crPlane = cbPlane + chromaSize;
+
+		for (size_t pixel = 0; pixel < numOfPixels; pixel++) {
+			const uint8_t *bgr = &_bgr[pixel * 3];
+			yPlane[pixel] = toY(bgr[2], bgr[1], bgr[0]);
+		}
+
+		//every chroma sample is the mean of the pixels it covers, fewer than 4 along an odd right or bottom edge
+		uint32_t blockSize = _chromaSubsampled ? 2 : 1;
+		for (uint32_t chromaRow = 0; chromaRow < chromaHeight; chromaRow++) {
+			for (uint32_t chromaColumn = 0; chromaColumn < chromaWidth; chromaColumn++) {
+				int r = 0, g = 0, b = 0, count = 0;
+
+				for (uint32_t row = chromaRow * blockSize; row < std::min((chromaRow + 1) * blockSize, _height); row++) {
+					for (uint32_t column = chromaColumn * blockSize; column < std::min((chromaColumn + 1) * blockSize, _width); column++) {
+						const uint8_t *bgr = &_bgr[row * rowSizeInBytes + column * 3];
+						r += bgr[2];
+						g += bgr[1];
+						b += bgr[0];
+						count++;
+					}
+				}
+
+				r = (r + count / 2) / count;
+				g = (g + count / 2) / count;
+				b = (b + count / 2) / count;
+
+				size_t chroma = (size_t)chromaRow * chromaWidth + chromaColumn;
+				cbPlane[chroma] = toCb(r, g, b);
+				crPlane[chroma] = toCr(r, g, b);
+			}
+		}
+	}
+
+	_sink.append(_frame.data(), _frame.size());
+	if (!_sink.flush()) {
+		return false;
+	}
+
+	_framesWritten++;
+	return true;
+}
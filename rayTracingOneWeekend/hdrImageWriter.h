@@ -0,0 +1,552 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <iostream>
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "vec3.h"
+#include "imageWriter.h"
+#include "accumulationBuffer.h"
+
+/*
+	Linear float image output, straight from the accumulation buffer (or a RenderResult) with no 8 bit quantizing in
+	between, so the image can be re-exposed or denoised downstream without rendering it again. Picked from the
+	extension like ImageWriter:
+
+	.pfm	portable float map, 32 bit float RGB, rows bottom to top like the AOV files
+	.hdr	Radiance RGBE, 8 bit mantissas and a shared exponent, run length encoded scanlines
+	.exr	OpenEXR, uncompressed half float B/G/R scanlines (one line per block, no tiles)
+
+	Converting and encoding is the slow part (a frexp per pixel for RGBE, RLE, half conversion) so the rows are cut into
+	bands that a few threads encode at once. The calling thread writes the bands out in order as they come in and the
+	encoders only run a couple of bands ahead of it, so no more than that is ever held in memory.
+
+	HdrImageStream writes the file a few rows at a time in file order (top first, PFM bottom first), for images that
+	are rendered out of core and never exist whole. HdrImageWriter hands it a whole image, reading the rows through a
+	HdrRowSource in engine order (row 0 at the bottom of the picture, pixelIndex = row * width + column like the
+	accumulation buffer). Row sources get called from several threads at once.
+	- http://www.pauldebevec.com/Research/HDR/PFM/
+	- https://www.graphics.cornell.edu/~bjw/rgbe.html
+	- https://openexr.com/en/latest/OpenEXRFileLayout.html
+*/
+
+enum HdrImageFormat {
+	HDR_IMAGE_FORMAT_PFM = 0,
+	HDR_IMAGE_FORMAT_RGBE,
+	HDR_IMAGE_FORMAT_EXR,
+	HDR_IMAGE_FORMAT_UNKNOWN
+};
+
+//fills rgb with width * 3 floats of the row
+typedef std::function<void(uint32_t row, float *rgb)> HdrRowSource;
+
+//from the extension, .pfm/.hdr/.exr in any case
+inline HdrImageFormat hdrImageFormatFromPath(const std::string &path) {
+	size_t dot = path.find_last_of('.');
+	if (dot == std::string::npos) {
+		return HDR_IMAGE_FORMAT_UNKNOWN;
+	}
+
+	std::string extension = path.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+
+	if (extension == "pfm") return HDR_IMAGE_FORMAT_PFM;
+	if (extension == "hdr") return HDR_IMAGE_FORMAT_RGBE;
+	if (extension == "exr") return HDR_IMAGE_FORMAT_EXR;
+	return HDR_IMAGE_FORMAT_UNKNOWN;
+}
+
+class HdrImageStream {
+public:
+	HdrImageStream() : _format(HDR_IMAGE_FORMAT_UNKNOWN), _width(0), _height(0), _numOfThreads(1), _rowsWritten(0) {}
+
+	HdrImageStream(const HdrImageStream &) = delete;
+	HdrImageStream &operator=(const HdrImageStream &) = delete;
+
+	//writes the header, the format comes from the extension. numOfThreads 0 = one encoder per hardware thread.
+	bool open(const std::string &path, uint32_t width, uint32_t height, uint32_t numOfThreads = 0) {
+		HdrImageFormat format = hdrImageFormatFromPath(path);
+
+		if (width == 0 || height == 0 || format == HDR_IMAGE_FORMAT_UNKNOWN) {
+			std::cout << "Can't write " << path << ", use a .pfm, .hdr or .exr name\n";
+			return false;
+		}
+
+		if (!_sink.open(path)) {
+			std::cout << "Failed to open " << path << "\n";
+			return false;
+		}
+
+		_format = format;
+		_width = width;
+		_height = height;
+		_numOfThreads = numOfThreads > 0 ? numOfThreads : std::max(1u, std::thread::hardware_concurrency());
+		_rowsWritten = 0;
+
+		writeHeader(_format, _width, _height, _header);
+		_sink.append(_header.data(), _header.size());
+		return _sink.flush();
+	}
+
+	bool isBottomUp() const {
+		return _format == HDR_IMAGE_FORMAT_PFM;
+	}
+
+	//the next numOfRows rows of the file, fileRowSource is asked for them by file row number
+	bool writeRows(uint32_t numOfRows, const HdrRowSource &fileRowSource) {
+		if (_format == HDR_IMAGE_FORMAT_UNKNOWN || numOfRows > _height - _rowsWritten) {
+			return false;
+		}
+
+		bool succeeded = encodeAndWriteBands(_rowsWritten, numOfRows, fileRowSource);
+		_rowsWritten += numOfRows;
+		return succeeded;
+	}
+
+	//row r at rgb + r * rowStrideInFloats, a negative stride walks a top first buffer backwards for PFM
+	bool writeRows(const float *rgb, uint32_t numOfRows, ptrdiff_t rowStrideInFloats) {
+		uint32_t firstFileRow = _rowsWritten;
+		size_t rowSizeInBytes = (size_t)_width * 3 * sizeof(float);
+
+		return writeRows(numOfRows, [rgb, rowStrideInFloats, firstFileRow, rowSizeInBytes](uint32_t fileRow, float *row) {
+			memcpy(row, rgb + (ptrdiff_t)(fileRow - firstFileRow) * rowStrideInFloats, rowSizeInBytes);
+		});
+	}
+
+	//false if a write failed or not every row was written
+	bool close() {
+		bool succeeded = _rowsWritten == _height;
+		_format = HDR_IMAGE_FORMAT_UNKNOWN;
+		return _sink.close() && succeeded;
+	}
+
+	uint32_t getRowsWritten() const {
+		return _rowsWritten;
+	}
+
+	//round to nearest even, overflow goes to infinity and NaN stays NaN
+	static uint16_t floatToHalf(float value) {
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		uint32_t sign = (bits >> 16) & 0x8000;
+		uint32_t exponent = (bits >> 23) & 0xff;
+		uint32_t mantissa = bits & 0x7fffff;
+
+		if (exponent == 0xff) {
+			return uint16_t(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+		}
+
+		int32_t halfExponent = (int32_t)exponent - 127 + 15;
+		if (halfExponent >= 31) {
+			return uint16_t(sign | 0x7c00);
+		}
+
+		uint32_t shift, half;
+		if (halfExponent <= 0) {
+			//subnormal, the implicit 1 becomes part of the mantissa
+			if (halfExponent < -10) {
+				return uint16_t(sign);
+			}
+			mantissa |= 0x800000;
+			shift = 14 - halfExponent;
+			half = mantissa >> shift;
+		}
+		else {
+			shift = 13;
+			half = ((uint32_t)halfExponent << 10) | (mantissa >> shift);
+		}
+
+		//a carry out of the mantissa bumps the exponent, which is still the right answer
+		uint32_t remainder = mantissa & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (half & 1))) {
+			half++;
+		}
+		return uint16_t(sign | half);
+	}
+
+	//RGBE, zero for anything that isn't a positive finite color
+	static void floatToRGBE(const float *rgb, uint8_t *rgbe) {
+		float r = rgb[0] > 0.0f ? rgb[0] : 0.0f;
+		float g = rgb[1] > 0.0f ? rgb[1] : 0.0f;
+		float b = rgb[2] > 0.0f ? rgb[2] : 0.0f;
+		float maxComponent = std::max(r, std::max(g, b));
+
+		if (!(maxComponent >= 1e-32f) || maxComponent > FLT_MAX) {
+			rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+			return;
+		}
+
+		int exponent;
+		float scale = frexpf(maxComponent, &exponent) * 256.0f / maxComponent;
+		rgbe[0] = uint8_t(r * scale);
+		rgbe[1] = uint8_t(g * scale);
+		rgbe[2] = uint8_t(b * scale);
+		rgbe[3] = uint8_t(exponent + 128);
+	}
+
+protected:
+	//rows per band, big enough that a band is one write and small enough that every thread gets a few
+	static const uint32_t HDR_ROWS_PER_BAND = 32;
+	//bands an encoder may run ahead of the writer, per thread
+	static const uint32_t HDR_BANDS_IN_FLIGHT_PER_THREAD = 2;
+
+	struct EncodedBand {
+		EncodedBand() : ready(false) {}
+
+		std::vector<uint8_t> bytes;
+		bool ready;
+	};
+
+	static void putLittleEndian(std::vector<uint8_t> &bytes, uint64_t value, int sizeInBytes) {
+		for (int byte = 0; byte < sizeInBytes; byte++) {
+			bytes.push_back(uint8_t(value >> (8 * byte)));
+		}
+	}
+
+	static void putString(std::vector<uint8_t> &bytes, const char *text) {
+		bytes.insert(bytes.end(), text, text + strlen(text) + 1);
+	}
+
+	//EXR header attribute: name, type, size, value
+	static void putExrAttribute(std::vector<uint8_t> &bytes, const char *name, const char *type, const std::vector<uint8_t> &value) {
+		putString(bytes, name);
+		putString(bytes, type);
+		putLittleEndian(bytes, value.size(), 4);
+		bytes.insert(bytes.end(), value.begin(), value.end());
+	}
+
+	static void writeHeader(HdrImageFormat format, uint32_t width, uint32_t height, std::vector<uint8_t> &header) {
+		std::string text;
+
+		switch (format) {
+		case HDR_IMAGE_FORMAT_PFM:
+			//negative scale marks little endian
+			text = "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+			header.assign(text.begin(), text.end());
+			break;
+		case HDR_IMAGE_FORMAT_RGBE:
+			//-Y H: rows top to bottom
+			text = "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\nEXPOSURE=1.0\n\n-Y " + std::to_string(height) + " +X " + std::to_string(width) + "\n";
+			header.assign(text.begin(), text.end());
+			break;
+		case HDR_IMAGE_FORMAT_EXR:
+			writeExrHeader(width, height, header);
+			//the scanline offset table, every block is the same size so it is known up front
+			{
+				uint64_t blockSizeInBytes = 8 + (uint64_t)width * 3 * sizeof(uint16_t);
+				uint64_t firstBlockOffset = header.size() + (uint64_t)height * 8;
+				for (uint32_t row = 0; row < height; row++) {
+					putLittleEndian(header, firstBlockOffset + row * blockSizeInBytes, 8);
+				}
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	static void writeExrHeader(uint32_t width, uint32_t height, std::vector<uint8_t> &header) {
+		header.clear();
+		//magic, version 2 single part scanline file
+		putLittleEndian(header, 20000630, 4);
+		putLittleEndian(header, 2, 4);
+
+		//channels in alphabetical order, HALF (1), not linear, no subsampling
+		std::vector<uint8_t> channels;
+		const char *channelNames[3] = { "B", "G", "R" };
+		for (const char *name : channelNames) {
+			putString(channels, name);
+			putLittleEndian(channels, 1, 4);
+			putLittleEndian(channels, 0, 4);
+			putLittleEndian(channels, 1, 4);
+			putLittleEndian(channels, 1, 4);
+		}
+		channels.push_back(0);
+		putExrAttribute(header, "channels", "chlist", channels);
+
+		putExrAttribute(header, "compression", "compression", std::vector<uint8_t>(1, 0));
+
+		std::vector<uint8_t> window;
+		putLittleEndian(window, 0, 4);
+		putLittleEndian(window, 0, 4);
+		putLittleEndian(window, width - 1, 4);
+		putLittleEndian(window, height - 1, 4);
+		putExrAttribute(header, "dataWindow", "box2i", window);
+		putExrAttribute(header, "displayWindow", "box2i", window);
+
+		//INCREASING_Y, the top row first
+		putExrAttribute(header, "lineOrder", "lineOrder", std::vector<uint8_t>(1, 0));
+
+		float one = 1.0f;
+		std::vector<uint8_t> oneBytes((const uint8_t *)&one, (const uint8_t *)&one + sizeof(one));
+		putExrAttribute(header, "pixelAspectRatio", "float", oneBytes);
+		putExrAttribute(header, "screenWindowCenter", "v2f", std::vector<uint8_t>(8, 0));
+		putExrAttribute(header, "screenWindowWidth", "float", oneBytes);
+
+		header.push_back(0);
+	}
+
+	//run length encodes one component of an RGBE scanline (the "new" RLE format, runs of 4 or more are worth it)
+	static void encodeRGBERun(const uint8_t *data, uint32_t count, std::vector<uint8_t> &bytes) {
+		const uint32_t minRunLength = 4;
+		uint32_t current = 0;
+
+		while (current < count) {
+			uint32_t runStart = current;
+			uint32_t runLength = 0, previousRunLength = 0;
+
+			//find the next run that is long enough
+			while (runLength < minRunLength && runStart < count) {
+				runStart += runLength;
+				previousRunLength = runLength;
+				runLength = 1;
+				while (runStart + runLength < count && runLength < 127 && data[runStart] == data[runStart + runLength]) {
+					runLength++;
+				}
+			}
+
+			//a short run right before it is cheaper as a run than as literals
+			if (previousRunLength > 1 && previousRunLength == runStart - current) {
+				bytes.push_back(uint8_t(128 + previousRunLength));
+				bytes.push_back(data[current]);
+				current = runStart;
+			}
+
+			while (current < runStart) {
+				uint32_t literalLength = std::min<uint32_t>(128, runStart - current);
+				bytes.push_back(uint8_t(literalLength));
+				bytes.insert(bytes.end(), data + current, data + current + literalLength);
+				current += literalLength;
+			}
+
+			if (runLength >= minRunLength) {
+				bytes.push_back(uint8_t(128 + runLength));
+				bytes.push_back(data[runStart]);
+				current += runLength;
+			}
+		}
+	}
+
+	static void encodeRow(HdrImageFormat format, uint32_t width, uint32_t fileRow, const float *rgb, std::vector<uint8_t> &scratch, std::vector<uint8_t> &bytes) {
+		switch (format) {
+		case HDR_IMAGE_FORMAT_PFM:
+			//the host is little endian like the header says
+			bytes.insert(bytes.end(), (const uint8_t *)rgb, (const uint8_t *)(rgb + width * 3));
+			break;
+
+		case HDR_IMAGE_FORMAT_RGBE: {
+			//planar components for the RLE
+			scratch.resize(width * 4);
+			for (uint32_t column = 0; column < width; column++) {
+				uint8_t rgbe[4];
+				floatToRGBE(rgb + column * 3, rgbe);
+				for (int component = 0; component < 4; component++) {
+					scratch[component * width + column] = rgbe[component];
+				}
+			}
+
+			//RLE scanlines have to be 8 to 32767 wide, anything else is stored flat
+			if (width < 8 || width > 0x7fff) {
+				for (uint32_t column = 0; column < width; column++) {
+					for (int component = 0; component < 4; component++) {
+						bytes.push_back(scratch[component * width + column]);
+					}
+				}
+				break;
+			}
+
+			bytes.push_back(2);
+			bytes.push_back(2);
+			bytes.push_back(uint8_t(width >> 8));
+			bytes.push_back(uint8_t(width & 0xff));
+			for (int component = 0; component < 4; component++) {
+				encodeRGBERun(&scratch[component * width], width, bytes);
+			}
+			break;
+		}
+
+		case HDR_IMAGE_FORMAT_EXR:
+			//block: y, size, then each channel's row B, G, R
+			putLittleEndian(bytes, fileRow, 4);
+			putLittleEndian(bytes, width * 3 * sizeof(uint16_t), 4);
+			{
+				size_t blockStart = bytes.size();
+				bytes.resize(blockStart + width * 3 * sizeof(uint16_t));
+				uint8_t *halfBytes = &bytes[blockStart];
+
+				for (int channel = 2; channel >= 0; channel--) {
+					for (uint32_t column = 0; column < width; column++, halfBytes += 2) {
+						uint16_t half = floatToHalf(rgb[column * 3 + channel]);
+						halfBytes[0] = uint8_t(half);
+						halfBytes[1] = uint8_t(half >> 8);
+					}
+				}
+			}
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	void encodeBand(uint32_t firstFileRow, uint32_t endFileRow, const HdrRowSource &fileRowSource, std::vector<uint8_t> &bytes) const {
+		std::vector<float> rgb((size_t)_width * 3);
+		std::vector<uint8_t> scratch;
+
+		//flat size, RLE only ever comes out smaller
+		bytes.reserve((size_t)(endFileRow - firstFileRow) * (8 + (size_t)_width * 3 * sizeof(float)));
+
+		for (uint32_t fileRow = firstFileRow; fileRow < endFileRow; fileRow++) {
+			fileRowSource(fileRow, rgb.data());
+			encodeRow(_format, _width, fileRow, rgb.data(), scratch, bytes);
+		}
+	}
+
+	bool encodeAndWriteBands(uint32_t firstFileRow, uint32_t numOfRows, const HdrRowSource &fileRowSource) {
+		if (numOfRows == 0) {
+			return true;
+		}
+
+		//a short call (one band of an out of core render) still gets split over every encoder
+		uint32_t rowsPerBand = (numOfRows + _numOfThreads - 1) / _numOfThreads;
+		if (rowsPerBand > HDR_ROWS_PER_BAND) rowsPerBand = HDR_ROWS_PER_BAND;
+
+		uint32_t numOfBands = (numOfRows + rowsPerBand - 1) / rowsPerBand;
+		uint32_t numOfThreads = std::min(_numOfThreads, numOfBands);
+		uint32_t bandsInFlight = numOfThreads * HDR_BANDS_IN_FLIGHT_PER_THREAD;
+
+		std::vector<EncodedBand> bands(numOfBands);
+		std::mutex bandMutex;
+		std::condition_variable bandReadyConditionVar, bandWrittenConditionVar;
+		uint32_t nextBandToEncode = 0, nextBandToWrite = 0;
+
+		auto encoder = [&]() {
+			std::unique_lock<std::mutex> bandLock(bandMutex);
+
+			for (;;) {
+				//don't run too far ahead of the writer
+				bandWrittenConditionVar.wait(bandLock, [&]() { return nextBandToEncode >= numOfBands || nextBandToEncode < nextBandToWrite + bandsInFlight; });
+				if (nextBandToEncode >= numOfBands) {
+					return;
+				}
+
+				uint32_t band = nextBandToEncode++;
+				bandLock.unlock();
+
+				uint32_t bandStart = firstFileRow + band * rowsPerBand;
+				uint32_t bandEnd = std::min(firstFileRow + numOfRows, bandStart + rowsPerBand);
+
+				std::vector<uint8_t> bytes;
+				encodeBand(bandStart, bandEnd, fileRowSource, bytes);
+
+				bandLock.lock();
+				bands[band].bytes.swap(bytes);
+				bands[band].ready = true;
+				bandReadyConditionVar.notify_all();
+			}
+		};
+
+		std::vector<std::thread> encoders;
+		for (uint32_t thread = 0; thread < numOfThreads; thread++) {
+			encoders.push_back(std::thread(encoder));
+		}
+
+		bool succeeded = true;
+		for (uint32_t band = 0; band < numOfBands; band++) {
+			std::unique_lock<std::mutex> bandLock(bandMutex);
+			bandReadyConditionVar.wait(bandLock, [&]() { return bands[band].ready; });
+			bandLock.unlock();
+
+			_sink.append(bands[band].bytes.data(), bands[band].bytes.size());
+			succeeded = _sink.flush() && succeeded;
+			std::vector<uint8_t>().swap(bands[band].bytes);
+
+			bandLock.lock();
+			nextBandToWrite++;
+			bandWrittenConditionVar.notify_all();
+		}
+
+		for (std::thread &thread : encoders) {
+			thread.join();
+		}
+		return succeeded;
+	}
+
+	ImageFileSink _sink;
+	HdrImageFormat _format;
+	uint32_t _width, _height;
+	uint32_t _numOfThreads;
+	uint32_t _rowsWritten;
+	//queued in the sink until the first flush
+	std::vector<uint8_t> _header;
+};
+
+//a whole image in one call
+class HdrImageWriter {
+public:
+	static HdrImageFormat formatFromPath(const std::string &path) {
+		return hdrImageFormatFromPath(path);
+	}
+
+	//the resolved mean of every pixel, only safe while nothing is accumulating into it
+	static uint32_t write(const std::string &path, const AccumulationBuffer &accumulationBuffer, uint32_t numOfThreads = 0) {
+		uint32_t width = accumulationBuffer.getWidth();
+
+		return write(path, width, accumulationBuffer.getHeight(), [&accumulationBuffer, width](uint32_t row, float *rgb) {
+			for (uint32_t column = 0; column < width; column++, rgb += 3) {
+				vec3 color = accumulationBuffer.resolve(row * width + column);
+				rgb[0] = color.r();
+				rgb[1] = color.g();
+				rgb[2] = color.b();
+			}
+		}, numOfThreads);
+	}
+
+	//RenderResult::pixels and the like
+	static uint32_t write(const std::string &path, const vec3 *pixels, uint32_t width, uint32_t height, uint32_t numOfThreads = 0) {
+		if (pixels == NULL) {
+			std::cout << "Can't write " << path << ", no pixels\n";
+			return 1;
+		}
+
+		return write(path, width, height, [pixels, width](uint32_t row, float *rgb) {
+			const vec3 *rowPixels = pixels + (size_t)row * width;
+			for (uint32_t column = 0; column < width; column++, rgb += 3) {
+				rgb[0] = rowPixels[column].r();
+				rgb[1] = rowPixels[column].g();
+				rgb[2] = rowPixels[column].b();
+			}
+		}, numOfThreads);
+	}
+
+	//0 on success like ImageWriter::write, source is asked for engine rows
+	static uint32_t write(const std::string &path, uint32_t width, uint32_t height, const HdrRowSource &source, uint32_t numOfThreads = 0) {
+		HdrImageStream stream;
+		if (!source || !stream.open(path, width, height, numOfThreads)) {
+			return 1;
+		}
+
+		//the file stores rows in its own order, map them back to engine rows (0 at the bottom)
+		bool bottomUp = stream.isBottomUp();
+		bool succeeded = stream.writeRows(height, [&source, bottomUp, height](uint32_t fileRow, float *rgb) {
+			source(bottomUp ? fileRow : height - 1 - fileRow, rgb);
+		});
+
+		if (!stream.close() || !succeeded) {
+			std::cout << "Failed to write " << path << "\n";
+			return 1;
+		}
+		return 0;
+	}
+};
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <atomic>
+
 #include "ray.h"
 #include "aabb.h"
 #include "mathUtilities.h"
+#include "sceneOwner.h"
 
 class Material;
 
@@ -14,12 +17,36 @@ struct HitRecord {
 	vec3 point;
 	vec3 normal;
 	Material *materialPointer;
+	//id of the leaf shape that was hit, see Hitable::_primitiveId
+	uint32_t primitiveId;
+	//how much of u and v the ray's footprint covers around the hit, 0 if the shape doesn't know (see ImageTexture)
+	float footprintU = 0.0f;
+	float footprintV = 0.0f;
 };
 
 class Hitable {
 public:
+	Hitable() : _primitiveId(nextPrimitiveId()++) {}
+	//the scenes never free anything, the library API does (see rayTracingApi.cpp) and the render daemon through a SceneOwner
+	virtual ~Hitable() {}
+
+	SCENE_OWNER_ALLOCATION(Hitable)
+
 	virtual bool hit(const ray &rayCast, float minPointAtParameterT, float maxPointAtParmeterT, HitRecord &hitRecord) const = 0;
 	virtual bool boundingBox(float t0, float t1, AABB &box) const = 0;
+
+	//only shapes that can be registered as emitters need to provide these, see lightSampler.h
+	virtual float surfaceArea() const { return 0.0f; }
+	virtual bool sampleSurface(vec3 &point, vec3 &normal) const { return false; }
+
+	//unique per constructed hitable, leaf shapes copy it into their hit records for the primitive id AOV
+	uint32_t _primitiveId;
+
+	//scenes can be built on several threads at once (render daemon, library API), a function static is defined once however many files include this
+	static std::atomic<uint32_t> &nextPrimitiveId() {
+		static std::atomic<uint32_t> nextId(1);
+		return nextId;
+	}
 };
 
 class FlipNormals : public Hitable {
@@ -37,6 +64,18 @@ public:
 	virtual bool boundingBox(float t0, float t1, AABB &box) const {
 		return _hitable->boundingBox(t0, t1, box);
 	}
+	virtual float surfaceArea() const {
+		return _hitable->surfaceArea();
+	}
+	virtual bool sampleSurface(vec3 &point, vec3 &normal) const {
+		if (_hitable->sampleSurface(point, normal)) {
+			normal = -normal;
+			return true;
+		}
+		else {
+			return false;
+		}
+	}
 
 	Hitable *_hitable;
 };
@@ -46,12 +85,24 @@ public:
 	Translate(Hitable *hitable, const vec3 &displacement) : _hitablePointer(hitable), _offset(displacement) {}
 	virtual bool hit(const ray &r, float tMin, float tMax, HitRecord &hitRecord) const;
 	virtual bool boundingBox(float t0, float t1, AABB &box) const;
+	virtual float surfaceArea() const {
+		return _hitablePointer->surfaceArea();
+	}
+	virtual bool sampleSurface(vec3 &point, vec3 &normal) const {
+		if (_hitablePointer->sampleSurface(point, normal)) {
+			point += _offset;
+			return true;
+		}
+		else {
+			return false;
+		}
+	}
 	Hitable *_hitablePointer;
 	vec3 _offset;
 };
 
 bool Translate::hit(const ray &r, float tMin, float tMax, HitRecord &hitRecord) const {
-	ray movedRay(r.origin() - _offset, r.direction(), r.time());
+	ray movedRay(r.origin() - _offset, r.direction(), r.time(), r._spreadAngle);
 	if (_hitablePointer->hit(movedRay, tMin, tMax, hitRecord)) {
 		hitRecord.point += _offset;
 		return true;
@@ -79,6 +130,10 @@ public:
 		box = _boundBox;
 		return _hasBox;
 	}
+	virtual float surfaceArea() const {
+		return _pointer->surfaceArea();
+	}
+	virtual bool sampleSurface(vec3 &point, vec3 &normal) const;
 
 	Hitable *_pointer;
 	float _sinTheta;
@@ -132,7 +187,7 @@ bool RotateY::hit(const ray &r, float tMin, float tMax, HitRecord &hitRecord) co
 	direction[0] = _cosTheta * r.direction()[0] - _sinTheta * r.direction()[2];
 	direction[2] = _sinTheta * r.direction()[0] + _cosTheta * r.direction()[2];
 
-	ray rotatedRay(origin, direction, r.time());
+	ray rotatedRay(origin, direction, r.time(), r._spreadAngle);
 
 	if (_pointer->hit(rotatedRay, tMin, tMax, hitRecord)) {
 		vec3 p = hitRecord.point;
@@ -152,3 +207,19 @@ bool RotateY::hit(const ray &r, float tMin, float tMax, HitRecord &hitRecord) co
 		return false;
 	}
 }
+
+bool RotateY::sampleSurface(vec3 &point, vec3 &normal) const {
+	vec3 p, n;
+	if (!_pointer->sampleSurface(p, n)) {
+		return false;
+	}
+
+	//same object to world rotation as the one applied to hit records
+	point = p;
+	normal = n;
+	point[0] = _cosTheta * p[0] + _sinTheta * p[2];
+	point[2] = -_sinTheta * p[0] + _cosTheta * p[2];
+	normal[0] = _cosTheta * n[0] + _sinTheta * n[2];
+	normal[2] = -_sinTheta * n[0] + _cosTheta * n[2];
+	return true;
+}
\ No newline at end of file
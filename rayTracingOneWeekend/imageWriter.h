@@ -0,0 +1,591 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <math.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined (_WIN32)
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#endif
+
+/*
+	8 bit image output, BMP, PPM (P6) or PNG picked at runtime from the output path.
+
+	The writers stream straight out of the framebuffer: the header goes out, then the rows one at a time, nothing
+	bigger than a row is ever allocated. The bytes are handed to the OS as a list of pieces (row, padding, row...)
+	that ImageFileSink sends with writev, so BMP row padding and the PNG block headers are never copied in next to
+	the pixels. BMP rows need no conversion at all, 32bpp rows are already 4 byte aligned. ImageStream takes the rows
+	a band at a time (an image rendered out of core never exists whole), ImageWriter hands it a whole framebuffer.
+
+	The input is the WorkerImageBuffer layout: BGR or BGRA bytes, top row first, the way the window blits it. PPM and
+	PNG store rows in that order, the BMP pixel array is bottom up so it walks them backwards. (The old BMP writer
+	stored them top down under a bottom up header, test.bmp came out upside down.)
+
+	The PNG is written with stored (uncompressed) deflate blocks, there is no zlib in the tree. It is as big as the
+	raw pixels but any PNG reader takes it, and writing it costs a CRC and an Adler32 per byte.
+	- https://www.w3.org/TR/PNG/
+	- https://www.rfc-editor.org/rfc/rfc1951 (section 3.2.4, non-compressed blocks)
+*/
+
+enum ImageFormat {
+	IMAGE_FORMAT_BMP = 0,
+	IMAGE_FORMAT_PPM,
+	IMAGE_FORMAT_PNG,
+	IMAGE_FORMAT_UNKNOWN
+};
+
+//unbuffered file that takes a list of pieces and writes them with as few system calls as it can
+class ImageFileSink {
+public:
+	ImageFileSink() : _file(-1), _failed(false), _ownsFile(false) {}
+
+	~ImageFileSink() {
+		close();
+	}
+
+	ImageFileSink(const ImageFileSink &) = delete;
+	ImageFileSink &operator=(const ImageFileSink &) = delete;
+
+	bool open(const std::string &path) {
+		close();
+		_failed = false;
+#if defined (_WIN32)
+		_file = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+		_file = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+		_ownsFile = true;
+		return _file >= 0;
+	}
+
+	//the process' stdout, in binary on Windows. close() only flushes it, whoever reads it sees the end when the process exits.
+	bool openStandardOutput() {
+		close();
+		_failed = false;
+#if defined (_WIN32)
+		_file = _fileno(stdout);
+		_setmode(_file, _O_BINARY);
+#else
+		_file = STDOUT_FILENO;
+#endif
+		_ownsFile = false;
+		return _file >= 0;
+	}
+
+	//queues a piece without copying it, it has to stay untouched until the next flush()
+	void append(const void *data, size_t sizeInBytes) {
+		if (sizeInBytes == 0) {
+			return;
+		}
+
+		//pieces that continue the previous one (consecutive rows of one buffer) go out as one
+		if (!_pieces.empty() && (const uint8_t *)_pieces.back().data + _pieces.back().sizeInBytes == (const uint8_t *)data) {
+			_pieces.back().sizeInBytes += sizeInBytes;
+		}
+		else {
+			Piece piece = { data, sizeInBytes };
+			_pieces.push_back(piece);
+		}
+
+		if (_pieces.size() >= IMAGE_SINK_MAX_PIECES) {
+			flush();
+		}
+	}
+
+	//false once any write has failed
+	bool flush();
+
+	bool close() {
+		bool succeeded = flush();
+
+		if (_file >= 0 && _ownsFile) {
+#if defined (_WIN32)
+			succeeded = _close(_file) == 0 && succeeded;
+#else
+			succeeded = ::close(_file) == 0 && succeeded;
+#endif
+		}
+		_file = -1;
+		return succeeded;
+	}
+
+protected:
+	//well under IOV_MAX everywhere
+	static const size_t IMAGE_SINK_MAX_PIECES = 64;
+
+	struct Piece {
+		const void *data;
+		size_t sizeInBytes;
+	};
+
+	int _file;
+	bool _failed;
+	bool _ownsFile;
+	std::vector<Piece> _pieces;
+};
+
+inline bool ImageFileSink::flush() {
+	if (_file < 0 || _failed) {
+		_pieces.clear();
+		return false;
+	}
+
+#if defined (_WIN32)
+	//no writev, each piece is one _write
+	for (const Piece &piece : _pieces) {
+		const uint8_t *bytes = (const uint8_t *)piece.data;
+		size_t remaining = piece.sizeInBytes;
+
+		while (remaining > 0 && !_failed) {
+			unsigned int chunk = (unsigned int)std::min<size_t>(remaining, 1u << 30);
+			int written = _write(_file, bytes, chunk);
+			if (written <= 0) {
+				_failed = true;
+				break;
+			}
+			bytes += written;
+			remaining -= written;
+		}
+	}
+#else
+	iovec vectors[IMAGE_SINK_MAX_PIECES];
+	size_t first = 0;
+
+	while (first < _pieces.size() && !_failed) {
+		int numOfVectors = 0;
+		for (size_t piece = first; piece < _pieces.size(); piece++) {
+			vectors[numOfVectors].iov_base = (void *)_pieces[piece].data;
+			vectors[numOfVectors].iov_len = _pieces[piece].sizeInBytes;
+			numOfVectors++;
+		}
+
+		ssize_t written = writev(_file, vectors, numOfVectors);
+		if (written <= 0) {
+			_failed = true;
+			break;
+		}
+
+		//a short write leaves the rest of the pieces for another go
+		while (first < _pieces.size() && (size_t)written >= _pieces[first].sizeInBytes) {
+			written -= _pieces[first].sizeInBytes;
+			first++;
+		}
+		if (first < _pieces.size()) {
+			_pieces[first].data = (const uint8_t *)_pieces[first].data + written;
+			_pieces[first].sizeInBytes -= written;
+		}
+	}
+#endif
+
+	_pieces.clear();
+	return !_failed;
+}
+
+//from the extension, .bmp/.ppm/.png in any case
+inline ImageFormat imageFormatFromPath(const std::string &path) {
+	size_t dot = path.find_last_of('.');
+	if (dot == std::string::npos) {
+		return IMAGE_FORMAT_UNKNOWN;
+	}
+
+	std::string extension = path.substr(dot + 1);
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+
+	if (extension == "bmp") return IMAGE_FORMAT_BMP;
+	if (extension == "ppm") return IMAGE_FORMAT_PPM;
+	if (extension == "png") return IMAGE_FORMAT_PNG;
+	return IMAGE_FORMAT_UNKNOWN;
+}
+
+//linear color to a byte, same sqrt gamma and 255.99 scale as writeColorToImageBuffer
+inline uint8_t linearToImageByte(float linear) {
+	if (!(linear > 0.0f)) {
+		return 0;
+	}
+	float value = 255.99f * sqrtf(linear);
+	return value >= 255.0f ? 255 : uint8_t(value);
+}
+
+//one row of linear RGB floats (RenderJob::outputPixels) to the BGR bytes the streams take
+inline void linearRowToBGR(const float *rgb, uint8_t *bgr, uint32_t width) {
+	for (uint32_t column = 0; column < width; column++, rgb += 3, bgr += 3) {
+		bgr[0] = linearToImageByte(rgb[2]);
+		bgr[1] = linearToImageByte(rgb[1]);
+		bgr[2] = linearToImageByte(rgb[0]);
+	}
+}
+
+/*
+	One image file written a few rows at a time, for images that are never in memory whole (see outOfCoreRender.h).
+	The header goes out on open(), rows go out in file order as they are handed in: top row first, except for BMP
+	which is bottom up (isBottomUp()). Nothing besides one converted row is buffered, the rows can be reused as soon as
+	writeRows returns.
+*/
+class ImageStream {
+public:
+	ImageStream() : _format(IMAGE_FORMAT_UNKNOWN), _width(0), _height(0), _bytesPerPixel(0), _rowsWritten(0), _adlerA(1), _adlerB(0) {}
+
+	ImageStream(const ImageStream &) = delete;
+	ImageStream &operator=(const ImageStream &) = delete;
+
+	//bytesPerPixel is 3 (BGR) or 4 (BGRA, alpha is dropped except in BMP)
+	bool open(const std::string &path, ImageFormat format, uint32_t width, uint32_t height, uint32_t bytesPerPixel);
+
+	bool isBottomUp() const {
+		return _format == IMAGE_FORMAT_BMP;
+	}
+
+	//row r at pixels + r * rowStrideInBytes, a negative stride walks a top first buffer backwards for BMP
+	bool writeRows(const uint8_t *pixels, uint32_t numOfRows, ptrdiff_t rowStrideInBytes);
+
+	//false if a write failed or not every row was written
+	bool close();
+
+	uint32_t getRowsWritten() const {
+		return _rowsWritten;
+	}
+
+protected:
+	static void putLittleEndian(uint8_t *bytes, uint32_t value, int sizeInBytes) {
+		for (int byte = 0; byte < sizeInBytes; byte++) {
+			bytes[byte] = uint8_t(value >> (8 * byte));
+		}
+	}
+
+	static void putBigEndian(uint8_t *bytes, uint32_t value) {
+		bytes[0] = uint8_t(value >> 24);
+		bytes[1] = uint8_t(value >> 16);
+		bytes[2] = uint8_t(value >> 8);
+		bytes[3] = uint8_t(value);
+	}
+
+	//BGR(A) to RGB for the formats that want it, one row at a time
+	static void convertRowToRGB(const uint8_t *row, uint32_t width, uint32_t bytesPerPixel, uint8_t *rgb) {
+		for (uint32_t column = 0; column < width; column++, row += bytesPerPixel, rgb += 3) {
+			rgb[0] = row[2];
+			rgb[1] = row[1];
+			rgb[2] = row[0];
+		}
+	}
+
+	struct CrcTable {
+		CrcTable() {
+			for (uint32_t entry = 0; entry < 256; entry++) {
+				uint32_t value = entry;
+				for (int bit = 0; bit < 8; bit++) {
+					value = (value & 1) ? 0xedb88320u ^ (value >> 1) : value >> 1;
+				}
+				entries[entry] = value;
+			}
+		}
+
+		uint32_t entries[256];
+	};
+
+	static uint32_t crc32(uint32_t crc, const uint8_t *bytes, size_t sizeInBytes) {
+		static const CrcTable table;
+
+		crc = ~crc;
+		for (size_t byte = 0; byte < sizeInBytes; byte++) {
+			crc = table.entries[(crc ^ bytes[byte]) & 0xff] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	static void adler32(uint32_t &a, uint32_t &b, const uint8_t *bytes, size_t sizeInBytes) {
+		//5552 bytes is the most that can be summed before b overflows 32 bits
+		while (sizeInBytes > 0) {
+			size_t run = std::min<size_t>(sizeInBytes, 5552);
+			sizeInBytes -= run;
+			while (run-- > 0) {
+				a += *bytes++;
+				b += a;
+			}
+			a %= 65521;
+			b %= 65521;
+		}
+	}
+
+	/*
+		BITMAPFILEHEADER + BITMAPINFOHEADER, bottom up rows padded to 4 bytes.
+		- https://en.wikipedia.org/wiki/BMP_file_format
+	*/
+	bool writeBMPHeader();
+	bool writeBMPRow(const uint8_t *row);
+
+	//binary netpbm, top row first
+	bool writePPMHeader();
+	bool writePPMRow(const uint8_t *row);
+
+	/*
+		One IDAT per scanline, each holding the scanline as stored deflate blocks. The first IDAT also carries the zlib
+		header and the last one the final block flag and the Adler32, so nothing has to be known about later rows.
+	*/
+	bool writePNGHeader();
+	bool writePNGRow(const uint8_t *row);
+	bool writePNGChunk(const char *type, const uint8_t *data, uint32_t sizeInBytes);
+
+	static const size_t PNG_MAX_STORED_BLOCK_SIZE = 65535;
+	static const uint32_t BMP_HEADER_SIZE_IN_BYTES = 14 + 40;
+
+	ImageFileSink _sink;
+	ImageFormat _format;
+	uint32_t _width, _height, _bytesPerPixel;
+	uint32_t _rowsWritten;
+
+	//RGB row for PPM, filter byte + RGB row for PNG
+	std::vector<uint8_t> _scanline;
+	std::vector<uint8_t> _blockHeaders;
+	uint32_t _adlerA, _adlerB;
+};
+
+inline bool ImageStream::open(const std::string &path, ImageFormat format, uint32_t width, uint32_t height, uint32_t bytesPerPixel) {
+	if (width == 0 || height == 0 || (bytesPerPixel != 3 && bytesPerPixel != 4) || format == IMAGE_FORMAT_UNKNOWN) {
+		std::cout << "Can't write " << path << ", use a .bmp, .ppm or .png name\n";
+		return false;
+	}
+
+	//every size in a BMP header is 32 bits
+	uint64_t paddedRowSizeInBytes = ((uint64_t)width * bytesPerPixel + 3) & ~(uint64_t)3;
+	if (format == IMAGE_FORMAT_BMP && BMP_HEADER_SIZE_IN_BYTES + paddedRowSizeInBytes * height > 0xffffffffu) {
+		std::cout << "Can't write " << path << ", over 4GB is too big for a BMP, use .ppm or .png\n";
+		return false;
+	}
+
+	if (!_sink.open(path)) {
+		std::cout << "Failed to open " << path << "\n";
+		return false;
+	}
+
+	_format = format;
+	_width = width;
+	_height = height;
+	_bytesPerPixel = bytesPerPixel;
+	_rowsWritten = 0;
+	_adlerA = 1;
+	_adlerB = 0;
+
+	switch (_format) {
+	case IMAGE_FORMAT_BMP: return writeBMPHeader();
+	case IMAGE_FORMAT_PPM: return writePPMHeader();
+	case IMAGE_FORMAT_PNG: return writePNGHeader();
+	default: return false;
+	}
+}
+
+inline bool ImageStream::writeRows(const uint8_t *pixels, uint32_t numOfRows, ptrdiff_t rowStrideInBytes) {
+	if (numOfRows > _height - _rowsWritten) {
+		return false;
+	}
+
+	bool succeeded = true;
+	for (uint32_t row = 0; row < numOfRows && succeeded; row++, pixels += rowStrideInBytes) {
+		switch (_format) {
+		case IMAGE_FORMAT_BMP: succeeded = writeBMPRow(pixels); break;
+		case IMAGE_FORMAT_PPM: succeeded = writePPMRow(pixels); break;
+		case IMAGE_FORMAT_PNG: succeeded = writePNGRow(pixels); break;
+		default: succeeded = false; break;
+		}
+		_rowsWritten++;
+	}
+
+	//the caller's rows can go away after this
+	return _sink.flush() && succeeded;
+}
+
+inline bool ImageStream::close() {
+	bool succeeded = _rowsWritten == _height;
+
+	if (_format == IMAGE_FORMAT_PNG && succeeded) {
+		succeeded = writePNGChunk("IEND", NULL, 0);
+	}
+	_format = IMAGE_FORMAT_UNKNOWN;
+
+	return _sink.close() && succeeded;
+}
+
+inline bool ImageStream::writeBMPHeader() {
+	uint32_t paddedRowSizeInBytes = (_width * _bytesPerPixel + 3) & ~3u;
+	uint32_t pixelArraySizeInBytes = paddedRowSizeInBytes * _height;
+
+	uint8_t header[BMP_HEADER_SIZE_IN_BYTES] = { 0 };
+	header[0] = 'B';
+	header[1] = 'M';
+	putLittleEndian(header + 2, BMP_HEADER_SIZE_IN_BYTES + pixelArraySizeInBytes, 4);
+	putLittleEndian(header + 10, BMP_HEADER_SIZE_IN_BYTES, 4);
+	putLittleEndian(header + 14, 40, 4);
+	putLittleEndian(header + 18, _width, 4);
+	putLittleEndian(header + 22, _height, 4);
+	putLittleEndian(header + 26, 1, 2);
+	putLittleEndian(header + 28, _bytesPerPixel * 8, 2);
+	putLittleEndian(header + 34, pixelArraySizeInBytes, 4);
+
+	_sink.append(header, BMP_HEADER_SIZE_IN_BYTES);
+	return _sink.flush();
+}
+
+inline bool ImageStream::writeBMPRow(const uint8_t *row) {
+	//BMP rows need no conversion at all, they go out of the caller's buffer
+	static const uint8_t padding[3] = { 0, 0, 0 };
+	uint32_t rowSizeInBytes = _width * _bytesPerPixel;
+
+	_sink.append(row, rowSizeInBytes);
+	_sink.append(padding, ((rowSizeInBytes + 3) & ~3u) - rowSizeInBytes);
+	return true;
+}
+
+inline bool ImageStream::writePPMHeader() {
+	std::string header = "P6\n" + std::to_string(_width) + " " + std::to_string(_height) + "\n255\n";
+	_sink.append(header.data(), header.size());
+
+	//BGR has to be swapped, so a row is the one buffer
+	_scanline.resize((size_t)_width * 3);
+	return _sink.flush();
+}
+
+inline bool ImageStream::writePPMRow(const uint8_t *row) {
+	//the sink still points at the last row until it is flushed
+	if (!_sink.flush()) {
+		return false;
+	}
+	convertRowToRGB(row, _width, _bytesPerPixel, _scanline.data());
+	_sink.append(_scanline.data(), _scanline.size());
+	return true;
+}
+
+inline bool ImageStream::writePNGChunk(const char *type, const uint8_t *data, uint32_t sizeInBytes) {
+	uint8_t prefix[8];
+	putBigEndian(prefix, sizeInBytes);
+	memcpy(prefix + 4, type, 4);
+
+	uint8_t crc[4];
+	putBigEndian(crc, crc32(crc32(0, prefix + 4, 4), data, sizeInBytes));
+
+	_sink.append(prefix, 8);
+	_sink.append(data, sizeInBytes);
+	_sink.append(crc, 4);
+	return _sink.flush();
+}
+
+inline bool ImageStream::writePNGHeader() {
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	_sink.append(signature, sizeof(signature));
+
+	uint8_t imageHeader[13] = { 0 };
+	putBigEndian(imageHeader, _width);
+	putBigEndian(imageHeader + 4, _height);
+	imageHeader[8] = 8;
+	//truecolor, default compression/filter/no interlace
+	imageHeader[9] = 2;
+
+	//filter type 0 (none) in front of every scanline
+	_scanline.assign(1 + (size_t)_width * 3, 0);
+
+	size_t numOfBlocks = (_scanline.size() + PNG_MAX_STORED_BLOCK_SIZE - 1) / PNG_MAX_STORED_BLOCK_SIZE;
+	_blockHeaders.assign(numOfBlocks * 5, 0);
+
+	return writePNGChunk("IHDR", imageHeader, sizeof(imageHeader));
+}
+
+inline bool ImageStream::writePNGRow(const uint8_t *row) {
+	bool firstRow = _rowsWritten == 0;
+	bool lastRow = _rowsWritten == _height - 1;
+	size_t numOfBlocks = _blockHeaders.size() / 5;
+
+	//everything queued for the last row points at members and this call's locals
+	if (!_sink.flush()) {
+		return false;
+	}
+
+	convertRowToRGB(row, _width, _bytesPerPixel, _scanline.data() + 1);
+	adler32(_adlerA, _adlerB, _scanline.data(), _scanline.size());
+
+	//deflate level "fastest", window 32k, the check bits make the header a multiple of 31
+	static const uint8_t zlibHeader[2] = { 0x78, 0x01 };
+	uint8_t adler[4];
+	putBigEndian(adler, (_adlerB << 16) | _adlerA);
+
+	uint32_t chunkSizeInBytes = (firstRow ? 2 : 0) + (uint32_t)(_blockHeaders.size() + _scanline.size()) + (lastRow ? 4 : 0);
+	uint8_t prefix[8];
+	putBigEndian(prefix, chunkSizeInBytes);
+	memcpy(prefix + 4, "IDAT", 4);
+
+	uint32_t crc = crc32(0, prefix + 4, 4);
+	_sink.append(prefix, 8);
+
+	if (firstRow) {
+		crc = crc32(crc, zlibHeader, 2);
+		_sink.append(zlibHeader, 2);
+	}
+
+	for (size_t block = 0; block < numOfBlocks; block++) {
+		size_t offset = block * PNG_MAX_STORED_BLOCK_SIZE;
+		uint16_t blockSize = (uint16_t)std::min(_scanline.size() - offset, (size_t)PNG_MAX_STORED_BLOCK_SIZE);
+		uint8_t *blockHeader = &_blockHeaders[block * 5];
+
+		blockHeader[0] = (lastRow && block == numOfBlocks - 1) ? 1 : 0;
+		putLittleEndian(blockHeader + 1, blockSize, 2);
+		putLittleEndian(blockHeader + 3, (uint16_t)~blockSize, 2);
+
+		crc = crc32(crc, blockHeader, 5);
+		crc = crc32(crc, _scanline.data() + offset, blockSize);
+		_sink.append(blockHeader, 5);
+		_sink.append(_scanline.data() + offset, blockSize);
+	}
+
+	if (lastRow) {
+		crc = crc32(crc, adler, 4);
+		_sink.append(adler, 4);
+	}
+
+	uint8_t crcBytes[4];
+	putBigEndian(crcBytes, crc);
+	_sink.append(crcBytes, 4);
+
+	//the prefix, adler and CRC are locals
+	return _sink.flush();
+}
+
+//the whole framebuffer in one call
+class ImageWriter {
+public:
+	static ImageFormat formatFromPath(const std::string &path) {
+		return imageFormatFromPath(path);
+	}
+
+	//0 on success like WINDIBBitmap::writeBMPToFile. bytesPerPixel is 3 (BGR) or 4 (BGRA, alpha is dropped except in BMP).
+	static uint32_t write(const std::string &path, const uint8_t *pixels, uint32_t width, uint32_t height, uint32_t bytesPerPixel) {
+		return write(path, formatFromPath(path), pixels, width, height, bytesPerPixel);
+	}
+
+	static uint32_t write(const std::string &path, ImageFormat format, const uint8_t *pixels, uint32_t width, uint32_t height, uint32_t bytesPerPixel) {
+		ImageStream stream;
+		if (pixels == NULL || !stream.open(path, format, width, height, bytesPerPixel)) {
+			return 1;
+		}
+
+		ptrdiff_t rowSizeInBytes = (ptrdiff_t)width * bytesPerPixel;
+		bool succeeded = stream.isBottomUp() ?
+			stream.writeRows(pixels + (height - 1) * rowSizeInBytes, height, -rowSizeInBytes) :
+			stream.writeRows(pixels, height, rowSizeInBytes);
+
+		if (!stream.close() || !succeeded) {
+			std::cout << "Failed to write " << path << "\n";
+			return 1;
+		}
+		return 0;
+	}
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <utility>
+#include <condition_variable>
+#include <stdint.h>
+
+#include "defines.h"
+#include "imageWriter.h"
+#include "hdrImageWriter.h"
+
+/*
+	Background threads that write finished images, so whoever produces them (sequenceRender.h) goes straight back to
+	rendering instead of waiting on the encoder and the disk.
+
+	The queue is bounded: enqueue() only blocks once queueDepth images are waiting, which is what keeps the memory of a
+	long sequence flat when the disk can't keep up. How long the producer spent blocked that way is counted, if it is
+	not ~0 there are too few writer threads or the disk is the bottleneck.
+
+	Any format ImageWriter or HdrImageWriter knows, picked from each path's extension.
+*/
+class ImageWriterPool {
+public:
+	explicit ImageWriterPool(uint32_t numOfThreads = IMAGE_WRITER_POOL_THREADS, uint32_t queueDepth = IMAGE_WRITER_POOL_QUEUE_DEPTH) :
+		_queueDepth(queueDepth > 0 ? queueDepth : 1), _busyThreads(0), _numOfFailedWrites(0), _blockedTime(Clock::duration::zero()), _exit(false) {
+
+		for (uint32_t i = 0; i < (numOfThreads > 0 ? numOfThreads : 1); i++) {
+			_threads.push_back(std::thread(&ImageWriterPool::writerProcedure, this));
+		}
+	}
+
+	//writes whatever is still queued first
+	~ImageWriterPool() {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_exit = true;
+		}
+		_queueConditionVar.notify_all();
+
+		for (std::thread &thread : _threads) {
+			thread.join();
+		}
+	}
+
+	ImageWriterPool(const ImageWriterPool &) = delete;
+	ImageWriterPool &operator=(const ImageWriterPool &) = delete;
+
+	//pixels are linear RGB floats, top row first like RenderJob::outputPixels. Blocks while the queue is full.
+	void enqueue(const std::string &path, std::vector<float> &&pixels, uint32_t width, uint32_t height) {
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		if (_queue.size() >= _queueDepth) {
+			auto blockedStartTime = Clock::now();
+			_spaceConditionVar.wait(lock, [this] { return _queue.size() < _queueDepth; });
+			_blockedTime += Clock::now() - blockedStartTime;
+		}
+
+		WriteRequest request = { path, std::move(pixels), width, height };
+		_queue.push_back(std::move(request));
+		_queueConditionVar.notify_one();
+	}
+
+	//blocks until everything enqueued so far is on disk, returns how many writes failed since the last call
+	uint32_t waitUntilIdle() {
+		std::unique_lock<std::mutex> lock(_mutex);
+		_idleConditionVar.wait(lock, [this] { return _queue.empty() && _busyThreads == 0; });
+
+		uint32_t numOfFailedWrites = _numOfFailedWrites;
+		_numOfFailedWrites = 0;
+		return numOfFailedWrites;
+	}
+
+	//total time enqueue() waited for room in the queue
+	float getBlockedMs() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return std::chrono::duration<float, std::milli>(_blockedTime).count();
+	}
+
+	//0 on success like ImageWriter::write, the float formats get the linear colors and the 8 bit ones BGR bytes
+	static uint32_t writeLinearImage(const std::string &path, const float *rgb, uint32_t width, uint32_t height) {
+		ptrdiff_t rowSizeInFloats = (ptrdiff_t)width * 3;
+
+		if (hdrImageFormatFromPath(path) != HDR_IMAGE_FORMAT_UNKNOWN) {
+			//one encoder thread, the pool already runs several images side by side
+			HdrImageStream stream;
+			if (!stream.open(path, width, height, 1)) {
+				return 1;
+			}
+
+			bool succeeded = stream.isBottomUp() ?
+				stream.writeRows(rgb + (height - 1) * rowSizeInFloats, height, -rowSizeInFloats) :
+				stream.writeRows(rgb, height, rowSizeInFloats);
+
+			if (!stream.close() || !succeeded) {
+				std::cout << "Failed to write " << path << "\n";
+				return 1;
+			}
+			return 0;
+		}
+
+		std::vector<uint8_t> bgr((size_t)rowSizeInFloats * height);
+		for (uint32_t row = 0; row < height; row++) {
+			linearRowToBGR(rgb + row * rowSizeInFloats, &bgr[(size_t)row * rowSizeInFloats], width);
+		}
+		return ImageWriter::write(path, bgr.data(), width, height, 3);
+	}
+
+protected:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	struct WriteRequest {
+		std::string path;
+		std::vector<float> pixels;
+		uint32_t width, height;
+	};
+
+	void writerProcedure() {
+		std::unique_lock<std::mutex> lock(_mutex);
+
+		while (true) {
+			_queueConditionVar.wait(lock, [this] { return _exit || !_queue.empty(); });
+			if (_queue.empty()) {
+				return;
+			}
+
+			WriteRequest request = std::move(_queue.front());
+			_queue.pop_front();
+			_busyThreads++;
+			_spaceConditionVar.notify_one();
+
+			lock.unlock();
+			uint32_t failed = writeLinearImage(request.path, request.pixels.data(), request.width, request.height);
+			//the frame is freed outside the lock too
+			std::vector<float>().swap(request.pixels);
+			lock.lock();
+
+			_busyThreads--;
+			if (failed != 0) {
+				_numOfFailedWrites++;
+			}
+			if (_queue.empty() && _busyThreads == 0) {
+				_idleConditionVar.notify_all();
+			}
+		}
+	}
+
+	uint32_t _queueDepth;
+
+	std::mutex _mutex;
+	std::condition_variable _queueConditionVar;
+	std::condition_variable _spaceConditionVar;
+	std::condition_variable _idleConditionVar;
+
+	std::deque<WriteRequest> _queue;
+	uint32_t _busyThreads;
+	uint32_t _numOfFailedWrites;
+	Clock::duration _blockedTime;
+	bool _exit;
+
+	std::vector<std::thread> _threads;
+};
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <vector>
+#include <unordered_set>
+
+#include "vec3.h"
+#include "rngs.h"
+#include "hitable.h"
+#include "material.h"
+
+/*
+	Registry of the emissive shapes in a scene. Lights are picked proportional to emitted power * area using
+	Vose's alias method so picking a light is O(1) no matter how many emitters the scene has.
+	- https://www.keithschwarz.com/darts-dice-coins/
+*/
+struct Emitter {
+	Hitable *shape;
+	Material *material;
+	float power;
+};
+
+class EmitterRegistry {
+public:
+	EmitterRegistry() : _totalPower(0.0f) {}
+
+	void addEmitter(Hitable *shape, Material *material);
+	void translateEmitters(const vec3 &offset);
+	void build();
+
+	bool empty() const {
+		return _emitters.empty() || _totalPower <= 0.0f;
+	}
+
+	uint32_t size() const {
+		return (uint32_t)_emitters.size();
+	}
+
+	bool isSampledMaterial(const Material *material) const {
+		return _materials.count(material) > 0;
+	}
+
+	const Emitter &sampleEmitter(float u, float &probability) const;
+
+protected:
+	std::vector<Emitter> _emitters;
+	std::unordered_set<const Material *> _materials;
+
+	//alias table, one bucket per emitter
+	std::vector<float> _bucketProbability;
+	std::vector<uint32_t> _bucketAlias;
+	float _totalPower;
+};
+
+void EmitterRegistry::addEmitter(Hitable *shape, Material *material) {
+	Emitter emitter;
+	emitter.shape = shape;
+	emitter.material = material;
+	emitter.power = 0.0f;
+
+	_emitters.push_back(emitter);
+	_materials.insert(material);
+}
+
+//scenes are built around their own origin and then moved into place by main, the emitters have to follow
+void EmitterRegistry::translateEmitters(const vec3 &offset) {
+	for (Emitter &emitter : _emitters) {
+		emitter.shape = new Translate(emitter.shape, offset);
+	}
+}
+
+void EmitterRegistry::build() {
+	uint32_t n = (uint32_t)_emitters.size();
+
+	_bucketProbability.assign(n, 0.0f);
+	_bucketAlias.assign(n, 0);
+	_totalPower = 0.0f;
+
+	for (Emitter &emitter : _emitters) {
+		vec3 point, normal;
+		vec3 radiance(0, 0, 0);
+
+		if (emitter.shape->sampleSurface(point, normal)) {
+			radiance = emitter.material->emitted(0.5f, 0.5f, point);
+		}
+
+		//luminance of the emitted radiance
+		float luminance = 0.2126f * radiance.r() + 0.7152f * radiance.g() + 0.0722f * radiance.b();
+		emitter.power = luminance * emitter.shape->surfaceArea();
+		_totalPower += emitter.power;
+	}
+
+	if (n == 0 || _totalPower <= 0.0f) {
+		return;
+	}
+
+	std::vector<float> scaled(n);
+	std::vector<uint32_t> small, large;
+
+	for (uint32_t i = 0; i < n; i++) {
+		scaled[i] = _emitters[i].power * n / _totalPower;
+
+		if (scaled[i] < 1.0f) {
+			small.push_back(i);
+		}
+		else {
+			large.push_back(i);
+		}
+	}
+
+	while (!small.empty() && !large.empty()) {
+		uint32_t lesser = small.back();
+		small.pop_back();
+		uint32_t greater = large.back();
+		large.pop_back();
+
+		_bucketProbability[lesser] = scaled[lesser];
+		_bucketAlias[lesser] = greater;
+
+		scaled[greater] = (scaled[greater] + scaled[lesser]) - 1.0f;
+
+		if (scaled[greater] < 1.0f) {
+			small.push_back(greater);
+		}
+		else {
+			large.push_back(greater);
+		}
+	}
+
+	//whatever is left over is 1.0 give or take float round off
+	for (uint32_t i : large) {
+		_bucketProbability[i] = 1.0f;
+		_bucketAlias[i] = i;
+	}
+	for (uint32_t i : small) {
+		_bucketProbability[i] = 1.0f;
+		_bucketAlias[i] = i;
+	}
+}
+
+//u is uniform in [0,1), probability returns the discrete probability of the emitter that was picked
+const Emitter &EmitterRegistry::sampleEmitter(float u, float &probability) const {
+	uint32_t n = (uint32_t)_emitters.size();
+
+	float scaledU = u * n;
+	uint32_t bucket = (uint32_t)scaledU;
+	if (bucket > n - 1) bucket = n - 1;
+
+	uint32_t index = (scaledU - bucket < _bucketProbability[bucket]) ? bucket : _bucketAlias[bucket];
+
+	probability = _emitters[index].power / _totalPower;
+	return _emitters[index];
+}
+
+//one light sample for a diffuse hit, returns the incoming radiance weighted by the lambertian BRDF (without albedo) and cosines
+vec3 sampleDirectLight(const HitRecord &hitRecord, Hitable *world, const EmitterRegistry &emitters, float time) {
+	float emitterProbability;
+	const Emitter &emitter = emitters.sampleEmitter(unifRand(randomNumberGenerator), emitterProbability);
+
+	vec3 lightPoint, lightNormal;
+	if (emitterProbability <= 0.0f || !emitter.shape->sampleSurface(lightPoint, lightNormal)) {
+		return vec3(0, 0, 0);
+	}
+
+	vec3 toLight = lightPoint - hitRecord.point;
+	float distanceSquared = toLight.squared_length();
+	vec3 toLightDirection = toLight / sqrt(distanceSquared);
+
+	float cosineSurface = dot(hitRecord.normal, toLightDirection);
+	float cosineLight = fabs(dot(unit_vector(lightNormal), toLightDirection));
+
+	if (cosineSurface <= 0.0f || cosineLight <= 0.0f) {
+		return vec3(0, 0, 0);
+	}
+
+	//shadow ray, stop just short of the light itself
+	HitRecord shadowRecord;
+	if (world->hit(ray(hitRecord.point, toLight, time), 0.001, 0.999, shadowRecord)) {
+		return vec3(0, 0, 0);
+	}
+
+	//convert the uniform area pdf to solid angle
+	float areaProbability = 1.0f / emitter.shape->surfaceArea();
+	float solidAngleProbability = emitterProbability * areaProbability * distanceSquared / cosineLight;
+
+	return emitter.material->emitted(0.5f, 0.5f, lightPoint) * (cosineSurface / (M_PI * solidAngleProbability));
+}
@@ -2,6 +2,8 @@
 #include "float.h"
 
 #include "defines.h"
+//before anything that pulls in Windows.h, see tcpSocket.h
+#include "tcpSocket.h"
 #include "vec3.h"
 #include "mat3x3.h"
 #include "quaternion.h"
@@ -10,11 +12,27 @@
 #include "color.h"
 #include "scenes.h"
 #include "common.h"
+#include "accumulationBuffer.h"
+#include "aovFramebuffer.h"
+#include "tileScheduler.h"
+#include "threadPool.h"
+#include "cpuTopology.h"
+#include "frameMailbox.h"
+#include "renderer.h"
+#include "distributedRender.h"
+#include "renderDaemon.h"
+#include "denoiser.h"
 #include "winGUI.h"
 
 #include "debug.h"
 
 #include "winDIBbitmap.h"
+#include "imageWriter.h"
+#include "hdrImageWriter.h"
+#include "outOfCoreRender.h"
+#include "renderCheckpoint.h"
+#include "sequenceRender.h"
+#include "sceneFile.h"
 
 //https://github.com/nothings/stb
 #define STB_IMAGE_IMPLEMENTATION
@@ -22,8 +40,8 @@
 
 /* 
 	Look into:
-	- drowan 20190601: https://eli.thegreenplace.net/2016/c11-threads-affinity-and-hyperthreading/
-	- drowan 20190607: Use OpenMPI???
+	- drowan 20190601: https://eli.thegreenplace.net/2016/c11-threads-affinity-and-hyperthreading/ (see cpuTopology.h)
+	- drowan 20190607: Use OpenMPI??? (see distributedRender.h, plain TCP for now)
 */
 
 /* 
@@ -40,23 +58,37 @@
 */
 
 void raytraceWorkerProcedure(
-	std::shared_ptr<WorkerThread> workerThread,
+	uint32_t workerId,
 	std::shared_ptr<WorkerImageBuffer> workerImageBuffer,
-	RenderProperties renderProps,
+	std::shared_ptr<AccumulationBuffer> accumulationBuffer,
+	std::shared_ptr<AOVFramebuffer> aovFramebuffer,
+	std::shared_ptr<TileScheduler> tileScheduler,
+	const RenderProperties &renderProps,
 	Camera *sceneCamera,
-	Hitable *world
+	Hitable *world,
+	const EmitterRegistry *emitters
 );
 
 void configureScene(RenderProperties &renderProps);
 
+void writeColorToImageBuffer(
+	std::shared_ptr<WorkerImageBuffer> workerImageBufferStruct,
+	const RenderProperties &renderProps,
+	uint32_t row,
+	uint32_t column,
+	vec3 linearColor
+);
+
 void bitBlitWorkerProcedure(
 	std::shared_ptr<WorkerThread> workerThreadStruct,
-	std::shared_ptr<WorkerImageBuffer> workerImageBufferStruct,
+	std::shared_ptr<FrameMailbox> frameMailbox,
 	RenderProperties renderProps
 );
 
-Hitable *randomScene();
-Hitable *cornellBox();
+Hitable *buildScene(uint32_t sceneId, EmitterRegistry *emitterRegistry);
+
+Hitable *randomScene(EmitterRegistry *emitterRegistry);
+Hitable *cornellBox(EmitterRegistry *emitterRegistry);
 
 /*
 Start -> 
@@ -66,7 +98,93 @@ Wait for input -> ?
 Return to [Render scene]
 */
 
-int main() {
+int main(int argc, char *argv[]) {
+
+	//"--worker <host>" traces tiles for a coordinator, "--coordinator" hands the first frame out to the workers,
+	//"--daemon [socket path]" serves render requests with the scenes kept built, "--output <path>" is where the final
+	//image goes (the extension picks the format), "--hdr-output <path>" the same for the unquantized float image,
+	//"--poster <width> <height> <path>" renders an image of any size straight to a file, a band at a time, and exits,
+	//"--checkpoint <path>" saves the progressive render every CHECKPOINT_INTERVAL_MS and "--resume <path>" carries on from one,
+	//"--sequence <camera path> <frames> <output pattern>" renders the keyframed camera path to numbered images and exits,
+	//an output of "-" (Y4M on stdout) or a .y4m/.rgb path streams the frames to a video encoder instead,
+	//"--scene <path>" renders a scene file instead of a built in scene and "--compile-scene <source> <output>" only compiles one,
+	//"--convert-texture <image> <output>" only converts an image to a mipmapped texture file (see mipmapCache.h)
+	const char *distributedWorkerHost = NULL;
+	bool runAsCoordinator = false;
+	const char *daemonSocketPath = NULL;
+	const char *outputImagePath = NULL;
+	const char *outputHdrImagePath = NULL;
+	const char *posterImagePath = NULL;
+	uint32_t posterWidthInPixels = 0, posterHeightInPixels = 0;
+	const char *checkpointPath = NULL;
+	const char *resumeCheckpointPath = NULL;
+	const char *sequenceCameraPath = NULL;
+	const char *sequenceOutputPattern = NULL;
+	uint32_t sequenceNumOfFrames = 0;
+	const char *sceneFilePath = NULL;
+	const char *compileSceneSourcePath = NULL;
+	const char *compileSceneOutputPath = NULL;
+	const char *convertTextureImagePath = NULL;
+	const char *convertTextureOutputPath = NULL;
+
+	for (int arg = 1; arg < argc; arg++) {
+		if (strcmp(argv[arg], "--worker") == 0 && arg + 1 < argc) {
+			distributedWorkerHost = argv[++arg];
+		}
+		else if (strcmp(argv[arg], "--coordinator") == 0) {
+			runAsCoordinator = true;
+		}
+		else if (strcmp(argv[arg], "--output") == 0 && arg + 1 < argc) {
+			outputImagePath = argv[++arg];
+		}
+		else if (strcmp(argv[arg], "--hdr-output") == 0 && arg + 1 < argc) {
+			outputHdrImagePath = argv[++arg];
+		}
+		else if (strcmp(argv[arg], "--poster") == 0 && arg + 3 < argc) {
+			posterWidthInPixels = (uint32_t)strtoul(argv[++arg], NULL, 10);
+			posterHeightInPixels = (uint32_t)strtoul(argv[++arg], NULL, 10);
+			posterImagePath = argv[++arg];
+		}
+		else if (strcmp(argv[arg], "--checkpoint") == 0 && arg + 1 < argc) {
+			checkpointPath = argv[++arg];
+		}
+		else if (strcmp(argv[arg], "--resume") == 0 && arg + 1 < argc) {
+			resumeCheckpointPath = argv[++arg];
+		}
+		else if (strcmp(argv[arg], "--sequence") == 0 && arg + 3 < argc) {
+			sequenceCameraPath = argv[++arg];
+			sequenceNumOfFrames = (uint32_t)strtoul(argv[++arg], NULL, 10);
+			sequenceOutputPattern = argv[++arg];
+		}
+		else if (strcmp(argv[arg], "--scene") == 0 && arg + 1 < argc) {
+			sceneFilePath = argv[++arg];
+		}
+		else if (strcmp(argv[arg], "--compile-scene") == 0 && arg + 2 < argc) {
+			compileSceneSourcePath = argv[++arg];
+			compileSceneOutputPath = argv[++arg];
+		}
+		else if (strcmp(argv[arg], "--convert-texture") == 0 && arg + 2 < argc) {
+			convertTextureImagePath = argv[++arg];
+			convertTextureOutputPath = argv[++arg];
+		}
+		else if (strcmp(argv[arg], "--daemon") == 0) {
+			daemonSocketPath = (arg + 1 < argc && argv[arg + 1][0] != '-') ? argv[++arg] : RENDER_DAEMON_SOCKET_PATH;
+		}
+	}
+
+	//stdout carries the frames, everything the render prints goes to stderr
+	bool streamToStandardOutput = sequenceOutputPattern != NULL && strcmp(sequenceOutputPattern, "-") == 0;
+	if (streamToStandardOutput) {
+		std::cout.rdbuf(std::cerr.rdbuf());
+	}
+
+	if (compileSceneSourcePath != NULL) {
+		return SceneFile::compile(compileSceneSourcePath, compileSceneOutputPath) != 0 ? 1 : 0;
+	}
+
+	if (convertTextureImagePath != NULL) {
+		return MipmapCache::convert(convertTextureImagePath, convertTextureOutputPath) != 0 ? 1 : 0;
+	}
 
 	//move the console window somewhere out of the way
 	HWND consoleWindowHandle = GetConsoleWindow();
@@ -80,22 +198,80 @@ int main() {
 
 	//Setup random number generator
 	timeSeed = std::chrono::high_resolution_clock::now().time_since_epoch().count();
-	std::seed_seq seedSequence{
-			uint32_t(timeSeed & 0xffffffff),
-			uint32_t(timeSeed >> 32)
-	};
 
-	randomNumberGenerator.seed(seedSequence);	
+	//a resumed render needs the seed it started with, for the scene and for the samples still to come
+	RenderCheckpointHeader resumeCheckpoint;
+	if (resumeCheckpointPath != NULL) {
+		if (!RenderCheckpoint::readHeader(resumeCheckpointPath, resumeCheckpoint)) {
+			return 1;
+		}
+		timeSeed = resumeCheckpoint.seed;
+	}
+	seedRandomNumberGenerator(timeSeed);
 	
+	//cores, SMT siblings and NUMA nodes, decides how many render threads to run and where
+	CpuTopology cpuTopology;
+
 #if DEBUG_RUN_THREADS > 0
 	int numOfRenderThreads = DEBUG_RUN_THREADS;
+#elif WORKER_AFFINITY_USE_SMT == 1
+	int numOfRenderThreads = cpuTopology.getNumOfLogicalCpus();
 #else
-	int numOfRenderThreads = std::thread::hardware_concurrency();	//DEBUG_RUN_THREADS;
+	int numOfRenderThreads = cpuTopology.getNumOfPhysicalCores();
+#endif
+
+	std::vector<uint32_t> renderThreadPlacement;
+	std::vector<int32_t> renderThreadNodes;
+
+#if WORKER_AFFINITY_EN == 1
+	if (cpuTopology.isDiscovered()) {
+		renderThreadPlacement = cpuTopology.getWorkerPlacement(numOfRenderThreads, WORKER_AFFINITY_USE_SMT == 1);
+
+		for (uint32_t cpu : renderThreadPlacement) {
+			renderThreadNodes.push_back(cpuTopology.getNodeOfCpu(cpu));
+		}
+	}
 #endif
 
 	DEBUG_MSG_L0("\t", "used hardware threads: " << numOfRenderThreads << "\n");
 
-	std::cout << "Threads: " << numOfRenderThreads << "\n";
+	std::cout << "Threads: " << numOfRenderThreads << " (cores: " << cpuTopology.getNumOfPhysicalCores() << " logical: " << cpuTopology.getNumOfLogicalCpus() << " nodes: " << cpuTopology.getNumOfNodes() << (renderThreadPlacement.empty() ? ", unpinned" : ", pinned") << ")\n";
+
+	//worker process, no window or render loop, just trace whatever tiles the coordinator sends until it says bye
+	if (distributedWorkerHost != NULL) {
+		DistributedWorker distributedWorker(numOfRenderThreads, renderThreadPlacement);
+
+		if (!distributedWorker.connect(distributedWorkerHost, DISTRIBUTED_PORT)) {
+			return 1;
+		}
+
+		//same seed, same scene as the coordinator
+		seedRandomNumberGenerator(distributedWorker.getSeed());
+
+		EmitterRegistry workerEmitters;
+		Hitable *workerWorld = buildScene(distributedWorker.getSceneId(), &workerEmitters);
+
+		std::cout << "Tracing tiles for " << distributedWorkerHost << ":" << DISTRIBUTED_PORT << "\n";
+		distributedWorker.serve(workerWorld, &workerEmitters);
+
+		return 0;
+	}
+
+	//daemon process, the render threads and every scene asked for stay up until a client sends SHUTDOWN
+	if (daemonSocketPath != NULL) {
+		Renderer daemonRenderer(numOfRenderThreads, renderThreadPlacement, renderThreadNodes);
+		RenderDaemon renderDaemon(daemonRenderer, buildScene);
+
+		if (!renderDaemon.start(daemonSocketPath)) {
+			return 1;
+		}
+
+		std::cout << "Render daemon listening on " << daemonSocketPath << "\n";
+		renderDaemon.waitForShutdown();
+		renderDaemon.stop();
+
+		return 0;
+	}
 
 	WINDIBBitmap winDIBBmp;
 	RenderProperties renderProps;
@@ -103,7 +279,7 @@ int main() {
 	configureScene(renderProps);
 
 	renderProps.bytesPerPixel = (winDIBBmp.getBitsPerPixel() / 8);
-	renderProps.finalImageBufferSizeInBytes = renderProps.resWidthInPixels * renderProps.resHeightInPixels * renderProps.bytesPerPixel;
+	renderProps.finalImageBufferSizeInBytes = (uint64_t)renderProps.resWidthInPixels * renderProps.resHeightInPixels * renderProps.bytesPerPixel;
 	
 	/* See camera for reference frame explanation*/
 
@@ -126,15 +302,100 @@ int main() {
 
 	// TODO: drowan(20190607) - should I make a way to select this programatically?
 #if OUTPUT_RANDOM_SCENE == 1
-	//random scene	
+	uint32_t sceneId = SCENE_ID_RANDOM;
+#else
+	uint32_t sceneId = SCENE_ID_CORNELL_BOX;
+#endif
+
+	//lights registered by the scene so they can be sampled directly
+	EmitterRegistry sceneEmitters;
 
 	//world bundles all the hitables and provides a generic way to call hit recursively in color (it's hit calls all the objects hits)
-	Hitable *world = new Translate(randomScene_NED(), vec3(0, 0, 1000));
-#else
-	//cornell box		
+	Hitable *world = NULL;
 
-	Hitable *world = new Translate(cornellBox_NED(), vec3(800, 0, 0));
-#endif
+	//a scene file lives as long as main, its objects are in its arena
+	SceneFile sceneFile;
+	//a built in scene is owned here instead, world only borrows from one of the two
+	std::unique_ptr<Hitable> builtInWorld;
+
+	if (sceneFilePath != NULL) {
+		bool loaded = SceneFile::isCompiledScenePath(sceneFilePath) ? sceneFile.load(sceneFilePath) : sceneFile.loadSource(sceneFilePath);
+		if (loaded) {
+			world = sceneFile.build(&sceneEmitters);
+		}
+		if (world == NULL) {
+			return 1;
+		}
+		sceneEmitters.build();
+
+		//checkpoints only resume on the same scene file contents
+		sceneId = (uint32_t)sceneFile.getSourceHash();
+	}
+	else {
+		builtInWorld.reset(buildScene(sceneId, &sceneEmitters));
+		world = builtInWorld.get();
+	}
+
+	std::cout << "Emitters: " << sceneEmitters.size() << "\n";
+
+	//poster, never allocates anything image sized, no window either
+	if (posterImagePath != NULL) {
+		float posterAspectRatio = posterHeightInPixels > 0 ? float(posterWidthInPixels) / float(posterHeightInPixels) : aspectRatio;
+		Camera posterCamera(lookFrom, lookAt, worldUp, vFoV, posterAspectRatio, aperture, distToFocus, 0.0, 1.0);
+
+		Renderer posterRenderer(numOfRenderThreads, renderThreadPlacement, renderThreadNodes);
+		OutOfCoreRenderer outOfCoreRenderer(posterRenderer);
+
+		SceneHandle posterScene = { world, &sceneEmitters };
+		RenderJob posterJob(posterScene, posterCamera, posterWidthInPixels, posterHeightInPixels, renderProps.antiAliasingSamplesPerPixel);
+		posterJob.seed = timeSeed;
+
+		std::cout << "Rendering " << posterWidthInPixels << "x" << posterHeightInPixels << " to " << posterImagePath << "...\n";
+		uint32_t failed = outOfCoreRenderer.renderToFile(posterJob, posterImagePath);
+
+		const OutOfCoreRenderStats &posterStats = outOfCoreRenderer.getLastStats();
+		std::cout << "Poster (ms): " << posterStats.renderTimeMs << " writing: " << posterStats.writeTimeMs << " bands: " << posterStats.numOfBands
+			<< " resident (MB): " << posterStats.residentBytes / (1024 * 1024) << " samples/s: " << posterStats.samplesPerSecond << "\n";
+
+		return failed != 0 ? 1 : 0;
+	}
+
+	//sequence, the scene is built once above and every frame renders it
+	if (sequenceCameraPath != NULL) {
+		CameraPath cameraPath(aperture, distToFocus, worldUp);
+		if (!cameraPath.load(sequenceCameraPath, vFoV)) {
+			return 1;
+		}
+
+		Renderer sequenceRenderer(numOfRenderThreads, renderThreadPlacement, renderThreadNodes);
+		ImageWriterPool writerPool;
+		SequenceRenderer sequence(sequenceRenderer, writerPool);
+
+		SceneHandle sequenceScene = { world, &sceneEmitters };
+		RenderJob sequenceJob(sequenceScene, mainCamera, renderProps.resWidthInPixels, renderProps.resHeightInPixels, renderProps.antiAliasingSamplesPerPixel);
+		sequenceJob.seed = timeSeed;
+
+		std::cout << "Rendering " << sequenceNumOfFrames << " frames of " << sequenceCameraPath << " to " << sequenceOutputPattern << "...\n";
+		uint32_t failed = 0;
+
+		if (frameStreamFormatFromPath(sequenceOutputPattern) != FRAME_STREAM_FORMAT_UNKNOWN) {
+			FrameStream frameStream;
+			if (!frameStream.open(sequenceOutputPattern, renderProps.resWidthInPixels, renderProps.resHeightInPixels)) {
+				return 1;
+			}
+			failed = sequence.renderSequence(sequenceJob, cameraPath, sequenceNumOfFrames, frameStream);
+			failed |= frameStream.close() ? 0 : 1;
+		}
+		else {
+			failed = sequence.renderSequence(sequenceJob, cameraPath, sequenceNumOfFrames, sequenceOutputPattern);
+		}
+
+		const SequenceRenderStats &sequenceStats = sequence.getLastStats();
+		std::cout << "Sequence (ms): " << sequenceStats.renderTimeMs << " frames/s: " << sequenceStats.framesPerSecond << " frames in flight: " << sequenceStats.framesInFlight
+			<< " blocked on output (ms): " << sequenceStats.outputBlockedMs << "\n";
+
+		return failed != 0 ? 1 : 0;
+	}
 
 	// Each thread will have a handle to this shared buffer but will access the memory with a thread specific memory offset which will hopefully mitigate concurrent access issues.
 	std::shared_ptr<WorkerImageBuffer> workerImageBufferStruct(new WorkerImageBuffer);
@@ -142,11 +403,62 @@ int main() {
 	//figure out how many rows each thread is going to work on
 	workerImageBufferStruct->resHeightInPixels = renderProps.resHeightInPixels;
 	workerImageBufferStruct->resWidthInPixels = renderProps.resWidthInPixels;
-	workerImageBufferStruct->sizeInBytes = workerImageBufferStruct->resHeightInPixels * workerImageBufferStruct->resWidthInPixels * renderProps.bytesPerPixel;
+	workerImageBufferStruct->sizeInBytes = (uint64_t)workerImageBufferStruct->resHeightInPixels * workerImageBufferStruct->resWidthInPixels * renderProps.bytesPerPixel;
+
+	//the workers draw into one of three byte buffers, finished frames go through the mailbox to the bitblit thread
+	std::shared_ptr<FrameMailbox> frameMailbox(new FrameMailbox(workerImageBufferStruct->sizeInBytes));
 
-	std::shared_ptr<uint8_t> _workingImageBuffer(new uint8_t[workerImageBufferStruct->sizeInBytes]);
+	workerImageBufferStruct->buffer = frameMailbox->getRenderBuffer();
+
+	//float sums the workers add to every pass, the byte buffer above is just the resolved view of it
+	std::shared_ptr<AccumulationBuffer> accumulationBuffer(new AccumulationBuffer(renderProps.resWidthInPixels, renderProps.resHeightInPixels));
+	accumulationBuffer->reset(mainCamera.getViewGeneration());
+#if ADAPTIVE_SAMPLING_EN == 1
+	accumulationBuffer->configureAdaptiveSampling(ADAPTIVE_SAMPLING_MIN_SAMPLES, ADAPTIVE_SAMPLING_MAX_SAMPLES, ADAPTIVE_SAMPLING_ERROR_THRESHOLD);
+#endif
 
-	workerImageBufferStruct->buffer = std::move(_workingImageBuffer);
+	//what decides the samples besides the sums, saved with every checkpoint and checked against the one being resumed
+	RenderCheckpointHeader checkpointSettings;
+	memset(&checkpointSettings, 0, sizeof(checkpointSettings));
+	checkpointSettings.resWidthInPixels = renderProps.resWidthInPixels;
+	checkpointSettings.resHeightInPixels = renderProps.resHeightInPixels;
+	checkpointSettings.sceneId = sceneId;
+	checkpointSettings.seed = timeSeed;
+	checkpointSettings.samplesPerPass = renderProps.samplesPerFrame;
+	checkpointSettings.tileSizeInPixels = TILE_SIZE_IN_PIXELS;
+#if ADAPTIVE_SAMPLING_EN == 1
+	checkpointSettings.batchSize = ADAPTIVE_SAMPLING_BATCH;
+#endif
+
+	//the view that was checkpointed and then its sums, the render loop goes on from its pass count
+	if (resumeCheckpointPath != NULL) {
+		if (!RenderCheckpoint::isCompatible(resumeCheckpoint, checkpointSettings)) {
+			return 1;
+		}
+		mainCamera.setRayState(resumeCheckpoint.cameraRayState);
+
+		if (!RenderCheckpoint::restore(resumeCheckpointPath, *accumulationBuffer, mainCamera.getViewGeneration())) {
+			return 1;
+		}
+		std::cout << "Resuming " << resumeCheckpointPath << " at pass " << accumulationBuffer->getPassCount() << "\n";
+	}
+
+	//first hit depth/normal/albedo/ids/time, reset together with the accumulation buffer
+	uint32_t aovChannels = AOV_CHANNELS;
+#if DENOISER_EN == 1
+	aovChannels |= AOV_FLAG_DEPTH | AOV_FLAG_NORMAL | AOV_FLAG_ALBEDO;
+#endif
+	std::shared_ptr<AOVFramebuffer> aovFramebuffer(new AOVFramebuffer(renderProps.resWidthInPixels, renderProps.resHeightInPixels, aovChannels));
+
+	//workers pull tiles from here instead of owning fixed columns, refilled before every pass
+	std::shared_ptr<TileScheduler> tileScheduler(new TileScheduler(numOfRenderThreads, renderProps.resWidthInPixels, renderProps.resHeightInPixels, TILE_SIZE_IN_PIXELS));
+	tileScheduler->setWorkerNodes(renderThreadNodes);
+	tileScheduler->beginFrame(mainCamera.getViewGeneration());
+
+#if DENOISER_EN == 1
+	ATrousDenoiser denoiser(renderProps.resWidthInPixels, renderProps.resHeightInPixels, DENOISER_ITERATIONS);
+	denoiser.setSigmas(DENOISER_COLOR_SIGMA, DENOISER_NORMAL_SIGMA, DENOISER_DEPTH_SIGMA);
+#endif
 
 #pragma region Init_Threads	
 	//gui
@@ -171,27 +483,41 @@ int main() {
 	bitBlitWorkerThread->start = false;
 	bitBlitWorkerThread->continueWork = false;
 	bitBlitWorkerThread->exit = false;
-	bitBlitWorkerThread->handle = std::thread(bitBlitWorkerProcedure, bitBlitWorkerThread, workerImageBufferStruct, renderProps);
+	bitBlitWorkerThread->handle = std::thread(bitBlitWorkerProcedure, bitBlitWorkerThread, frameMailbox, renderProps);
 #endif
 
-	//render
-	std::vector<std::shared_ptr<WorkerImageBuffer>> workerImageBufferVector;
-	std::vector<std::shared_ptr<WorkerThread>> workerThreadVector;
-	std::shared_ptr<uint8_t> finalImageBuffer(new uint8_t[renderProps.finalImageBufferSizeInBytes]);
+	//render, the threads stay parked in the pool until the first frame is submitted
+	std::shared_ptr<uint8_t> finalImageBuffer(new uint8_t[(size_t)renderProps.finalImageBufferSizeInBytes]);
+
+	RenderThreadPool renderThreadPool(numOfRenderThreads, renderThreadPlacement);
+
+	//the workers trace with a copy of the camera taken when the frame is submitted, input can move mainCamera at any time
+	Camera renderCamera = mainCamera;
+
+	//the same job every frame, each pool thread pulls tiles until the scheduler runs dry
+	RenderThreadPool::FrameJob renderFrameJob = [&](uint32_t workerId) {
+		raytraceWorkerProcedure(workerId, workerImageBufferStruct, accumulationBuffer, aovFramebuffer, tileScheduler, renderProps, &renderCamera, world, &sceneEmitters);
+	};
+
+	//coordinator, only the first frame is distributed: the workers and the local render threads share its tiles and trace the full
+	//AA budget into the accumulation buffer, then the local threads keep refining it on their own like any other run.
+	//A resumed render already has that frame. The workers build scenes by id, so a scene file renders locally.
+	if (runAsCoordinator && resumeCheckpointPath == NULL && sceneFilePath == NULL) {
+		DistributedCoordinator distributedCoordinator(sceneId, timeSeed, renderProps.resWidthInPixels, renderProps.resHeightInPixels);
 
-	for (uint32_t i = 0; i < numOfRenderThreads; i++) {
+		if (distributedCoordinator.start(DISTRIBUTED_PORT)) {
+			std::cout << "Waiting for workers on port " << DISTRIBUTED_PORT << "...\n";
+			distributedCoordinator.waitForWorkers(DISTRIBUTED_MIN_WORKERS, std::chrono::milliseconds(DISTRIBUTED_WAIT_FOR_WORKERS_MS));
 
-		std::shared_ptr<WorkerThread> workerThread(new WorkerThread);
+			auto distributedStartTime = std::chrono::high_resolution_clock::now();
+			uint32_t tilesLeft = distributedCoordinator.renderFrame(mainCamera, renderProps.antiAliasingSamplesPerPixel, *accumulationBuffer, &renderThreadPool, world, &sceneEmitters);
+			std::chrono::duration<float, std::milli> distributedTime = std::chrono::high_resolution_clock::now() - distributedStartTime;
 
-		workerThread->id = i;
-		workerThread->workIsDone = false;
-		workerThread->start = false;
-		workerThread->continueWork = false;
-		workerThread->exit = false;
-		workerThread->handle = std::thread(raytraceWorkerProcedure, workerThread, workerImageBufferStruct, renderProps, &mainCamera, world);
-		workerThread->configuredMaxThreads = numOfRenderThreads;
+			std::cout << "Distributed frame (ms): " << distributedTime.count() << " workers: " << distributedCoordinator.getNumOfWorkers() << " tiles left: " << tilesLeft << "\n";
 
-		workerThreadVector.push_back(workerThread);
+			//the workers traced it as pass 0, the local passes go on from 1
+			accumulationBuffer->passCompleted();
+		}
 	}
 
 #pragma endregion Init_Threads
@@ -209,12 +535,7 @@ int main() {
 #endif
 
 	//render
-	for (std::shared_ptr<WorkerThread> &thread : workerThreadVector) {
-		std::unique_lock<std::mutex> startLock(thread->startMutex);
-		thread->start = true;
-		thread->startConditionVar.notify_all();
-		startLock.unlock();
-	}
+	renderThreadPool.submitFrame(renderFrameJob);
 	
 	//bitblit
 #if ENABLE_BITBLIT == 1
@@ -244,18 +565,110 @@ int main() {
 	double angleRadiansRotateAboutRollAxis = 0.0;
 	double angleRadiansRotateAboutPitchAxis = 0.0;
 
+	auto lastCheckpointTime = std::chrono::high_resolution_clock::now();
+
+	//the newest finished frame, this is what gets saved at the end. publish() hands back an older buffer to draw into
+	std::shared_ptr<uint8_t> lastPublishedBuffer;
+
+	//the raw mouse/key state the camera was last moved with, a change while a frame renders cancels it
+#if defined ENABLE_MOUSE_CONTROLS && ENABLE_MOUSE_CONTROLS == 1
+	int appliedMouseX = 0, appliedMouseY = 0;
+#endif
+#if defined ENABLE_KEYBOARD_CONTROLS && ENABLE_KEYBOARD_CONTROLS == 1
+	GUIControlInputs appliedControlInputs;
+#endif
+
+	auto hasInputChanged = [&]() -> bool {
+		bool changed = false;
+#if defined ENABLE_MOUSE_CONTROLS && ENABLE_MOUSE_CONTROLS == 1
+		int mouseX = 0, mouseY = 0;
+		getMouseCoord(mouseX, mouseY);
+		changed |= (mouseX != appliedMouseX || mouseY != appliedMouseY);
+#endif
+#if defined ENABLE_KEYBOARD_CONTROLS && ENABLE_KEYBOARD_CONTROLS == 1
+		GUIControlInputs controlInputs;
+		getGUIControlInputs(controlInputs);
+		changed |= (controlInputs.forwardAsserted != appliedControlInputs.forwardAsserted ||
+			controlInputs.reverseAsserted != appliedControlInputs.reverseAsserted ||
+			controlInputs.leftAsserted != appliedControlInputs.leftAsserted ||
+			controlInputs.rightAsserted != appliedControlInputs.rightAsserted ||
+			controlInputs.spaceAsserted != appliedControlInputs.spaceAsserted ||
+			controlInputs.leftShiftAsserted != appliedControlInputs.leftShiftAsserted);
+#endif
+		return changed;
+	};
+
 	for (int i = 0; i < 10000; i++) {
 
+		//wait for the frame submitted last time around
+		//the pool only reports done once every tile of the pass is gone, idle threads steal instead of waiting here.
+		//The camera input further down is applied once per submitted frame, while waiting only look for something that
+		//should cancel this one: the window closing or the mouse/keys changing. The workers drop out after their current tile
+		while (!renderThreadPool.waitForFrameFor(std::chrono::milliseconds(INPUT_POLL_INTERVAL_MS))) {
+			//already cancelled, just let it drain
+			if (tileScheduler->isFrameCancelled()) {
+				continue;
+			}
+
+			if (!checkIfGuiIsRunning() || hasInputChanged()) {
+				tileScheduler->requestGeneration(tileScheduler->getFrameGeneration() + 1);
+			}
+		}
+
 		//check if the gui is running
 		if (!checkIfGuiIsRunning()) {
 			break;
 		}
 
+		//a cancelled frame is only partly traced with a view that is already stale, don't show it or count it
+		bool frameCancelled = tileScheduler->isFrameCancelled();
+		if (!frameCancelled) {
+#if DENOISER_EN == 1
+			//post stage, the workers only accumulated floats this pass and the denoiser produces the displayed bytes
+			denoiser.denoise(*accumulationBuffer, *aovFramebuffer, renderThreadPool);
+
+			for (uint32_t row = 0; row < renderProps.resHeightInPixels; row++) {
+				for (uint32_t column = 0; column < renderProps.resWidthInPixels; column++) {
+					writeColorToImageBuffer(workerImageBufferStruct, renderProps, row, column, denoiser.getPixel(row * renderProps.resWidthInPixels + column));
+				}
+			}
+
+#if DENOISER_REPORT_TIME == 1
+			std::cout << "denoise (ms): " << denoiser.getLastDenoiseTimeMs() << "\n";
+#endif
+#endif
+
+			//hand the finished frame to the bitblit thread and keep going on whatever buffer comes back, it never waits on the blit
+			lastPublishedBuffer = workerImageBufferStruct->buffer;
+			workerImageBufferStruct->buffer = frameMailbox->publish();
+
+			//all render workers are parked here so the accumulation buffer can be touched safely
+			accumulationBuffer->passCompleted();
+
+			DEBUG_MSG_L0(__func__, "pass " << accumulationBuffer->getPassCount() << " converged pixels: " << accumulationBuffer->countConvergedPixels());
+
+#if PROGRESSIVE_RENDER_EN == 1
+			//still parked, and the sums are exactly passCount whole passes of renderCamera's view
+			if (checkpointPath != NULL && std::chrono::high_resolution_clock::now() - lastCheckpointTime >= std::chrono::milliseconds(CHECKPOINT_INTERVAL_MS)) {
+				auto checkpointStartTime = std::chrono::high_resolution_clock::now();
+
+				renderCamera.getRayState(checkpointSettings.cameraRayState);
+				if (RenderCheckpoint::write(checkpointPath, checkpointSettings, *accumulationBuffer) == 0) {
+					std::chrono::duration<float, std::milli> checkpointTime = std::chrono::high_resolution_clock::now() - checkpointStartTime;
+					std::cout << "Checkpoint at pass " << accumulationBuffer->getPassCount() << " (ms): " << checkpointTime.count() << "\n";
+				}
+				lastCheckpointTime = std::chrono::high_resolution_clock::now();
+			}
+#endif
+		}
+
 #if defined ENABLE_MOUSE_CONTROLS && ENABLE_MOUSE_CONTROLS == 1
 
 		//get the current mouse position
 		int xCartesian = 0, yCartesian = 0;
 		getMouseCoord(xCartesian, yCartesian);
+		appliedMouseX = xCartesian;
+		appliedMouseY = yCartesian;
 		//std::cout << "xCart,yCart (" << xCartesian << "," << yCartesian << ")\n";
 
 		//look into this:
@@ -564,6 +977,7 @@ int main() {
 		//check some keys
 		GUIControlInputs guiControlInputs;
 		getGUIControlInputs(guiControlInputs);
+		appliedControlInputs = guiControlInputs;
 
 		/*
 		drowan_DEBUG_20200102: very crude WASD control. Basically "flying no clip" like movement.
@@ -645,90 +1059,38 @@ int main() {
 
 #pragma region Manage_Threads
 	
-		//check if render is done
-		//TODO: Waiting for done here may effectively limit performance to the slowest thread...
-		for (std::shared_ptr<WorkerThread> &thread : workerThreadVector) {
-
-			std::unique_lock<std::mutex> doneLock(thread->workIsDoneMutex);			
-			while (!thread->workIsDone) {
-				thread->workIsDoneConditionVar.wait(doneLock);				
-			}
-			//reset the workIsDone indicator to acknowledge
-			thread->workIsDone = false;
-			doneLock.unlock();			
-		}
-
-		//bitblit
-#if ENABLE_BITBLIT == 1		
-		std::unique_lock<std::mutex> bitBlitContinueLock(bitBlitWorkerThread->continueWorkMutex);
-		bitBlitWorkerThread->continueWork = true;
-		bitBlitWorkerThread->continueWorkConditionVar.notify_all();
-		bitBlitContinueLock.unlock();
-		//bitBlitWorkerThread->continueWorkConditionVar.notify_all();
-
-		std::unique_lock<std::mutex> bitBlitDoneLock(bitBlitWorkerThread->workIsDoneMutex);
-		while (!bitBlitWorkerThread->workIsDone) {
-			bitBlitWorkerThread->workIsDoneConditionVar.wait(bitBlitDoneLock);
+#if PROGRESSIVE_RENDER_EN == 1
+		//a cancelled pass left part of its samples in the sums without being counted, and the pass number gets traced again
+		//with the same tile seeds. Input that cancelled it doesn't always move the camera (a key release), so drop the
+		//partial pass either way, the sums can't be rolled back by one pass so the accumulation starts over
+		if (frameCancelled || accumulationBuffer->getViewGeneration() != mainCamera.getViewGeneration()) {
+			accumulationBuffer->reset(mainCamera.getViewGeneration());
+			aovFramebuffer->reset();
 		}
-		//reset the workdIsDone indicator to acknowledge
-		bitBlitWorkerThread->workIsDone = false;
-		bitBlitDoneLock.unlock();
+#else
+		accumulationBuffer->reset(mainCamera.getViewGeneration());
+		aovFramebuffer->reset();
 #endif
 		
-		//start the render threads again
-		for (std::shared_ptr<WorkerThread> &thread : workerThreadVector) {
+		renderCamera = mainCamera;
+		tileScheduler->beginFrame(renderCamera.getViewGeneration());
 
-			std::unique_lock<std::mutex> continueLock(thread->continueWorkMutex);
-			thread->continueWork = true;
-			thread->continueWorkConditionVar.notify_all();
-			continueLock.unlock();
-			//thread->continueWorkConditionVar.notify_all();
-		}
+		//start the render threads again
+		renderThreadPool.submitFrame(renderFrameJob);
 	}
 	//END OF RENDER LOOP
 
 #pragma endregion Manage_Threads
 
 #pragma region Stop_Threads
-	//gui
-	//wait for the threads
-	for (std::shared_ptr<WorkerThread> &thread : workerThreadVector) {
-		
-		std::unique_lock<std::mutex> doneLock(thread->workIsDoneMutex);
-		while (!thread->workIsDone) {
-			thread->workIsDoneConditionVar.wait(doneLock);			
-		}		
-		doneLock.unlock();		
-
-		std::unique_lock<std::mutex> continueLock(thread->continueWorkMutex);
-		thread->continueWork = false;
-		thread->continueWorkConditionVar.notify_all();		
-		continueLock.unlock();		
-	}
-
-	//join threads
-	for (std::shared_ptr<WorkerThread> &thread : workerThreadVector) {
-		//signal to the thread to exit		
-
-		std::unique_lock<std::mutex> threadExitLock(thread->exitMutex);
-		thread->exit = true;
-		thread->exitConditionVar.notify_all();
-		threadExitLock.unlock();
-
-		while(!thread->handle.joinable()) {
-			//sit and spin
-		}
-		thread->handle.join();		
-	}
+	//render, lets the frame in flight finish and joins the pool threads
+	renderThreadPool.shutdown();
 
 	//bitblit
 #if ENABLE_BITBLIT == 1
 	//exit the bitblit thread
-	std::unique_lock<std::mutex> bitBlitContinueLock(bitBlitWorkerThread->continueWorkMutex);
-	bitBlitWorkerThread->continueWork = false;
-	bitBlitWorkerThread->continueWorkConditionVar.notify_all();
-	bitBlitContinueLock.unlock();
-	
+	frameMailbox->close();
+
 	std::unique_lock<std::mutex> bitBlitDoneLock(bitBlitWorkerThread->workIsDoneMutex);
 	while (!bitBlitWorkerThread->workIsDone) {		
 		bitBlitWorkerThread->workIsDoneConditionVar.wait(bitBlitDoneLock);
@@ -768,12 +1130,31 @@ int main() {
 
 #pragma endregion Stop_Threads
 
-#if OUTPUT_BMP_EN == 1
-	std::cout << "Writing to bmp file...\n";
+	if (OUTPUT_BMP_EN == 1 || outputImagePath != NULL) {
+		std::string imagePath = outputImagePath != NULL ? outputImagePath : OUTPUT_IMAGE_PATH;
+		std::cout << "Writing " << imagePath << "...\n";
+
+		//nothing published means the loop ended before a frame finished, the render buffer is all there is then
+		std::shared_ptr<uint8_t> imageBuffer = lastPublishedBuffer ? lastPublishedBuffer : workerImageBufferStruct->buffer;
+
+		ImageWriter::write(imagePath, imageBuffer.get(), renderProps.resWidthInPixels, renderProps.resHeightInPixels, renderProps.bytesPerPixel);
+	}
+
+	//the render threads are joined, nothing is accumulating anymore
+	if (OUTPUT_HDR_EN == 1 || outputHdrImagePath != NULL) {
+		std::string hdrImagePath = outputHdrImagePath != NULL ? outputHdrImagePath : OUTPUT_HDR_IMAGE_PATH;
+		std::cout << "Writing " << hdrImagePath << "...\n";
 
-	winDIBBmp.writeBMPToFile(workerImageBufferStruct->buffer.get(), renderProps.finalImageBufferSizeInBytes, renderProps.resWidthInPixels, renderProps.resHeightInPixels, BMP_BITS_PER_PIXEL);
+		HdrImageWriter::write(hdrImagePath, *accumulationBuffer);
+	}
+
+#if AOV_OUTPUT_EN == 1
+	std::cout << "Writing AOVs...\n";
+
+	//in PROGRESSIVE mode the buffers were last reset only if the view changed, so they hold what the image shows
+	aovFramebuffer->writeToFiles("test");
+#endif
 
-#endif	
 
 	// drowan(20190607) BUG: For some reason if the rendered scene is small (10x10 pixels) it crashes?
 	std::cout << "Hit any key to exit...";
@@ -781,16 +1162,33 @@ int main() {
 	//std::cin.ignore(INT_MAX, '\n');
 	std::cin.get();
 
-	delete[] world;
-
 	return 0;
 }
 
+//expects a freshly seeded RNG, the distributed workers rebuild the coordinator's scene by calling this with its seed
+Hitable *buildScene(uint32_t sceneId, EmitterRegistry *emitterRegistry) {
+	Hitable *world = NULL;
+
+	if (sceneId == SCENE_ID_RANDOM) {
+		world = new Translate(randomScene_NED(emitterRegistry), vec3(0, 0, 1000));
+		emitterRegistry->translateEmitters(vec3(0, 0, 1000));
+	}
+	else {
+		world = new Translate(cornellBox_NED(emitterRegistry), vec3(800, 0, 0));
+		emitterRegistry->translateEmitters(vec3(800, 0, 0));
+	}
+
+	emitterRegistry->build();
+
+	return world;
+}
+
 void configureScene(RenderProperties &renderProps) {
 
 	renderProps.resHeightInPixels = DEFAULT_RENDER_HEIGHT;
 	renderProps.resWidthInPixels = DEFAULT_RENDER_WIDTH;
 	renderProps.antiAliasingSamplesPerPixel = DEFAULT_RENDER_AA;
+	renderProps.samplesPerFrame = PROGRESSIVE_SAMPLES_PER_FRAME;
 
 #if BYPASS_SCENE_CONFIG == 0
 	//ask for image dimensions
@@ -871,173 +1269,98 @@ void configureScene(RenderProperties &renderProps) {
 		}
 	}
 #endif
+
+#if PROGRESSIVE_RENDER_EN == 0
+	renderProps.samplesPerFrame = renderProps.antiAliasingSamplesPerPixel;
+#endif
 }
 
 void raytraceWorkerProcedure(
-	std::shared_ptr<WorkerThread> workerThreadStruct,
+	uint32_t workerId,
 	std::shared_ptr<WorkerImageBuffer> workerImageBufferStruct,
-	RenderProperties renderProps,
+	std::shared_ptr<AccumulationBuffer> accumulationBuffer,
+	std::shared_ptr<AOVFramebuffer> aovFramebuffer,
+	std::shared_ptr<TileScheduler> tileScheduler,
+	const RenderProperties &renderProps,
 	Camera *sceneCamera,
-	Hitable *world
+	Hitable *world,
+	const EmitterRegistry *emitters
 ) {
+	//runs once per frame on every pool thread, the thread setup/teardown lives in RenderThreadPool
 
-	std::unique_lock<std::mutex> exitLock(workerThreadStruct->exitMutex);
-	exitLock.unlock();
-
-	std::unique_lock<std::mutex> continueLock(workerThreadStruct->continueWorkMutex);
-	continueLock.unlock();
-
-	std::unique_lock<std::mutex> coutLock(globalCoutGuard);
-	coutLock.unlock();
-
-	std::unique_lock<std::mutex> startLock(workerThreadStruct->startMutex);
-	while (!workerThreadStruct->start) {
-		workerThreadStruct->startConditionVar.wait(startLock, [workerThreadStruct] {return workerThreadStruct->start == true; });
-	}
-	startLock.unlock();
-
+#if DISPLAY_WINDOW == 1 && DEBUG_SET_PIXEL == 1
 	//DEBUG drowan(20190704): pretty sure this is not safe to have multiple threads accessing the canvas without a mutex
-	HDC hdcRayTraceWindow;
-
-	hdcRayTraceWindow = GetDC(raytraceMSWindowHandle);
-		
-
-	int numOfThreads = workerThreadStruct->configuredMaxThreads;
+	HDC hdcRayTraceWindow = GetDC(raytraceMSWindowHandle);
+#endif
 
-	DEBUG_MSG_L0(__func__, 
-		"worker " << workerThreadStruct->id <<
-		"\n\tHwnd: " << raytraceMSWindowHandle <<
-		"\n\tThread ID: " << workerThreadStruct->id <<
-		"\n\tLookat: " << sceneCamera->getLookAt() << 
-		"\n\tWorld hitable address:  " << world <<
-		"\n\tImage buffer address: " << &workerImageBufferStruct << 
-		" @[0]: " << workerImageBufferStruct->buffer.get()[0] << " Size in bytes: " << workerImageBufferStruct->sizeInBytes		
-	);
+	//the resolved colors of the tile being worked on, copied out to the shared byte buffer in one go when the tile is done
+	//kept per thread so the pool threads don't reallocate them every frame
+	uint32_t tileSizeInPixels = tileScheduler->getTileSizeInPixels();
+	static thread_local std::vector<vec3> tileColor;
+	tileColor.resize(tileSizeInPixels * tileSizeInPixels);
+
+	TileTraceContext context;
+	context.resWidthInPixels = workerImageBufferStruct->resWidthInPixels;
+	context.resHeightInPixels = workerImageBufferStruct->resHeightInPixels;
+	context.firstRow = 0;
+	context.samplesPerPass = renderProps.samplesPerFrame;
+	//the buffer only moves on to the next pass while the workers are parked
+	context.seed = timeSeed;
+	context.pass = accumulationBuffer->getPassCount();
+#if ADAPTIVE_SAMPLING_EN == 1
+	context.batchSize = ADAPTIVE_SAMPLING_BATCH;
+#else
+	context.batchSize = 0;
+#endif
+	context.camera = sceneCamera;
+	context.world = world;
+	context.emitters = emitters;
+	context.accumulationBuffer = accumulationBuffer.get();
+	context.aovFramebuffer = aovFramebuffer.get();
 
-	uint32_t rowOffsetInPixels = 0;
+#if RUN_RAY_TRACE == 1
+	RenderTile tile;
 
-	clock_t endWorkerTime = 0, startWorkerTime = 0;
+	//keep pulling tiles, first our own and then whatever the other workers haven't gotten to yet
+	while (tileScheduler->nextTile(workerId, tile)) {
 
-#if RUN_RAY_TRACE == 1
-	while (true) {
+		traceTile(tile, context, tileColor.data(), tileSizeInPixels);
 
-		/* # of Threads = 4
-		T1 (n + t*i):		0, 4, 8
-		T2 (n+1 + t*i):		1, 5, 9
-		T3 (n+2 + t*i):		2, 6, 10
-		T4 (n+3 + t*i):		3, 7, 11
-	*/		
-		startWorkerTime = clock();
-
-		for (int row = workerImageBufferStruct->resHeightInPixels - 1; row >= 0; row--) {
-			//for (int row = 0; row < workerImageBufferStruct->resHeightInPixels; row++) {
-			for (int i = 0; i < workerImageBufferStruct->resWidthInPixels; i++) {
-
-				int column = workerThreadStruct->id + numOfThreads * i;
-
-				if (column < workerImageBufferStruct->resWidthInPixels) {
-					vec3 outputColor(0, 0, 0);
-					//loop to produce AA samples
-					for (int sample = 0; sample < renderProps.antiAliasingSamplesPerPixel; sample++) {
-
-						float u = (float)(column + unifRand(randomNumberGenerator)) / (float)workerImageBufferStruct->resWidthInPixels;
-						float v = (float)(row + unifRand(randomNumberGenerator)) / (float)workerImageBufferStruct->resHeightInPixels;
-
-						//A, the origin of the ray (camera)
-						//rayCast stores a ray projected from the camera as it points into the scene that is swept across the uv "picture" frame.
-						ray rayCast = sceneCamera->getRay(u, v);
-
-						//NOTE: not sure about magic number 2.0 in relation with my tweaks to the viewport frame
-						vec3 pointAt = rayCast.pointAtParameter(2.0);
-						outputColor += color(rayCast, world, 0);
-					}
-
-					outputColor /= float(renderProps.antiAliasingSamplesPerPixel);
-					outputColor = vec3(sqrt(outputColor[0]), sqrt(outputColor[1]), sqrt(outputColor[2]));
-					// drowan(20190602): This seems to perform a modulo remap of the value. 362 becomes 106 maybe remap to 255? Does not seem to work right.
-					// Probably related to me outputing to bitmap instead of the ppm format...
-					uint8_t ir = 0;
-					uint8_t ig = 0;
-					uint8_t ib = 0;
-
-					uint16_t irO = uint16_t(255.99 * outputColor[0]);
-					uint16_t igO = uint16_t(255.99 * outputColor[1]);
-					uint16_t ibO = uint16_t(255.99 * outputColor[2]);
-
-					// cap the values to 255 max
-					(irO > 255) ? ir = 255 : ir = uint8_t(irO);
-					(igO > 255) ? ig = 255 : ig = uint8_t(igO);
-					(ibO > 255) ? ib = 255 : ib = uint8_t(ibO);
-
-					//Seems OK with multiple thread access. Or at least can't see any obvious issues.
-					// Look into replacing this since it is pretty slow:
-					// https://stackoverflow.com/questions/26005744/how-to-display-pixels-on-screen-directly-from-a-raw-array-of-rgb-values-faster-t
+		//Seems OK with multiple thread access. Or at least can't see any obvious issues.
+		// Look into replacing this since it is pretty slow:
+		// https://stackoverflow.com/questions/26005744/how-to-display-pixels-on-screen-directly-from-a-raw-array-of-rgb-values-faster-t
 #if DISPLAY_WINDOW == 1 && DEBUG_SET_PIXEL == 1
+		for (uint32_t row = tile.rowStart; row < tile.rowEnd; row++) {
+			for (uint32_t column = tile.columnStart; column < tile.columnEnd; column++) {
+				vec3 outputColor = tileColor[(row - tile.rowStart) * tileSizeInPixels + (column - tile.columnStart)];
+
 				//SetPixel is really slow on my laptop. Maybe GPU bound as CPU only loads to ~40%. Without it, can reach 100%
 				//For WinAPI look into Lockbits
-				SetPixel(hdcRayTraceWindow, column, renderProps.resHeightInPixels - row, RGB(ir, ig, ib));				
-#endif
-
-#if 1			
-					uint32_t rowIndex = row * renderProps.resWidthInPixels * renderProps.bytesPerPixel;
-					uint32_t columnIndex = (renderProps.resWidthInPixels * renderProps.bytesPerPixel) - column * renderProps.bytesPerPixel;
-					uint32_t bufferIndex = workerImageBufferStruct->sizeInBytes - (rowIndex + columnIndex);
-					workerImageBufferStruct->buffer.get()[bufferIndex] = ib;
-					workerImageBufferStruct->buffer.get()[bufferIndex + 1] = ig;
-					workerImageBufferStruct->buffer.get()[bufferIndex + 2] = ir;
-					//alpha channel for now is just 0
-					workerImageBufferStruct->buffer.get()[bufferIndex + 3] = 0;
-#endif
-				}
-				else {
-					break;
-				}
+				SetPixel(hdcRayTraceWindow, column, renderProps.resHeightInPixels - row, RGB(uint8_t(255.99 * sqrt(outputColor[0])), uint8_t(255.99 * sqrt(outputColor[1])), uint8_t(255.99 * sqrt(outputColor[2]))));
 			}
 		}
+#endif
 
-		clock_t workerProcessTime = clock() - startWorkerTime;
-
-		//DEBUG_MSG_L0(__func__, "worker " << workerThreadStruct->id << " proc time (sec): " << (float)workerProcessTime/CLOCKS_PER_SEC);
-
-		//DEBUG_MSG_L0(__func__, "worker " << workerThreadStruct->id << " signaling done!");
-		//indicate that ray tracing is complete	
-		std::unique_lock<std::mutex> doneLock(workerThreadStruct->workIsDoneMutex);
-		workerThreadStruct->workIsDone = true;
-		workerThreadStruct->workIsDoneConditionVar.notify_all();
-		doneLock.unlock();		
+#if DENOISER_EN == 0
+		for (uint32_t row = tile.rowStart; row < tile.rowEnd; row++) {
+			for (uint32_t column = tile.columnStart; column < tile.columnEnd; column++) {
+				uint32_t tilePixelIndex = (row - tile.rowStart) * tileSizeInPixels + (column - tile.columnStart);
 
-		//check if we need to continue rendering
-		//DEBUG_MSG_L0(__func__, "worker " << workerThreadStruct->id << " waiting for continue notice");
-		continueLock.lock();
-		workerThreadStruct->continueWorkConditionVar.wait(continueLock);
-		
-		if (workerThreadStruct->continueWork) {
-			//continue
-			continueLock.unlock();
-			//DEBUG_MSG_L0(__func__, "worker " << workerThreadStruct->id << " got continue notice...");
+				writeColorToImageBuffer(workerImageBufferStruct, renderProps, row, column, tileColor[tilePixelIndex]);
+			}
 		}
-		else {
-			continueLock.unlock();
-			//DEBUG_MSG_L0(__func__, "worker " << workerThreadStruct->id << " got stop work notice...");
-			break;
-		}		
+#endif
 	}
 #endif
-	
-	//check for exit
-	exitLock.lock();
-	DEBUG_MSG_L0(__func__, "worker " << workerThreadStruct->id << " waiting for exit notice");
-	workerThreadStruct->exitConditionVar.wait(exitLock, [workerThreadStruct] {return workerThreadStruct->exit == true; });
-	DEBUG_MSG_L0(__func__, "worker " << workerThreadStruct->id << " exiting...");
-
-	DeleteDC(hdcRayTraceWindow);
 
-	return;
+#if DISPLAY_WINDOW == 1 && DEBUG_SET_PIXEL == 1
+	ReleaseDC(raytraceMSWindowHandle, hdcRayTraceWindow);
+#endif
 }
 
 void bitBlitWorkerProcedure(
 	std::shared_ptr<WorkerThread> workerThreadStruct,
-	const std::shared_ptr<WorkerImageBuffer> workerImageBufferStruct,
+	std::shared_ptr<FrameMailbox> frameMailbox,
 	const RenderProperties renderProps
 ) {
 	std::unique_lock<std::mutex> coutLock(globalCoutGuard);
@@ -1046,9 +1369,6 @@ void bitBlitWorkerProcedure(
 	std::unique_lock<std::mutex> exitLock(workerThreadStruct->exitMutex);
 	exitLock.unlock();
 
-	std::unique_lock<std::mutex> continueLock(workerThreadStruct->continueWorkMutex);
-	continueLock.unlock();
-
 	std::unique_lock<std::mutex> doneLock(workerThreadStruct->workIsDoneMutex);
 	doneLock.unlock();
 
@@ -1068,26 +1388,18 @@ void bitBlitWorkerProcedure(
 
 		counter++;
 
-		//check if we need to continue blitting
-		continueLock.lock();
-		//DEBUG_MSG_L0(__func__, "worker " << workerThreadStruct->id << " waiting for continue notice");
-		workerThreadStruct->continueWorkConditionVar.wait(continueLock);
-		//DEBUG_MSG_L0(__func__, "worker " << workerThreadStruct->id << " continuing...");
-		if (workerThreadStruct->continueWork) {
-			//continue						
-			continueLock.unlock();
-
-			//check if need to delete the bitmap
-			//helps a little. probably need to pass bytes and array length throuhg user LPARAM and leave
-			//bitmap stuff to the gui thread
-			if (newBitmap) {
-				DeleteObject(newBitmap);
-			}
-		}
-		else {
-			continueLock.unlock();
+		//sleep until the render loop publishes a frame, only the newest one gets shown if several landed meanwhile
+		if (!frameMailbox->waitForFrame()) {
 			break;
 		}
+		frameMailbox->acquire();
+
+		//check if need to delete the bitmap
+		//helps a little. probably need to pass bytes and array length throuhg user LPARAM and leave
+		//bitmap stuff to the gui thread
+		if (newBitmap) {
+			DeleteObject(newBitmap);
+		}
 
 #if 1		
 		//https://stackoverflow.com/questions/26011437/c-trouble-with-making-a-bitmap-from-scratch
@@ -1102,7 +1414,7 @@ void bitBlitWorkerProcedure(
 			renderProps.resHeightInPixels,
 			1,
 			renderProps.bytesPerPixel * 8,
-			workerImageBufferStruct->buffer.get()
+			frameMailbox->getPresentBuffer().get()
 		);				
 
 		//DEBUG! After about 10K iterations, bitmap creation fails and the system stalls
@@ -1118,11 +1430,6 @@ void bitBlitWorkerProcedure(
 		//SendMessageCallback(...);
 
 #endif		
-		//indicate that blitting is complete	
-		doneLock.lock();
-		workerThreadStruct->workIsDone = true;
-		workerThreadStruct->workIsDoneConditionVar.notify_all();
-		doneLock.unlock();		
 	}
 		
 	doneLock.lock();
@@ -1138,4 +1445,38 @@ void bitBlitWorkerProcedure(
 	DEBUG_MSG_L0(__func__, "worker " << workerThreadStruct->id << " waiting for exit notice");	
 	workerThreadStruct->exitConditionVar.wait(exitLock, [workerThreadStruct]{return workerThreadStruct->exit == true; });
 	DEBUG_MSG_L0(__func__, "worker " << workerThreadStruct->id << " exiting...");
+}
+
+//gamma corrects, quantizes and stores one pixel in the BGRA byte buffer the bitblit thread displays
+void writeColorToImageBuffer(
+	std::shared_ptr<WorkerImageBuffer> workerImageBufferStruct,
+	const RenderProperties &renderProps,
+	uint32_t row,
+	uint32_t column,
+	vec3 linearColor
+) {
+	vec3 outputColor = vec3(sqrt(linearColor[0]), sqrt(linearColor[1]), sqrt(linearColor[2]));
+	// drowan(20190602): This seems to perform a modulo remap of the value. 362 becomes 106 maybe remap to 255? Does not seem to work right.
+	// Probably related to me outputing to bitmap instead of the ppm format...
+	uint8_t ir = 0;
+	uint8_t ig = 0;
+	uint8_t ib = 0;
+
+	uint16_t irO = uint16_t(255.99 * outputColor[0]);
+	uint16_t igO = uint16_t(255.99 * outputColor[1]);
+	uint16_t ibO = uint16_t(255.99 * outputColor[2]);
+
+	// cap the values to 255 max
+	(irO > 255) ? ir = 255 : ir = uint8_t(irO);
+	(igO > 255) ? ig = 255 : ig = uint8_t(igO);
+	(ibO > 255) ? ib = 255 : ib = uint8_t(ibO);
+
+	uint64_t rowIndex = (uint64_t)row * renderProps.resWidthInPixels * renderProps.bytesPerPixel;
+	uint64_t columnIndex = ((uint64_t)renderProps.resWidthInPixels * renderProps.bytesPerPixel) - (uint64_t)column * renderProps.bytesPerPixel;
+	size_t bufferIndex = (size_t)(workerImageBufferStruct->sizeInBytes - (rowIndex + columnIndex));
+	workerImageBufferStruct->buffer.get()[bufferIndex] = ib;
+	workerImageBufferStruct->buffer.get()[bufferIndex + 1] = ig;
+	workerImageBufferStruct->buffer.get()[bufferIndex + 2] = ir;
+	//alpha channel for now is just 0
+	workerImageBufferStruct->buffer.get()[bufferIndex + 3] = 0;
 }
\ No newline at end of file
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if defined (_WIN32)
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/*
+	Read only view of a whole file. The pages come straight out of the OS page cache, so every process that maps the
+	same file shares one physical copy and "loading" it costs nothing until the pages are touched. Move only, the
+	view is unmapped when the object goes away.
+
+	create() makes a new file of a given size and maps it read/write instead, the writer fills it in place and flush()
+	gets it onto the disk (checkpoints, see renderCheckpoint.h, compiled scenes, see sceneFile.h).
+*/
+class MappedFile {
+public:
+	MappedFile() : _data(NULL), _sizeInBytes(0), _writable(false) {
+#if defined (_WIN32)
+		_mapping = NULL;
+		_file = INVALID_HANDLE_VALUE;
+#else
+		_file = -1;
+#endif
+	}
+
+	~MappedFile() {
+		close();
+	}
+
+	MappedFile(MappedFile &&other) : _data(other._data), _sizeInBytes(other._sizeInBytes), _writable(other._writable), _file(other._file) {
+#if defined (_WIN32)
+		_mapping = other._mapping;
+		other._mapping = NULL;
+		other._file = INVALID_HANDLE_VALUE;
+#else
+		other._file = -1;
+#endif
+		other._data = NULL;
+		other._sizeInBytes = 0;
+		other._writable = false;
+	}
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	//false if the file is missing, empty or can't be mapped
+	bool open(const std::string &path) {
+		close();
+
+#if defined (_WIN32)
+		HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+			CloseHandle(file);
+			return false;
+		}
+
+		//the view keeps the mapping alive and the mapping keeps the file open, the handles aren't needed afterwards
+		_mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		CloseHandle(file);
+		if (_mapping == NULL) {
+			return false;
+		}
+
+		_data = (const uint8_t *)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+		if (_data == NULL) {
+			CloseHandle(_mapping);
+			_mapping = NULL;
+			return false;
+		}
+		_sizeInBytes = (size_t)fileSize.QuadPart;
+#else
+		int file = ::open(path.c_str(), O_RDONLY);
+		if (file < 0) {
+			return false;
+		}
+
+		struct stat fileStat;
+		if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0) {
+			::close(file);
+			return false;
+		}
+
+		void *data = mmap(NULL, (size_t)fileStat.st_size, PROT_READ, MAP_SHARED, file, 0);
+		::close(file);
+		if (data == MAP_FAILED) {
+			return false;
+		}
+
+		_data = (const uint8_t *)data;
+		_sizeInBytes = (size_t)fileStat.st_size;
+#endif
+		return true;
+	}
+
+	//creates (or truncates) path to sizeInBytes and maps it read/write, the contents start out zeroed
+	bool create(const std::string &path, size_t sizeInBytes) {
+		close();
+
+		if (sizeInBytes == 0) {
+			return false;
+		}
+
+#if defined (_WIN32)
+		//the file handle stays open this time, flush() needs it
+		_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (_file == INVALID_HANDLE_VALUE) {
+			return false;
+		}
+
+		//a mapping bigger than the file grows the file to its size
+		_mapping = CreateFileMappingA(_file, NULL, PAGE_READWRITE, (DWORD)((uint64_t)sizeInBytes >> 32), (DWORD)(sizeInBytes & 0xffffffff), NULL);
+		if (_mapping != NULL) {
+			_data = (const uint8_t *)MapViewOfFile(_mapping, FILE_MAP_WRITE, 0, 0, 0);
+		}
+		if (_data == NULL) {
+			if (_mapping != NULL) {
+				CloseHandle(_mapping);
+				_mapping = NULL;
+			}
+			CloseHandle(_file);
+			_file = INVALID_HANDLE_VALUE;
+			return false;
+		}
+#else
+		_file = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (_file < 0) {
+			return false;
+		}
+
+		void *data = MAP_FAILED;
+		if (ftruncate(_file, (off_t)sizeInBytes) == 0) {
+			data = mmap(NULL, sizeInBytes, PROT_READ | PROT_WRITE, MAP_SHARED, _file, 0);
+		}
+		if (data == MAP_FAILED) {
+			::close(_file);
+			_file = -1;
+			return false;
+		}
+		_data = (const uint8_t *)data;
+#endif
+		_sizeInBytes = sizeInBytes;
+		_writable = true;
+		return true;
+	}
+
+	//writes the dirty pages of a create()d file out and waits for the disk, false if that failed
+	bool flush() {
+		if (_data == NULL || !_writable) {
+			return false;
+		}
+
+#if defined (_WIN32)
+		return FlushViewOfFile(_data, 0) && FlushFileBuffers(_file);
+#else
+		return msync((void *)_data, _sizeInBytes, MS_SYNC) == 0 && fsync(_file) == 0;
+#endif
+	}
+
+	void close() {
+		if (_data == NULL) {
+			return;
+		}
+
+#if defined (_WIN32)
+		UnmapViewOfFile(_data);
+		CloseHandle(_mapping);
+		_mapping = NULL;
+		if (_file != INVALID_HANDLE_VALUE) {
+			CloseHandle(_file);
+			_file = INVALID_HANDLE_VALUE;
+		}
+#else
+		munmap((void *)_data, _sizeInBytes);
+		if (_file >= 0) {
+			::close(_file);
+			_file = -1;
+		}
+#endif
+		_data = NULL;
+		_sizeInBytes = 0;
+		_writable = false;
+	}
+
+	bool isOpen() const {
+		return _data != NULL;
+	}
+
+	const uint8_t *data() const {
+		return _data;
+	}
+
+	//NULL unless the file was create()d
+	uint8_t *mutableData() {
+		return _writable ? const_cast<uint8_t *>(_data) : NULL;
+	}
+
+	size_t getSizeInBytes() const {
+		return _sizeInBytes;
+	}
+
+protected:
+	const uint8_t *_data;
+	size_t _sizeInBytes;
+	bool _writable;
+
+	//only kept open for create()d files
+#if defined (_WIN32)
+	HANDLE _file;
+	HANDLE _mapping;
+#else
+	int _file;
+#endif
+};
+
+//rename that replaces an existing file, in one step on both platforms. Files written through create() go to path.tmp
+//first and get renamed over path once flushed, so a crash in the middle leaves the previous file alone.
+inline bool replaceFile(const std::string &from, const std::string &to) {
+#if defined (_WIN32)
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+//size and modification time, caches derived from a file (decoded images, mip chains) are only used while they match
+inline bool getFileStamp(const std::string &path, uint64_t &sizeInBytes, int64_t &modifiedTime) {
+#if defined (_WIN32)
+	struct _stat64 fileStat;
+	if (_stat64(path.c_str(), &fileStat) != 0) {
+		return false;
+	}
+#else
+	struct stat fileStat;
+	if (stat(path.c_str(), &fileStat) != 0) {
+		return false;
+	}
+#endif
+	sizeInBytes = (uint64_t)fileStat.st_size;
+	modifiedTime = (int64_t)fileStat.st_mtime;
+	return true;
+}
+
+//FNV-1a over 64 bit words for the payloads of mapped files, the tail that isn't a whole word goes in a byte at a time
+inline uint64_t checksumBytes(const uint8_t *data, size_t sizeInBytes) {
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	size_t offset = 0;
+
+	for (; offset + sizeof(uint64_t) <= sizeInBytes; offset += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, data + offset, sizeof(word));
+		hash = (hash ^ word) * 0x100000001b3ULL;
+	}
+	for (; offset < sizeInBytes; offset++) {
+		hash = (hash ^ data[offset]) * 0x100000001b3ULL;
+	}
+	return hash;
+}
@@ -1,10 +1,13 @@
 #pragma once
 
+#include <atomic>
+
 #include "vec3.h"
 #include "rngs.h"
 #include "mathUtilities.h"
 
 #include "ray.h"
+#include "sceneOwner.h"
 #include "hitable.h"
 #include "texture.h"
 
@@ -33,11 +36,30 @@ float schlick(float cosine, float refIndex) {
 
 class Material {
 public:
+	Material() : _materialId(nextMaterialId()++) {}
+	virtual ~Material() {}
+
+	SCENE_OWNER_ALLOCATION(Material)
+
 	virtual bool scatter(const ray &inputRay, const HitRecord &hitRecord, vec3 &attenuation, ray &scatteredRay) const = 0;
 
 	virtual vec3 emitted(float u, float v, const vec3 &p) const {
 		return vec3(0, 0, 0);
 	}
+
+	//diffuse materials get explicit light samples in color(), see lightSampler.h
+	virtual bool isDiffuse() const {
+		return false;
+	}
+
+	//unique per constructed material, used for the material id AOV
+	uint32_t _materialId;
+
+	//same as Hitable::nextPrimitiveId()
+	static std::atomic<uint32_t> &nextMaterialId() {
+		static std::atomic<uint32_t> nextId(1);
+		return nextId;
+	}
 };
 
 class Lambertian : public Material {
@@ -48,7 +70,11 @@ public:
 		////produce a "reflection" ray that originates at the point where a hit was detected and is cast in some random direction away from the impact surface.
 		vec3 target = hitRecord.point + hitRecord.normal + randomInUnitSphere();
 		scatteredRay = ray(hitRecord.point, target - hitRecord.point, inputRay.time());
-		attenuation = _albedo->value(hitRecord.u, hitRecord.v, hitRecord.point);
+		attenuation = _albedo->filteredValue(hitRecord);
+		return true;
+	}
+
+	virtual bool isDiffuse() const {
 		return true;
 	}
 
@@ -140,7 +166,7 @@ public:
 
 	virtual bool scatter(const ray &inputRay, const HitRecord &hitRecord, vec3 &attenuation, ray &scatteredRay) const {
 		scatteredRay = ray(hitRecord.point, randomInUnitSphere());
-		attenuation = _albedo->value(hitRecord.u, hitRecord.v, hitRecord.point);
+		attenuation = _albedo->filteredValue(hitRecord);
 		return true;
 	}
 
@@ -0,0 +1,307 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "defines.h"
+#include "mappedFile.h"
+#include "mipmappedImage.h"
+#include "sharedImageCache.h"
+#include "stb_image.h"
+
+/*
+	Image textures converted to MipmappedImages once and saved next to the image (<image><TEXTURE_MIP_CACHE_SUFFIX>),
+	from then on every process maps that file read only. Startup is an mmap instead of decoding the 8k earth JPEG, the
+	pages are shared by every renderer on the node like the .rgb8 files of sharedImageCache.h, and only the tiles and
+	levels the render actually looks at ever get read in.
+
+	The cache is rebuilt when the image's size or time changes and written under a temporary name and renamed into
+	place, so a racing process never maps half of it. "--convert-texture <image> <output>" does the conversion offline,
+	a path ending in the suffix is mapped as is without looking for the image.
+
+	With TEXTURE_MIP_CACHE_EN 0, or when the directory is read only, the chain is built on the heap every start.
+*/
+class MipmapCache {
+public:
+	//NULL if the image can't be read, otherwise lives as long as the process. The same path gives the same image.
+	static const MipmappedImage *load(const std::string &path);
+
+	//0 on success like ImageWriter::write
+	static uint32_t convert(const std::string &imagePath, const std::string &outputPath);
+
+protected:
+	//the level sizes and where they go, false if the image is too big for the header
+	static bool layOut(uint32_t width, uint32_t height, MipmapCacheHeader &header, size_t &fileSizeInBytes);
+
+	//fills the levels of an image laid out by layOut, base is the start of the file
+	static void build(const unsigned char *rgb, const MipmapCacheHeader &header, uint8_t *base);
+
+	static uint32_t write(const std::string &path, const unsigned char *rgb, uint32_t width, uint32_t height, uint64_t sourceSizeInBytes, int64_t sourceModifiedTime);
+
+	//quietly false unless path is a cache of this layout (and of that source, unless checkSource is false)
+	static bool open(const std::string &path, bool checkSource, uint64_t sourceSizeInBytes, int64_t sourceModifiedTime, MipmappedImage &image);
+
+	static bool hasSuffix(const std::string &path) {
+		size_t suffixLength = strlen(TEXTURE_MIP_CACHE_SUFFIX);
+		return path.size() > suffixLength && path.compare(path.size() - suffixLength, suffixLength, TEXTURE_MIP_CACHE_SUFFIX) == 0;
+	}
+
+	static std::map<std::string, std::unique_ptr<MipmappedImage>> &getImages() {
+		static std::map<std::string, std::unique_ptr<MipmappedImage>> images;
+		return images;
+	}
+};
+
+const MipmappedImage *MipmapCache::load(const std::string &path) {
+	auto loaded = getImages().find(path);
+	if (loaded != getImages().end()) {
+		return loaded->second.get();
+	}
+
+	std::unique_ptr<MipmappedImage> image(new MipmappedImage);
+
+	if (hasSuffix(path)) {
+		if (!open(path, false, 0, 0, *image)) {
+			std::cout << path << " isn't a texture cache of this version\n";
+			return NULL;
+		}
+		return (getImages()[path] = std::move(image)).get();
+	}
+
+	int width = 0, height = 0;
+	const unsigned char *rgb = NULL;
+	unsigned char *decoded = NULL;
+
+#if TEXTURE_MIP_CACHE_EN == 1
+	uint64_t sourceSizeInBytes = 0;
+	int64_t sourceModifiedTime = 0;
+
+	if (!getFileStamp(path, sourceSizeInBytes, sourceModifiedTime)) {
+		std::cout << "Failed to open " << path << "\n";
+		return NULL;
+	}
+
+	std::string cachePath = path + TEXTURE_MIP_CACHE_SUFFIX;
+	if (open(cachePath, true, sourceSizeInBytes, sourceModifiedTime, *image)) {
+		return (getImages()[path] = std::move(image)).get();
+	}
+
+	int channels = 0;
+	rgb = decoded = stbi_load(path.c_str(), &width, &height, &channels, 3);
+	if (rgb == NULL) {
+		return NULL;
+	}
+
+	if (write(cachePath, rgb, (uint32_t)width, (uint32_t)height, sourceSizeInBytes, sourceModifiedTime) == 0 &&
+		open(cachePath, true, sourceSizeInBytes, sourceModifiedTime, *image)) {
+
+		stbi_image_free(decoded);
+		return (getImages()[path] = std::move(image)).get();
+	}
+#else
+	rgb = SharedImageCache::load(path, width, height);
+	if (rgb == NULL) {
+		return NULL;
+	}
+#endif
+
+	//no cache, this process builds its own chain
+	MipmapCacheHeader header;
+	size_t sizeInBytes = 0;
+
+	if (!layOut((uint32_t)width, (uint32_t)height, header, sizeInBytes)) {
+		std::cout << path << " is too big for a texture\n";
+		if (decoded) stbi_image_free(decoded);
+		return NULL;
+	}
+
+	image->_heapCopy.resize(sizeInBytes);
+	build(rgb, header, image->_heapCopy.data());
+	image->setLevels(image->_heapCopy.data(), header);
+
+	if (decoded) stbi_image_free(decoded);
+	return (getImages()[path] = std::move(image)).get();
+}
+
+uint32_t MipmapCache::convert(const std::string &imagePath, const std::string &outputPath) {
+	uint64_t sourceSizeInBytes = 0;
+	int64_t sourceModifiedTime = 0;
+	int width = 0, height = 0, channels = 0;
+
+	unsigned char *rgb = getFileStamp(imagePath, sourceSizeInBytes, sourceModifiedTime) ? stbi_load(imagePath.c_str(), &width, &height, &channels, 3) : NULL;
+	if (rgb == NULL) {
+		std::cout << "Can't read " << imagePath << "\n";
+		return 1;
+	}
+
+	uint32_t result = write(outputPath, rgb, (uint32_t)width, (uint32_t)height, sourceSizeInBytes, sourceModifiedTime);
+	stbi_image_free(rgb);
+
+	if (result == 0) {
+		std::cout << "Converted " << imagePath << " (" << width << "x" << height << ") to " << outputPath << "\n";
+	}
+	return result;
+}
+
+bool MipmapCache::layOut(uint32_t width, uint32_t height, MipmapCacheHeader &header, size_t &fileSizeInBytes) {
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "RTMIP", sizeof("RTMIP"));
+	header.version = MIPMAP_CACHE_VERSION;
+	header.headerSizeInBytes = sizeof(header);
+	header.width = width;
+	header.height = height;
+	header.tileSize = MIPMAP_TILE_SIZE;
+
+	if (width == 0 || height == 0) {
+		return false;
+	}
+
+	//levels start on a cache line, they are whole tiles so they all do
+	uint64_t offsetInBytes = (sizeof(header) + 63) & ~(uint64_t)63;
+	uint32_t levelWidth = width, levelHeight = height;
+
+	for (;;) {
+		if (header.numOfLevels == MIPMAP_MAX_LEVELS) {
+			return false;
+		}
+
+		MipmapLevelRecord &record = header.levels[header.numOfLevels++];
+		record.offsetInBytes = offsetInBytes;
+		record.width = levelWidth;
+		record.height = levelHeight;
+		record.tilesPerRow = (levelWidth + MIPMAP_TILE_SIZE - 1) / MIPMAP_TILE_SIZE;
+		record.tilesPerColumn = (levelHeight + MIPMAP_TILE_SIZE - 1) / MIPMAP_TILE_SIZE;
+
+		offsetInBytes += (uint64_t)record.tilesPerRow * record.tilesPerColumn * MIPMAP_TILE_SIZE_IN_BYTES;
+
+		if (levelWidth == 1 && levelHeight == 1) {
+			break;
+		}
+		levelWidth = std::max(levelWidth / 2, 1u);
+		levelHeight = std::max(levelHeight / 2, 1u);
+	}
+
+	fileSizeInBytes = (size_t)offsetInBytes;
+	return true;
+}
+
+void MipmapCache::build(const unsigned char *rgb, const MipmapCacheHeader &header, uint8_t *base) {
+	const MipmapLevelRecord &top = header.levels[0];
+	uint8_t *texels = base + top.offsetInBytes;
+
+	for (uint32_t y = 0; y < top.height; y++) {
+		for (uint32_t x = 0; x < top.width; x++) {
+			const unsigned char *source = rgb + ((size_t)y * top.width + x) * 3;
+			uint8_t *texel = texels + MipmappedImage::texelOffset(top.tilesPerRow, x, y);
+
+			texel[0] = source[0];
+			texel[1] = source[1];
+			texel[2] = source[2];
+			texel[3] = 255;
+		}
+	}
+
+	//every texel is the mean of the 2x2 under it, an odd last row or column is used twice
+	for (uint32_t level = 1; level < header.numOfLevels; level++) {
+		const MipmapLevelRecord &fine = header.levels[level - 1];
+		const MipmapLevelRecord &coarse = header.levels[level];
+		const uint8_t *fineTexels = base + fine.offsetInBytes;
+		uint8_t *coarseTexels = base + coarse.offsetInBytes;
+
+		for (uint32_t y = 0; y < coarse.height; y++) {
+			uint32_t y0 = std::min(2 * y, fine.height - 1);
+			uint32_t y1 = std::min(2 * y + 1, fine.height - 1);
+
+			for (uint32_t x = 0; x < coarse.width; x++) {
+				uint32_t x0 = std::min(2 * x, fine.width - 1);
+				uint32_t x1 = std::min(2 * x + 1, fine.width - 1);
+
+				const uint8_t *t00 = fineTexels + MipmappedImage::texelOffset(fine.tilesPerRow, x0, y0);
+				const uint8_t *t10 = fineTexels + MipmappedImage::texelOffset(fine.tilesPerRow, x1, y0);
+				const uint8_t *t01 = fineTexels + MipmappedImage::texelOffset(fine.tilesPerRow, x0, y1);
+				const uint8_t *t11 = fineTexels + MipmappedImage::texelOffset(fine.tilesPerRow, x1, y1);
+				uint8_t *texel = coarseTexels + MipmappedImage::texelOffset(coarse.tilesPerRow, x, y);
+
+				for (int channel = 0; channel < 4; channel++) {
+					texel[channel] = (uint8_t)((t00[channel] + t10[channel] + t01[channel] + t11[channel] + 2) / 4);
+				}
+			}
+		}
+	}
+}
+
+uint32_t MipmapCache::write(const std::string &path, const unsigned char *rgb, uint32_t width, uint32_t height, uint64_t sourceSizeInBytes, int64_t sourceModifiedTime) {
+	MipmapCacheHeader header;
+	size_t sizeInBytes = 0;
+
+	if (!layOut(width, height, header, sizeInBytes)) {
+		std::cout << "A " << width << "x" << height << " image is too big for a texture\n";
+		return 1;
+	}
+	header.sourceSizeInBytes = sourceSizeInBytes;
+	header.sourceModifiedTime = sourceModifiedTime;
+
+	//per process, several renderers may be converting the same image at once
+#if defined (_WIN32)
+	std::string temporaryPath = path + ".tmp" + std::to_string(GetCurrentProcessId());
+#else
+	std::string temporaryPath = path + ".tmp" + std::to_string(getpid());
+#endif
+	MappedFile file;
+
+	if (!file.create(temporaryPath, sizeInBytes)) {
+		std::cout << "Can't create " << temporaryPath << "\n";
+		return 1;
+	}
+
+	//create() zeroes the file, the padding of the edge tiles stays that way
+	memcpy(file.mutableData(), &header, sizeof(header));
+	build(rgb, header, file.mutableData());
+
+	bool flushed = file.flush();
+	file.close();
+
+	if (!flushed || !replaceFile(temporaryPath, path)) {
+		std::cout << "Failed to write " << path << "\n";
+		remove(temporaryPath.c_str());
+		return 1;
+	}
+	return 0;
+}
+
+bool MipmapCache::open(const std::string &path, bool checkSource, uint64_t sourceSizeInBytes, int64_t sourceModifiedTime, MipmappedImage &image) {
+	MappedFile &file = image._file;
+	MipmapCacheHeader header;
+
+	if (!file.open(path) || file.getSizeInBytes() < sizeof(header)) {
+		file.close();
+		return false;
+	}
+	memcpy(&header, file.data(), sizeof(header));
+
+	if (memcmp(header.magic, "RTMIP", sizeof("RTMIP")) != 0 || header.version != MIPMAP_CACHE_VERSION || header.headerSizeInBytes != sizeof(header) ||
+		(checkSource && (header.sourceSizeInBytes != sourceSizeInBytes || header.sourceModifiedTime != sourceModifiedTime))) {
+		file.close();
+		return false;
+	}
+
+	//the levels have to be exactly where this build would put them, so nothing is read outside the file
+	MipmapCacheHeader expected;
+	size_t sizeInBytes = 0;
+
+	if (!layOut(header.width, header.height, expected, sizeInBytes) || file.getSizeInBytes() != sizeInBytes ||
+		header.numOfLevels != expected.numOfLevels || memcmp(header.levels, expected.levels, sizeof(header.levels)) != 0) {
+		file.close();
+		return false;
+	}
+
+	image.setLevels(file.data(), header);
+	return true;
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vec3.h"
+#include "mappedFile.h"
+
+#define MIPMAP_CACHE_VERSION 1
+//16x16 texel tiles, 1KB of RGBA8. Inside a tile the texels are in Morton order so every 4x4 block is one cache line.
+#define MIPMAP_TILE_SHIFT 4
+#define MIPMAP_TILE_SIZE (1 << MIPMAP_TILE_SHIFT)
+#define MIPMAP_TILE_SIZE_IN_BYTES (MIPMAP_TILE_SIZE * MIPMAP_TILE_SIZE * 4)
+//a 32k image down to 1x1
+#define MIPMAP_MAX_LEVELS 16
+
+struct MipmapLevelRecord {
+	uint64_t offsetInBytes;
+	uint32_t width, height;
+	uint32_t tilesPerRow, tilesPerColumn;
+};
+
+//fixed size, the levels follow it, largest first
+struct MipmapCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSizeInBytes;
+	uint32_t width, height;
+	uint32_t numOfLevels;
+	uint32_t tileSize;
+	//the image it was converted from, like SharedImageHeader
+	uint64_t sourceSizeInBytes;
+	int64_t sourceModifiedTime;
+	MipmapLevelRecord levels[MIPMAP_MAX_LEVELS];
+};
+
+static_assert(sizeof(MipmapLevelRecord) == 24 && sizeof(MipmapCacheHeader) == 432, "the mipmap cache is written as is");
+
+/*
+	An image as a box filtered mip chain, every level cut into tiles (see MIPMAP_TILE_SHIFT). A bilinear lookup touches
+	one or two cache lines instead of two rows thousands of bytes apart, and a lookup at a level that fits the pixel's
+	footprint doesn't walk all over an 8k image to shade a sphere a few hundred pixels across.
+
+	The texels are a mapped cache file or, when that can't be written, a heap copy (see mipmapCache.h).
+*/
+class MipmappedImage {
+public:
+	MipmappedImage() : _width(0), _height(0) {}
+
+	MipmappedImage(const MipmappedImage &) = delete;
+	MipmappedImage &operator=(const MipmappedImage &) = delete;
+
+	/*
+		u, v like ImageTexture (v = 1 is the top row). footprintU/V are how much of the 0..1 range the pixel covers
+		around the lookup (see HitRecord), the level is picked from the larger one in texels and blended with the next
+		(trilinear). 0 is the full resolution level, bilinear.
+	*/
+	vec3 sample(float u, float v, float footprintU, float footprintV) const;
+
+	uint32_t getWidth() const {
+		return _width;
+	}
+
+	uint32_t getHeight() const {
+		return _height;
+	}
+
+	uint32_t getNumOfLevels() const {
+		return (uint32_t)_levels.size();
+	}
+
+protected:
+	friend class MipmapCache;
+
+	struct Level {
+		const uint8_t *texels;
+		uint32_t width, height;
+		uint32_t tilesPerRow;
+	};
+
+	//spreads the 4 bits of a coordinate inside the tile onto the even bits
+	static uint32_t mortonSpread(uint32_t value) {
+		value = (value | (value << 2)) & 0x33;
+		value = (value | (value << 1)) & 0x55;
+		return value;
+	}
+
+	static size_t texelOffset(uint32_t tilesPerRow, uint32_t x, uint32_t y) {
+		size_t tile = (size_t)(y >> MIPMAP_TILE_SHIFT) * tilesPerRow + (x >> MIPMAP_TILE_SHIFT);
+		uint32_t texelInTile = mortonSpread(x & (MIPMAP_TILE_SIZE - 1)) | (mortonSpread(y & (MIPMAP_TILE_SIZE - 1)) << 1);
+		return ((tile << (2 * MIPMAP_TILE_SHIFT)) + texelInTile) * 4;
+	}
+
+	vec3 sampleBilinear(const Level &level, float u, float v) const;
+
+	void setLevels(const uint8_t *base, const MipmapCacheHeader &header) {
+		_width = header.width;
+		_height = header.height;
+		_levels.clear();
+
+		for (uint32_t level = 0; level < header.numOfLevels; level++) {
+			const MipmapLevelRecord &record = header.levels[level];
+			Level entry = { base + record.offsetInBytes, record.width, record.height, record.tilesPerRow };
+			_levels.push_back(entry);
+		}
+	}
+
+	uint32_t _width, _height;
+	std::vector<Level> _levels;
+
+	//what the levels point into, one or the other
+	MappedFile _file;
+	std::vector<uint8_t> _heapCopy;
+};
+
+vec3 MipmappedImage::sample(float u, float v, float footprintU, float footprintV) const {
+	float footprintInTexels = std::max(footprintU * _width, footprintV * _height);
+
+	if (!(footprintInTexels > 1.0f) || _levels.size() == 1) {
+		return sampleBilinear(_levels[0], u, v);
+	}
+
+	float level = std::min(log2f(footprintInTexels), (float)(_levels.size() - 1));
+	uint32_t fineLevel = (uint32_t)level;
+	float blend = level - fineLevel;
+
+	vec3 color = sampleBilinear(_levels[fineLevel], u, v);
+	if (blend > 0.0f && fineLevel + 1 < _levels.size()) {
+		color = (1.0f - blend) * color + blend * sampleBilinear(_levels[fineLevel + 1], u, v);
+	}
+	return color;
+}
+
+vec3 MipmappedImage::sampleBilinear(const Level &level, float u, float v) const {
+	//texel centers are at .5, clamped at the edges like ImageTexture (a NaN ends up on the first texel)
+	float x = u * level.width - 0.5f;
+	float y = (1.0f - v) * level.height - 0.5f;
+	x = x > 0.0f ? std::min(x, (float)(level.width - 1)) : 0.0f;
+	y = y > 0.0f ? std::min(y, (float)(level.height - 1)) : 0.0f;
+
+	uint32_t x0 = (uint32_t)x;
+	uint32_t y0 = (uint32_t)y;
+	uint32_t x1 = std::min(x0 + 1, level.width - 1);
+	uint32_t y1 = std::min(y0 + 1, level.height - 1);
+	float fx = x - x0;
+	float fy = y - y0;
+
+	const uint8_t *t00 = level.texels + texelOffset(level.tilesPerRow, x0, y0);
+	const uint8_t *t10 = level.texels + texelOffset(level.tilesPerRow, x1, y0);
+	const uint8_t *t01 = level.texels + texelOffset(level.tilesPerRow, x0, y1);
+	const uint8_t *t11 = level.texels + texelOffset(level.tilesPerRow, x1, y1);
+
+	float w00 = (1.0f - fx) * (1.0f - fy);
+	float w10 = fx * (1.0f - fy);
+	float w01 = (1.0f - fx) * fy;
+	float w11 = fx * fy;
+
+	return vec3(
+		w00 * t00[0] + w10 * t10[0] + w01 * t01[0] + w11 * t11[0],
+		w00 * t00[1] + w10 * t10[1] + w01 * t01[1] + w11 * t11[1],
+		w00 * t00[2] + w10 * t10[2] + w01 * t01[2] + w11 * t11[2]) / 255.0f;
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <future>
+#include <chrono>
+#include <utility>
+#include <iostream>
+#include <string.h>
+#include <stdint.h>
+
+#include "defines.h"
+#include "renderer.h"
+#include "imageWriter.h"
+#include "hdrImageWriter.h"
+
+//what the last renderToFile did
+struct OutOfCoreRenderStats {
+	uint32_t numOfBands;
+	//accumulation buffers and band pixels of the bands in flight, the most that was ever resident at once
+	uint64_t residentBytes;
+	float renderTimeMs;
+	//the part of it the calling thread spent quantizing/encoding/writing, the workers keep going meanwhile
+	float writeTimeMs;
+	double samplesPerSecond;
+};
+
+/*
+	Renders an image too big to hold in memory (32K x 32K posters...) straight into a file. Any of the ImageWriter or
+	HdrImageWriter formats works, the extension picks it.
+
+	The image is cut into bands of rows, written in the order the file stores them, and every band is a Renderer job of its
+	own (RenderJob::firstRow/numOfRows) that only allocates its own accumulation buffer, tiles and output floats. At
+	most bandsInFlight bands are submitted at a time, each a priority step below the one before: the workers finish
+	the bands in file order, and the ones that find nothing left of the oldest band already start on the next instead
+	of idling at the band boundary. The calling thread writes every band as it finishes while the next ones render,
+	then reuses its buffer for the next submission.
+
+	So what is resident is bandsInFlight * width * bandHeight * 32 bytes (20 of accumulation, 12 of output) whatever
+	the height, about 130MB for a 32K wide image with the default 4 bands of 32 rows. Sizes are 64 bit throughout, the
+	only limits left are the formats' own (BMP stops at 4GB, RGBE scanlines past 32767 wide are stored without RLE).
+
+	Bands go out at job.priority, job.priority - 1... so other jobs on the same renderer at job.priority get ahead of
+	all but the first band.
+*/
+class OutOfCoreRenderer {
+public:
+	explicit OutOfCoreRenderer(Renderer &renderer, uint32_t bandHeightInPixels = OUT_OF_CORE_BAND_HEIGHT_IN_PIXELS, uint32_t bandsInFlight = OUT_OF_CORE_BANDS_IN_FLIGHT) :
+		_renderer(renderer), _bandHeightInPixels(bandHeightInPixels > 0 ? bandHeightInPixels : TILE_SIZE_IN_PIXELS), _bandsInFlight(bandsInFlight > 0 ? bandsInFlight : 1) {
+
+		memset(&_lastStats, 0, sizeof(_lastStats));
+	}
+
+	//job describes the whole image, its rows and output are ignored. 0 on success like ImageWriter::write.
+	uint32_t renderToFile(const RenderJob &job, const std::string &path);
+
+	const OutOfCoreRenderStats &getLastStats() const {
+		return _lastStats;
+	}
+
+protected:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	struct Band {
+		uint32_t firstFileRow, numOfRows;
+		//linear RGB, top row of the band first
+		std::vector<float> pixels;
+		std::future<RenderResult> result;
+	};
+
+	Renderer &_renderer;
+	uint32_t _bandHeightInPixels;
+	uint32_t _bandsInFlight;
+
+	OutOfCoreRenderStats _lastStats;
+};
+
+uint32_t OutOfCoreRenderer::renderToFile(const RenderJob &job, const std::string &path) {
+	uint32_t width = job.resWidthInPixels;
+	uint32_t height = job.resHeightInPixels;
+
+	memset(&_lastStats, 0, sizeof(_lastStats));
+
+	if (job.scene.world == NULL || width == 0 || height == 0 || job.samplesPerPixel == 0) {
+		std::cout << "Can't render " << path << ", the job needs a scene, a size and at least one sample per pixel\n";
+		return 1;
+	}
+
+	//float formats get the linear colors, the 8 bit ones BGR bytes
+	bool floatOutput = hdrImageFormatFromPath(path) != HDR_IMAGE_FORMAT_UNKNOWN;
+	if (!floatOutput && imageFormatFromPath(path) == IMAGE_FORMAT_UNKNOWN) {
+		std::cout << "Can't write " << path << ", use a .bmp, .ppm, .png, .pfm, .hdr or .exr name\n";
+		return 1;
+	}
+	HdrImageStream hdrStream;
+	ImageStream imageStream;
+
+	if (floatOutput ? !hdrStream.open(path, width, height) : !imageStream.open(path, imageFormatFromPath(path), width, height, 3)) {
+		return 1;
+	}
+
+	bool bottomUp = floatOutput ? hdrStream.isBottomUp() : imageStream.isBottomUp();
+	uint32_t numOfBands = (height + _bandHeightInPixels - 1) / _bandHeightInPixels;
+	size_t bandRowSizeInFloats = (size_t)width * 3;
+
+	std::deque<Band> bandsInFlight;
+	std::vector<std::vector<float>> freeBuffers;
+	std::vector<uint8_t> bandBytes;
+
+	auto startTime = Clock::now();
+	Clock::duration writeTime = Clock::duration::zero();
+	bool succeeded = true;
+	uint32_t nextBand = 0;
+
+	while (!bandsInFlight.empty() || (succeeded && nextBand < numOfBands)) {
+		//keep the window full, a failed write stops new bands but the ones in flight still have to come back
+		while (succeeded && nextBand < numOfBands && bandsInFlight.size() < _bandsInFlight) {
+			//bands sit on the engine's row grid (0 at the bottom) whichever way the file goes, so with a band height
+			//that is a multiple of the tile size every tile is where a whole image render has it and traces the same samples
+			Band band;
+			uint32_t firstRow = (bottomUp ? nextBand : numOfBands - 1 - nextBand) * _bandHeightInPixels;
+			band.numOfRows = std::min(_bandHeightInPixels, height - firstRow);
+			band.firstFileRow = bottomUp ? firstRow : height - firstRow - band.numOfRows;
+
+			if (!freeBuffers.empty()) {
+				band.pixels.swap(freeBuffers.back());
+				freeBuffers.pop_back();
+			}
+			band.pixels.resize(bandRowSizeInFloats * band.numOfRows);
+
+			RenderJob bandJob = job;
+			bandJob.firstRow = firstRow;
+			bandJob.numOfRows = band.numOfRows;
+			bandJob.priority = job.priority - (int32_t)nextBand;
+			bandJob.outputPixels = band.pixels.data();
+			bandJob.outputRowStrideInFloats = 0;
+
+			band.result = _renderer.submit(bandJob);
+			bandsInFlight.push_back(std::move(band));
+			nextBand++;
+
+			uint64_t residentBytes = 0;
+			for (const Band &resident : bandsInFlight) {
+				residentBytes += (uint64_t)width * resident.numOfRows * (sizeof(vec3) + sizeof(float) + sizeof(uint32_t) + 3 * sizeof(float));
+			}
+			_lastStats.residentBytes = std::max(_lastStats.residentBytes, residentBytes);
+		}
+
+		Band &band = bandsInFlight.front();
+		try {
+			band.result.get();
+		}
+		catch (const std::exception &exception) {
+			std::cout << "Band at row " << band.firstFileRow << " of " << path << " failed: " << exception.what() << "\n";
+			succeeded = false;
+		}
+
+		if (succeeded) {
+			auto writeStartTime = Clock::now();
+			const float *topRow = band.pixels.data();
+			const float *bottomRow = topRow + bandRowSizeInFloats * (band.numOfRows - 1);
+
+			if (floatOutput) {
+				succeeded = bottomUp ?
+					hdrStream.writeRows(bottomRow, band.numOfRows, -(ptrdiff_t)bandRowSizeInFloats) :
+					hdrStream.writeRows(topRow, band.numOfRows, (ptrdiff_t)bandRowSizeInFloats);
+			}
+			else {
+				//BGR like the WorkerImageBuffer, in file order
+				bandBytes.resize(bandRowSizeInFloats * band.numOfRows);
+				for (uint32_t row = 0; row < band.numOfRows; row++) {
+					const float *rgb = bottomUp ? bottomRow - row * bandRowSizeInFloats : topRow + row * bandRowSizeInFloats;
+					linearRowToBGR(rgb, &bandBytes[row * bandRowSizeInFloats], width);
+				}
+				succeeded = imageStream.writeRows(bandBytes.data(), band.numOfRows, (ptrdiff_t)bandRowSizeInFloats);
+			}
+			writeTime += Clock::now() - writeStartTime;
+		}
+
+		freeBuffers.push_back(std::move(band.pixels));
+		bandsInFlight.pop_front();
+	}
+
+	succeeded = (floatOutput ? hdrStream.close() : imageStream.close()) && succeeded;
+
+	std::chrono::duration<float, std::milli> renderTime = Clock::now() - startTime;
+	_lastStats.numOfBands = numOfBands;
+	_lastStats.renderTimeMs = renderTime.count();
+	_lastStats.writeTimeMs = std::chrono::duration<float, std::milli>(writeTime).count();
+	_lastStats.samplesPerSecond = renderTime.count() > 0.0f ? (double)width * height * job.samplesPerPixel / (renderTime.count() / 1000.0) : 0.0;
+
+	if (!succeeded) {
+		std::cout << "Failed to write " << path << "\n";
+		return 1;
+	}
+	return 0;
+}
@@ -143,6 +143,53 @@ public:
 		return result.normalizeVersor();
 	}
 
+	//https://en.wikipedia.org/wiki/Rotation_matrix#Quaternion
+	//the rotation that takes the body x/y/z axes onto the given (orthonormal, right handed) world vectors
+	static inline quaternion basisToQuaternion(const vec3 &xAxis, const vec3 &yAxis, const vec3 &zAxis) {
+		quaternion result;
+
+		//m[row][column], the axes are the columns
+		float trace = xAxis.x() + yAxis.y() + zAxis.z();
+
+		if (trace > 0) {
+			float s = 0.5f / sqrt(trace + 1.0f);
+			result.components.w = 0.25f / s;
+			result.components.x = (yAxis.z() - zAxis.y()) * s;
+			result.components.y = (zAxis.x() - xAxis.z()) * s;
+			result.components.z = (xAxis.y() - yAxis.x()) * s;
+		}
+		else if (xAxis.x() > yAxis.y() && xAxis.x() > zAxis.z()) {
+			float s = 2.0f * sqrt(1.0f + xAxis.x() - yAxis.y() - zAxis.z());
+			result.components.w = (yAxis.z() - zAxis.y()) / s;
+			result.components.x = 0.25f * s;
+			result.components.y = (yAxis.x() + xAxis.y()) / s;
+			result.components.z = (zAxis.x() + xAxis.z()) / s;
+		}
+		else if (yAxis.y() > zAxis.z()) {
+			float s = 2.0f * sqrt(1.0f + yAxis.y() - xAxis.x() - zAxis.z());
+			result.components.w = (zAxis.x() - xAxis.z()) / s;
+			result.components.x = (yAxis.x() + xAxis.y()) / s;
+			result.components.y = 0.25f * s;
+			result.components.z = (zAxis.y() + yAxis.z()) / s;
+		}
+		else {
+			float s = 2.0f * sqrt(1.0f + zAxis.z() - xAxis.x() - yAxis.y());
+			result.components.w = (xAxis.y() - yAxis.x()) / s;
+			result.components.x = (zAxis.x() + xAxis.z()) / s;
+			result.components.y = (zAxis.y() + yAxis.z()) / s;
+			result.components.z = 0.25f * s;
+		}
+
+		return result.normalizeVersor();
+	}
+
+	//q * v * q^-1 for a versor, same as the camera rotations in main()
+	static inline vec3 rotateVector(const quaternion &q, const vec3 &v);
+
+	//https://en.wikipedia.org/wiki/Slerp
+	//constant angular speed from q1 (t = 0) to q2 (t = 1) the short way round, nearly equal versors just get lerped
+	static inline quaternion slerp(const quaternion &q1, const quaternion &q2, const float t);
+
 	inline quaternion conjugate() {
 		quaternion result;
 
@@ -266,4 +313,33 @@ inline quaternion operator/(float t, const quaternion &q1) {
 
 inline quaternion operator/(const quaternion &q1, float t) {
 	return quaternion(q1.w() / t, q1.x() / t, q1.y() / t, q1.z() / t);
-}
\ No newline at end of file
+}
+
+//after the operators, they need them
+inline vec3 quaternion::rotateVector(const quaternion &q, const vec3 &v) {
+	quaternion vectorVersor = { 0, v.x(), v.y(), v.z() };
+	quaternion qConjugate(q.w(), -q.x(), -q.y(), -q.z());
+	quaternion result = q * vectorVersor * qConjugate;
+
+	return vec3(result.x(), result.y(), result.z());
+}
+
+inline quaternion quaternion::slerp(const quaternion &q1, const quaternion &q2, const float t) {
+	quaternion end = q2;
+	float cosTheta = q1.w() * q2.w() + q1.x() * q2.x() + q1.y() * q2.y() + q1.z() * q2.z();
+
+	//q and -q are the same rotation, take the one less than 180 degrees away
+	if (cosTheta < 0) {
+		end = -1.0f * q2;
+		cosTheta = -cosTheta;
+	}
+
+	if (cosTheta > 0.9995f) {
+		return ((1.0f - t) * q1 + t * end).normalizeVersor();
+	}
+
+	float theta = acos(cosTheta);
+	float sinTheta = sin(theta);
+
+	return (sin((1.0f - t) * theta) / sinTheta) * q1 + (sin(t * theta) / sinTheta) * end;
+}
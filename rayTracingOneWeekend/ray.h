@@ -3,14 +3,18 @@
 class ray {
 public:
 	ray() {}
-	ray(const vec3& a, const vec3& b, float ti = 0.0) { _a = a; _b = b; _time = ti; }
+	ray(const vec3& a, const vec3& b, float ti = 0.0, float spreadAngle = 0.0f) { _a = a; _b = b; _time = ti; _spreadAngle = spreadAngle; }
 	
 	vec3 origin() const { return _a; }
 	vec3 direction() const { return _b; }
 	float time() const { return _time; }
 	vec3 pointAtParameter(float t) const { return _a + t*_b; }
+	//width of the ray's cone at t, how much of a surface one pixel sees there (textures pick their mip level from it)
+	float footprintAt(float t) const { return _spreadAngle > 0.0f ? _spreadAngle * t * _b.length() : 0.0f; }
 
 	vec3 _a;
 	vec3 _b;
 	float _time;
+	//radians the cone widens per unit of distance, a pixel's angle for camera rays. 0 (a thin ray) for everything that bounced.
+	float _spreadAngle;
 };
\ No newline at end of file
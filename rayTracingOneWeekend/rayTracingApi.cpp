@@ -0,0 +1,408 @@
+/*
+	The renderer library, everything behind rayTracingApi.h.
+
+	Like main.cpp this is the one translation unit the engine headers are compiled into, so the functions they define
+	out of line (color, refract, surroundingBox...) exist once in the library. Only the rt* functions are exported,
+	a host never sees the C++ side.
+*/
+
+//no matrix dumps from a library
+#define CAMERA_PRINT_BASIS_EN 0
+
+#include <new>
+#include <iostream>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <future>
+#include <stdexcept>
+#include <cmath>
+#include "float.h"
+
+#define RT_API_BUILD
+#include "rayTracingApi.h"
+
+#include "defines.h"
+#include "vec3.h"
+#include "hitableList.h"
+#include "camera.h"
+#include "color.h"
+#include "sphere.h"
+#include "xy_rect.h"
+#include "box.h"
+#include "material.h"
+#include "texture.h"
+#include "bvhNode.h"
+#include "lightSampler.h"
+#include "renderer.h"
+
+//https://github.com/nothings/stb, static so it can't clash with a host that has its own copy
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "mipmapCache.h"
+
+struct rtScene {
+	std::vector<std::unique_ptr<Texture>> textures;
+	std::vector<std::unique_ptr<Material>> materials;
+	std::vector<std::unique_ptr<Hitable>> shapes;
+	//the BVH keeps pointers into this
+	std::vector<Hitable *> shapeList;
+
+	EmitterRegistry emitters;
+	std::unique_ptr<BvhNode> world;
+	uint64_t seed;
+};
+
+struct rtRenderer {
+	explicit rtRenderer(uint32_t numOfThreads) : renderer(numOfThreads) {}
+
+	Renderer renderer;
+};
+
+namespace {
+
+//scene building draws from randomNumberGenerator and hands out the hitable/material ids, one at a time
+std::mutex sceneBuildMutex;
+
+bool isValid(const float value[3]) {
+	return value != NULL && std::isfinite(value[0]) && std::isfinite(value[1]) && std::isfinite(value[2]);
+}
+
+//finite and not empty or flipped, the rectangles' hit test has no other guard
+bool isValidRange(float low, float high) {
+	return std::isfinite(low) && std::isfinite(high) && low < high;
+}
+
+//the camera's basis is cross products of these, a zero view direction or an up along it normalizes to NaN
+bool isValidView(const float lookFrom[3], const float lookAt[3], const float up[3]) {
+	vec3 viewDirection(lookAt[0] - lookFrom[0], lookAt[1] - lookFrom[1], lookAt[2] - lookFrom[2]);
+	float sideLength = cross(vec3(up[0], up[1], up[2]), viewDirection).length();
+
+	return std::isfinite(sideLength) && sideLength > 0.0f;
+}
+
+rtStatus addTexture(rtScene *scene, Texture *texture, rtTexture *handle) {
+	scene->textures.push_back(std::unique_ptr<Texture>(texture));
+	*handle = (rtTexture)(scene->textures.size() - 1);
+	return RT_OK;
+}
+
+rtStatus addMaterial(rtScene *scene, Material *material, rtMaterial *handle) {
+	scene->materials.push_back(std::unique_ptr<Material>(material));
+	*handle = (rtMaterial)(scene->materials.size() - 1);
+	return RT_OK;
+}
+
+rtStatus addShape(rtScene *scene, Hitable *shape, rtMaterial material) {
+	scene->shapes.push_back(std::unique_ptr<Hitable>(shape));
+	scene->shapeList.push_back(shape);
+
+	//lights get sampled directly, shapes that can't be sampled (boxes) still light whatever they are hit from
+	Material *materialPointer = scene->materials[material].get();
+	if (dynamic_cast<DiffuseLight *>(materialPointer) != NULL && shape->surfaceArea() > 0.0f) {
+		scene->emitters.addEmitter(shape, materialPointer);
+	}
+	return RT_OK;
+}
+
+//every scene call starts with this, checks the handle and that the scene is still open for adding
+#define RT_CHECK_OPEN_SCENE(scene)								\
+	if ((scene) == NULL) return RT_ERROR_INVALID_ARGUMENT;		\
+	std::lock_guard<std::mutex> lock(sceneBuildMutex);			\
+	if ((scene)->world) return RT_ERROR_INVALID_STATE;
+
+//the engine reports running out of memory with bad_alloc, nothing else is expected to get here
+#define RT_CATCH_ALL													\
+	catch (const std::bad_alloc &) { return RT_ERROR_OUT_OF_MEMORY; }	\
+	catch (...) { return RT_ERROR_INTERNAL; }
+
+}
+
+extern "C" {
+
+RT_API uint32_t rtGetApiVersion(void) {
+	return RT_API_VERSION;
+}
+
+RT_API const char *rtGetStatusString(rtStatus status) {
+	switch (status) {
+	case RT_OK: return "ok";
+	case RT_ERROR_INVALID_ARGUMENT: return "invalid argument";
+	case RT_ERROR_INVALID_STATE: return "invalid state";
+	case RT_ERROR_OUT_OF_MEMORY: return "out of memory";
+	case RT_ERROR_IO: return "file can't be read";
+	case RT_ERROR_INTERNAL: return "internal error";
+	}
+	return "unknown status";
+}
+
+RT_API rtStatus rtSceneCreate(uint64_t seed, rtScene **scene) {
+	if (scene == NULL) {
+		return RT_ERROR_INVALID_ARGUMENT;
+	}
+
+	*scene = new (std::nothrow) rtScene;
+	if (*scene == NULL) {
+		return RT_ERROR_OUT_OF_MEMORY;
+	}
+	(*scene)->seed = seed;
+	return RT_OK;
+}
+
+RT_API void rtSceneDestroy(rtScene *scene) {
+	std::lock_guard<std::mutex> lock(sceneBuildMutex);
+	delete scene;
+}
+
+RT_API rtStatus rtSceneAddConstantTexture(rtScene *scene, const float color[3], rtTexture *texture) {
+	RT_CHECK_OPEN_SCENE(scene);
+	if (!isValid(color) || texture == NULL) {
+		return RT_ERROR_INVALID_ARGUMENT;
+	}
+
+	try {
+		return addTexture(scene, new ConstantTexture(vec3(color[0], color[1], color[2])), texture);
+	}
+	RT_CATCH_ALL
+}
+
+RT_API rtStatus rtSceneAddCheckerTexture(rtScene *scene, rtTexture even, rtTexture odd, rtTexture *texture) {
+	RT_CHECK_OPEN_SCENE(scene);
+	if (even >= scene->textures.size() || odd >= scene->textures.size() || texture == NULL) {
+		return RT_ERROR_INVALID_ARGUMENT;
+	}
+
+	try {
+		return addTexture(scene, new CheckerTexture(scene->textures[even].get(), scene->textures[odd].get()), texture);
+	}
+	RT_CATCH_ALL
+}
+
+RT_API rtStatus rtSceneAddNoiseTexture(rtScene *scene, float scale, rtTexture *texture) {
+	RT_CHECK_OPEN_SCENE(scene);
+	if (!std::isfinite(scale) || texture == NULL) {
+		return RT_ERROR_INVALID_ARGUMENT;
+	}
+
+	try {
+		return addTexture(scene, new NoiseTexture(true, scale), texture);
+	}
+	RT_CATCH_ALL
+}
+
+RT_API rtStatus rtSceneAddImageTexture(rtScene *scene, const char *path, rtTexture *texture) {
+	RT_CHECK_OPEN_SCENE(scene);
+	if (path == NULL || texture == NULL) {
+		return RT_ERROR_INVALID_ARGUMENT;
+	}
+
+	try {
+		const MipmappedImage *mipmaps = MipmapCache::load(path);
+		if (mipmaps == NULL) {
+			return RT_ERROR_IO;
+		}
+		return addTexture(scene, new ImageTexture(mipmaps), texture);
+	}
+	RT_CATCH_ALL
+}
+
+RT_API rtStatus rtSceneAddLambertian(rtScene *scene, rtTexture albedo, rtMaterial *material) {
+	RT_CHECK_OPEN_SCENE(scene);
+	if (albedo >= scene->textures.size() || material == NULL) {
+		return RT_ERROR_INVALID_ARGUMENT;
+	}
+
+	try {
+		return addMaterial(scene, new Lambertian(scene->textures[albedo].get()), material);
+	}
+	RT_CATCH_ALL
+}
+
+RT_API rtStatus rtSceneAddMetal(rtScene *scene, const float albedo[3], float fuzz, rtMaterial *material) {
+	RT_CHECK_OPEN_SCENE(scene);
+	if (!isValid(albedo) || !std::isfinite(fuzz) || material == NULL) {
+		return RT_ERROR_INVALID_ARGUMENT;
+	}
+
+	try {
+		return addMaterial(scene, new Metal(vec3(albedo[0], albedo[1], albedo[2]), fuzz), material);
+	}
+	RT_CATCH_ALL
+}
+
+RT_API rtStatus rtSceneAddDielectric(rtScene *scene, float refractiveIndex, rtMaterial *material) {
+	RT_CHECK_OPEN_SCENE(scene);
+	if (!(refractiveIndex > 0.0f) || material == NULL) {
+		return RT_ERROR_INVALID_ARGUMENT;
+	}
+
+	try {
+		return addMaterial(scene, new Dielectric(refractiveIndex), material);
+	}
+	RT_CATCH_ALL
+}
+
+RT_API rtStatus rtSceneAddDiffuseLight(rtScene *scene, rtTexture emitted, rtMaterial *material) {
+	RT_CHECK_OPEN_SCENE(scene);
+	if (emitted >= scene->textures.size() || material == NULL) {
+		return RT_ERROR_INVALID_ARGUMENT;
+	}
+
+	try {
+		return addMaterial(scene, new DiffuseLight(scene->textures[emitted].get()), material);
+	}
+	RT_CATCH_ALL
+}
+
+RT_API rtStatus rtSceneAddSphere(rtScene *scene, const float center[3], float radius, rtMaterial material) {
+	RT_CHECK_OPEN_SCENE(scene);
+	if (!isValid(center) || !(radius > 0.0f) || material >= scene->materials.size()) {
+		return RT_ERROR_INVALID_ARGUMENT;
+	}
+
+	try {
+		return addShape(scene, new Sphere(vec3(center[0], center[1], center[2]), radius, scene->materials[material].get()), material);
+	}
+	RT_CATCH_ALL
+}
+
+RT_API rtStatus rtSceneAddBox(rtScene *scene, const float minCorner[3], const float maxCorner[3], rtMaterial material) {
+	RT_CHECK_OPEN_SCENE(scene);
+	if (minCorner == NULL || maxCorner == NULL || !isValidRange(minCorner[0], maxCorner[0]) || !isValidRange(minCorner[1], maxCorner[1]) ||
+		!isValidRange(minCorner[2], maxCorner[2]) || material >= scene->materials.size()) {
+		return RT_ERROR_INVALID_ARGUMENT;
+	}
+
+	try {
+		vec3 p0(minCorner[0], minCorner[1], minCorner[2]);
+		vec3 p1(maxCorner[0], maxCorner[1], maxCorner[2]);
+		return addShape(scene, new Box(p0, p1, scene->materials[material].get()), material);
+	}
+	RT_CATCH_ALL
+}
+
+RT_API rtStatus rtSceneAddRectangleXY(rtScene *scene, float x0, float x1, float y0, float y1, float k, rtMaterial material) {
+	RT_CHECK_OPEN_SCENE(scene);
+	if (!isValidRange(x0, x1) || !isValidRange(y0, y1) || !std::isfinite(k) || material >= scene->materials.size()) {
+		return RT_ERROR_INVALID_ARGUMENT;
+	}
+
+	try {
+		return addShape(scene, new XYRectangle(x0, x1, y0, y1, k, scene->materials[material].get()), material);
+	}
+	RT_CATCH_ALL
+}
+
+RT_API rtStatus rtSceneAddRectangleXZ(rtScene *scene, float x0, float x1, float z0, float z1, float k, rtMaterial material) {
+	RT_CHECK_OPEN_SCENE(scene);
+	if (!isValidRange(x0, x1) || !isValidRange(z0, z1) || !std::isfinite(k) || material >= scene->materials.size()) {
+		return RT_ERROR_INVALID_ARGUMENT;
+	}
+
+	try {
+		return addShape(scene, new XZRectangle(x0, x1, z0, z1, k, scene->materials[material].get()), material);
+	}
+	RT_CATCH_ALL
+}
+
+RT_API rtStatus rtSceneAddRectangleYZ(rtScene *scene, float y0, float y1, float z0, float z1, float k, rtMaterial material) {
+	RT_CHECK_OPEN_SCENE(scene);
+	if (!isValidRange(y0, y1) || !isValidRange(z0, z1) || !std::isfinite(k) || material >= scene->materials.size()) {
+		return RT_ERROR_INVALID_ARGUMENT;
+	}
+
+	try {
+		return addShape(scene, new YZRectangle(y0, y1, z0, z1, k, scene->materials[material].get()), material);
+	}
+	RT_CATCH_ALL
+}
+
+RT_API rtStatus rtSceneBuild(rtScene *scene) {
+	RT_CHECK_OPEN_SCENE(scene);
+	if (scene->shapeList.empty()) {
+		return RT_ERROR_INVALID_STATE;
+	}
+
+	try {
+		seedRandomNumberGenerator(scene->seed);
+		scene->world.reset(new BvhNode(scene->shapeList.data(), (int)scene->shapeList.size(), 0.0f, 1.0f));
+		scene->emitters.build();
+		return RT_OK;
+	}
+	RT_CATCH_ALL
+}
+
+RT_API rtStatus rtRendererCreate(uint32_t numOfThreads, rtRenderer **renderer) {
+	if (renderer == NULL) {
+		return RT_ERROR_INVALID_ARGUMENT;
+	}
+
+	if (numOfThreads == 0) {
+		numOfThreads = std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	try {
+		*renderer = new rtRenderer(numOfThreads);
+		return RT_OK;
+	}
+	RT_CATCH_ALL
+}
+
+RT_API void rtRendererDestroy(rtRenderer *renderer) {
+	delete renderer;
+}
+
+RT_API uint32_t rtRendererGetNumOfThreads(const rtRenderer *renderer) {
+	return renderer ? renderer->renderer.getNumOfThreads() : 0;
+}
+
+RT_API rtStatus rtRender(rtRenderer *renderer, const rtScene *scene, const rtCamera *camera, uint32_t width, uint32_t height,
+	uint32_t samplesPerPixel, float *pixels, size_t rowStrideInFloats, rtRenderStats *stats) {
+
+	if (renderer == NULL || scene == NULL || camera == NULL || pixels == NULL || width == 0 || height == 0 || samplesPerPixel == 0 ||
+		(rowStrideInFloats != 0 && rowStrideInFloats < (size_t)width * 3) || rowStrideInFloats > UINT32_MAX ||
+		!isValid(camera->lookFrom) || !isValid(camera->lookAt) || !isValid(camera->up) || !isValidView(camera->lookFrom, camera->lookAt, camera->up) ||
+		!(camera->verticalFovDegrees > 0.0f && camera->verticalFovDegrees < 180.0f) ||
+		!(camera->aperture >= 0.0f) || !std::isfinite(camera->aperture) ||
+		!(camera->focusDistance > 0.0f) || !std::isfinite(camera->focusDistance)) {
+		return RT_ERROR_INVALID_ARGUMENT;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(sceneBuildMutex);
+		if (!scene->world) {
+			return RT_ERROR_INVALID_STATE;
+		}
+	}
+
+	try {
+		Camera renderCamera(
+			vec3(camera->lookFrom[0], camera->lookFrom[1], camera->lookFrom[2]),
+			vec3(camera->lookAt[0], camera->lookAt[1], camera->lookAt[2]),
+			vec3(camera->up[0], camera->up[1], camera->up[2]),
+			camera->verticalFovDegrees, float(width) / float(height), camera->aperture, camera->focusDistance, 0.0f, 1.0f);
+
+		SceneHandle sceneHandle = { scene->world.get(), &scene->emitters };
+		RenderJob job(sceneHandle, renderCamera, width, height, samplesPerPixel);
+		job.outputPixels = pixels;
+		job.outputRowStrideInFloats = (uint32_t)rowStrideInFloats;
+
+		RenderResult result = renderer->renderer.submit(job).get();
+
+		if (stats != NULL) {
+			stats->queueLatencyMs = result.stats.queueLatencyMs;
+			stats->renderTimeMs = result.stats.renderTimeMs;
+			stats->samplesPerSecond = result.stats.samplesPerSecond;
+			stats->numOfTiles = result.stats.numOfTiles;
+		}
+		return RT_OK;
+	}
+	catch (const std::invalid_argument &) {
+		return RT_ERROR_INVALID_ARGUMENT;
+	}
+	RT_CATCH_ALL
+}
+
+}
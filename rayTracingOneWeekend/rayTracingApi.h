@@ -0,0 +1,138 @@
+#pragma once
+
+/*
+	C interface of the renderer library (rayTracingLibrary.vcxproj, built from rayTracingApi.cpp).
+
+	Plain C so anything with a C FFI can link it, and nothing C++ crosses the boundary: scenes and renderers are opaque
+	handles, textures/materials are small integer handles into their scene, every call returns an rtStatus. A host
+	renders straight into its own float buffer, there is no process to spawn or image file to parse.
+
+		rtScene *scene;
+		rtSceneCreate(seed, &scene);
+		rtSceneAddConstantTexture(scene, gray, &texture);
+		rtSceneAddLambertian(scene, texture, &material);
+		rtSceneAddSphere(scene, center, radius, material);
+		rtSceneBuild(scene);
+
+		rtRenderer *renderer;
+		rtRendererCreate(0, &renderer);
+		rtRender(renderer, scene, &camera, width, height, samplesPerPixel, pixels, 0, &stats);
+
+	Adding to scenes (and building them) is serialized inside the library, they share the engine's RNG. A built scene
+	is read only, any number of threads can rtRender it at once, on one renderer or several. Jobs submitted to the same
+	renderer at the same time share its threads.
+
+	The coordinate frame is the engine's NED one (+x north, +y east, +z down), see camera.h.
+
+	Bump RT_API_VERSION whenever a signature or struct here changes, hosts can check rtGetApiVersion() at load time.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RT_API_VERSION 1
+
+//define RT_API_STATIC when linking the static library instead of the DLL
+#if defined (RT_API_STATIC)
+#define RT_API
+#elif defined (_WIN32)
+#if defined (RT_API_BUILD)
+#define RT_API __declspec(dllexport)
+#else
+#define RT_API __declspec(dllimport)
+#endif
+#elif defined (__GNUC__)
+#define RT_API __attribute__((visibility("default")))
+#else
+#define RT_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum rtStatus {
+	RT_OK = 0,
+	RT_ERROR_INVALID_ARGUMENT = -1,
+	//adding to a scene that was already built, rendering one that wasn't
+	RT_ERROR_INVALID_STATE = -2,
+	RT_ERROR_OUT_OF_MEMORY = -3,
+	//a texture image that can't be read
+	RT_ERROR_IO = -4,
+	RT_ERROR_INTERNAL = -5
+} rtStatus;
+
+typedef struct rtScene rtScene;
+typedef struct rtRenderer rtRenderer;
+
+typedef uint32_t rtTexture;
+typedef uint32_t rtMaterial;
+
+typedef struct rtCamera {
+	//lookAt has to differ from lookFrom, and up can't point along the view direction
+	float lookFrom[3];
+	float lookAt[3];
+	float up[3];
+	//between 0 and 180, exclusive
+	float verticalFovDegrees;
+	//0 for a pinhole camera, never negative
+	float aperture;
+	//has to be > 0
+	float focusDistance;
+} rtCamera;
+
+typedef struct rtRenderStats {
+	//submit to first tile, first tile to last
+	float queueLatencyMs;
+	float renderTimeMs;
+	double samplesPerSecond;
+	uint32_t numOfTiles;
+} rtRenderStats;
+
+RT_API uint32_t rtGetApiVersion(void);
+RT_API const char *rtGetStatusString(rtStatus status);
+
+//the seed drives everything random in the scene build (BVH split axes), same adds + same seed = same scene
+RT_API rtStatus rtSceneCreate(uint64_t seed, rtScene **scene);
+//frees every texture, material, shape and the BVH of the scene. No render may be using it.
+RT_API void rtSceneDestroy(rtScene *scene);
+
+RT_API rtStatus rtSceneAddConstantTexture(rtScene *scene, const float color[3], rtTexture *texture);
+RT_API rtStatus rtSceneAddCheckerTexture(rtScene *scene, rtTexture even, rtTexture odd, rtTexture *texture);
+RT_API rtStatus rtSceneAddNoiseTexture(rtScene *scene, float scale, rtTexture *texture);
+//any format stb_image reads, converted to a mip chain once per machine (see mipmapCache.h)
+RT_API rtStatus rtSceneAddImageTexture(rtScene *scene, const char *path, rtTexture *texture);
+
+RT_API rtStatus rtSceneAddLambertian(rtScene *scene, rtTexture albedo, rtMaterial *material);
+RT_API rtStatus rtSceneAddMetal(rtScene *scene, const float albedo[3], float fuzz, rtMaterial *material);
+RT_API rtStatus rtSceneAddDielectric(rtScene *scene, float refractiveIndex, rtMaterial *material);
+//shapes with a light material are sampled directly as well as hit
+RT_API rtStatus rtSceneAddDiffuseLight(rtScene *scene, rtTexture emitted, rtMaterial *material);
+
+RT_API rtStatus rtSceneAddSphere(rtScene *scene, const float center[3], float radius, rtMaterial material);
+//minCorner has to be below maxCorner on every axis
+RT_API rtStatus rtSceneAddBox(rtScene *scene, const float minCorner[3], const float maxCorner[3], rtMaterial material);
+//axis aligned rectangles, the plane sits at k on the remaining axis. Bounds have to be finite with x0 < x1 etc.
+RT_API rtStatus rtSceneAddRectangleXY(rtScene *scene, float x0, float x1, float y0, float y1, float k, rtMaterial material);
+RT_API rtStatus rtSceneAddRectangleXZ(rtScene *scene, float x0, float x1, float z0, float z1, float k, rtMaterial material);
+RT_API rtStatus rtSceneAddRectangleYZ(rtScene *scene, float y0, float y1, float z0, float z1, float k, rtMaterial material);
+
+//builds the BVH and the light table, the scene can't be added to afterwards
+RT_API rtStatus rtSceneBuild(rtScene *scene);
+
+//0 threads = one per hardware thread
+RT_API rtStatus rtRendererCreate(uint32_t numOfThreads, rtRenderer **renderer);
+//waits for the tiles in flight, renders still waiting in rtRender return RT_ERROR_INTERNAL
+RT_API void rtRendererDestroy(rtRenderer *renderer);
+RT_API uint32_t rtRendererGetNumOfThreads(const rtRenderer *renderer);
+
+/*
+	Blocks until the image is done. pixels gets linear RGB floats written in place, top row first, row r starting at
+	pixels + r * rowStrideInFloats (0 = width * 3). stats may be NULL.
+*/
+RT_API rtStatus rtRender(rtRenderer *renderer, const rtScene *scene, const rtCamera *camera, uint32_t width, uint32_t height,
+	uint32_t samplesPerPixel, float *pixels, size_t rowStrideInFloats, rtRenderStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
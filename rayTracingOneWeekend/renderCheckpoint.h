@@ -0,0 +1,195 @@
+#pragma once
+
+#include <string>
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "vec3.h"
+#include "camera.h"
+#include "mappedFile.h"
+#include "accumulationBuffer.h"
+
+#define RENDER_CHECKPOINT_VERSION 1
+
+//fixed size, followed by the color sums (3 floats a pixel), the luminance squared sums and the sample counts
+struct RenderCheckpointHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSizeInBytes;
+	uint32_t resWidthInPixels, resHeightInPixels;
+	uint32_t sceneId;
+	//passes already in the sums, the resumed render traces pass passCount next
+	uint32_t passCount;
+	uint64_t seed;
+	uint64_t payloadChecksum;
+	//the rest decides which samples a pass traces, a resume has to run with the same values to continue the sequence
+	uint32_t samplesPerPass;
+	uint32_t tileSizeInPixels;
+	uint32_t batchSize;
+	float cameraRayState[CAMERA_RAY_STATE_SIZE];
+};
+
+static_assert(sizeof(RenderCheckpointHeader) == 144, "the checkpoint header is written as is");
+static_assert(sizeof(vec3) == 3 * sizeof(float), "the color sums are written as is");
+
+/*
+	Snapshots of a long progressive render, so it can be stopped (or crash) and be picked up again later.
+
+	A checkpoint is the accumulation buffer's raw sums plus what is needed to go on tracing the same samples: the
+	render seed, the pass count and the camera's rays. The samples a tile traces only depend on the seed, the pass and
+	where the tile is (seedTileRandomNumberGenerator in rngs.h), so there is no generator state to save, a resumed
+	render traces exactly the passes the uninterrupted one would have and the sums come out bit for bit the same. That
+	holds as long as the scene, samples per pass, tile size and batch size match, isCompatible() checks those.
+
+	write() fills path.tmp through a read/write mapping, flushes it to the disk and then renames it over path, so a
+	crash in the middle leaves the previous checkpoint alone. The payload has a checksum that restore() checks.
+
+	Only call these while nothing is accumulating. The AOVs are not saved, they start over with the resumed passes.
+*/
+class RenderCheckpoint {
+public:
+	//header carries the scene, seed, sampling settings and camera rays, the rest comes from buffer. 0 on success.
+	static uint32_t write(const std::string &path, RenderCheckpointHeader header, const AccumulationBuffer &buffer);
+
+	//only reads and checks the header, the seed has to be known before the scene is built
+	static bool readHeader(const std::string &path, RenderCheckpointHeader &header);
+
+	//false (and why on the console) if the checkpoint came from a render that samples differently than current
+	static bool isCompatible(const RenderCheckpointHeader &checkpoint, const RenderCheckpointHeader &current);
+
+	//checks the payload and loads it into buffer, which takes viewGeneration and the checkpoint's pass count
+	static bool restore(const std::string &path, AccumulationBuffer &buffer, uint64_t viewGeneration);
+
+protected:
+	static size_t getPayloadSizeInBytes(uint32_t resWidthInPixels, uint32_t resHeightInPixels) {
+		size_t numOfPixels = (size_t)resWidthInPixels * resHeightInPixels;
+		return numOfPixels * (sizeof(vec3) + sizeof(float) + sizeof(uint32_t));
+	}
+
+	static bool checkHeader(const std::string &path, const MappedFile &file, RenderCheckpointHeader &header);
+};
+
+uint32_t RenderCheckpoint::write(const std::string &path, RenderCheckpointHeader header, const AccumulationBuffer &buffer) {
+	uint32_t width = buffer.getWidth();
+	uint32_t height = buffer.getHeight();
+	size_t numOfPixels = (size_t)width * height;
+	size_t payloadSizeInBytes = getPayloadSizeInBytes(width, height);
+
+	memcpy(header.magic, "RTCHKPT", sizeof(header.magic));
+	header.version = RENDER_CHECKPOINT_VERSION;
+	header.headerSizeInBytes = sizeof(RenderCheckpointHeader);
+	header.resWidthInPixels = width;
+	header.resHeightInPixels = height;
+	header.passCount = buffer.getPassCount();
+
+	std::string temporaryPath = path + ".tmp";
+	MappedFile file;
+
+	if (!file.create(temporaryPath, sizeof(header) + payloadSizeInBytes)) {
+		std::cout << "Can't create " << temporaryPath << "\n";
+		return 1;
+	}
+
+	uint8_t *payload = file.mutableData() + sizeof(header);
+	memcpy(payload, buffer.getColorSums(), numOfPixels * sizeof(vec3));
+	memcpy(payload + numOfPixels * sizeof(vec3), buffer.getLuminanceSquaredSums(), numOfPixels * sizeof(float));
+	memcpy(payload + numOfPixels * (sizeof(vec3) + sizeof(float)), buffer.getSampleCounts(), numOfPixels * sizeof(uint32_t));
+
+	header.payloadChecksum = checksumBytes(payload, payloadSizeInBytes);
+	memcpy(file.mutableData(), &header, sizeof(header));
+
+	//on the disk before the rename, otherwise a crash could leave a renamed file with holes in it
+	bool flushed = file.flush();
+	file.close();
+
+	if (!flushed || !replaceFile(temporaryPath, path)) {
+		std::cout << "Failed to write checkpoint " << path << "\n";
+		remove(temporaryPath.c_str());
+		return 1;
+	}
+	return 0;
+}
+
+bool RenderCheckpoint::checkHeader(const std::string &path, const MappedFile &file, RenderCheckpointHeader &header) {
+	if (file.getSizeInBytes() < sizeof(header)) {
+		std::cout << path << " is not a checkpoint\n";
+		return false;
+	}
+	memcpy(&header, file.data(), sizeof(header));
+
+	if (memcmp(header.magic, "RTCHKPT", sizeof(header.magic)) != 0 || header.headerSizeInBytes != sizeof(header)) {
+		std::cout << path << " is not a checkpoint\n";
+		return false;
+	}
+	if (header.version != RENDER_CHECKPOINT_VERSION) {
+		std::cout << path << " is a version " << header.version << " checkpoint, this build reads version " << RENDER_CHECKPOINT_VERSION << "\n";
+		return false;
+	}
+	if (file.getSizeInBytes() != sizeof(header) + getPayloadSizeInBytes(header.resWidthInPixels, header.resHeightInPixels)) {
+		std::cout << path << " is truncated\n";
+		return false;
+	}
+	return true;
+}
+
+bool RenderCheckpoint::readHeader(const std::string &path, RenderCheckpointHeader &header) {
+	MappedFile file;
+
+	if (!file.open(path)) {
+		std::cout << "Can't open checkpoint " << path << "\n";
+		return false;
+	}
+	return checkHeader(path, file, header);
+}
+
+bool RenderCheckpoint::isCompatible(const RenderCheckpointHeader &checkpoint, const RenderCheckpointHeader &current) {
+	if (checkpoint.sceneId != current.sceneId) {
+		std::cout << "The checkpoint is of scene " << checkpoint.sceneId << ", this render is scene " << current.sceneId << "\n";
+		return false;
+	}
+	if (checkpoint.resWidthInPixels != current.resWidthInPixels || checkpoint.resHeightInPixels != current.resHeightInPixels) {
+		std::cout << "The checkpoint is " << checkpoint.resWidthInPixels << "x" << checkpoint.resHeightInPixels << ", this render is "
+			<< current.resWidthInPixels << "x" << current.resHeightInPixels << "\n";
+		return false;
+	}
+	if (checkpoint.samplesPerPass != current.samplesPerPass || checkpoint.tileSizeInPixels != current.tileSizeInPixels || checkpoint.batchSize != current.batchSize) {
+		std::cout << "The checkpoint was traced with " << checkpoint.samplesPerPass << " samples a pass, " << checkpoint.tileSizeInPixels << " pixel tiles and batches of "
+			<< checkpoint.batchSize << ", this render uses " << current.samplesPerPass << ", " << current.tileSizeInPixels << " and " << current.batchSize << "\n";
+		return false;
+	}
+	return true;
+}
+
+bool RenderCheckpoint::restore(const std::string &path, AccumulationBuffer &buffer, uint64_t viewGeneration) {
+	MappedFile file;
+	RenderCheckpointHeader header;
+
+	if (!file.open(path)) {
+		std::cout << "Can't open checkpoint " << path << "\n";
+		return false;
+	}
+	if (!checkHeader(path, file, header)) {
+		return false;
+	}
+	if (header.resWidthInPixels != buffer.getWidth() || header.resHeightInPixels != buffer.getHeight()) {
+		std::cout << "The checkpoint " << path << " doesn't match the " << buffer.getWidth() << "x" << buffer.getHeight() << " accumulation buffer\n";
+		return false;
+	}
+
+	const uint8_t *payload = file.data() + sizeof(header);
+	if (checksumBytes(payload, getPayloadSizeInBytes(header.resWidthInPixels, header.resHeightInPixels)) != header.payloadChecksum) {
+		std::cout << "The checkpoint " << path << " is corrupt\n";
+		return false;
+	}
+
+	//the mapping is page aligned and every array starts at a multiple of 4 bytes, enough for floats
+	size_t numOfPixels = (size_t)header.resWidthInPixels * header.resHeightInPixels;
+	buffer.restore(viewGeneration, header.passCount,
+		(const vec3 *)payload,
+		(const float *)(payload + numOfPixels * sizeof(vec3)),
+		(const uint32_t *)(payload + numOfPixels * (sizeof(vec3) + sizeof(float))));
+
+	return true;
+}
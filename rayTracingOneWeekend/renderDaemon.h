@@ -0,0 +1,644 @@
+#pragma once
+
+#include <map>
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <functional>
+#include <condition_variable>
+#include <string.h>
+#include <stdint.h>
+#include <stdexcept>
+
+#include "tcpSocket.h"
+#include "defines.h"
+#include "vec3.h"
+#include "camera.h"
+#include "hitable.h"
+#include "lightSampler.h"
+#include "sceneFile.h"
+#include "sceneOwner.h"
+#include "renderer.h"
+#include "distributedRender.h"
+
+/*
+	Long running render process. Scenes are built once and kept, so a repeated render of the same scene skips the
+	scene generation, BVH build, texture loads and thread startup and goes straight to tracing.
+
+	A request names a scene file, cached under the hash of its contents (a renamed copy is the same scene, an edited
+	file a new one), or a built in scene the way the distributed mode ships it, scene id plus RNG seed, which is all
+	that scene's content comes from and so is what gets hashed. Up to RENDER_DAEMON_MAX_CACHED_SCENES stay built, past
+	that the least recently used one is destroyed (once the renders still using it are done, see sceneOwner.h for how a
+	built in scene is freed). A build runs outside the cache lock, requests for scenes that are already there don't
+	wait for it, ones for the scene being built wait for that build instead of starting another.
+
+	Requests come in over a local (Unix domain) socket and are rendered by one shared Renderer, so several clients can
+	have jobs in flight at once and their priorities/weights apply between them. Framing is the distributed mode's
+	{type, size} header:
+
+	client										daemon
+	RENDER {scene, seed, size, spp, camera...}
+												TILE {tile} + RGB floats per pixel (if asked for, as they finish)
+												ROWS {first row, count} + RGB floats per pixel (the whole image, bottom row first)
+												DONE {stats}
+	or										ERROR {text}
+	... more RENDERs on the same connection ...
+	SHUTDOWN									stops the daemon
+
+	Pixels are linear color, the client does its own gamma/tonemapping. The image goes out in bands so a 4k float frame
+	doesn't hit DISTRIBUTED_MAX_MESSAGE_SIZE.
+*/
+
+enum RenderDaemonMessageType {
+	RENDER_DAEMON_MSG_RENDER = 100,
+	RENDER_DAEMON_MSG_TILE,
+	RENDER_DAEMON_MSG_ROWS,
+	RENDER_DAEMON_MSG_DONE,
+	RENDER_DAEMON_MSG_ERROR,
+	RENDER_DAEMON_MSG_SHUTDOWN
+};
+
+//stream every tile back as soon as it is traced, not just the final image
+#define RENDER_DAEMON_FLAG_STREAM_TILES 0x1
+
+struct RenderDaemonRequest {
+	uint32_t sceneId;
+	uint32_t flags;
+	uint64_t seed;
+	uint32_t resWidthInPixels, resHeightInPixels;
+	uint32_t samplesPerPixel;
+	int32_t priority;
+	uint32_t weight;
+	float cameraRayState[CAMERA_RAY_STATE_SIZE];
+	//scene file (text or compiled) to render instead of sceneId, empty for the built in scene
+	char scenePath[RENDER_DAEMON_MAX_SCENE_PATH_SIZE];
+};
+
+//followed by tile width * height RGB floats, rows bottom to top
+struct RenderDaemonTileMessage {
+	uint32_t columnStart, columnEnd;
+	uint32_t rowStart, rowEnd;
+	uint32_t index;
+	uint32_t tilesDone, numOfTiles;
+};
+
+//followed by numOfRows * width RGB floats
+struct RenderDaemonRowsMessage {
+	uint32_t rowStart, numOfRows;
+};
+
+struct RenderDaemonDoneMessage {
+	uint64_t sceneHash;
+	//1 if the scene was already built
+	uint32_t sceneCacheHit;
+	//time to build the scene for this request, 0 on a cache hit
+	float sceneSetupMs;
+	float queueLatencyMs;
+	float renderTimeMs;
+	double samplesPerSecond;
+};
+
+//FNV-1a, only has to tell scene descriptions apart, not resist anybody
+uint64_t hashSceneDescription(const void *data, size_t sizeInBytes, uint64_t hash = 0xcbf29ce484222325ULL) {
+	const uint8_t *bytes = (const uint8_t *)data;
+
+	for (size_t byte = 0; byte < sizeInBytes; byte++) {
+		hash ^= bytes[byte];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+//builds the scene the id names, the RNG has already been seeded. Same contract as buildScene() in main.cpp.
+typedef std::function<Hitable *(uint32_t sceneId, EmitterRegistry *emitterRegistry)> SceneBuilder;
+
+class RenderDaemon {
+public:
+	RenderDaemon(Renderer &renderer, const SceneBuilder &sceneBuilder) :
+		_renderer(renderer), _sceneBuilder(sceneBuilder), _running(false), _sceneUseCount(0) {
+	}
+
+	~RenderDaemon() {
+		stop();
+	}
+
+	//starts taking connections in the background
+	bool start(const std::string &socketPath) {
+		if (!_listenSocket.listenLocal(socketPath)) {
+			std::cout << "Render daemon failed to listen on " << socketPath << "\n";
+			return false;
+		}
+
+		_socketPath = socketPath;
+		_running = true;
+		_acceptThread = std::thread(&RenderDaemon::acceptProcedure, this);
+		return true;
+	}
+
+	//blocks until a client sends SHUTDOWN
+	void waitForShutdown() {
+		std::unique_lock<std::mutex> lock(_connectionMutex);
+		_shutdownConditionVar.wait(lock, [this] { return !_running; });
+	}
+
+	void stop();
+
+	size_t getNumOfCachedScenes() {
+		std::lock_guard<std::mutex> lock(_sceneMutex);
+		return _scenes.size();
+	}
+
+protected:
+	struct CachedScene {
+		CachedScene() : world(NULL) {}
+
+		//a built in scene's objects, a scene file's live in its arena
+		SceneOwner owner;
+		SceneFile sceneFile;
+		Hitable *world;
+		EmitterRegistry emitters;
+	};
+
+	typedef std::shared_future<std::shared_ptr<CachedScene>> SceneFuture;
+
+	struct SceneCacheEntry {
+		//ready once the build is done, every request for the scene holds on to it until its render is done
+		SceneFuture scene;
+		uint64_t lastUsed;
+	};
+
+	struct Connection {
+		std::shared_ptr<TcpSocket> socket;
+		std::thread thread;
+		std::shared_ptr<std::atomic<bool>> finished;
+	};
+
+	//tiles handed over from the render threads, sent by the connection thread so a slow client never stalls a render thread
+	struct TileQueue {
+		std::mutex mutex;
+		std::condition_variable conditionVar;
+		std::deque<std::pair<RenderDaemonTileMessage, std::vector<float>>> tiles;
+	};
+
+	void acceptProcedure() {
+		while (_running) {
+			TcpSocket client = _listenSocket.accept();
+			if (!client.isOpen()) {
+				continue;
+			}
+
+			std::lock_guard<std::mutex> lock(_connectionMutex);
+			if (!_running) {
+				break;
+			}
+
+			//the daemon runs for days, don't keep every client that ever connected
+			for (auto connection = _connections.begin(); connection != _connections.end();) {
+				if (*connection->finished) {
+					connection->thread.join();
+					connection = _connections.erase(connection);
+				}
+				else {
+					++connection;
+				}
+			}
+
+			Connection connection;
+			connection.socket = std::make_shared<TcpSocket>(std::move(client));
+			connection.finished = std::make_shared<std::atomic<bool>>(false);
+			connection.thread = std::thread(&RenderDaemon::connectionProcedure, this, connection.socket, connection.finished);
+			_connections.push_back(std::move(connection));
+		}
+	}
+
+	void connectionProcedure(std::shared_ptr<TcpSocket> connection, std::shared_ptr<std::atomic<bool>> finished) {
+		serveConnection(*connection);
+		*finished = true;
+	}
+
+	void serveConnection(TcpSocket &connection) {
+		DistributedMessageHeader header;
+		std::vector<uint8_t> payload;
+
+		while (receiveDistributedMessage(connection, header, payload)) {
+			if (header.type == RENDER_DAEMON_MSG_SHUTDOWN) {
+				std::lock_guard<std::mutex> lock(_connectionMutex);
+				_running = false;
+				_shutdownConditionVar.notify_all();
+				return;
+			}
+
+			if (header.type != RENDER_DAEMON_MSG_RENDER || payload.size() != sizeof(RenderDaemonRequest)) {
+				sendError(connection, "unexpected message");
+				return;
+			}
+
+			RenderDaemonRequest request;
+			memcpy(&request, payload.data(), sizeof(request));
+
+			if (!render(connection, request)) {
+				return;
+			}
+		}
+	}
+
+	//false once the client is gone
+	bool render(TcpSocket &connection, const RenderDaemonRequest &request);
+
+	//throws if the scene can't be loaded or built
+	std::shared_ptr<CachedScene> getScene(const RenderDaemonRequest &request, uint64_t &sceneHash, bool &cacheHit, float &setupMs);
+
+	static bool sendError(TcpSocket &connection, const std::string &text) {
+		return sendDistributedMessage(connection, RENDER_DAEMON_MSG_ERROR, text.c_str(), (uint32_t)text.size());
+	}
+
+	static bool sendTiles(TcpSocket &connection, TileQueue &tileQueue) {
+		std::deque<std::pair<RenderDaemonTileMessage, std::vector<float>>> tiles;
+		{
+			std::lock_guard<std::mutex> lock(tileQueue.mutex);
+			tiles.swap(tileQueue.tiles);
+		}
+
+		std::vector<uint8_t> message;
+		for (const auto &tile : tiles) {
+			message.resize(sizeof(RenderDaemonTileMessage) + tile.second.size() * sizeof(float));
+			memcpy(message.data(), &tile.first, sizeof(RenderDaemonTileMessage));
+			memcpy(message.data() + sizeof(RenderDaemonTileMessage), tile.second.data(), tile.second.size() * sizeof(float));
+
+			if (!sendDistributedMessage(connection, RENDER_DAEMON_MSG_TILE, message.data(), (uint32_t)message.size())) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	Renderer &_renderer;
+	SceneBuilder _sceneBuilder;
+
+	TcpSocket _listenSocket;
+	std::string _socketPath;
+	std::atomic<bool> _running;
+	std::thread _acceptThread;
+
+	std::mutex _connectionMutex;
+	std::condition_variable _shutdownConditionVar;
+	std::vector<Connection> _connections;
+
+	//only held to look up/insert/evict, never for a load or a build
+	std::mutex _sceneMutex;
+	std::map<uint64_t, SceneCacheEntry> _scenes;
+	uint64_t _sceneUseCount;
+
+	//compiling a scene file writes next to it, and building goes through the process wide texture caches and ids
+	std::mutex _sceneLoadMutex;
+	std::mutex _sceneBuildMutex;
+};
+
+void RenderDaemon::stop() {
+	std::vector<Connection> connections;
+	{
+		std::lock_guard<std::mutex> lock(_connectionMutex);
+		_running = false;
+		_shutdownConditionVar.notify_all();
+
+		//wakes the accept and every connection blocked in a receive
+		_listenSocket.shutdown();
+		_listenSocket.close();
+		for (Connection &connection : _connections) {
+			connection.socket->shutdown();
+		}
+		connections.swap(_connections);
+	}
+
+	if (_acceptThread.joinable()) {
+		_acceptThread.join();
+	}
+
+	//a connection in the middle of a render finishes it first, the Renderer has no way to drop a job
+	for (Connection &connection : connections) {
+		connection.thread.join();
+	}
+
+	if (!_socketPath.empty()) {
+		remove(_socketPath.c_str());
+		_socketPath.clear();
+	}
+}
+
+std::shared_ptr<RenderDaemon::CachedScene> RenderDaemon::getScene(const RenderDaemonRequest &request, uint64_t &sceneHash, bool &cacheHit, float &setupMs) {
+	auto setupStart = std::chrono::high_resolution_clock::now();
+
+	std::shared_ptr<CachedScene> scene = std::make_shared<CachedScene>();
+	std::string scenePath(request.scenePath, strnlen(request.scenePath, sizeof(request.scenePath)));
+
+	if (!scenePath.empty()) {
+		//maps the file (compiling the text the first time), nothing is constructed until it turns out to be a miss
+		bool loaded = false;
+		{
+			std::lock_guard<std::mutex> lock(_sceneLoadMutex);
+			loaded = SceneFile::isCompiledScenePath(scenePath) ? scene->sceneFile.load(scenePath) : scene->sceneFile.loadSource(scenePath);
+		}
+		if (!loaded) {
+			throw std::runtime_error("can't load scene file " + scenePath);
+		}
+		sceneHash = scene->sceneFile.getSourceHash();
+	}
+	else {
+		sceneHash = hashSceneDescription(&request.sceneId, sizeof(request.sceneId));
+		sceneHash = hashSceneDescription(&request.seed, sizeof(request.seed), sceneHash);
+	}
+
+	std::promise<std::shared_ptr<CachedScene>> built;
+	SceneFuture cachedScene;
+	//dropped after the lock, the last reference to an evicted scene destroys it right there
+	std::vector<SceneCacheEntry> evicted;
+	{
+		std::lock_guard<std::mutex> lock(_sceneMutex);
+
+		auto cached = _scenes.find(sceneHash);
+		if (cached != _scenes.end()) {
+			cached->second.lastUsed = ++_sceneUseCount;
+			cachedScene = cached->second.scene;
+		}
+		else {
+			SceneCacheEntry entry = { built.get_future().share(), ++_sceneUseCount };
+			_scenes[sceneHash] = entry;
+
+			while (_scenes.size() > RENDER_DAEMON_MAX_CACHED_SCENES) {
+				auto leastRecentlyUsed = std::min_element(_scenes.begin(), _scenes.end(),
+					[](const std::pair<const uint64_t, SceneCacheEntry> &a, const std::pair<const uint64_t, SceneCacheEntry> &b) { return a.second.lastUsed < b.second.lastUsed; });
+
+				evicted.push_back(leastRecentlyUsed->second);
+				_scenes.erase(leastRecentlyUsed);
+			}
+		}
+	}
+	evicted.clear();
+
+	if (cachedScene.valid()) {
+		//waits if it is still being built, throws if that build failed
+		cacheHit = true;
+		setupMs = 0.0f;
+		return cachedScene.get();
+	}
+
+	try {
+		std::lock_guard<std::mutex> lock(_sceneBuildMutex);
+
+		//the generator is per thread, a scene built while other jobs render comes out the same as a cold build with that seed
+		seedRandomNumberGenerator(request.seed);
+
+		if (scenePath.empty()) {
+			SceneOwner::Scope scope(scene->owner);
+			scene->world = _sceneBuilder(request.sceneId, &scene->emitters);
+		}
+		else {
+			scene->world = scene->sceneFile.build(&scene->emitters);
+			if (scene->world != NULL) {
+				scene->emitters.build();
+			}
+		}
+
+		if (scene->world == NULL) {
+			throw std::runtime_error("can't build the scene");
+		}
+	}
+	catch (...) {
+		//whoever waits on this build gets the error too, the next request for the scene tries again
+		{
+			std::lock_guard<std::mutex> lock(_sceneMutex);
+
+			auto cached = _scenes.find(sceneHash);
+			if (cached != _scenes.end() && cached->second.scene.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+				_scenes.erase(cached);
+			}
+		}
+		built.set_exception(std::current_exception());
+		throw;
+	}
+
+	built.set_value(scene);
+
+	cacheHit = false;
+	setupMs = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - setupStart).count();
+
+	std::cout << "Render daemon built scene " << (scenePath.empty() ? std::to_string(request.sceneId) : scenePath) << " seed " << request.seed << " in " << setupMs << "ms\n";
+	return scene;
+}
+
+bool RenderDaemon::render(TcpSocket &connection, const RenderDaemonRequest &request) {
+	//the request comes straight off the socket, the image buffers are allocated from these before anything renders
+	if (request.resWidthInPixels == 0 || request.resHeightInPixels == 0 || request.samplesPerPixel == 0) {
+		return sendError(connection, "image size and samples per pixel have to be at least 1");
+	}
+	if (request.resWidthInPixels > RENDER_DAEMON_MAX_RES_IN_PIXELS || request.resHeightInPixels > RENDER_DAEMON_MAX_RES_IN_PIXELS ||
+		(uint64_t)request.resWidthInPixels * request.resHeightInPixels > RENDER_DAEMON_MAX_NUM_OF_PIXELS) {
+		return sendError(connection, "image size is over the daemon's limit");
+	}
+	if (request.samplesPerPixel > RENDER_DAEMON_MAX_SAMPLES_PER_PIXEL) {
+		return sendError(connection, "samples per pixel is over the daemon's limit");
+	}
+
+	uint64_t sceneHash = 0;
+	bool cacheHit = false;
+	float setupMs = 0.0f;
+
+	//held until the render is done, the cache may evict the scene meanwhile
+	std::shared_ptr<CachedScene> scene;
+	try {
+		scene = getScene(request, sceneHash, cacheHit, setupMs);
+	}
+	catch (const std::exception &exception) {
+		return sendError(connection, exception.what());
+	}
+
+	Camera camera(vec3(0, 0, 0), vec3(1, 0, 0), vec3(0, 0, -1), 90.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f);
+	camera.setRayState(request.cameraRayState);
+
+	SceneHandle sceneHandle = { scene->world, &scene->emitters };
+	RenderJob job(sceneHandle, camera, request.resWidthInPixels, request.resHeightInPixels, request.samplesPerPixel);
+	job.priority = request.priority;
+	job.weight = request.weight;
+
+	TileQueue tileQueue;
+
+	if (request.flags & RENDER_DAEMON_FLAG_STREAM_TILES) {
+		job.onTileDone = [&tileQueue](const TileProgress &progress) {
+			const RenderTile &tile = progress.tile;
+			RenderDaemonTileMessage message = { tile.columnStart, tile.columnEnd, tile.rowStart, tile.rowEnd, tile.index, progress.tilesDone, progress.numOfTiles };
+
+			uint32_t tileWidth = tile.columnEnd - tile.columnStart;
+			uint32_t tileHeight = tile.rowEnd - tile.rowStart;
+			std::vector<float> tileColor(tileWidth * tileHeight * 3);
+
+			for (uint32_t row = 0; row < tileHeight; row++) {
+				for (uint32_t column = 0; column < tileWidth; column++) {
+					const vec3 &color = progress.tileColor[row * progress.tileStride + column];
+					float *pixel = &tileColor[(row * tileWidth + column) * 3];
+
+					pixel[0] = color.r();
+					pixel[1] = color.g();
+					pixel[2] = color.b();
+				}
+			}
+
+			std::lock_guard<std::mutex> lock(tileQueue.mutex);
+			tileQueue.tiles.push_back(std::make_pair(message, std::move(tileColor)));
+			tileQueue.conditionVar.notify_one();
+		};
+	}
+
+	//submit allocates the job's buffers right away, running out of memory there only fails this request
+	std::future<RenderResult> futureResult;
+	try {
+		futureResult = _renderer.submit(job);
+	}
+	catch (const std::exception &exception) {
+		return sendError(connection, exception.what());
+	}
+
+	//the callback runs before the job is counted done, so once the future is ready every tile is in the queue
+	bool clientConnected = true;
+	while (futureResult.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+		{
+			std::unique_lock<std::mutex> lock(tileQueue.mutex);
+			tileQueue.conditionVar.wait_for(lock, std::chrono::milliseconds(10), [&tileQueue] { return !tileQueue.tiles.empty(); });
+		}
+		if (clientConnected) {
+			clientConnected = sendTiles(connection, tileQueue);
+		}
+	}
+
+	//the job has to finish before tileQueue goes out of scope either way, a client that left only stops the sending
+	if (!clientConnected || !sendTiles(connection, tileQueue)) {
+		try {
+			futureResult.get();
+		}
+		catch (...) {
+		}
+		return false;
+	}
+
+	RenderResult result;
+	try {
+		result = futureResult.get();
+	}
+	catch (const std::exception &exception) {
+		return sendError(connection, exception.what());
+	}
+
+	//bands of whole rows that stay well under the message size limit
+	size_t rowSizeInBytes = (size_t)result.resWidthInPixels * 3 * sizeof(float);
+	uint32_t rowsPerMessage = (uint32_t)std::max<size_t>(1, RENDER_DAEMON_MAX_BAND_SIZE_IN_BYTES / rowSizeInBytes);
+	std::vector<uint8_t> message;
+
+	for (uint32_t rowStart = 0; rowStart < result.resHeightInPixels; rowStart += rowsPerMessage) {
+		RenderDaemonRowsMessage rows = { rowStart, std::min(rowsPerMessage, result.resHeightInPixels - rowStart) };
+		size_t numOfPixels = (size_t)rows.numOfRows * result.resWidthInPixels;
+
+		try {
+			message.resize(sizeof(rows) + numOfPixels * 3 * sizeof(float));
+		}
+		catch (const std::exception &exception) {
+			return sendError(connection, exception.what());
+		}
+		memcpy(message.data(), &rows, sizeof(rows));
+
+		float *pixel = (float *)(message.data() + sizeof(rows));
+		const vec3 *color = &result.pixels[(size_t)rowStart * result.resWidthInPixels];
+
+		for (size_t pixelIndex = 0; pixelIndex < numOfPixels; pixelIndex++) {
+			*pixel++ = color[pixelIndex].r();
+			*pixel++ = color[pixelIndex].g();
+			*pixel++ = color[pixelIndex].b();
+		}
+
+		if (!sendDistributedMessage(connection, RENDER_DAEMON_MSG_ROWS, message.data(), (uint32_t)message.size())) {
+			return false;
+		}
+	}
+
+	RenderDaemonDoneMessage done = { sceneHash, cacheHit ? 1u : 0u, setupMs, result.stats.queueLatencyMs, result.stats.renderTimeMs, result.stats.samplesPerSecond };
+	return sendDistributedMessage(connection, RENDER_DAEMON_MSG_DONE, &done, sizeof(done));
+}
+
+/*
+	Client end for other processes (and tools) that want images out of a running daemon. One request at a time per
+	client, render() blocks until the image is back.
+*/
+class RenderDaemonClient {
+public:
+	//called for each streamed tile, rows bottom to top, tileColor is tile width * height RGB floats
+	typedef std::function<void(const RenderDaemonTileMessage &tile, const float *tileColor)> TileCallback;
+
+	bool connect(const std::string &socketPath) {
+		return _socket.connectLocal(socketPath);
+	}
+
+	//pixels gets width * height RGB floats, bottom row first. errorText is set if the daemon turned the request down.
+	bool render(const RenderDaemonRequest &request, std::vector<float> &pixels, RenderDaemonDoneMessage &done, std::string &errorText, const TileCallback &onTile = TileCallback()) {
+		if (!sendDistributedMessage(_socket, RENDER_DAEMON_MSG_RENDER, &request, sizeof(request))) {
+			return false;
+		}
+
+		//sized once the first rows come in, by then the daemon has taken the request
+		pixels.clear();
+
+		DistributedMessageHeader header;
+		std::vector<uint8_t> payload;
+
+		while (receiveDistributedMessage(_socket, header, payload)) {
+			if (header.type == RENDER_DAEMON_MSG_TILE && payload.size() >= sizeof(RenderDaemonTileMessage)) {
+				RenderDaemonTileMessage tile;
+				memcpy(&tile, payload.data(), sizeof(tile));
+
+				if (onTile) {
+					onTile(tile, (const float *)(payload.data() + sizeof(tile)));
+				}
+			}
+			else if (header.type == RENDER_DAEMON_MSG_ROWS && payload.size() >= sizeof(RenderDaemonRowsMessage)) {
+				RenderDaemonRowsMessage rows;
+				memcpy(&rows, payload.data(), sizeof(rows));
+
+				if (pixels.empty()) {
+					pixels.assign((size_t)request.resWidthInPixels * request.resHeightInPixels * 3, 0.0f);
+				}
+
+				size_t offset = (size_t)rows.rowStart * request.resWidthInPixels * 3;
+				size_t count = (size_t)rows.numOfRows * request.resWidthInPixels * 3;
+
+				if (offset + count > pixels.size() || payload.size() != sizeof(rows) + count * sizeof(float)) {
+					return false;
+				}
+				memcpy(&pixels[offset], payload.data() + sizeof(rows), count * sizeof(float));
+			}
+			else if (header.type == RENDER_DAEMON_MSG_DONE && payload.size() == sizeof(RenderDaemonDoneMessage)) {
+				memcpy(&done, payload.data(), sizeof(done));
+				return true;
+			}
+			else if (header.type == RENDER_DAEMON_MSG_ERROR) {
+				errorText.assign(payload.begin(), payload.end());
+				return false;
+			}
+			else {
+				return false;
+			}
+		}
+		return false;
+	}
+
+	bool shutdownDaemon() {
+		return sendDistributedMessage(_socket, RENDER_DAEMON_MSG_SHUTDOWN, NULL, 0);
+	}
+
+protected:
+	TcpSocket _socket;
+};
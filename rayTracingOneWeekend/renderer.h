@@ -0,0 +1,502 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <future>
+#include <chrono>
+#include <stdexcept>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+#include <stdint.h>
+
+#include "defines.h"
+#include "vec3.h"
+#include "camera.h"
+#include "hitable.h"
+#include "color.h"
+#include "lightSampler.h"
+#include "accumulationBuffer.h"
+#include "aovFramebuffer.h"
+#include "tileScheduler.h"
+#include "threadPool.h"
+
+//everything traceTile needs to know about the image it is working on
+struct TileTraceContext {
+	uint32_t resWidthInPixels, resHeightInPixels;
+	//image row that row 0 of the tiles and the buffers is, 0 unless only a band of the image is being rendered
+	uint32_t firstRow;
+	//samples every pixel gets this pass (unless it converges first), traced batchSize at a time
+	uint32_t samplesPerPass;
+	uint32_t batchSize;
+	//every tile reseeds its thread's generator from these (seedTileRandomNumberGenerator), pass counts from 0
+	uint64_t seed;
+	uint32_t pass;
+	Camera *camera;
+	Hitable *world;
+	const EmitterRegistry *emitters;
+	AccumulationBuffer *accumulationBuffer;
+	//NULL when nobody wants the AOVs
+	AOVFramebuffer *aovFramebuffer;
+};
+
+/*
+	Traces one pass of one tile: the samples get added to the accumulation (and AOV) buffer and the resolved color of
+	every pixel lands in tileColor, row r of the tile at tileColor[r * tileStride]. Used by the interactive render loop
+	and by the Renderer jobs.
+*/
+void traceTile(const RenderTile &tile, const TileTraceContext &context, vec3 *tileColor, uint32_t tileStride) {
+	AccumulationBuffer *accumulationBuffer = context.accumulationBuffer;
+	AOVFramebuffer *aovFramebuffer = context.aovFramebuffer;
+	uint32_t batchLimit = context.batchSize > 0 ? context.batchSize : context.samplesPerPass;
+	float pixelSpreadAngle = context.camera->getPixelSpreadAngle(context.resHeightInPixels);
+
+	seedTileRandomNumberGenerator(context.seed, context.pass, tile.columnStart, context.firstRow + tile.rowStart);
+
+	for (int row = tile.rowEnd - 1; row >= (int)tile.rowStart; row--) {
+		for (uint32_t column = tile.columnStart; column < tile.columnEnd; column++) {
+			uint32_t pixelIndex = row * context.resWidthInPixels + column;
+			uint32_t samplesThisPass = 0;
+
+			//this pass' AA samples go out in small batches so converged pixels stop early, they get added to whatever earlier passes accumulated
+			while (samplesThisPass < context.samplesPerPass && !accumulationBuffer->isConverged(pixelIndex)) {
+				uint32_t batchSize = context.samplesPerPass - samplesThisPass;
+				if (batchSize > batchLimit) batchSize = batchLimit;
+
+				vec3 sampleSum(0, 0, 0);
+				float luminanceSquaredSum = 0.0f;
+				AOVSample aovSample = { 0.0f, vec3(0, 0, 0), vec3(0, 0, 0), 0, 0, 0.0f };
+				auto batchStartTime = std::chrono::high_resolution_clock::now();
+
+				for (uint32_t sample = 0; sample < batchSize; sample++) {
+
+					float u = (float)(column + unifRand(randomNumberGenerator)) / (float)context.resWidthInPixels;
+					float v = (float)(row + context.firstRow + unifRand(randomNumberGenerator)) / (float)context.resHeightInPixels;
+
+					//A, the origin of the ray (camera)
+					//rayCast stores a ray projected from the camera as it points into the scene that is swept across the uv "picture" frame.
+					ray rayCast = context.camera->getRay(u, v);
+					rayCast._spreadAngle = pixelSpreadAngle;
+
+					FirstHitFeatures features;
+					vec3 sampleColor = color(rayCast, context.world, 0, context.emitters, false, aovFramebuffer ? &features : NULL);
+					float sampleLuminance = AccumulationBuffer::luminance(sampleColor);
+
+					sampleSum += sampleColor;
+					luminanceSquaredSum += sampleLuminance * sampleLuminance;
+
+					if (aovFramebuffer) {
+						aovSample.albedoSum += features.albedo;
+						aovSample.normalSum += features.normal;
+						aovSample.depthSum += features.depth;
+						if (sample == 0) {
+							aovSample.materialId = features.materialId;
+							aovSample.primitiveId = features.primitiveId;
+						}
+					}
+				}
+
+				accumulationBuffer->addSamples(pixelIndex, sampleSum, luminanceSquaredSum, batchSize);
+
+				if (aovFramebuffer) {
+					if (aovFramebuffer->isEnabled(AOV_FLAG_TIME)) {
+						std::chrono::duration<float> batchTime = std::chrono::high_resolution_clock::now() - batchStartTime;
+						aovSample.seconds = batchTime.count();
+					}
+					aovFramebuffer->addSamples(pixelIndex, aovSample, batchSize);
+				}
+				samplesThisPass += batchSize;
+			}
+
+			//converged pixels are still resolved, the caller's output may hold an older frame
+			tileColor[(row - tile.rowStart) * tileStride + (column - tile.columnStart)] = accumulationBuffer->resolve(pixelIndex);
+		}
+	}
+}
+
+//what the caller renders, the Renderer never owns or deletes the hitables/emitters
+struct SceneHandle {
+	Hitable *world;
+	const EmitterRegistry *emitters;
+};
+
+//handed to the progress callback once per finished tile
+struct TileProgress {
+	RenderTile tile;
+	//linear colors of the tile, row r at tileColor[r * tileStride], only valid during the callback
+	const vec3 *tileColor;
+	uint32_t tileStride;
+	uint32_t tilesDone;
+	uint32_t numOfTiles;
+};
+
+//runs on whichever render thread finished the tile, keep it short, thread safe and don't throw
+typedef std::function<void(const TileProgress &progress)> TileProgressCallback;
+
+struct RenderJob {
+	RenderJob(const SceneHandle &scene, const Camera &camera, uint32_t resWidthInPixels, uint32_t resHeightInPixels, uint32_t samplesPerPixel) :
+		scene(scene), camera(camera), resWidthInPixels(resWidthInPixels), resHeightInPixels(resHeightInPixels), firstRow(0), numOfRows(0),
+		samplesPerPixel(samplesPerPixel), seed(0), priority(0), weight(1), outputPixels(NULL), outputRowStrideInFloats(0) {
+	}
+
+	SceneHandle scene;
+	Camera camera;
+	uint32_t resWidthInPixels, resHeightInPixels;
+	//only render image rows [firstRow, firstRow + numOfRows), 0 rows = all of them. Everything the job allocates, the
+	//tiles it reports and its output are that band only, row 0 of them is image row firstRow. See outOfCoreRender.h.
+	uint32_t firstRow, numOfRows;
+	uint32_t samplesPerPixel;
+	//sampling seed, the same job with the same seed traces the same samples
+	uint64_t seed;
+	//higher priority jobs get every free worker first, jobs of the same priority split the workers by weight
+	int32_t priority;
+	uint32_t weight;
+	TileProgressCallback onTileDone;
+	//if set the workers write linear RGB floats straight into this (top row first, row r at outputPixels + r * stride,
+	//0 stride = width * 3) and RenderResult::pixels stays empty. It has to stay valid until the future is ready.
+	float *outputPixels;
+	uint32_t outputRowStrideInFloats;
+};
+
+//per job counters, queue latency is submit to first tile, render time is first tile to last
+struct RenderJobStats {
+	uint64_t jobId;
+	int32_t priority;
+	uint32_t weight;
+	uint32_t tilesDone, numOfTiles;
+	float queueLatencyMs;
+	float renderTimeMs;
+	float tilesPerSecond;
+	double samplesPerSecond;
+};
+
+struct RenderResult {
+	//the band's height for a job with numOfRows set
+	uint32_t resWidthInPixels, resHeightInPixels;
+	uint32_t samplesPerPixel;
+	//linear color, bottom row first like the accumulation buffer: pixel (column, row) is at row * width + column.
+	//Empty if the job rendered into RenderJob::outputPixels.
+	std::vector<vec3> pixels;
+	RenderJobStats stats;
+};
+
+/*
+	Library level entry point for rendering without the interactive loop in main().
+
+	submit() returns right away with a future for the finished framebuffer. Every submitted job gets its own
+	accumulation buffer and TileScheduler, and all of them share one render thread pool: each time a worker finishes a
+	tile it goes back to pickTile(), which hands out a tile of the highest priority job that still has some. So a
+	preview submitted in the middle of a batch render takes over the workers as they come off their current tile
+	(preemption is at tile boundaries, a tile is never interrupted) and the batch job picks up where it was once the
+	preview is out of tiles.
+
+	Jobs of the same priority share by weight with stride scheduling: every tile handed out adds 1/weight to the job's
+	virtual time and the job furthest behind goes next, so weights 3 and 1 get tiles 3:1. A job joining late starts at
+	the virtual time of the ones already running instead of 0, otherwise it would get every tile until it caught up.
+
+	The pool runs one frame for the Renderer's whole life. A worker that finds no job with tiles left sleeps in pickTile()
+	until submit() wakes it, so a new job gets every thread at once, not just the ones that happened to still be busy.
+	Outstanding requests cost a job entry, not a thread. A job that can't run (no scene, zero size or samples) fails its future with
+	std::invalid_argument. Jobs not finished when the Renderer is destroyed fail with std::future_error (broken_promise),
+	the tiles already being traced are finished first.
+
+	C++14 has no coroutines, the future is what callers wait on (or poll with wait_for).
+*/
+class Renderer {
+public:
+	explicit Renderer(uint32_t numOfThreads, const std::vector<uint32_t> &cpuPlacement = std::vector<uint32_t>(), const std::vector<int32_t> &workerNodes = std::vector<int32_t>()) :
+		_threadPool(numOfThreads, cpuPlacement), _workerNodes(workerNodes), _nextJobId(1), _exit(false) {
+
+		_threadPool.submitFrame([this](uint32_t workerId) {workerProcedure(workerId); });
+	}
+
+	~Renderer() {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_exit = true;
+			_workConditionVar.notify_all();
+		}
+		_threadPool.waitForFrame();
+		_threadPool.shutdown();
+
+		//dropping the promises breaks the futures of everything unfinished
+		_jobs.clear();
+	}
+
+	std::future<RenderResult> submit(const RenderJob &job);
+
+	//counters of every job that isn't finished yet, finished jobs report theirs in RenderResult::stats
+	std::vector<RenderJobStats> getJobStats() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		std::vector<RenderJobStats> stats;
+
+		for (const std::shared_ptr<ActiveJob> &job : _jobs) {
+			stats.push_back(job->getStats(Clock::now()));
+		}
+		return stats;
+	}
+
+	//jobs submitted but not finished yet
+	size_t getNumOfJobs() {
+		std::lock_guard<std::mutex> lock(_mutex);
+		return _jobs.size();
+	}
+
+	uint32_t getNumOfThreads() const {
+		return _threadPool.getNumOfThreads();
+	}
+
+protected:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	struct ActiveJob {
+		explicit ActiveJob(const RenderJob &job) : job(job), tilesIssued(0), tilesDone(0), tilesReported(0), virtualTime(0.0), started(false) {}
+
+		RenderJobStats getStats(Clock::time_point now) const {
+			RenderJobStats stats;
+			stats.jobId = id;
+			stats.priority = job.priority;
+			stats.weight = job.weight;
+			stats.tilesDone = tilesDone.load(std::memory_order_acquire);
+			stats.numOfTiles = numOfTiles;
+
+			std::chrono::duration<float, std::milli> queueLatency = (started ? startTime : now) - submitTime;
+			std::chrono::duration<float, std::milli> renderTime = started ? now - startTime : Clock::duration::zero();
+			stats.queueLatencyMs = queueLatency.count();
+			stats.renderTimeMs = renderTime.count();
+
+			float seconds = stats.renderTimeMs / 1000.0f;
+			uint64_t pixelsDone = (uint64_t)stats.tilesDone * TILE_SIZE_IN_PIXELS * TILE_SIZE_IN_PIXELS;
+			uint64_t numOfPixels = (uint64_t)job.resWidthInPixels * job.numOfRows;
+			if (pixelsDone > numOfPixels || stats.tilesDone == numOfTiles) pixelsDone = numOfPixels;
+
+			stats.tilesPerSecond = seconds > 0.0f ? stats.tilesDone / seconds : 0.0f;
+			stats.samplesPerSecond = seconds > 0.0f ? (double)pixelsDone * job.samplesPerPixel / seconds : 0.0;
+			return stats;
+		}
+
+		uint64_t id;
+		RenderJob job;
+		std::promise<RenderResult> promise;
+		RenderResult result;
+
+		std::unique_ptr<AccumulationBuffer> accumulationBuffer;
+		std::unique_ptr<TileScheduler> tileScheduler;
+		TileTraceContext context;
+
+		uint32_t numOfTiles;
+		//tilesIssued, virtualTime and the times are only touched under the Renderer mutex
+		uint32_t tilesIssued;
+		std::atomic<uint32_t> tilesDone;
+		std::atomic<uint32_t> tilesReported;
+		double virtualTime;
+
+		bool started;
+		Clock::time_point submitTime, startTime;
+	};
+
+	bool hasRunnableJob() const {
+		for (const std::shared_ptr<ActiveJob> &job : _jobs) {
+			if (job->tilesIssued < job->numOfTiles) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void workerProcedure(uint32_t workerId);
+	bool pickTile(uint32_t workerId, std::shared_ptr<ActiveJob> &job, RenderTile &tile);
+	void tileCompleted(const std::shared_ptr<ActiveJob> &job);
+
+	RenderThreadPool _threadPool;
+	std::vector<int32_t> _workerNodes;
+
+	std::mutex _mutex;
+	std::condition_variable _workConditionVar;
+	std::vector<std::shared_ptr<ActiveJob>> _jobs;
+	uint64_t _nextJobId;
+	bool _exit;
+};
+
+std::future<RenderResult> Renderer::submit(const RenderJob &job) {
+	std::shared_ptr<ActiveJob> activeJob(new ActiveJob(job));
+	std::future<RenderResult> future = activeJob->promise.get_future();
+
+	activeJob->submitTime = Clock::now();
+
+	if (job.scene.world == NULL || job.resWidthInPixels == 0 || job.resHeightInPixels == 0 || job.samplesPerPixel == 0) {
+		activeJob->promise.set_exception(std::make_exception_ptr(std::invalid_argument("render job needs a scene, a size and at least one sample per pixel")));
+		return future;
+	}
+
+	if ((uint64_t)job.firstRow + job.numOfRows > job.resHeightInPixels || (job.numOfRows == 0 && job.firstRow != 0)) {
+		activeJob->promise.set_exception(std::make_exception_ptr(std::invalid_argument("render job rows are outside the image")));
+		return future;
+	}
+
+	if (activeJob->job.weight == 0) {
+		activeJob->job.weight = 1;
+	}
+	if (activeJob->job.numOfRows == 0) {
+		activeJob->job.numOfRows = job.resHeightInPixels;
+	}
+
+	uint32_t numOfRows = activeJob->job.numOfRows;
+
+	RenderResult &result = activeJob->result;
+	result.resWidthInPixels = job.resWidthInPixels;
+	result.resHeightInPixels = numOfRows;
+	result.samplesPerPixel = job.samplesPerPixel;
+	if (job.outputPixels == NULL) {
+		result.pixels.assign((size_t)job.resWidthInPixels * numOfRows, vec3(0, 0, 0));
+	}
+	else if (activeJob->job.outputRowStrideInFloats == 0) {
+		activeJob->job.outputRowStrideInFloats = job.resWidthInPixels * 3;
+	}
+
+	activeJob->accumulationBuffer.reset(new AccumulationBuffer(job.resWidthInPixels, numOfRows));
+	activeJob->accumulationBuffer->reset(0);
+
+	activeJob->tileScheduler.reset(new TileScheduler(_threadPool.getNumOfThreads(), job.resWidthInPixels, numOfRows, TILE_SIZE_IN_PIXELS));
+	activeJob->tileScheduler->setWorkerNodes(_workerNodes);
+	activeJob->tileScheduler->beginFrame();
+	activeJob->numOfTiles = activeJob->tileScheduler->getNumOfTiles();
+
+	//the whole budget goes out in one pass, batching only keeps the per sample loop short
+	TileTraceContext &context = activeJob->context;
+	context.resWidthInPixels = job.resWidthInPixels;
+	context.resHeightInPixels = job.resHeightInPixels;
+	context.firstRow = job.firstRow;
+	context.samplesPerPass = job.samplesPerPixel;
+	context.batchSize = ADAPTIVE_SAMPLING_BATCH;
+	context.seed = job.seed;
+	context.pass = 0;
+	context.camera = &activeJob->job.camera;
+	context.world = job.scene.world;
+	context.emitters = job.scene.emitters;
+	context.accumulationBuffer = activeJob->accumulationBuffer.get();
+	context.aovFramebuffer = NULL;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	activeJob->id = _nextJobId++;
+
+	//start level with the jobs of the same priority that are still handing out tiles
+	bool first = true;
+	for (const std::shared_ptr<ActiveJob> &other : _jobs) {
+		if (other->job.priority == job.priority && other->tilesIssued < other->numOfTiles && (first || other->virtualTime < activeJob->virtualTime)) {
+			activeJob->virtualTime = other->virtualTime;
+			first = false;
+		}
+	}
+
+	_jobs.push_back(activeJob);
+	_workConditionVar.notify_all();
+
+	return future;
+}
+
+bool Renderer::pickTile(uint32_t workerId, std::shared_ptr<ActiveJob> &job, RenderTile &tile) {
+	std::unique_lock<std::mutex> lock(_mutex);
+	ActiveJob *best = NULL;
+
+	while (best == NULL) {
+		//nothing to do, sleep until a job is submitted instead of leaving the pool frame
+		_workConditionVar.wait(lock, [this] {return _exit || hasRunnableJob(); });
+
+		if (_exit) {
+			return false;
+		}
+
+		//highest priority first, then whoever is furthest behind on its weighted share, then the oldest
+		for (const std::shared_ptr<ActiveJob> &candidate : _jobs) {
+			if (candidate->tilesIssued >= candidate->numOfTiles) {
+				continue;
+			}
+			if (best == NULL || candidate->job.priority > best->job.priority ||
+				(candidate->job.priority == best->job.priority && candidate->virtualTime < best->virtualTime)) {
+				best = candidate.get();
+				job = candidate;
+			}
+		}
+
+		//the scheduler ran dry before the count said so, don't pick this job again
+		if (!best->tileScheduler->nextTile(workerId, tile)) {
+			best->tilesIssued = best->numOfTiles;
+			best = NULL;
+		}
+	}
+
+	best->tilesIssued++;
+	best->virtualTime += 1.0 / best->job.weight;
+
+	if (!best->started) {
+		best->started = true;
+		best->startTime = Clock::now();
+	}
+
+	return true;
+}
+
+void Renderer::workerProcedure(uint32_t workerId) {
+	//every job uses the same tile size so one scratch tile per thread covers all of them
+	static thread_local std::vector<vec3> tileColor;
+	tileColor.resize(TILE_SIZE_IN_PIXELS * TILE_SIZE_IN_PIXELS);
+
+	std::shared_ptr<ActiveJob> job;
+	RenderTile tile;
+
+	//a new pick every tile, that's where higher priority jobs take over
+	while (pickTile(workerId, job, tile)) {
+		traceTile(tile, job->context, tileColor.data(), TILE_SIZE_IN_PIXELS);
+
+		//tiles don't overlap so the workers never write the same pixels
+		if (job->job.outputPixels == NULL) {
+			for (uint32_t row = tile.rowStart; row < tile.rowEnd; row++) {
+				for (uint32_t column = tile.columnStart; column < tile.columnEnd; column++) {
+					job->result.pixels[row * job->job.resWidthInPixels + column] = tileColor[(row - tile.rowStart) * TILE_SIZE_IN_PIXELS + (column - tile.columnStart)];
+				}
+			}
+		}
+		else {
+			for (uint32_t row = tile.rowStart; row < tile.rowEnd; row++) {
+				float *outputRow = job->job.outputPixels + (size_t)(job->job.numOfRows - 1 - row) * job->job.outputRowStrideInFloats;
+
+				for (uint32_t column = tile.columnStart; column < tile.columnEnd; column++) {
+					const vec3 &color = tileColor[(row - tile.rowStart) * TILE_SIZE_IN_PIXELS + (column - tile.columnStart)];
+
+					outputRow[column * 3 + 0] = color.r();
+					outputRow[column * 3 + 1] = color.g();
+					outputRow[column * 3 + 2] = color.b();
+				}
+			}
+		}
+
+		//the callback runs before the tile counts as done so every callback of a job happens before its future is ready
+		if (job->job.onTileDone) {
+			TileProgress progress = { tile, tileColor.data(), TILE_SIZE_IN_PIXELS, job->tilesReported.fetch_add(1, std::memory_order_relaxed) + 1, job->numOfTiles };
+			job->job.onTileDone(progress);
+		}
+
+		tileCompleted(job);
+	}
+}
+
+void Renderer::tileCompleted(const std::shared_ptr<ActiveJob> &job) {
+	if (job->tilesDone.fetch_add(1, std::memory_order_acq_rel) + 1 != job->numOfTiles) {
+		return;
+	}
+
+	//last tile of the job, every other worker is done writing its pixels
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		job->result.stats = job->getStats(Clock::now());
+		_jobs.erase(std::find(_jobs.begin(), _jobs.end(), job));
+	}
+
+	job->promise.set_value(std::move(job->result));
+}
@@ -6,6 +6,37 @@
 //https://stackoverflow.com/questions/9878965/rand-between-0-and-1
 //https://www.guyrutenberg.com/2014/05/03/c-mt19937-example/
 
-std::mt19937_64 randomNumberGenerator;
+//one generator per thread: the render threads used to share (and race on) a single one, which made no two runs trace
+//the same samples. Every tile now reseeds its thread's generator, see seedTileRandomNumberGenerator.
+thread_local std::mt19937_64 randomNumberGenerator;
 uint64_t timeSeed;
-std::uniform_real_distribution<double> unifRand(0.0, 1.0);
\ No newline at end of file
+thread_local std::uniform_real_distribution<double> unifRand(0.0, 1.0);
+
+//the same seed gives the same random scene, the distributed workers rely on that to rebuild the coordinator's scene
+void seedRandomNumberGenerator(uint64_t seed) {
+	std::seed_seq seedSequence{
+			uint32_t(seed & 0xffffffff),
+			uint32_t(seed >> 32)
+	};
+
+	randomNumberGenerator.seed(seedSequence);
+}
+
+//splitmix64 finalizer, spreads nearby keys (pass 1, pass 2...) over the whole 64 bits
+uint64_t mixRandomSeed(uint64_t key) {
+	key += 0x9e3779b97f4a7c15ULL;
+	key = (key ^ (key >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	key = (key ^ (key >> 27)) * 0x94d049bb133111ebULL;
+	return key ^ (key >> 31);
+}
+
+/*
+	Seeds this thread's generator for one tile of one pass. The samples a tile traces then only depend on the render
+	seed, the pass number and where the tile is (its first pixel in the whole image), not on which thread got it or
+	what that thread traced before. That is what lets a checkpointed render resume and carry on with exactly the
+	samples it would have traced without stopping, see renderCheckpoint.h.
+*/
+void seedTileRandomNumberGenerator(uint64_t seed, uint32_t pass, uint32_t column, uint32_t row) {
+	uint64_t key = mixRandomSeed(seed ^ mixRandomSeed(((uint64_t)pass << 32) | 0x5eed));
+	randomNumberGenerator.seed(mixRandomSeed(key ^ (((uint64_t)row << 32) | column)));
+}
@@ -0,0 +1,952 @@
+#pragma once
+
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "defines.h"
+#include "vec3.h"
+#include "hitable.h"
+#include "sphere.h"
+#include "xy_rect.h"
+#include "box.h"
+#include "constantMedium.h"
+#include "material.h"
+#include "texture.h"
+#include "bvhNode.h"
+#include "bvhCache.h"
+#include "lightSampler.h"
+#include "alignedBuffer.h"
+#include "mappedFile.h"
+#include "mipmapCache.h"
+
+#define SCENE_FILE_VERSION 1
+#define SCENE_FILE_NO_INDEX 0xffffffffu
+//every object in the arena starts at a multiple of this, enough for anything a hitable holds
+#define SCENE_FILE_ARENA_ALIGNMENT 16
+
+enum SceneTextureType {
+	SCENE_TEXTURE_CONSTANT = 0,
+	SCENE_TEXTURE_CHECKER,
+	SCENE_TEXTURE_NOISE,
+	SCENE_TEXTURE_IMAGE
+};
+
+enum SceneMaterialType {
+	SCENE_MATERIAL_LAMBERTIAN = 0,
+	SCENE_MATERIAL_METAL,
+	SCENE_MATERIAL_DIELECTRIC,
+	SCENE_MATERIAL_DIFFUSE_LIGHT,
+	SCENE_MATERIAL_ISOTROPIC
+};
+
+enum SceneNodeType {
+	SCENE_NODE_SPHERE = 0,
+	SCENE_NODE_MOVING_SPHERE,
+	SCENE_NODE_RECTANGLE_XY,
+	SCENE_NODE_RECTANGLE_XZ,
+	SCENE_NODE_RECTANGLE_YZ,
+	SCENE_NODE_BOX,
+	SCENE_NODE_FLIP_NORMALS,
+	SCENE_NODE_TRANSLATE,
+	SCENE_NODE_ROTATE_Y,
+	SCENE_NODE_CONSTANT_MEDIUM
+};
+
+//fixed size, followed by the texture, material, node and world records and then the string table, in that order
+struct SceneFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSizeInBytes;
+	uint32_t numOfTextures;
+	uint32_t numOfMaterials;
+	uint32_t numOfNodes;
+	uint32_t numOfWorldNodes;
+	uint32_t stringTableSizeInBytes;
+	uint32_t reserved;
+	//of the text it was compiled from, a stale compiled file gets recompiled
+	uint64_t sourceHash;
+	uint64_t payloadChecksum;
+};
+
+//checker: the two textures, image: the path's offset in the string table, constant: the color, noise: the scale
+struct SceneTextureRecord {
+	uint32_t type;
+	uint32_t even, odd;
+	float values[3];
+};
+
+struct SceneMaterialRecord {
+	uint32_t type;
+	uint32_t texture;
+	//metal: albedo and fuzz, dielectric: refractive index
+	float values[4];
+};
+
+//a shape (material set) or a wrapper around child (translate/rotateY/flip/medium, the medium's material is its phase function)
+struct SceneNodeRecord {
+	uint32_t type;
+	uint32_t material;
+	uint32_t child;
+	uint32_t reserved;
+	//the constructor arguments in order, vectors as 3 floats
+	float values[10];
+};
+
+//one of the shapes the world is made of, emitterMaterial is the light it gets registered with (or SCENE_FILE_NO_INDEX)
+struct SceneWorldRecord {
+	uint32_t node;
+	uint32_t emitterMaterial;
+};
+
+static_assert(sizeof(SceneFileHeader) == 56, "the scene header is written as is");
+static_assert(sizeof(SceneTextureRecord) == 24 && sizeof(SceneMaterialRecord) == 24 && sizeof(SceneNodeRecord) == 56, "the scene records are written as is");
+
+/*
+	Scenes out of a file instead of scenes.h, so switching scenes needs no rebuild.
+
+	The text form is one statement a line, # starts a comment, names are defined before they are used:
+
+		texture <name> constant <r> <g> <b> | checker <even> <odd> | noise <scale> | image <path>
+		material <name> lambertian <texture> | metal <r> <g> <b> <fuzz> | dielectric <index> | light <texture> | isotropic <texture>
+		[shape <name>] sphere <x> <y> <z> <radius> <material>
+		[shape <name>] movingSphere <x0> <y0> <z0> <x1> <y1> <z1> <t0> <t1> <radius> <material>
+		[shape <name>] rectXY <x0> <x1> <y0> <y1> <k> <material>   (rectXZ <x0> <x1> <z0> <z1> <k>, rectYZ <y0> <y1> <z0> <z1> <k>)
+		[shape <name>] box <x0> <y0> <z0> <x1> <y1> <z1> <material>
+		[shape <name>] flip <shape> | translate <shape> <x> <y> <z> | rotateY <shape> <degrees> | medium <shape> <density> <texture>
+		add <shape>
+
+	A shape statement without "shape <name>" goes straight into the world, a named one only when it is add'ed, so it
+	can be a medium's boundary, be transformed or both. Spheres and rectangles with a light material (also under
+	flip/translate/rotateY) are registered as emitters when they go into the world.
+
+	compile() turns that into a versioned binary file of fixed size records, children always before their parents.
+	load() maps it and checks it, nothing is parsed, and build() constructs every texture, material and shape straight
+	from the records into one arena allocated up front. The world's BVH is mapped from the cache next to the compiled
+	file (bvhCache.h) and only built, then cached, when that is missing or doesn't match the geometry. The objects
+	live as long as the SceneFile, a compiled scene file is around 50 bytes a shape on the disk.
+*/
+class SceneFile {
+public:
+	SceneFile() : _header(NULL), _arenaOffset(0), _textures(NULL), _materials(NULL), _nodes(NULL),
+		_constructedTextures(0), _constructedMaterials(0), _constructedNodes(0) {}
+
+	~SceneFile() {
+		release();
+	}
+
+	SceneFile(const SceneFile &) = delete;
+	SceneFile &operator=(const SceneFile &) = delete;
+
+	//text in, binary out. 0 on success like ImageWriter::write, what's wrong and where on the console otherwise.
+	static uint32_t compile(const std::string &sourcePath, const std::string &outputPath);
+
+	//maps a compiled scene and checks it, nothing is constructed yet
+	bool load(const std::string &path);
+
+	//loads sourcePath + SCENE_FILE_COMPILED_SUFFIX, compiling it first if it is missing or from another version of the text
+	bool loadSource(const std::string &sourcePath);
+
+	/*
+		Constructs the scene and returns its world, lights go into emitterRegistry (build() it afterwards). NULL if a
+		texture image can't be read. The BVH only depends on the scene, a rebuilt cache is the same tree. Once per load.
+	*/
+	Hitable *build(EmitterRegistry *emitterRegistry);
+
+	uint64_t getSourceHash() const {
+		return _header != NULL ? _header->sourceHash : 0;
+	}
+
+	static bool isCompiledScenePath(const std::string &path) {
+		size_t suffixSize = strlen(SCENE_FILE_COMPILED_SUFFIX);
+		return path.size() >= suffixSize && path.compare(path.size() - suffixSize, suffixSize, SCENE_FILE_COMPILED_SUFFIX) == 0;
+	}
+
+protected:
+	struct Source;
+
+	static bool hashSourceFile(const std::string &path, uint64_t &hash, std::string *text);
+
+	//objects are placed back to back in the arena, each at a multiple of the arena alignment
+	static size_t alignArenaSize(size_t sizeInBytes) {
+		return (sizeInBytes + SCENE_FILE_ARENA_ALIGNMENT - 1) & ~(size_t)(SCENE_FILE_ARENA_ALIGNMENT - 1);
+	}
+
+	static size_t getNodeSizeInBytes(uint32_t type);
+
+	void *reserve(size_t sizeInBytes) {
+		void *memory = _arena.data() + _arenaOffset;
+		_arenaOffset += alignArenaSize(sizeInBytes);
+		return memory;
+	}
+
+	template <typename T, typename... Arguments>
+	T *construct(Arguments &&... arguments) {
+		return new (reserve(sizeof(T))) T(std::forward<Arguments>(arguments)...);
+	}
+
+	void release();
+
+	//maps the cached BVH of the world or builds (and caches) it, false if it can't be built at all
+	bool buildBvh(Hitable *const *worldList);
+
+	std::string _path;
+	MappedFile _file;
+	const SceneFileHeader *_header;
+	const SceneTextureRecord *_textureRecords;
+	const SceneMaterialRecord *_materialRecords;
+	const SceneNodeRecord *_nodeRecords;
+	const SceneWorldRecord *_worldRecords;
+	const char *_strings;
+
+	AlignedBuffer<uint8_t> _arena;
+	size_t _arenaOffset;
+	Texture **_textures;
+	Material **_materials;
+	Hitable **_nodes;
+	uint32_t _constructedTextures, _constructedMaterials, _constructedNodes;
+
+	//the BVH nodes come out of _bvhFile, or _bvhNodes when the cache couldn't be written
+	MappedFile _bvhFile;
+	std::vector<FlatBvhNode> _bvhNodes;
+	std::unique_ptr<FlatBvh> _world;
+};
+
+//what compile() collects before writing it out
+struct SceneFile::Source {
+	std::vector<SceneTextureRecord> textures;
+	std::vector<SceneMaterialRecord> materials;
+	std::vector<SceneNodeRecord> nodes;
+	std::vector<SceneWorldRecord> world;
+	std::string strings;
+
+	std::map<std::string, uint32_t> textureNames, materialNames, nodeNames;
+
+	//the light a shape would be registered with, through the wrappers that keep its surface sampleable
+	uint32_t findEmitterMaterial(uint32_t node) const {
+		while (node != SCENE_FILE_NO_INDEX) {
+			const SceneNodeRecord &record = nodes[node];
+
+			switch (record.type) {
+			case SCENE_NODE_SPHERE:
+			case SCENE_NODE_RECTANGLE_XY:
+			case SCENE_NODE_RECTANGLE_XZ:
+			case SCENE_NODE_RECTANGLE_YZ:
+				return materials[record.material].type == SCENE_MATERIAL_DIFFUSE_LIGHT ? record.material : SCENE_FILE_NO_INDEX;
+			case SCENE_NODE_FLIP_NORMALS:
+			case SCENE_NODE_TRANSLATE:
+			case SCENE_NODE_ROTATE_Y:
+				node = record.child;
+				break;
+			default:
+				return SCENE_FILE_NO_INDEX;
+			}
+		}
+		return SCENE_FILE_NO_INDEX;
+	}
+};
+
+bool SceneFile::hashSourceFile(const std::string &path, uint64_t &hash, std::string *text) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file) {
+		return false;
+	}
+
+	std::ostringstream contents;
+	contents << file.rdbuf();
+	std::string source = contents.str();
+
+	hash = checksumBytes((const uint8_t *)source.data(), source.size());
+	if (text != NULL) {
+		text->swap(source);
+	}
+	return true;
+}
+
+uint32_t SceneFile::compile(const std::string &sourcePath, const std::string &outputPath) {
+	std::string text;
+	uint64_t sourceHash;
+
+	if (!hashSourceFile(sourcePath, sourceHash, &text)) {
+		std::cout << "Can't open scene " << sourcePath << "\n";
+		return 1;
+	}
+
+	Source source;
+	std::istringstream lines(text);
+	std::string line;
+	uint32_t lineNumber = 0;
+
+	while (std::getline(lines, line)) {
+		lineNumber++;
+
+		size_t comment = line.find('#');
+		if (comment != std::string::npos) {
+			line.erase(comment);
+		}
+
+		std::istringstream fields(line);
+		std::vector<std::string> tokens;
+		std::string token;
+		while (fields >> token) {
+			tokens.push_back(token);
+		}
+		if (tokens.empty()) {
+			continue;
+		}
+
+		//every failure below ends up here with what was wrong
+		std::string error;
+		size_t next = 1;
+
+		auto numberAt = [&](float &value) {
+			if (error.empty() && next >= tokens.size()) {
+				error = "is missing a number";
+			}
+			if (!error.empty()) {
+				return;
+			}
+
+			char *end = NULL;
+			value = strtof(tokens[next].c_str(), &end);
+			if (end == tokens[next].c_str() || *end != '\0' || !std::isfinite(value)) {
+				error = "has " + tokens[next] + " where a number goes";
+			}
+			next++;
+		};
+
+		auto nameAt = [&](const std::map<std::string, uint32_t> &names, const char *kind, uint32_t &index) {
+			if (error.empty() && next >= tokens.size()) {
+				error = std::string("is missing a ") + kind;
+			}
+			if (!error.empty()) {
+				return;
+			}
+
+			auto found = names.find(tokens[next]);
+			if (found == names.end()) {
+				error = std::string("uses ") + kind + " " + tokens[next] + " before defining it";
+			}
+			else {
+				index = found->second;
+			}
+			next++;
+		};
+
+		if (tokens[0] == "texture" || tokens[0] == "material") {
+			bool isTexture = tokens[0] == "texture";
+			if (tokens.size() < 3) {
+				error = "needs a name and a type";
+			}
+			else if ((isTexture ? source.textureNames : source.materialNames).count(tokens[1]) > 0) {
+				error = "defines " + tokens[1] + " again";
+			}
+			next = 3;
+
+			if (error.empty() && isTexture) {
+				SceneTextureRecord record;
+				memset(&record, 0, sizeof(record));
+				record.even = record.odd = SCENE_FILE_NO_INDEX;
+
+				if (tokens[2] == "constant") {
+					record.type = SCENE_TEXTURE_CONSTANT;
+					numberAt(record.values[0]);
+					numberAt(record.values[1]);
+					numberAt(record.values[2]);
+				}
+				else if (tokens[2] == "checker") {
+					record.type = SCENE_TEXTURE_CHECKER;
+					nameAt(source.textureNames, "texture", record.even);
+					nameAt(source.textureNames, "texture", record.odd);
+				}
+				else if (tokens[2] == "noise") {
+					record.type = SCENE_TEXTURE_NOISE;
+					numberAt(record.values[0]);
+				}
+				else if (tokens[2] == "image" && tokens.size() > 3) {
+					record.type = SCENE_TEXTURE_IMAGE;
+					record.even = (uint32_t)source.strings.size();
+					source.strings.append(tokens[3]);
+					source.strings.push_back('\0');
+					next = 4;
+				}
+				else {
+					error = "has an unknown texture " + tokens[2];
+				}
+
+				if (error.empty()) {
+					source.textureNames[tokens[1]] = (uint32_t)source.textures.size();
+					source.textures.push_back(record);
+				}
+			}
+			else if (error.empty()) {
+				SceneMaterialRecord record;
+				memset(&record, 0, sizeof(record));
+				record.texture = SCENE_FILE_NO_INDEX;
+
+				if (tokens[2] == "lambertian" || tokens[2] == "light" || tokens[2] == "isotropic") {
+					record.type = tokens[2] == "lambertian" ? SCENE_MATERIAL_LAMBERTIAN : tokens[2] == "light" ? SCENE_MATERIAL_DIFFUSE_LIGHT : SCENE_MATERIAL_ISOTROPIC;
+					nameAt(source.textureNames, "texture", record.texture);
+				}
+				else if (tokens[2] == "metal") {
+					record.type = SCENE_MATERIAL_METAL;
+					for (int value = 0; value < 4; value++) {
+						numberAt(record.values[value]);
+					}
+				}
+				else if (tokens[2] == "dielectric") {
+					record.type = SCENE_MATERIAL_DIELECTRIC;
+					numberAt(record.values[0]);
+				}
+				else {
+					error = "has an unknown material " + tokens[2];
+				}
+
+				if (error.empty()) {
+					source.materialNames[tokens[1]] = (uint32_t)source.materials.size();
+					source.materials.push_back(record);
+				}
+			}
+		}
+		else if (tokens[0] == "add") {
+			uint32_t node = SCENE_FILE_NO_INDEX;
+			nameAt(source.nodeNames, "shape", node);
+
+			if (error.empty()) {
+				SceneWorldRecord record = { node, source.findEmitterMaterial(node) };
+				source.world.push_back(record);
+			}
+		}
+		else {
+			//"shape <name> <type> ..." or just "<type> ..." straight into the world
+			std::string name;
+			size_t typeToken = 0;
+
+			if (tokens[0] == "shape") {
+				if (tokens.size() < 3) {
+					error = "needs a name and a type";
+				}
+				else if (source.nodeNames.count(tokens[1]) > 0) {
+					error = "defines " + tokens[1] + " again";
+				}
+				name = tokens[1];
+				typeToken = 2;
+			}
+
+			SceneNodeRecord record;
+			memset(&record, 0, sizeof(record));
+			record.material = record.child = SCENE_FILE_NO_INDEX;
+			next = typeToken + 1;
+
+			const std::string &type = error.empty() ? tokens[typeToken] : name;
+			size_t numOfValues = 0;
+			bool hasMaterial = true;
+
+			if (type == "sphere") {
+				record.type = SCENE_NODE_SPHERE;
+				numOfValues = 4;
+			}
+			else if (type == "movingSphere") {
+				record.type = SCENE_NODE_MOVING_SPHERE;
+				numOfValues = 9;
+			}
+			else if (type == "rectXY" || type == "rectXZ" || type == "rectYZ") {
+				record.type = type == "rectXY" ? SCENE_NODE_RECTANGLE_XY : type == "rectXZ" ? SCENE_NODE_RECTANGLE_XZ : SCENE_NODE_RECTANGLE_YZ;
+				numOfValues = 5;
+			}
+			else if (type == "box") {
+				record.type = SCENE_NODE_BOX;
+				numOfValues = 6;
+			}
+			else if (type == "flip" || type == "translate" || type == "rotateY" || type == "medium") {
+				record.type = type == "flip" ? SCENE_NODE_FLIP_NORMALS : type == "translate" ? SCENE_NODE_TRANSLATE : type == "rotateY" ? SCENE_NODE_ROTATE_Y : SCENE_NODE_CONSTANT_MEDIUM;
+				numOfValues = type == "flip" ? 0 : type == "translate" ? 3 : 1;
+				hasMaterial = false;
+				nameAt(source.nodeNames, "shape", record.child);
+			}
+			else if (error.empty()) {
+				error = "has an unknown statement " + type;
+			}
+
+			for (size_t value = 0; value < numOfValues; value++) {
+				numberAt(record.values[value]);
+			}
+
+			if (hasMaterial) {
+				nameAt(source.materialNames, "material", record.material);
+			}
+			else if (record.type == SCENE_NODE_CONSTANT_MEDIUM) {
+				//the phase function is a material of its own, nothing else refers to it
+				uint32_t texture = SCENE_FILE_NO_INDEX;
+				nameAt(source.textureNames, "texture", texture);
+
+				if (error.empty()) {
+					SceneMaterialRecord phaseFunction;
+					memset(&phaseFunction, 0, sizeof(phaseFunction));
+					phaseFunction.type = SCENE_MATERIAL_ISOTROPIC;
+					phaseFunction.texture = texture;
+
+					record.material = (uint32_t)source.materials.size();
+					source.materials.push_back(phaseFunction);
+				}
+			}
+
+			if (error.empty()) {
+				uint32_t node = (uint32_t)source.nodes.size();
+				source.nodes.push_back(record);
+
+				if (name.empty()) {
+					SceneWorldRecord worldRecord = { node, source.findEmitterMaterial(node) };
+					source.world.push_back(worldRecord);
+				}
+				else {
+					source.nodeNames[name] = node;
+				}
+			}
+		}
+
+		if (error.empty() && next < tokens.size()) {
+			error = "has " + tokens[next] + " left over at the end";
+		}
+		if (!error.empty()) {
+			std::cout << sourcePath << ":" << lineNumber << " " << error << "\n";
+			return 1;
+		}
+	}
+
+	if (source.world.empty()) {
+		std::cout << sourcePath << " has nothing in the world\n";
+		return 1;
+	}
+
+	//strings last, padded so the file stays a multiple of 4 bytes
+	while (source.strings.size() % 4 != 0) {
+		source.strings.push_back('\0');
+	}
+
+	SceneFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "RTSCENE", sizeof(header.magic));
+	header.version = SCENE_FILE_VERSION;
+	header.headerSizeInBytes = sizeof(header);
+	header.numOfTextures = (uint32_t)source.textures.size();
+	header.numOfMaterials = (uint32_t)source.materials.size();
+	header.numOfNodes = (uint32_t)source.nodes.size();
+	header.numOfWorldNodes = (uint32_t)source.world.size();
+	header.stringTableSizeInBytes = (uint32_t)source.strings.size();
+	header.sourceHash = sourceHash;
+
+	size_t payloadSizeInBytes = source.textures.size() * sizeof(SceneTextureRecord) + source.materials.size() * sizeof(SceneMaterialRecord) +
+		source.nodes.size() * sizeof(SceneNodeRecord) + source.world.size() * sizeof(SceneWorldRecord) + source.strings.size();
+
+	std::string temporaryPath = outputPath + ".tmp";
+	MappedFile file;
+
+	if (!file.create(temporaryPath, sizeof(header) + payloadSizeInBytes)) {
+		std::cout << "Can't create " << temporaryPath << "\n";
+		return 1;
+	}
+
+	uint8_t *payload = file.mutableData() + sizeof(header);
+	uint8_t *position = payload;
+	auto append = [&position](const void *data, size_t sizeInBytes) {
+		if (sizeInBytes > 0) {
+			memcpy(position, data, sizeInBytes);
+			position += sizeInBytes;
+		}
+	};
+
+	append(source.textures.data(), source.textures.size() * sizeof(SceneTextureRecord));
+	append(source.materials.data(), source.materials.size() * sizeof(SceneMaterialRecord));
+	append(source.nodes.data(), source.nodes.size() * sizeof(SceneNodeRecord));
+	append(source.world.data(), source.world.size() * sizeof(SceneWorldRecord));
+	append(source.strings.data(), source.strings.size());
+
+	header.payloadChecksum = checksumBytes(payload, payloadSizeInBytes);
+	memcpy(file.mutableData(), &header, sizeof(header));
+
+	bool flushed = file.flush();
+	file.close();
+
+	if (!flushed || !replaceFile(temporaryPath, outputPath)) {
+		std::cout << "Failed to write " << outputPath << "\n";
+		remove(temporaryPath.c_str());
+		return 1;
+	}
+	return 0;
+}
+
+bool SceneFile::load(const std::string &path) {
+	release();
+
+	if (!_file.open(path)) {
+		std::cout << "Can't open scene " << path << "\n";
+		return false;
+	}
+	_path = path;
+
+	SceneFileHeader header;
+	if (_file.getSizeInBytes() < sizeof(header)) {
+		std::cout << path << " is not a compiled scene\n";
+		_file.close();
+		return false;
+	}
+	memcpy(&header, _file.data(), sizeof(header));
+
+	if (memcmp(header.magic, "RTSCENE", sizeof(header.magic)) != 0 || header.headerSizeInBytes != sizeof(header)) {
+		std::cout << path << " is not a compiled scene\n";
+		_file.close();
+		return false;
+	}
+	if (header.version != SCENE_FILE_VERSION) {
+		std::cout << path << " is a version " << header.version << " scene, this build reads version " << SCENE_FILE_VERSION << ", compile it again\n";
+		_file.close();
+		return false;
+	}
+
+	size_t payloadSizeInBytes = (size_t)header.numOfTextures * sizeof(SceneTextureRecord) + (size_t)header.numOfMaterials * sizeof(SceneMaterialRecord) +
+		(size_t)header.numOfNodes * sizeof(SceneNodeRecord) + (size_t)header.numOfWorldNodes * sizeof(SceneWorldRecord) + header.stringTableSizeInBytes;
+
+	if (_file.getSizeInBytes() != sizeof(header) + payloadSizeInBytes) {
+		std::cout << path << " is truncated\n";
+		_file.close();
+		return false;
+	}
+
+	const uint8_t *payload = _file.data() + sizeof(header);
+	if (checksumBytes(payload, payloadSizeInBytes) != header.payloadChecksum) {
+		std::cout << "The scene " << path << " is corrupt\n";
+		_file.close();
+		return false;
+	}
+
+	//the mapping is page aligned and every record array starts at a multiple of 4 bytes
+	_header = (const SceneFileHeader *)_file.data();
+	_textureRecords = (const SceneTextureRecord *)payload;
+	_materialRecords = (const SceneMaterialRecord *)(_textureRecords + header.numOfTextures);
+	_nodeRecords = (const SceneNodeRecord *)(_materialRecords + header.numOfMaterials);
+	_worldRecords = (const SceneWorldRecord *)(_nodeRecords + header.numOfNodes);
+	_strings = (const char *)(_worldRecords + header.numOfWorldNodes);
+
+	//a valid checksum says the file is what some compile() wrote, the references still get checked so that build()
+	//can't be walked out of the arrays by a file from somewhere else
+	bool valid = header.numOfWorldNodes > 0 && (header.stringTableSizeInBytes == 0 || _strings[header.stringTableSizeInBytes - 1] == '\0');
+
+	for (uint32_t texture = 0; valid && texture < header.numOfTextures; texture++) {
+		const SceneTextureRecord &record = _textureRecords[texture];
+		valid = record.type <= SCENE_TEXTURE_IMAGE &&
+			(record.type != SCENE_TEXTURE_CHECKER || (record.even < texture && record.odd < texture)) &&
+			(record.type != SCENE_TEXTURE_IMAGE || record.even < header.stringTableSizeInBytes);
+	}
+	for (uint32_t material = 0; valid && material < header.numOfMaterials; material++) {
+		const SceneMaterialRecord &record = _materialRecords[material];
+		bool textured = record.type == SCENE_MATERIAL_LAMBERTIAN || record.type == SCENE_MATERIAL_DIFFUSE_LIGHT || record.type == SCENE_MATERIAL_ISOTROPIC;
+		valid = record.type <= SCENE_MATERIAL_ISOTROPIC && (!textured || record.texture < header.numOfTextures);
+	}
+	for (uint32_t node = 0; valid && node < header.numOfNodes; node++) {
+		const SceneNodeRecord &record = _nodeRecords[node];
+		bool wrapper = record.type >= SCENE_NODE_FLIP_NORMALS;
+		valid = record.type <= SCENE_NODE_CONSTANT_MEDIUM && (!wrapper || record.child < node) &&
+			((wrapper && record.type != SCENE_NODE_CONSTANT_MEDIUM) || record.material < header.numOfMaterials);
+	}
+	for (uint32_t world = 0; valid && world < header.numOfWorldNodes; world++) {
+		const SceneWorldRecord &record = _worldRecords[world];
+		valid = record.node < header.numOfNodes && (record.emitterMaterial == SCENE_FILE_NO_INDEX || record.emitterMaterial < header.numOfMaterials);
+	}
+
+	if (!valid) {
+		std::cout << "The scene " << path << " refers to records it doesn't have\n";
+		release();
+		return false;
+	}
+	return true;
+}
+
+bool SceneFile::loadSource(const std::string &sourcePath) {
+	uint64_t sourceHash;
+	if (!hashSourceFile(sourcePath, sourceHash, NULL)) {
+		std::cout << "Can't open scene " << sourcePath << "\n";
+		return false;
+	}
+
+	std::string compiledPath = sourcePath + SCENE_FILE_COMPILED_SUFFIX;
+	SceneFileHeader header;
+	bool upToDate = false;
+
+	MappedFile compiled;
+	if (compiled.open(compiledPath) && compiled.getSizeInBytes() >= sizeof(header)) {
+		memcpy(&header, compiled.data(), sizeof(header));
+		upToDate = memcmp(header.magic, "RTSCENE", sizeof(header.magic)) == 0 && header.version == SCENE_FILE_VERSION && header.sourceHash == sourceHash;
+	}
+	compiled.close();
+
+	if (!upToDate) {
+		std::cout << "Compiling " << sourcePath << " to " << compiledPath << "\n";
+		if (compile(sourcePath, compiledPath) != 0) {
+			return false;
+		}
+	}
+	return load(compiledPath);
+}
+
+size_t SceneFile::getNodeSizeInBytes(uint32_t type) {
+	switch (type) {
+	case SCENE_NODE_SPHERE:
+		return alignArenaSize(sizeof(Sphere));
+	case SCENE_NODE_MOVING_SPHERE:
+		return alignArenaSize(sizeof(MovingSphere));
+	case SCENE_NODE_RECTANGLE_XY:
+		return alignArenaSize(sizeof(XYRectangle));
+	case SCENE_NODE_RECTANGLE_XZ:
+		return alignArenaSize(sizeof(XZRectangle));
+	case SCENE_NODE_RECTANGLE_YZ:
+		return alignArenaSize(sizeof(YZRectangle));
+	case SCENE_NODE_BOX:
+		//the box, its side list and the six sides, three of them flipped
+		return alignArenaSize(sizeof(Box)) + alignArenaSize(sizeof(HitableList)) + alignArenaSize(6 * sizeof(Hitable *)) +
+			2 * (alignArenaSize(sizeof(XYRectangle)) + alignArenaSize(sizeof(XZRectangle)) + alignArenaSize(sizeof(YZRectangle))) + 3 * alignArenaSize(sizeof(FlipNormals));
+	case SCENE_NODE_FLIP_NORMALS:
+		return alignArenaSize(sizeof(FlipNormals));
+	case SCENE_NODE_TRANSLATE:
+		return alignArenaSize(sizeof(Translate));
+	case SCENE_NODE_ROTATE_Y:
+		return alignArenaSize(sizeof(RotateY));
+	default:
+		return alignArenaSize(sizeof(ConstantMedium));
+	}
+}
+
+Hitable *SceneFile::build(EmitterRegistry *emitterRegistry) {
+	if (_header == NULL || _arena.data() != NULL) {
+		std::cout << "Scene files are built once, after a load\n";
+		return NULL;
+	}
+
+	const SceneFileHeader &header = *_header;
+
+	//every object goes in one allocation, sized from the records before anything is constructed
+	size_t arenaSizeInBytes = alignArenaSize(header.numOfTextures * sizeof(Texture *)) + alignArenaSize(header.numOfMaterials * sizeof(Material *)) +
+		alignArenaSize(header.numOfNodes * sizeof(Hitable *)) + alignArenaSize(header.numOfWorldNodes * sizeof(Hitable *));
+
+	for (uint32_t texture = 0; texture < header.numOfTextures; texture++) {
+		arenaSizeInBytes += alignArenaSize(std::max(std::max(sizeof(ConstantTexture), sizeof(CheckerTexture)), std::max(sizeof(NoiseTexture), sizeof(ImageTexture))));
+	}
+	for (uint32_t material = 0; material < header.numOfMaterials; material++) {
+		arenaSizeInBytes += alignArenaSize(std::max(std::max(sizeof(Lambertian), sizeof(Metal)), std::max(std::max(sizeof(Dielectric), sizeof(DiffuseLight)), sizeof(Isotropic))));
+	}
+	for (uint32_t node = 0; node < header.numOfNodes; node++) {
+		arenaSizeInBytes += getNodeSizeInBytes(_nodeRecords[node].type);
+	}
+
+	try {
+		_arena.allocate(arenaSizeInBytes);
+	}
+	catch (const std::bad_alloc &) {
+		std::cout << "Not enough memory for the scene's " << arenaSizeInBytes << " bytes\n";
+		return NULL;
+	}
+	_arenaOffset = 0;
+
+	_textures = (Texture **)reserve(header.numOfTextures * sizeof(Texture *));
+	_materials = (Material **)reserve(header.numOfMaterials * sizeof(Material *));
+	_nodes = (Hitable **)reserve(header.numOfNodes * sizeof(Hitable *));
+	Hitable **worldList = (Hitable **)reserve(header.numOfWorldNodes * sizeof(Hitable *));
+
+	//nothing is constructed yet, release() only destroys what is counted here
+	_constructedTextures = _constructedMaterials = _constructedNodes = 0;
+
+	for (uint32_t texture = 0; texture < header.numOfTextures; texture++) {
+		const SceneTextureRecord &record = _textureRecords[texture];
+		vec3 color(record.values[0], record.values[1], record.values[2]);
+
+		switch (record.type) {
+		case SCENE_TEXTURE_CONSTANT:
+			_textures[texture] = construct<ConstantTexture>(color);
+			break;
+		case SCENE_TEXTURE_CHECKER:
+			_textures[texture] = construct<CheckerTexture>(_textures[record.even], _textures[record.odd]);
+			break;
+		case SCENE_TEXTURE_NOISE:
+			_textures[texture] = construct<NoiseTexture>(true, record.values[0]);
+			break;
+		default: {
+			//converted once per node and mapped, like the scenes.h textures
+			const MipmappedImage *textureData = MipmapCache::load(_strings + record.even);
+			if (textureData == NULL) {
+				std::cout << "Can't read texture " << (_strings + record.even) << "\n";
+				return NULL;
+			}
+			_textures[texture] = construct<ImageTexture>(textureData);
+			break;
+		}
+		}
+		_constructedTextures++;
+	}
+
+	for (uint32_t material = 0; material < header.numOfMaterials; material++) {
+		const SceneMaterialRecord &record = _materialRecords[material];
+
+		switch (record.type) {
+		case SCENE_MATERIAL_LAMBERTIAN:
+			_materials[material] = construct<Lambertian>(_textures[record.texture]);
+			break;
+		case SCENE_MATERIAL_METAL:
+			_materials[material] = construct<Metal>(vec3(record.values[0], record.values[1], record.values[2]), record.values[3]);
+			break;
+		case SCENE_MATERIAL_DIELECTRIC:
+			_materials[material] = construct<Dielectric>(record.values[0]);
+			break;
+		case SCENE_MATERIAL_DIFFUSE_LIGHT:
+			_materials[material] = construct<DiffuseLight>(_textures[record.texture]);
+			break;
+		default:
+			_materials[material] = construct<Isotropic>(_textures[record.texture]);
+			break;
+		}
+		_constructedMaterials++;
+	}
+
+	for (uint32_t node = 0; node < header.numOfNodes; node++) {
+		const SceneNodeRecord &record = _nodeRecords[node];
+		const float *v = record.values;
+		Material *material = record.material < header.numOfMaterials ? _materials[record.material] : NULL;
+		Hitable *child = record.child < node ? _nodes[record.child] : NULL;
+
+		switch (record.type) {
+		case SCENE_NODE_SPHERE:
+			_nodes[node] = construct<Sphere>(vec3(v[0], v[1], v[2]), v[3], material);
+			break;
+		case SCENE_NODE_MOVING_SPHERE:
+			_nodes[node] = construct<MovingSphere>(vec3(v[0], v[1], v[2]), vec3(v[3], v[4], v[5]), v[6], v[7], v[8], material);
+			break;
+		case SCENE_NODE_RECTANGLE_XY:
+			_nodes[node] = construct<XYRectangle>(v[0], v[1], v[2], v[3], v[4], material);
+			break;
+		case SCENE_NODE_RECTANGLE_XZ:
+			_nodes[node] = construct<XZRectangle>(v[0], v[1], v[2], v[3], v[4], material);
+			break;
+		case SCENE_NODE_RECTANGLE_YZ:
+			_nodes[node] = construct<YZRectangle>(v[0], v[1], v[2], v[3], v[4], material);
+			break;
+		case SCENE_NODE_BOX: {
+			//the same sides Box::Box makes, just not on the heap
+			vec3 p0(v[0], v[1], v[2]), p1(v[3], v[4], v[5]);
+			Hitable **sides = (Hitable **)reserve(6 * sizeof(Hitable *));
+
+			sides[0] = construct<FlipNormals>(construct<XYRectangle>(p0.x(), p1.x(), p0.y(), p1.y(), p1.z(), material));
+			sides[1] = construct<XYRectangle>(p0.x(), p1.x(), p0.y(), p1.y(), p0.z(), material);
+			sides[2] = construct<XZRectangle>(p0.x(), p1.x(), p0.z(), p1.z(), p1.y(), material);
+			sides[3] = construct<FlipNormals>(construct<XZRectangle>(p0.x(), p1.x(), p0.z(), p1.z(), p0.y(), material));
+			sides[4] = construct<YZRectangle>(p0.y(), p1.y(), p0.z(), p1.z(), p1.x(), material);
+			sides[5] = construct<FlipNormals>(construct<YZRectangle>(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), material));
+
+			_nodes[node] = construct<Box>(p0, p1, (Hitable *)construct<HitableList>(sides, 6u));
+			break;
+		}
+		case SCENE_NODE_FLIP_NORMALS:
+			_nodes[node] = construct<FlipNormals>(child);
+			break;
+		case SCENE_NODE_TRANSLATE:
+			_nodes[node] = construct<Translate>(child, vec3(v[0], v[1], v[2]));
+			break;
+		case SCENE_NODE_ROTATE_Y:
+			_nodes[node] = construct<RotateY>(child, v[0]);
+			break;
+		default:
+			_nodes[node] = construct<ConstantMedium>(child, v[0], material);
+			break;
+		}
+		_constructedNodes++;
+	}
+
+	for (uint32_t world = 0; world < header.numOfWorldNodes; world++) {
+		const SceneWorldRecord &record = _worldRecords[world];
+		worldList[world] = _nodes[record.node];
+
+		if (emitterRegistry != NULL && record.emitterMaterial != SCENE_FILE_NO_INDEX) {
+			emitterRegistry->addEmitter(worldList[world], _materials[record.emitterMaterial]);
+		}
+	}
+
+	if (!buildBvh(worldList)) {
+		return NULL;
+	}
+	return _world.get();
+}
+
+bool SceneFile::buildBvh(Hitable *const *worldList) {
+	uint32_t numOfLeaves = _header->numOfWorldNodes;
+	uint64_t key = BvhCache::makeKey(_header->payloadChecksum, numOfLeaves, 0.0f, 1.0f);
+	std::string cachePath = _path + SCENE_FILE_BVH_CACHE_SUFFIX;
+	const FlatBvhNode *nodes = NULL;
+
+	if (!BvhCache::open(cachePath, key, numOfLeaves, _bvhFile, nodes)) {
+		std::cout << "Building the BVH of " << _path << " into " << cachePath << "\n";
+
+		//BvhNode sorts the list it gets and picks split axes off the RNG, seeded from the key here (and put back after)
+		//so the tree only depends on the scene
+		std::vector<Hitable *> sortedList(worldList, worldList + numOfLeaves);
+		std::mt19937_64 savedGenerator = randomNumberGenerator;
+		seedRandomNumberGenerator(mixRandomSeed(key));
+
+		BvhNode *tree = new BvhNode(sortedList.data(), (int)numOfLeaves, 0.0f, 1.0f);
+		randomNumberGenerator = savedGenerator;
+
+		bool flattened = BvhCache::flatten(tree, worldList, numOfLeaves, _bvhNodes);
+		delete tree;
+		if (!flattened) {
+			return false;
+		}
+
+		//mapped back in on success so every process rendering the scene shares the pages, else straight from memory
+		if (BvhCache::write(cachePath, key, numOfLeaves, _bvhNodes) == 0 && BvhCache::open(cachePath, key, numOfLeaves, _bvhFile, nodes)) {
+			_bvhNodes.clear();
+			_bvhNodes.shrink_to_fit();
+		}
+		else {
+			nodes = _bvhNodes.data();
+		}
+	}
+
+	_world.reset(new FlatBvh(nodes, worldList));
+	return true;
+}
+
+void SceneFile::release() {
+	_world.reset();
+	_bvhFile.close();
+	_bvhNodes.clear();
+
+	//the box sides and side lists own nothing, only what is in the tables needs its destructor run
+	for (uint32_t node = 0; node < _constructedNodes; node++) {
+		_nodes[node]->~Hitable();
+	}
+	for (uint32_t material = 0; material < _constructedMaterials; material++) {
+		_materials[material]->~Material();
+	}
+	for (uint32_t texture = 0; texture < _constructedTextures; texture++) {
+		_textures[texture]->~Texture();
+	}
+	_constructedTextures = _constructedMaterials = _constructedNodes = 0;
+
+	_arena.release();
+	_arenaOffset = 0;
+	_textures = NULL;
+	_materials = NULL;
+	_nodes = NULL;
+
+	_file.close();
+	_header = NULL;
+	_path.clear();
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <new>
+#include <vector>
+#include <unordered_map>
+#include <stddef.h>
+
+/*
+	Deletes a built in scene. The scene functions (scenes.h) new every hitable, material and texture and hand back only
+	the world, fine for a process that renders one scene until it exits but not for the render daemon, which drops the
+	scenes it hasn't used in a while.
+
+	While a SceneOwner::Scope is open, every hitable/material/texture newed on that thread is adopted by the owner (the
+	base classes route their operator new through here), and the owner deletes whatever is left of them when it goes.
+	Oldest first: a box or BVH node is allocated before the sides/inner nodes its constructor makes, so it goes first,
+	and the children it deletes itself are struck off here instead of being deleted twice. Nothing else a destructor
+	touches (leaves, materials) has to still be there.
+
+	Something an owner adopted is either left to it or deleted on the same thread with the scope still open.
+*/
+class SceneOwner {
+public:
+	typedef void (*Deleter)(void *object);
+
+	//adopts for as long as it is open, scopes nest
+	class Scope {
+	public:
+		explicit Scope(SceneOwner &owner) : _previous(current()) {
+			current() = &owner;
+		}
+
+		~Scope() {
+			current() = _previous;
+		}
+
+		Scope(const Scope &) = delete;
+		Scope &operator=(const Scope &) = delete;
+
+	protected:
+		SceneOwner *_previous;
+	};
+
+	SceneOwner() {}
+
+	~SceneOwner() {
+		release();
+	}
+
+	SceneOwner(const SceneOwner &) = delete;
+	SceneOwner &operator=(const SceneOwner &) = delete;
+
+	//deleter gets the object back once it is constructed, it knows the type
+	static void *allocate(size_t sizeInBytes, Deleter deleter) {
+		void *object = ::operator new(sizeInBytes);
+
+		SceneOwner *owner = current();
+		if (owner != NULL) {
+			try {
+				owner->_objects.push_back(std::make_pair(object, deleter));
+				owner->_alive[object] = owner->_objects.size() - 1;
+			}
+			catch (...) {
+				::operator delete(object);
+				throw;
+			}
+		}
+		return object;
+	}
+
+	static void deallocate(void *object) {
+		SceneOwner *owner = current();
+		if (owner != NULL) {
+			owner->_alive.erase(object);
+		}
+		::operator delete(object);
+	}
+
+	void release() {
+		Scope scope(*this);
+
+		for (size_t object = 0; object < _objects.size(); object++) {
+			//a freed address can come back for a later object, only the newest entry for it is alive then
+			auto alive = _alive.find(_objects[object].first);
+			if (alive != _alive.end() && alive->second == object) {
+				_objects[object].second(_objects[object].first);
+			}
+		}
+
+		_objects.clear();
+		_alive.clear();
+	}
+
+	size_t size() const {
+		return _alive.size();
+	}
+
+protected:
+	static SceneOwner *&current() {
+		static thread_local SceneOwner *owner = NULL;
+		return owner;
+	}
+
+	std::vector<std::pair<void *, Deleter>> _objects;
+	//address to its entry in _objects
+	std::unordered_map<void *, size_t> _alive;
+};
+
+//for the base classes, routes new/delete of everything derived from them through the thread's owner (if any)
+#define SCENE_OWNER_ALLOCATION(BaseClass)																\
+	static void *operator new(size_t sizeInBytes) {														\
+		return SceneOwner::allocate(sizeInBytes, [](void *object) { delete (BaseClass *)object; });		\
+	}																									\
+	static void operator delete(void *object) {															\
+		SceneOwner::deallocate(object);																	\
+	}																									\
+	/* a class operator new hides the placement one, scene files construct into their arena */			\
+	static void *operator new(size_t, void *place) {													\
+		return place;																					\
+	}																									\
+	static void operator delete(void *, void *) {														\
+	}
@@ -17,6 +17,7 @@
 #include "camera.h"
 #include "color.h"
 #include "bvhNode.h"
+#include "lightSampler.h"
 
 #include "debug.h"
 
@@ -25,8 +26,15 @@
 //https://github.com/nothings/stb
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#include "mipmapCache.h"
 
-Hitable *randomScene() {
+//which scene buildScene() in main.cpp puts together, also what the distributed coordinator tells its workers to build
+enum SceneId {
+	SCENE_ID_CORNELL_BOX = 0,
+	SCENE_ID_RANDOM = 1
+};
+
+Hitable *randomScene(EmitterRegistry *emitterRegistry = NULL) {
 	//drowan 20190210: maybe use camera lookat to figure out the centerX and Y coords?
 	int n = 100;
 	Hitable **list = new Hitable*[n + 1];
@@ -43,11 +51,11 @@ Hitable *randomScene() {
 	Material *emitterMat = new DiffuseLight(new ConstantTexture(vec3(20 * 1, 20 * 0, 20 * 0)));
 
 	//read in an image for texture mapping
-	int nx, ny, nn;
-	unsigned char *textureData = stbi_load("./input_images/earth1300x1300.jpg", &nx, &ny, &nn, 0);
+	//converted to a mip chain once per node and mapped by every render process, see mipmapCache.h
+	const MipmappedImage *textureData = MipmapCache::load("./input_images/earth1300x1300.jpg");
 	//unsigned char *textureData = stbi_load("./input_images/red750x750.jpg", &nx, &ny, &nn, 0);
 
-	Material *imageMat = new Lambertian(new ImageTexture(textureData, nx, ny));
+	Material *imageMat = new Lambertian(new ImageTexture(textureData));
 
 	list[0] = new Sphere(vec3(0, 1000, 0), 1000, new Lambertian(perlin));
 
@@ -112,6 +120,7 @@ Hitable *randomScene() {
 	list[i++] = new Sphere(vec3(4, -1.0, 0), 1.0, new Metal(vec3(0.7, 0.6, 0.5), 0.0));		
 	//basic "sun"?
 	list[i++] = new Sphere(vec3(0, -400, 10), 100.0, emitterMat);
+	if (emitterRegistry) emitterRegistry->addEmitter(list[i - 1], emitterMat);
 #endif
 
 	//std::cout << "n+1 = " << n << " i= " << i << "\n";
@@ -119,7 +128,7 @@ Hitable *randomScene() {
 	//return new HitableList(list, i);
 }
 
-Hitable *randomScene_NED() {
+Hitable *randomScene_NED(EmitterRegistry *emitterRegistry = NULL) {
 	//drowan 20190210: maybe use camera lookat to figure out the centerX and Y coords?
 	int n = 100;
 	Hitable **list = new Hitable*[n + 1];
@@ -136,12 +145,12 @@ Hitable *randomScene_NED() {
 	Material *emitterMat = new DiffuseLight(new ConstantTexture(vec3(20 * 1, 20 * 0, 20 * 0)));
 
 	//read in an image for texture mapping
-	int nx, ny, nn;
-	unsigned char *textureData = stbi_load("./input_images/1_earth_8k.jpg", &nx, &ny, &nn, 0);
+	//converted to a mip chain once per node and mapped by every render process, see mipmapCache.h
+	const MipmappedImage *textureData = MipmapCache::load("./input_images/1_earth_8k.jpg");
 	//unsigned char *textureData = stbi_load("./input_images/earth1300x1300.jpg", &nx, &ny, &nn, 0);
 	//unsigned char *textureData = stbi_load("./input_images/red750x750.jpg", &nx, &ny, &nn, 0);
 
-	Material *imageMat = new Lambertian(new ImageTexture(textureData, nx, ny));
+	Material *imageMat = new Lambertian(new ImageTexture(textureData));
 
 	float worldSphereRadius = 1000.0;
 	float worldSphereRadiusOffset = -1 * worldSphereRadius;
@@ -210,6 +219,7 @@ Hitable *randomScene_NED() {
 	list[i++] = new Sphere(vec3(100, 70, worldSphereRadiusOffset), 50.0, new Metal(vec3(0.7, 0.6, 0.5), 0.0));
 	//basic "sun"?
 	list[i++] = new Sphere(vec3(0, 0, worldSphereRadiusOffset - 500), 100.0, emitterMat);
+	if (emitterRegistry) emitterRegistry->addEmitter(list[i - 1], emitterMat);
 #endif
 
 	//std::cout << "n+1 = " << n << " i= " << i << "\n";
@@ -217,7 +227,7 @@ Hitable *randomScene_NED() {
 	//return new HitableList(list, i);
 }
 
-Hitable *cornellBox() {
+Hitable *cornellBox(EmitterRegistry *emitterRegistry = NULL) {
 	Hitable **list = new Hitable*[100];
 	int i = 0;
 
@@ -249,6 +259,7 @@ Hitable *cornellBox() {
 		(-planeAxisDepthOffset / 2) + 1,
 		light
 	);
+	if (emitterRegistry) emitterRegistry->addEmitter(list[i - 1], light);
 	/**/
 
 #endif
@@ -352,7 +363,7 @@ Hitable *cornellBox() {
 	return new HitableList(list, i);
 }
 
-Hitable *cornellBox_NED() {
+Hitable *cornellBox_NED(EmitterRegistry *emitterRegistry = NULL) {
 	Hitable **list = new Hitable*[100];
 	int i = 0;
 
@@ -380,6 +391,7 @@ Hitable *cornellBox_NED() {
 			light
 		), vec3(-planeWidth / 4, -planeWidth / 4, (-planeHeight / 2) + 1)
 	);
+	if (emitterRegistry) emitterRegistry->addEmitter(list[i - 1], light);
 
 	//top panel	
 	list[i++] = new Translate(
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <future>
+#include <functional>
+#include <chrono>
+#include <utility>
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "defines.h"
+#include "renderer.h"
+#include "cameraPath.h"
+#include "imageWriterPool.h"
+#include "frameStream.h"
+
+//what the last renderSequence did
+struct SequenceRenderStats {
+	uint32_t numOfFrames;
+	uint32_t framesInFlight;
+	float renderTimeMs;
+	float framesPerSecond;
+	//time finished frames waited to be handed to the output (a full writer queue, a reader behind on the stream)
+	float outputBlockedMs;
+	uint32_t numOfFailedWrites;
+};
+
+/*
+	Renders a camera path (cameraPath.h) as numbered images, "frame_%04d.png" style.
+
+	Every frame is a Renderer job on the same scene, so the BVH, textures and lights are built once and shared by all
+	of them. Up to framesInFlight frames are submitted at a time, each a priority step below the one before: the workers
+	finish the frames in order, but the ones that find nothing left of the oldest frame start on the next instead of
+	idling until the last tile of the frame is done. At low resolutions a single frame has fewer tiles than there are
+	threads, then several frames render side by side; 0 frames in flight picks enough to give every thread a few tiles.
+
+	Finished frames go to an ImageWriterPool, the encoding and file I/O happen on its threads while the next frames
+	render. What is resident is framesInFlight frames being rendered plus the writer queue.
+
+	Or they go into a FrameStream (frameStream.h) in order, on the calling thread. A reader that falls behind blocks
+	that thread, no new frames are submitted meanwhile, so at most framesInFlight frames are ever waiting on it.
+*/
+class SequenceRenderer {
+public:
+	SequenceRenderer(Renderer &renderer, ImageWriterPool &writerPool, uint32_t framesInFlight = SEQUENCE_FRAMES_IN_FLIGHT) :
+		_renderer(renderer), _writerPool(writerPool), _framesInFlight(framesInFlight) {
+
+		memset(&_lastStats, 0, sizeof(_lastStats));
+	}
+
+	/*
+		job has the scene, size, samples, seed and priority, its camera and output are ignored. Frame i is the camera
+		at start + (end - start) * i / (numOfFrames - 1) of the path and gets job.seed + i as its seed. outputPattern
+		has one integer conversion (%d, %04d...) for the frame number. 0 on success like ImageWriter::write.
+	*/
+	uint32_t renderSequence(const RenderJob &job, const CameraPath &path, uint32_t numOfFrames, const std::string &outputPattern);
+
+	//the same frames into an open stream, the writer pool isn't used
+	uint32_t renderSequence(const RenderJob &job, const CameraPath &path, uint32_t numOfFrames, FrameStream &stream);
+
+	const SequenceRenderStats &getLastStats() const {
+		return _lastStats;
+	}
+
+	//false unless pattern has exactly one %d style conversion (flags, width), %% is fine anywhere
+	static bool isValidFramePattern(const std::string &pattern) {
+		uint32_t numOfConversions = 0;
+
+		for (size_t i = 0; i < pattern.size(); i++) {
+			if (pattern[i] != '%') {
+				continue;
+			}
+			if (i + 1 < pattern.size() && pattern[i + 1] == '%') {
+				i++;
+				continue;
+			}
+
+			i++;
+			while (i < pattern.size() && (pattern[i] == '0' || pattern[i] == '-' || pattern[i] == '+' || pattern[i] == ' ')) i++;
+			while (i < pattern.size() && pattern[i] >= '0' && pattern[i] <= '9') i++;
+
+			if (i == pattern.size() || (pattern[i] != 'd' && pattern[i] != 'u')) {
+				return false;
+			}
+			numOfConversions++;
+		}
+		return numOfConversions == 1;
+	}
+
+protected:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	//gets every finished frame in order, pixels can be taken or left to be reused. False stops the sequence.
+	typedef std::function<bool(uint32_t frameIndex, std::vector<float> &pixels)> FrameSink;
+
+	uint32_t renderFrames(const RenderJob &job, const CameraPath &path, uint32_t numOfFrames, const FrameSink &sink);
+
+	struct Frame {
+		uint32_t index;
+		std::vector<float> pixels;
+		std::future<RenderResult> result;
+	};
+
+	static std::string framePath(const std::string &pattern, uint32_t frame) {
+		char path[4096];
+		snprintf(path, sizeof(path), pattern.c_str(), frame);
+		return path;
+	}
+
+	Renderer &_renderer;
+	ImageWriterPool &_writerPool;
+	uint32_t _framesInFlight;
+
+	SequenceRenderStats _lastStats;
+};
+
+uint32_t SequenceRenderer::renderSequence(const RenderJob &job, const CameraPath &path, uint32_t numOfFrames, const std::string &outputPattern) {
+	if (!isValidFramePattern(outputPattern)) {
+		std::cout << "Can't write frames to " << outputPattern << ", it needs one %d (or %04d...) for the frame number\n";
+		return 1;
+	}
+	if (imageFormatFromPath(outputPattern) == IMAGE_FORMAT_UNKNOWN && hdrImageFormatFromPath(outputPattern) == HDR_IMAGE_FORMAT_UNKNOWN) {
+		std::cout << "Can't write " << outputPattern << ", use a .bmp, .ppm, .png, .pfm, .hdr or .exr name\n";
+		return 1;
+	}
+
+	_writerPool.waitUntilIdle();
+
+	uint32_t width = job.resWidthInPixels;
+	uint32_t height = job.resHeightInPixels;
+	uint32_t failed = renderFrames(job, path, numOfFrames, [this, &outputPattern, width, height](uint32_t frameIndex, std::vector<float> &pixels) {
+		_writerPool.enqueue(framePath(outputPattern, frameIndex), std::move(pixels), width, height);
+		return true;
+	});
+
+	uint32_t failedWrites = _writerPool.waitUntilIdle();
+	_lastStats.numOfFailedWrites = failedWrites;
+
+	if (failedWrites > 0) {
+		std::cout << failedWrites << " frames failed to write\n";
+		return 1;
+	}
+	return failed;
+}
+
+uint32_t SequenceRenderer::renderSequence(const RenderJob &job, const CameraPath &path, uint32_t numOfFrames, FrameStream &stream) {
+	uint32_t failed = renderFrames(job, path, numOfFrames, [this, &stream](uint32_t frameIndex, std::vector<float> &pixels) {
+		if (!stream.writeFrame(pixels.data())) {
+			std::cout << "Failed to stream frame " << frameIndex << ", the reader went away?\n";
+			_lastStats.numOfFailedWrites++;
+			return false;
+		}
+		return true;
+	});
+
+	return _lastStats.numOfFailedWrites > 0 ? 1 : failed;
+}
+
+uint32_t SequenceRenderer::renderFrames(const RenderJob &job, const CameraPath &path, uint32_t numOfFrames, const FrameSink &sink) {
+	uint32_t width = job.resWidthInPixels;
+	uint32_t height = job.resHeightInPixels;
+
+	memset(&_lastStats, 0, sizeof(_lastStats));
+
+	if (job.scene.world == NULL || width == 0 || height == 0 || job.samplesPerPixel == 0 || numOfFrames == 0 || path.getNumOfKeyframes() == 0) {
+		std::cout << "Can't render the sequence, it needs a scene, a size, samples, frames and a camera path\n";
+		return 1;
+	}
+
+	//a few tiles per thread, otherwise the tail of every frame leaves most of the threads without work
+	uint32_t framesInFlight = _framesInFlight;
+	if (framesInFlight == 0) {
+		uint32_t tilesPerFrame = ((width + TILE_SIZE_IN_PIXELS - 1) / TILE_SIZE_IN_PIXELS) * ((height + TILE_SIZE_IN_PIXELS - 1) / TILE_SIZE_IN_PIXELS);
+		uint32_t tilesWanted = _renderer.getNumOfThreads() * SEQUENCE_TILES_PER_THREAD;
+
+		framesInFlight = (tilesWanted + tilesPerFrame - 1) / tilesPerFrame;
+		framesInFlight = std::max(2u, std::min(framesInFlight, (uint32_t)SEQUENCE_MAX_FRAMES_IN_FLIGHT));
+	}
+
+	float aspectRatio = float(width) / float(height);
+	float startTime = path.getStartTime();
+	float endTime = path.getEndTime();
+
+	std::deque<Frame> framesRendering;
+	std::vector<std::vector<float>> freeBuffers;
+	Clock::duration outputTime = Clock::duration::zero();
+	bool succeeded = true;
+	uint32_t nextFrame = 0;
+
+	auto renderStartTime = Clock::now();
+
+	while (!framesRendering.empty() || (succeeded && nextFrame < numOfFrames)) {
+		//a failed frame or output stops new frames, the ones in flight still have to come back
+		while (succeeded && nextFrame < numOfFrames && framesRendering.size() < framesInFlight) {
+			Frame frame;
+			frame.index = nextFrame;
+
+			if (!freeBuffers.empty()) {
+				frame.pixels.swap(freeBuffers.back());
+				freeBuffers.pop_back();
+			}
+			frame.pixels.resize((size_t)width * height * 3);
+
+			float time = numOfFrames > 1 ? startTime + (endTime - startTime) * nextFrame / (numOfFrames - 1) : startTime;
+
+			RenderJob frameJob = job;
+			frameJob.camera = path.cameraAt(time, aspectRatio);
+			frameJob.seed = job.seed + nextFrame;
+			frameJob.priority = job.priority - (int32_t)nextFrame;
+			frameJob.outputPixels = frame.pixels.data();
+			frameJob.outputRowStrideInFloats = 0;
+
+			frame.result = _renderer.submit(frameJob);
+			framesRendering.push_back(std::move(frame));
+			nextFrame++;
+		}
+
+		Frame &frame = framesRendering.front();
+		try {
+			frame.result.get();
+		}
+		catch (const std::exception &exception) {
+			std::cout << "Frame " << frame.index << " failed: " << exception.what() << "\n";
+			succeeded = false;
+		}
+
+		if (succeeded) {
+			auto outputStartTime = Clock::now();
+			succeeded = sink(frame.index, frame.pixels);
+			outputTime += Clock::now() - outputStartTime;
+		}
+
+		//whatever the sink left behind is reused for a later frame
+		if (frame.pixels.capacity() > 0) {
+			freeBuffers.push_back(std::move(frame.pixels));
+		}
+		framesRendering.pop_front();
+	}
+
+	std::chrono::duration<float, std::milli> renderTime = Clock::now() - renderStartTime;
+	_lastStats.numOfFrames = nextFrame;
+	_lastStats.framesInFlight = framesInFlight;
+	_lastStats.renderTimeMs = renderTime.count();
+	_lastStats.framesPerSecond = renderTime.count() > 0.0f ? nextFrame / (renderTime.count() / 1000.0f) : 0.0f;
+	_lastStats.outputBlockedMs = std::chrono::duration<float, std::milli>(outputTime).count();
+
+	return succeeded ? 0 : 1;
+}
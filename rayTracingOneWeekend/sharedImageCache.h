@@ -0,0 +1,149 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "defines.h"
+#include "mappedFile.h"
+#include "stb_image.h"
+
+//"RIC1", raw image cache
+#define SHARED_IMAGE_MAGIC 0x31434952
+//the pixels start on their own cache line after the header
+#define SHARED_IMAGE_HEADER_SIZE 64
+
+struct SharedImageHeader {
+	uint32_t magic;
+	uint32_t width, height, channels;
+	//the cache is only used while the image it was decoded from is unchanged
+	uint64_t sourceSizeInBytes;
+	int64_t sourceModifiedTime;
+};
+
+/*
+	Decoded images shared between render processes.
+
+	The first process to load an image decodes it once with stb_image and writes the raw RGB8 pixels next to it
+	(<image><SHARED_IMAGE_CACHE_SUFFIX>). From then on every process, including that first one, maps the raw file read
+	only, so the 8k earth texture (~100MB decoded) is one physical copy in the page cache no matter how many renderers
+	run on the node, and a cold start is an mmap instead of a JPEG decode.
+
+	The file is written under a temporary name and renamed into place, so a process never maps a half written one.
+	If the cache can't be written (read only directory) the image is decoded onto the heap like before.
+*/
+class SharedImageCache {
+public:
+	//RGB8 rows top to bottom like stbi_load(..., 3), NULL if the image can't be read. The pixels live as long as the process.
+	static const unsigned char *load(const std::string &path, int &width, int &height);
+
+protected:
+	static const unsigned char *mapCached(const std::string &cachePath, uint64_t sourceSizeInBytes, int64_t sourceModifiedTime, int &width, int &height) {
+		std::unique_ptr<MappedFile> mappedFile(new MappedFile);
+		if (!mappedFile->open(cachePath) || mappedFile->getSizeInBytes() < SHARED_IMAGE_HEADER_SIZE) {
+			return NULL;
+		}
+
+		SharedImageHeader header;
+		memcpy(&header, mappedFile->data(), sizeof(header));
+
+		if (header.magic != SHARED_IMAGE_MAGIC || header.channels != 3 ||
+			header.sourceSizeInBytes != sourceSizeInBytes || header.sourceModifiedTime != sourceModifiedTime ||
+			mappedFile->getSizeInBytes() < SHARED_IMAGE_HEADER_SIZE + (size_t)header.width * header.height * 3) {
+			return NULL;
+		}
+
+		width = (int)header.width;
+		height = (int)header.height;
+
+		const unsigned char *pixels = mappedFile->data() + SHARED_IMAGE_HEADER_SIZE;
+		getMappedImages().push_back(std::move(mappedFile));
+		return pixels;
+	}
+
+	static bool writeCache(const std::string &cachePath, const SharedImageHeader &header, const unsigned char *pixels) {
+#if defined (_WIN32)
+		std::string temporaryPath = cachePath + ".tmp" + std::to_string(GetCurrentProcessId());
+#else
+		std::string temporaryPath = cachePath + ".tmp" + std::to_string(getpid());
+#endif
+		std::ofstream outputStream(temporaryPath.c_str(), std::ios::out | std::ios::binary);
+		if (outputStream.fail()) {
+			return false;
+		}
+
+		char headerBlock[SHARED_IMAGE_HEADER_SIZE] = { 0 };
+		memcpy(headerBlock, &header, sizeof(header));
+
+		outputStream.write(headerBlock, SHARED_IMAGE_HEADER_SIZE);
+		outputStream.write((const char *)pixels, (std::streamsize)header.width * header.height * 3);
+		outputStream.close();
+
+		if (outputStream.fail()) {
+			remove(temporaryPath.c_str());
+			return false;
+		}
+
+		//somebody else may have won the race, theirs is just as good
+#if defined (_WIN32)
+		if (!MoveFileExA(temporaryPath.c_str(), cachePath.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+#else
+		if (rename(temporaryPath.c_str(), cachePath.c_str()) != 0) {
+#endif
+			remove(temporaryPath.c_str());
+		}
+		return true;
+	}
+
+	//keeps the views mapped until exit, the textures point straight into them
+	static std::vector<std::unique_ptr<MappedFile>> &getMappedImages() {
+		static std::vector<std::unique_ptr<MappedFile>> mappedImages;
+		return mappedImages;
+	}
+};
+
+const unsigned char *SharedImageCache::load(const std::string &path, int &width, int &height) {
+	int channels = 0;
+
+#if SHARED_IMAGE_CACHE_EN == 1
+	uint64_t sourceSizeInBytes = 0;
+	int64_t sourceModifiedTime = 0;
+
+	if (!getFileStamp(path, sourceSizeInBytes, sourceModifiedTime)) {
+		std::cout << "Failed to open " << path << "\n";
+		return NULL;
+	}
+
+	std::string cachePath = path + SHARED_IMAGE_CACHE_SUFFIX;
+
+	const unsigned char *pixels = mapCached(cachePath, sourceSizeInBytes, sourceModifiedTime, width, height);
+	if (pixels) {
+		return pixels;
+	}
+
+	unsigned char *decoded = stbi_load(path.c_str(), &width, &height, &channels, 3);
+	if (decoded == NULL) {
+		return NULL;
+	}
+
+	SharedImageHeader header = { SHARED_IMAGE_MAGIC, (uint32_t)width, (uint32_t)height, 3, sourceSizeInBytes, sourceModifiedTime };
+
+	if (writeCache(cachePath, header, decoded)) {
+		pixels = mapCached(cachePath, sourceSizeInBytes, sourceModifiedTime, width, height);
+		if (pixels) {
+			stbi_image_free(decoded);
+			return pixels;
+		}
+	}
+
+	//no cache, fall back to this process' own copy
+	return decoded;
+#else
+	return stbi_load(path.c_str(), &width, &height, &channels, 3);
+#endif
+}
@@ -11,10 +11,28 @@ public:
 
 	virtual bool hit(const ray &rayCast, float minPointAtParameterT, float maxPointAtParamterT, HitRecord &hitRecord) const;
 	virtual bool boundingBox(float t0, float t1, AABB &box) const;
+	virtual float surfaceArea() const;
+	virtual bool sampleSurface(vec3 &point, vec3 &normal) const;
 
 	vec3 _center;
 	float _radius;
 	Material *_materialPointer;
+
+protected:
+	//u goes around a circle of 2 pi r cos(latitude), v over half of one
+	void getSphereFootprint(const ray &rayCast, HitRecord &hitRecord) const {
+		float footprint = rayCast.footprintAt(hitRecord.pointAtParameterT);
+		if (footprint == 0.0f) {
+			hitRecord.footprintU = hitRecord.footprintV = 0.0f;
+			return;
+		}
+
+		float y = (hitRecord.point.y() - _center.y()) / _radius;
+		float cosLatitude = sqrt(ffmax(1.0f - y * y, 1e-4f));
+
+		hitRecord.footprintU = footprint / (2.0f * float(M_PI) * _radius * cosLatitude);
+		hitRecord.footprintV = footprint / (float(M_PI) * _radius);
+	}
 };
 
 bool Sphere::hit(const ray &rayCast, float minPointAtParameterT, float maxPointAtParamterT, HitRecord &hitRecord) const {	
@@ -47,9 +65,11 @@ bool Sphere::hit(const ray &rayCast, float minPointAtParameterT, float maxPointA
 			hitRecord.point = rayCast.pointAtParameter(hitRecord.pointAtParameterT);
 						
 			get_sphere_uv((hitRecord.point - _center)/_radius, hitRecord.u, hitRecord.v);
+			getSphereFootprint(rayCast, hitRecord);
 
 			hitRecord.normal = (hitRecord.point - _center) / _radius;	
 			hitRecord.materialPointer = _materialPointer;
+			hitRecord.primitiveId = _primitiveId;
 			return true;
 		}
 		temp = (-b + sqrt(b*b - a * c)) / a;
@@ -58,9 +78,11 @@ bool Sphere::hit(const ray &rayCast, float minPointAtParameterT, float maxPointA
 			hitRecord.point = rayCast.pointAtParameter(hitRecord.pointAtParameterT);
 
 			get_sphere_uv((hitRecord.point - _center)/_radius, hitRecord.u, hitRecord.v);
+			getSphereFootprint(rayCast, hitRecord);
 
 			hitRecord.normal = (hitRecord.point - _center) / _radius;
 			hitRecord.materialPointer = _materialPointer;
+			hitRecord.primitiveId = _primitiveId;
 			return true;
 		}
 	}
@@ -73,6 +95,17 @@ bool Sphere::boundingBox(float t0, float t1, AABB &box) const {
 	return true;
 }
 
+float Sphere::surfaceArea() const {
+	return 4.0 * M_PI * _radius * _radius;
+}
+
+bool Sphere::sampleSurface(vec3 &point, vec3 &normal) const {
+	//uniform over the whole sphere, the far side just ends up shadowed by the near side
+	normal = unit_vector(randomInUnitSphere());
+	point = _center + _radius * normal;
+	return true;
+}
+
 class MovingSphere : public Hitable {
 public:
 	MovingSphere() {}
@@ -103,6 +136,7 @@ bool MovingSphere::hit(const ray& r, float t_min, float t_max, HitRecord& record
 			record.point = r.pointAtParameter(record.pointAtParameterT);
 			record.normal = (record.point - center(r.time())) / _radius;
 			record.materialPointer = _materialPointer;
+			record.primitiveId = _primitiveId;
 			return true;
 		}
 		temp = (-b + sqrt(discriminant)) / a;
@@ -111,6 +145,7 @@ bool MovingSphere::hit(const ray& r, float t_min, float t_max, HitRecord& record
 			record.point = r.pointAtParameter(record.pointAtParameterT);
 			record.normal = (record.point - center(r.time())) / _radius;
 			record.materialPointer = _materialPointer;
+			record.primitiveId = _primitiveId;
 			return true;
 		}
 	}
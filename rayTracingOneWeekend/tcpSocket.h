@@ -0,0 +1,284 @@
+#pragma once
+
+#include <string>
+#include <string.h>
+#include <stdint.h>
+
+//winsock2 has to be seen before Windows.h or the old winsock.h it pulls in clashes with it, so include this early
+#if defined (_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <afunix.h>
+#pragma comment(lib, "Ws2_32.lib")
+typedef SOCKET NativeSocket;
+#define INVALID_NATIVE_SOCKET INVALID_SOCKET
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+typedef int NativeSocket;
+#define INVALID_NATIVE_SOCKET (-1)
+#endif
+
+/*
+	Minimal blocking TCP socket, just what the distributed render mode needs: listen/accept on the coordinator,
+	connect on the workers and exact size sends/receives. Move only, the socket is closed when the object goes away.
+
+	Nagle is turned off since the messages are small request/response pairs and waiting to batch them only adds latency.
+
+	listenLocal/connectLocal do the same over a Unix domain socket (a path instead of a port) for the render daemon,
+	Windows 10 has those too.
+*/
+class TcpSocket {
+public:
+	TcpSocket() : _socket(INVALID_NATIVE_SOCKET) {}
+
+	~TcpSocket() {
+		close();
+	}
+
+	TcpSocket(TcpSocket &&other) : _socket(other._socket) {
+		other._socket = INVALID_NATIVE_SOCKET;
+	}
+
+	TcpSocket &operator=(TcpSocket &&other) {
+		if (this != &other) {
+			close();
+			_socket = other._socket;
+			other._socket = INVALID_NATIVE_SOCKET;
+		}
+		return *this;
+	}
+
+	TcpSocket(const TcpSocket &) = delete;
+	TcpSocket &operator=(const TcpSocket &) = delete;
+
+	bool isOpen() const {
+		return _socket != INVALID_NATIVE_SOCKET;
+	}
+
+	//any interface, port 0 picks a free one (see getLocalPort)
+	bool listen(uint16_t port, int backlog = 16) {
+		if (!startup()) {
+			return false;
+		}
+
+		close();
+		_socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (!isOpen()) {
+			return false;
+		}
+
+		int reuse = 1;
+		setsockopt(_socket, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse));
+
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		address.sin_port = htons(port);
+
+		if (::bind(_socket, (const sockaddr *)&address, sizeof(address)) != 0 || ::listen(_socket, backlog) != 0) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	//Unix domain socket at path, a stale socket file from an earlier run is removed first
+	bool listenLocal(const std::string &path, int backlog = 16) {
+		sockaddr_un address;
+		if (!startup() || !makeLocalAddress(path, address)) {
+			return false;
+		}
+
+		close();
+		_socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (!isOpen()) {
+			return false;
+		}
+
+#if defined (_WIN32)
+		DeleteFileA(path.c_str());
+#else
+		unlink(path.c_str());
+#endif
+
+		if (::bind(_socket, (const sockaddr *)&address, sizeof(address)) != 0 || ::listen(_socket, backlog) != 0) {
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	bool connectLocal(const std::string &path) {
+		sockaddr_un address;
+		if (!startup() || !makeLocalAddress(path, address)) {
+			return false;
+		}
+
+		close();
+		_socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (isOpen() && ::connect(_socket, (const sockaddr *)&address, sizeof(address)) != 0) {
+			close();
+		}
+		return isOpen();
+	}
+
+	//blocks until somebody connects, returns a closed socket on error
+	TcpSocket accept() {
+		TcpSocket client;
+		client._socket = ::accept(_socket, NULL, NULL);
+		client.setNoDelay();
+		return client;
+	}
+
+	bool connect(const std::string &host, uint16_t port) {
+		if (!startup()) {
+			return false;
+		}
+
+		close();
+
+		addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+
+		addrinfo *addresses = NULL;
+		if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0) {
+			return false;
+		}
+
+		for (addrinfo *address = addresses; address != NULL; address = address->ai_next) {
+			_socket = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+			if (isOpen() && ::connect(_socket, address->ai_addr, (int)address->ai_addrlen) == 0) {
+				break;
+			}
+			close();
+		}
+		freeaddrinfo(addresses);
+
+		setNoDelay();
+		return isOpen();
+	}
+
+	uint16_t getLocalPort() const {
+		sockaddr_in address;
+		socklen_t length = sizeof(address);
+		if (getsockname(_socket, (sockaddr *)&address, &length) != 0) {
+			return 0;
+		}
+		return ntohs(address.sin_port);
+	}
+
+	//a receive that waits longer than this fails, 0 waits forever
+	void setReceiveTimeout(uint32_t timeoutMs) {
+#if defined (_WIN32)
+		DWORD timeout = timeoutMs;
+#else
+		timeval timeout;
+		timeout.tv_sec = timeoutMs / 1000;
+		timeout.tv_usec = (timeoutMs % 1000) * 1000;
+#endif
+		setsockopt(_socket, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeout, sizeof(timeout));
+	}
+
+	//false if the connection went away before everything was sent
+	bool sendAll(const void *data, size_t sizeInBytes) {
+		const char *bytes = (const char *)data;
+
+		while (sizeInBytes > 0) {
+#if defined (MSG_NOSIGNAL)
+			int sent = (int)::send(_socket, bytes, (int)sizeInBytes, MSG_NOSIGNAL);
+#else
+			int sent = (int)::send(_socket, bytes, (int)sizeInBytes, 0);
+#endif
+			if (sent <= 0) {
+				return false;
+			}
+			bytes += sent;
+			sizeInBytes -= sent;
+		}
+		return true;
+	}
+
+	//false on a closed connection, an error or the receive timeout
+	bool receiveAll(void *data, size_t sizeInBytes) {
+		char *bytes = (char *)data;
+
+		while (sizeInBytes > 0) {
+			int received = (int)::recv(_socket, bytes, (int)sizeInBytes, 0);
+			if (received <= 0) {
+				return false;
+			}
+			bytes += received;
+			sizeInBytes -= received;
+		}
+		return true;
+	}
+
+	//wakes up a thread blocked in accept/receive on this socket, close() still has to be called afterwards
+	void shutdown() {
+		if (isOpen()) {
+#if defined (_WIN32)
+			::shutdown(_socket, SD_BOTH);
+#else
+			::shutdown(_socket, SHUT_RDWR);
+#endif
+		}
+	}
+
+	void close() {
+		if (isOpen()) {
+#if defined (_WIN32)
+			::closesocket(_socket);
+#else
+			::close(_socket);
+#endif
+			_socket = INVALID_NATIVE_SOCKET;
+		}
+	}
+
+protected:
+	static bool makeLocalAddress(const std::string &path, sockaddr_un &address) {
+		memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+			return false;
+		}
+		memcpy(address.sun_path, path.c_str(), path.size());
+		return true;
+	}
+
+	//fails harmlessly on Unix domain sockets
+	void setNoDelay() {
+		if (isOpen()) {
+			int noDelay = 1;
+			setsockopt(_socket, IPPROTO_TCP, TCP_NODELAY, (const char *)&noDelay, sizeof(noDelay));
+		}
+	}
+
+	//winsock needs WSAStartup once per process, a no-op everywhere else
+	static bool startup() {
+#if defined (_WIN32)
+		static bool started = false;
+		if (!started) {
+			WSADATA wsaData;
+			started = WSAStartup(MAKEWORD(2, 2), &wsaData) == 0;
+		}
+		return started;
+#else
+		return true;
+#endif
+	}
+
+	NativeSocket _socket;
+};
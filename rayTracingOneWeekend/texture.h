@@ -2,10 +2,21 @@
 
 #include "vec3.h"
 #include "noise.h"
+#include "hitable.h"
+#include "mipmappedImage.h"
+#include "sceneOwner.h"
 
 class Texture {
 public:
+	virtual ~Texture() {}
+
+	SCENE_OWNER_ALLOCATION(Texture)
+
 	virtual vec3 value(float u, float v, const vec3 &p) const = 0;
+	//the value over the hit's footprint, only textures that can filter (ImageTexture) look at more than u, v and the point
+	virtual vec3 filteredValue(const HitRecord &hitRecord) const {
+		return value(hitRecord.u, hitRecord.v, hitRecord.point);
+	}
 };
 
 class ConstantTexture : public Texture {
@@ -33,6 +44,11 @@ public:
 			return _even->value(u, v, p);
 		}
 	}
+	virtual vec3 filteredValue(const HitRecord &hitRecord) const {
+		const vec3 &p = hitRecord.point;
+		float sines = sin(10 * p.x())*sin(10 * p.y())*sin(10 * p.z());
+		return sines < 0 ? _odd->filteredValue(hitRecord) : _even->filteredValue(hitRecord);
+	}
 
 	Texture *_odd;
 	Texture *_even;
@@ -55,14 +71,29 @@ public:
 class ImageTexture : public Texture {
 public:
 	ImageTexture() {}
-	ImageTexture(unsigned char *pixels, int A, int B) : _data(pixels), _nx(A), _ny(B) { }
+	//raw RGB8 rows, point sampled
+	ImageTexture(const unsigned char *pixels, int A, int B) : _data(pixels), _nx(A), _ny(B), _mipmaps(NULL) { }
+	//a mip chain from MipmapCache, filtered over the hit's footprint
+	ImageTexture(const MipmappedImage *mipmaps) : _data(NULL), _nx((int)mipmaps->getWidth()), _ny((int)mipmaps->getHeight()), _mipmaps(mipmaps) { }
 	
 	virtual vec3 value(float u, float v, const vec3 &p) const;	
-	unsigned char *_data;
+	virtual vec3 filteredValue(const HitRecord &hitRecord) const {
+		if (_mipmaps) {
+			return _mipmaps->sample(hitRecord.u, hitRecord.v, hitRecord.footprintU, hitRecord.footprintV);
+		}
+		return value(hitRecord.u, hitRecord.v, hitRecord.point);
+	}
+
+	const unsigned char *_data;
 	int _nx, _ny;
+	const MipmappedImage *_mipmaps;
 };
 
 vec3 ImageTexture::value(float u, float v, const vec3 &p) const {
+	if (_mipmaps) {
+		return _mipmaps->sample(u, v, 0.0f, 0.0f);
+	}
+
 	int i = (u)*_nx;
 	int j = (1 - v)*_ny - 0.001;
 
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <condition_variable>
+#include <stdint.h>
+
+#include "cpuTopology.h"
+
+//how many times a parked thread polls the epoch/pending counter before it falls back to sleeping on the condition variable
+#define THREAD_POOL_SPIN_COUNT 4096
+
+/*
+	Render threads that live for the whole run and get one job per frame.
+
+	Frames are tracked with an epoch counter: submitFrame() stores the job and bumps the epoch, every thread that sees a
+	new epoch runs the job once with its own id and counts itself off. waitForFrame() returns once the count is back to
+	zero. Both sides spin for a little while first since at interactive resolutions a frame is often only a few ms long
+	and a sleep/wake round trip through the scheduler costs more than that. After the spin they block on a condition
+	variable (a futex on Linux, a keyed event on Windows). All the state is checked under the mutex before blocking so a
+	notify can't get lost in between, and every wait has a predicate so spurious wakeups are harmless.
+
+	With a cpu placement every thread pins itself before it touches anything, so whatever it allocates afterwards
+	(thread_local tile scratch) is first touched, and therefore placed, on its own NUMA node.
+*/
+class RenderThreadPool {
+public:
+	typedef std::function<void(uint32_t workerId)> FrameJob;
+
+	//cpuPlacement[i] is the logical CPU thread i is pinned to, leave it empty to let the OS schedule them
+	explicit RenderThreadPool(uint32_t numOfThreads, const std::vector<uint32_t> &cpuPlacement = std::vector<uint32_t>()) :
+		_numOfThreads(numOfThreads > 0 ? numOfThreads : 1), _epoch(0), _pending(0), _exit(false), _cpuPlacement(cpuPlacement) {
+
+		for (uint32_t i = 0; i < _numOfThreads; i++) {
+			_threads.push_back(std::thread(&RenderThreadPool::threadProcedure, this, i));
+		}
+	}
+
+	~RenderThreadPool() {
+		shutdown();
+	}
+
+	//hand every thread the job for the next frame, the previous frame must have been waited on
+	void submitFrame(const FrameJob &job) {
+		_job = job;
+		_pending.store(_numOfThreads, std::memory_order_relaxed);
+
+		std::lock_guard<std::mutex> lock(_mutex);
+		_epoch.fetch_add(1, std::memory_order_release);
+		_epochConditionVar.notify_all();
+	}
+
+	//blocks until every thread is done with the submitted frame
+	void waitForFrame() {
+		for (uint32_t spin = 0; spin < THREAD_POOL_SPIN_COUNT; spin++) {
+			if (_pending.load(std::memory_order_acquire) == 0) {
+				return;
+			}
+		}
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		_frameDoneConditionVar.wait(lock, [this] {return _pending.load(std::memory_order_acquire) == 0; });
+	}
+
+	//like waitForFrame but gives up after timeout, false means the frame is still running
+	bool waitForFrameFor(std::chrono::milliseconds timeout) {
+		for (uint32_t spin = 0; spin < THREAD_POOL_SPIN_COUNT; spin++) {
+			if (_pending.load(std::memory_order_acquire) == 0) {
+				return true;
+			}
+		}
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		return _frameDoneConditionVar.wait_for(lock, timeout, [this] {return _pending.load(std::memory_order_acquire) == 0; });
+	}
+
+	//waits for the frame in flight (if any) and joins the threads
+	void shutdown() {
+		if (_threads.empty()) {
+			return;
+		}
+
+		waitForFrame();
+
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_exit = true;
+			_epoch.fetch_add(1, std::memory_order_release);
+			_epochConditionVar.notify_all();
+		}
+
+		for (std::thread &thread : _threads) {
+			thread.join();
+		}
+		_threads.clear();
+	}
+
+	uint32_t getNumOfThreads() const {
+		return _numOfThreads;
+	}
+
+	std::thread &getThread(uint32_t workerId) {
+		return _threads[workerId];
+	}
+
+protected:
+	void threadProcedure(uint32_t workerId) {
+		uint64_t seenEpoch = 0;
+
+		if (workerId < _cpuPlacement.size()) {
+			CpuTopology::pinCurrentThread(_cpuPlacement[workerId]);
+		}
+
+		while (true) {
+			uint64_t epoch = waitForEpochAfter(seenEpoch);
+			seenEpoch = epoch;
+
+			if (_exit) {
+				break;
+			}
+
+			_job(workerId);
+
+			//last one out wakes up whoever is waiting on the frame
+			if (_pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				std::lock_guard<std::mutex> lock(_mutex);
+				_frameDoneConditionVar.notify_all();
+			}
+		}
+	}
+
+	uint64_t waitForEpochAfter(uint64_t seenEpoch) {
+		for (uint32_t spin = 0; spin < THREAD_POOL_SPIN_COUNT; spin++) {
+			uint64_t epoch = _epoch.load(std::memory_order_acquire);
+			if (epoch != seenEpoch) {
+				return epoch;
+			}
+		}
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		_epochConditionVar.wait(lock, [this, seenEpoch] {return _epoch.load(std::memory_order_acquire) != seenEpoch; });
+		return _epoch.load(std::memory_order_acquire);
+	}
+
+	uint32_t _numOfThreads;
+
+	std::atomic<uint64_t> _epoch;
+	std::atomic<uint32_t> _pending;
+	bool _exit;
+	FrameJob _job;
+	std::vector<uint32_t> _cpuPlacement;
+
+	std::mutex _mutex;
+	std::condition_variable _epochConditionVar;
+	std::condition_variable _frameDoneConditionVar;
+
+	std::vector<std::thread> _threads;
+};
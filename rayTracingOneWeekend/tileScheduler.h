@@ -0,0 +1,197 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <stdint.h>
+
+#include "alignedBuffer.h"
+
+//pixel rectangle [columnStart, columnEnd) x [rowStart, rowEnd)
+struct RenderTile {
+	uint32_t columnStart, columnEnd;
+	uint32_t rowStart, rowEnd;
+	uint32_t index;
+
+	uint32_t getWidth() const {
+		return columnEnd - columnStart;
+	}
+
+	uint32_t getHeight() const {
+		return rowEnd - rowStart;
+	}
+};
+
+/*
+	Splits the image into square tiles and hands them to the render workers through one deque per worker.
+
+	At the start of a frame every worker gets a contiguous run of tiles so neighbouring tiles (and the cache lines of
+	the byte buffer they touch) stay on one thread. A worker takes its own tiles from the front and, once it runs dry,
+	steals from the back of the other workers' deques, so nobody sits at the end of frame barrier while there is still
+	work left anywhere.
+
+	When the workers are pinned, setWorkerNodes() makes thieves try the workers on their own NUMA node first so stolen
+	tiles mostly stay near the memory the victim already touched.
+
+	Every frame carries the camera view generation it was started with. requestGeneration() with a newer one cancels
+	the frame: workers finish the tile they are on and then get no more, so a camera move waits at most one tile
+	instead of a whole frame.
+
+	The deques are guarded by their own mutex. Tiles are big enough (32x32 pixels times the samples) that the lock is
+	noise, it's only contended when somebody steals.
+*/
+class TileScheduler {
+public:
+	TileScheduler(uint32_t numOfWorkers, uint32_t resWidthInPixels, uint32_t resHeightInPixels, uint32_t tileSizeInPixels) :
+		_numOfWorkers(numOfWorkers > 0 ? numOfWorkers : 1), _resWidthInPixels(resWidthInPixels), _resHeightInPixels(resHeightInPixels),
+		_tileSizeInPixels(tileSizeInPixels > 0 ? tileSizeInPixels : 1), _frameGeneration(0), _latestGeneration(0) {
+
+		uint32_t tilesPerRow = (resWidthInPixels + _tileSizeInPixels - 1) / _tileSizeInPixels;
+		uint32_t tilesPerColumn = (resHeightInPixels + _tileSizeInPixels - 1) / _tileSizeInPixels;
+
+		//top row of the image first, same order the workers used to scan in
+		for (int tileRow = (int)tilesPerColumn - 1; tileRow >= 0; tileRow--) {
+			for (uint32_t tileColumn = 0; tileColumn < tilesPerRow; tileColumn++) {
+				RenderTile tile;
+				tile.columnStart = tileColumn * _tileSizeInPixels;
+				tile.columnEnd = (tile.columnStart + _tileSizeInPixels < resWidthInPixels) ? tile.columnStart + _tileSizeInPixels : resWidthInPixels;
+				tile.rowStart = tileRow * _tileSizeInPixels;
+				tile.rowEnd = (tile.rowStart + _tileSizeInPixels < resHeightInPixels) ? tile.rowStart + _tileSizeInPixels : resHeightInPixels;
+				tile.index = (uint32_t)_tiles.size();
+
+				_tiles.push_back(tile);
+			}
+		}
+
+		for (uint32_t i = 0; i < _numOfWorkers; i++) {
+			_queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue));
+		}
+
+		setWorkerNodes(std::vector<int32_t>());
+	}
+
+	//NUMA node of every worker, workers missing from the list count as node 0
+	void setWorkerNodes(const std::vector<int32_t> &workerNodes) {
+		_stealOrder.assign(_numOfWorkers, std::vector<uint32_t>());
+
+		for (uint32_t worker = 0; worker < _numOfWorkers; worker++) {
+			int32_t node = worker < workerNodes.size() ? workerNodes[worker] : 0;
+
+			//the next workers over on the same node, then everybody else in the same rotation
+			for (int pass = 0; pass < 2; pass++) {
+				for (uint32_t offset = 1; offset < _numOfWorkers; offset++) {
+					uint32_t victim = (worker + offset) % _numOfWorkers;
+					int32_t victimNode = victim < workerNodes.size() ? workerNodes[victim] : 0;
+
+					if ((victimNode == node) == (pass == 0)) {
+						_stealOrder[worker].push_back(victim);
+					}
+				}
+			}
+		}
+	}
+
+	//refill every deque, the workers must not be pulling tiles while this runs
+	void beginFrame(uint64_t generation = 0) {
+		uint32_t numOfTiles = (uint32_t)_tiles.size();
+
+		_frameGeneration = generation;
+		_latestGeneration.store(generation, std::memory_order_release);
+
+		for (uint32_t worker = 0; worker < _numOfWorkers; worker++) {
+			WorkerQueue &queue = *_queues[worker];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+
+			queue.tiles.clear();
+
+			uint32_t first = (uint64_t)numOfTiles * worker / _numOfWorkers;
+			uint32_t last = (uint64_t)numOfTiles * (worker + 1) / _numOfWorkers;
+
+			for (uint32_t i = first; i < last; i++) {
+				queue.tiles.push_back(i);
+			}
+		}
+	}
+
+	//safe to call while the workers run, a generation other than the frame's stops handing out tiles
+	void requestGeneration(uint64_t generation) {
+		_latestGeneration.store(generation, std::memory_order_release);
+	}
+
+	bool isFrameCancelled() const {
+		return _latestGeneration.load(std::memory_order_acquire) != _frameGeneration;
+	}
+
+	uint64_t getFrameGeneration() const {
+		return _frameGeneration;
+	}
+
+	//false once there is nothing left to do anywhere this frame, or the frame was cancelled
+	bool nextTile(uint32_t workerId, RenderTile &tile) {
+		if (isFrameCancelled()) {
+			return false;
+		}
+
+		WorkerQueue &own = *_queues[workerId % _numOfWorkers];
+
+		{
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.tiles.empty()) {
+				tile = _tiles[own.tiles.front()];
+				own.tiles.pop_front();
+				return true;
+			}
+		}
+
+		//steal from the far end of the other workers, nearest first
+		for (uint32_t victimId : _stealOrder[workerId % _numOfWorkers]) {
+			WorkerQueue &victim = *_queues[victimId];
+
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tiles.empty()) {
+				tile = _tiles[victim.tiles.back()];
+				victim.tiles.pop_back();
+				own.stolen++;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	uint32_t getNumOfTiles() const {
+		return (uint32_t)_tiles.size();
+	}
+
+	uint32_t getTileSizeInPixels() const {
+		return _tileSizeInPixels;
+	}
+
+	//tiles the worker took from others since the scheduler was created
+	uint64_t getStolenCount(uint32_t workerId) const {
+		return _queues[workerId % _numOfWorkers]->stolen;
+	}
+
+protected:
+	//separate allocations padded out past a cache line so workers popping their own tiles don't bounce each other's mutex around
+	struct WorkerQueue {
+		char padding[CACHE_LINE_SIZE_IN_BYTES];
+		std::mutex mutex;
+		std::deque<uint32_t> tiles;
+		uint64_t stolen = 0;
+	};
+
+	uint32_t _numOfWorkers;
+	uint32_t _resWidthInPixels, _resHeightInPixels;
+	uint32_t _tileSizeInPixels;
+
+	std::vector<RenderTile> _tiles;
+	std::vector<std::unique_ptr<WorkerQueue>> _queues;
+	std::vector<std::vector<uint32_t>> _stealOrder;
+
+	//_frameGeneration only changes while the workers are parked
+	uint64_t _frameGeneration;
+	std::atomic<uint64_t> _latestGeneration;
+};
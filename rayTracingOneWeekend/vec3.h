@@ -83,6 +83,14 @@ inline vec3 operator/(const vec3 &v, float t) {
 	return vec3(v.e[0] / t, v.e[1] / t, v.e[2] / t);
 }
 
+inline bool operator==(const vec3 &v1, const vec3 &v2) {
+	return v1.e[0] == v2.e[0] && v1.e[1] == v2.e[1] && v1.e[2] == v2.e[2];
+}
+
+inline bool operator!=(const vec3 &v1, const vec3 &v2) {
+	return !(v1 == v2);
+}
+
 inline float dot(const vec3 &v1, const vec3 &v2) {
 	return v1.e[0] * v2.e[0] + v1.e[1] * v2.e[1] + v1.e[2] * v2.e[2];
 }
@@ -15,6 +15,15 @@ public:
 		return true;
 	}
 
+	virtual float surfaceArea() const {
+		return (_x1 - _x0) * (_y1 - _y0);
+	}
+	virtual bool sampleSurface(vec3 &point, vec3 &normal) const {
+		point = vec3(_x0 + unifRand(randomNumberGenerator) * (_x1 - _x0), _y0 + unifRand(randomNumberGenerator) * (_y1 - _y0), _k);
+		normal = vec3(0, 0, 1);
+		return true;
+	}
+
 	Material *_material;
 	float _x0, _x1, _y0, _y1, _k;
 };
@@ -32,8 +41,12 @@ bool XYRectangle::hit(const ray &inputRay, float t0, float t1, HitRecord &hitRec
 
 	hitRecrod.u = (x - _x0) / (_x1 - _x0);
 	hitRecrod.v = (y - _y0) / (_y1 - _y0);
+	float footprint = inputRay.footprintAt(t);
+	hitRecrod.footprintU = footprint / (_x1 - _x0);
+	hitRecrod.footprintV = footprint / (_y1 - _y0);
 	hitRecrod.pointAtParameterT = t;
 	hitRecrod.materialPointer = _material;
+	hitRecrod.primitiveId = _primitiveId;
 	hitRecrod.point = inputRay.pointAtParameter(t);
 	hitRecrod.normal = vec3(0, 0, 1);
 	return true;
@@ -50,6 +63,15 @@ public:
 		return true;
 	}
 
+	virtual float surfaceArea() const {
+		return (_x1 - _x0) * (_z1 - _z0);
+	}
+	virtual bool sampleSurface(vec3 &point, vec3 &normal) const {
+		point = vec3(_x0 + unifRand(randomNumberGenerator) * (_x1 - _x0), _k, _z0 + unifRand(randomNumberGenerator) * (_z1 - _z0));
+		normal = vec3(0, 1, 0);
+		return true;
+	}
+
 	Material *_material;
 	float _x0, _x1, _z0, _z1, _k;
 };
@@ -67,8 +89,12 @@ bool XZRectangle::hit(const ray &inputRay, float t0, float t1, HitRecord &hitRec
 
 	hitRecrod.u = (x - _x0) / (_x1 - _x0);
 	hitRecrod.v = (z - _z0) / (_z1 - _z0);
+	float footprint = inputRay.footprintAt(t);
+	hitRecrod.footprintU = footprint / (_x1 - _x0);
+	hitRecrod.footprintV = footprint / (_z1 - _z0);
 	hitRecrod.pointAtParameterT = t;
 	hitRecrod.materialPointer = _material;
+	hitRecrod.primitiveId = _primitiveId;
 	hitRecrod.point = inputRay.pointAtParameter(t);
 	hitRecrod.normal = vec3(0, 1, 0);
 	return true;
@@ -85,6 +111,15 @@ public:
 		return true;
 	}
 
+	virtual float surfaceArea() const {
+		return (_y1 - _y0) * (_z1 - _z0);
+	}
+	virtual bool sampleSurface(vec3 &point, vec3 &normal) const {
+		point = vec3(_k, _y0 + unifRand(randomNumberGenerator) * (_y1 - _y0), _z0 + unifRand(randomNumberGenerator) * (_z1 - _z0));
+		normal = vec3(1, 0, 0);
+		return true;
+	}
+
 	Material *_material;
 	float _y0, _y1, _z0, _z1, _k;
 };
@@ -102,8 +137,12 @@ bool YZRectangle::hit(const ray &inputRay, float t0, float t1, HitRecord &hitRec
 
 	hitRecrod.u = (y - _y0) / (_y1 - _y0);
 	hitRecrod.v = (z - _z0) / (_z1 - _z0);
+	float footprint = inputRay.footprintAt(t);
+	hitRecrod.footprintU = footprint / (_y1 - _y0);
+	hitRecrod.footprintV = footprint / (_z1 - _z0);
 	hitRecrod.pointAtParameterT = t;
 	hitRecrod.materialPointer = _material;
+	hitRecrod.primitiveId = _primitiveId;
 	hitRecrod.point = inputRay.pointAtParameter(t);
 	hitRecrod.normal = vec3(1, 0, 0);
 	return true;